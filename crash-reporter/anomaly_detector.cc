@@ -4,11 +4,16 @@
 
 #include "crash-reporter/anomaly_detector.h"
 
+#include <bitset>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include <anomaly_detector/proto_bindings/anomaly_detector.pb.h>
+#include <base/check.h>
+#include <base/check_op.h>
 #include <base/logging.h>
+#include <base/no_destructor.h>
 #include <base/rand_util.h>
 #include <base/strings/strcat.h>
 #include <base/strings/string_util.h>
@@ -19,6 +24,7 @@
 #include <dbus/exported_object.h>
 #include <dbus/message.h>
 #include <re2/re2.h>
+#include <re2/set.h>
 
 #include "crash-reporter/util.h"
 
@@ -78,6 +84,10 @@ MaybeCrashReport Parser::PeriodicUpdate() {
 
 constexpr LazyRE2 service_failure = {
     R"((\S+) \S+ process \(\d+\) terminated with status (\d+))"};
+// A literal part of |service_failure|. Upstart logs many lines which are not
+// about service failures, and checking for it first is cheaper than running
+// |service_failure|, which cannot be searched for from a literal prefix.
+constexpr char service_failure_literal[] = " terminated with status ";
 
 ServiceParser::ServiceParser(bool testonly_send_all)
     : testonly_send_all_(testonly_send_all) {}
@@ -85,7 +95,8 @@ ServiceParser::ServiceParser(bool testonly_send_all)
 MaybeCrashReport ServiceParser::ParseLogEntry(const std::string& line) {
   std::string service_name;
   std::string exit_status;
-  if (!RE2::FullMatch(line, *service_failure, &service_name, &exit_status))
+  if (line.find(service_failure_literal) == std::string::npos ||
+      !RE2::FullMatch(line, *service_failure, &service_name, &exit_status))
     return base::nullopt;
 
   if (service_name == "cros-camera") {
@@ -116,7 +127,7 @@ MaybeCrashReport ServiceParser::ParseLogEntry(const std::string& line) {
   return CrashReport(std::move(text), {std::move(flag)});
 }
 
-std::string GetField(const std::string& line, std::string pattern) {
+std::string GetField(const std::string& line, const RE2& pattern) {
   std::string field_value;
   RE2::PartialMatch(line, pattern, &field_value);
   // This will return the empty string if there wasn't a match.
@@ -138,6 +149,11 @@ bool IsCrosSelinuxViolation(const std::vector<std::string>& contents) {
 }
 
 constexpr LazyRE2 granted = {"avc:[ ]*granted"};
+constexpr LazyRE2 scontext_field = {R"(scontext=(\S*))"};
+constexpr LazyRE2 tcontext_field = {R"(tcontext=(\S*))"};
+constexpr LazyRE2 permission_field = {R"(\{ (\S*) \})"};
+constexpr LazyRE2 comm_field = {R"'(comm="([^"]*)")'"};
+constexpr LazyRE2 name_field = {R"'(name="([^"]*)")'"};
 
 SELinuxParser::SELinuxParser(bool testonly_send_all)
     : testonly_send_all_(testonly_send_all) {}
@@ -167,11 +183,11 @@ MaybeCrashReport SELinuxParser::ParseLogEntry(const std::string& line) {
   if (RE2::PartialMatch(line, *granted))
     signature += "granted-";
 
-  std::string scontext = GetField(line, R"(scontext=(\S*))");
-  std::string tcontext = GetField(line, R"(tcontext=(\S*))");
-  std::string permission = GetField(line, R"(\{ (\S*) \})");
-  std::string comm = GetField(line, R"'(comm="([^"]*)")'");
-  std::string name = GetField(line, R"'(name="([^"]*)")'");
+  std::string scontext = GetField(line, *scontext_field);
+  std::string tcontext = GetField(line, *tcontext_field);
+  std::string permission = GetField(line, *permission_field);
+  std::string comm = GetField(line, *comm_field);
+  std::string name = GetField(line, *name_field);
 
   // Ignore ARC++, and other non-CrOS, errors. They are extremely common and
   // largely not used anyway, providing a lot of noise.
@@ -220,25 +236,83 @@ std::string DetermineFlag(const std::string& info) {
   return "--kernel_warning";
 }
 
-constexpr LazyRE2 start_ath10k_dump = {R"(ath10k_.*firmware crashed!)"};
-constexpr LazyRE2 end_ath10k_dump = {R"(ath10k_.*htt-ver)"};
-constexpr LazyRE2 tag_ath10k_dump = {R"(ath10k_)"};
+namespace {
+
+// The patterns looked for by KernelParser, in the order of kKernelPatterns.
+// All of them are matched in a single pass over each line, instead of running
+// each of them in turn, as KernelParser sees every line of the kernel log.
+enum KernelPattern {
+  kCutHere,
+  kEndTrace,
+  kStartAth10kDump,
+  kEndAth10kDump,
+  kTagAth10kDump,
+  kStartIwlwifiDump,
+  kStartIwlwifiDumpUmac,
+  kEndIwlwifiDumpUmac,
+  kEndIwlwifiDumpLmac,
+  kSmmuFault,
+  kCrashReporterRlimit,
+  kNumKernelPatterns,
+};
+
+constexpr const char* kKernelPatterns[kNumKernelPatterns] = {
+    R"(------------\[ cut here)",
+    R"(---\[ end trace)",
+    R"(ath10k_.*firmware crashed!)",
+    R"(ath10k_.*htt-ver)",
+    R"(ath10k_)",
+    // Older wifi chips have lmac dump only and newer wifi chips have lmac
+    // followed by umac dumps. The KernelParser should parse the dumps
+    // accordingly. The following regexp identify the beginning of the iwlwifi
+    // dump.
+    R"(iwlwifi.*Loaded firmware version:)",
+    // The following regexp separates the umac and lmac.
+    R"(Start IWL Error Log Dump.+)",
+    // The following regexps identify the iwlwifi error dump end.
+    R"(.+isr status reg)",
+    R"(.+flow_handler)",
+    R"(Unhandled context fault: fsr=0x)",
+    R"(\(crash_reporter\) has RLIMIT_CORE set to)",
+};
+
+using KernelPatternMatches = std::bitset<kNumKernelPatterns>;
+
+// Matches lines against all of kKernelPatterns at once.
+class KernelPatternMatcher {
+ public:
+  KernelPatternMatcher() : set_(RE2::DefaultOptions, RE2::UNANCHORED) {
+    for (int i = 0; i < kNumKernelPatterns; i++) {
+      std::string error;
+      CHECK_EQ(set_.Add(kKernelPatterns[i], &error), i) << error;
+    }
+    CHECK(set_.Compile());
+  }
+  KernelPatternMatcher(const KernelPatternMatcher&) = delete;
+  KernelPatternMatcher& operator=(const KernelPatternMatcher&) = delete;
+
+  // Returns the patterns found in |line|.
+  KernelPatternMatches Match(const std::string& line) const {
+    KernelPatternMatches matches;
+    // Most lines match nothing, in which case |indices| does not allocate.
+    std::vector<int> indices;
+    if (set_.Match(line, &indices)) {
+      for (int index : indices)
+        matches.set(index);
+    }
+    return matches;
+  }
 
-// Older wifi chips have lmac dump only and newer wifi chips have lmac followed
-// by umac dumps. The KernelParser should parse the dumps accordingly.
-// The following regexp identify the beginning of the iwlwifi dump.
-constexpr LazyRE2 start_iwlwifi_dump = {R"(iwlwifi.*Loaded firmware version:)"};
+ private:
+  RE2::Set set_;
+};
 
-// The following regexp separates the umac and lmac.
-constexpr LazyRE2 start_iwlwifi_dump_umac = {R"(Start IWL Error Log Dump(.+))"};
-// The following regexps identify the iwlwifi error dump end.
-constexpr LazyRE2 end_iwlwifi_dump_umac = {R"((.+)isr status reg)"};
-constexpr LazyRE2 end_iwlwifi_dump_lmac = {R"((.+)flow_handler)"};
+const KernelPatternMatcher& GetKernelPatternMatcher() {
+  static const base::NoDestructor<KernelPatternMatcher> matcher;
+  return *matcher;
+}
 
-constexpr char cut_here[] = "------------[ cut here";
-constexpr char end_trace[] = "---[ end trace";
-constexpr char crash_report_rlimit[] =
-    "(crash_reporter) has RLIMIT_CORE set to";
+}  // namespace
 
 // The CPU and PID information got added in the 3.11 kernel development cycle
 // per commit dcb6b45254e2281b6f99ea7f2d51343954aa3ba8. That part is marked
@@ -248,14 +322,14 @@ constexpr char crash_report_rlimit[] =
 constexpr LazyRE2 header = {
     R"(^\[\s*\S+\] WARNING:(?: CPU: \d+ PID: \d+)? at (.+))"};
 
-constexpr LazyRE2 smmu_fault = {R"(Unhandled context fault: fsr=0x)"};
-
 KernelParser::KernelParser(bool testonly_send_all)
     : testonly_send_all_(testonly_send_all) {}
 
 MaybeCrashReport KernelParser::ParseLogEntry(const std::string& line) {
+  const KernelPatternMatches matches = GetKernelPatternMatcher().Match(line);
+
   if (last_line_ == LineType::None) {
-    if (line.find(cut_here) != std::string::npos)
+    if (matches[kCutHere])
       last_line_ = LineType::Start;
   } else if (last_line_ == LineType::Start || last_line_ == LineType::Header) {
     std::string info;
@@ -285,7 +359,7 @@ MaybeCrashReport KernelParser::ParseLogEntry(const std::string& line) {
       last_line_ = LineType::None;
     }
   } else if (last_line_ == LineType::Body) {
-    if (line.find(end_trace) != std::string::npos) {
+    if (matches[kEndTrace]) {
       last_line_ = LineType::None;
       std::string text_tmp;
       text_tmp.swap(text_);
@@ -304,17 +378,16 @@ MaybeCrashReport KernelParser::ParseLogEntry(const std::string& line) {
   }
 
   if (ath10k_last_line_ == Ath10kLineType::None) {
-    if (RE2::PartialMatch(line, *start_ath10k_dump)) {
+    if (matches[kStartAth10kDump]) {
       ath10k_last_line_ = Ath10kLineType::Start;
       ath10k_text_ += line + "\n";
     }
   } else if (ath10k_last_line_ == Ath10kLineType::Start) {
-    // Return if the end_ath10k_dump is reached or the log tag doesn't match
-    // tag_ath10k_dump.
-    if (RE2::PartialMatch(line, *end_ath10k_dump) ||
-        !RE2::PartialMatch(line, *tag_ath10k_dump)) {
+    // Return if the end of the dump is reached or the log tag doesn't match
+    // ath10k_.
+    if (matches[kEndAth10kDump] || !matches[kTagAth10kDump]) {
       ath10k_last_line_ = Ath10kLineType::None;
-      if (RE2::PartialMatch(line, *end_ath10k_dump)) {
+      if (matches[kEndAth10kDump]) {
         ath10k_text_ += line + "\n";
       }
       std::string ath10k_text_tmp;
@@ -335,14 +408,14 @@ MaybeCrashReport KernelParser::ParseLogEntry(const std::string& line) {
   }
 
   if (iwlwifi_last_line_ == IwlwifiLineType::None) {
-    if (RE2::PartialMatch(line, *start_iwlwifi_dump)) {
+    if (matches[kStartIwlwifiDump]) {
       iwlwifi_last_line_ = IwlwifiLineType::Start;
       iwlwifi_text_ += line + "\n";
     }
   } else if (iwlwifi_last_line_ == IwlwifiLineType::Start) {
-    if (RE2::PartialMatch(line, *end_iwlwifi_dump_lmac)) {
+    if (matches[kEndIwlwifiDumpLmac]) {
       iwlwifi_last_line_ = IwlwifiLineType::Lmac;
-    } else if (RE2::PartialMatch(line, *end_iwlwifi_dump_umac)) {
+    } else if (matches[kEndIwlwifiDumpUmac]) {
       // Return if the line is equal to the umac end. There is never anything
       // after the umac end.
       iwlwifi_last_line_ = IwlwifiLineType::None;
@@ -363,7 +436,7 @@ MaybeCrashReport KernelParser::ParseLogEntry(const std::string& line) {
     iwlwifi_text_ += line + "\n";
   } else if (iwlwifi_last_line_ == IwlwifiLineType::Lmac) {
     // Check if there is an umac dump.
-    if (RE2::PartialMatch(line, *start_iwlwifi_dump_umac)) {
+    if (matches[kStartIwlwifiDumpUmac]) {
       iwlwifi_last_line_ = IwlwifiLineType::Start;
       iwlwifi_text_ += line + "\n";
     } else {
@@ -384,13 +457,13 @@ MaybeCrashReport KernelParser::ParseLogEntry(const std::string& line) {
     }
   }
 
-  if (RE2::PartialMatch(line, *smmu_fault)) {
+  if (matches[kSmmuFault]) {
     std::string smmu_text_tmp = line + "\n";
     return CrashReport(std::move(smmu_text_tmp),
                        {std::move("--kernel_smmu_fault")});
   }
 
-  if (line.find(crash_report_rlimit) != std::string::npos) {
+  if (matches[kCrashReporterRlimit]) {
     LOG(INFO) << "crash_reporter crashed!";
     // Rate limit reporting crash_reporter failures to prevent crash loops.
     if (crash_reporter_last_crashed_.is_null() ||
@@ -0,0 +1,143 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures the throughput of the anomaly_detector parsers over the TEST_*
+// logs of anomaly_detector_test, each fed to the parser of its tag.
+// Usage (from the crash-reporter directory):
+//   anomaly_detector_benchmark [benchmark flags]
+
+#include <initializer_list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/at_exit.h>
+#include <base/check.h>
+#include <base/check_op.h>
+#include <base/files/file_enumerator.h>
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/no_destructor.h>
+#include <base/strings/string_split.h>
+#include <benchmark/benchmark.h>
+
+#include "crash-reporter/anomaly_detector.h"
+
+namespace anomaly {
+namespace {
+
+// Lines of the logs matching |patterns| in the current directory.
+std::vector<std::string> LoadLines(
+    std::initializer_list<const char*> patterns) {
+  std::vector<std::string> lines;
+  for (const char* pattern : patterns) {
+    const size_t previous_size = lines.size();
+    base::FileEnumerator files(base::FilePath("."), /*recursive=*/false,
+                               base::FileEnumerator::FILES, pattern);
+    for (base::FilePath path = files.Next(); !path.empty();
+         path = files.Next()) {
+      std::string content;
+      CHECK(base::ReadFileToString(path, &content));
+      for (auto& line :
+           base::SplitString(content, "\n", base::KEEP_WHITESPACE,
+                             base::SPLIT_WANT_NONEMPTY)) {
+        lines.push_back(std::move(line));
+      }
+    }
+    CHECK_GT(lines.size(), previous_size)
+        << "No " << pattern << " log, run from the crash-reporter directory";
+  }
+  return lines;
+}
+
+// Parses |lines| with |parser| repeatedly. Reports are sent for every anomaly
+// so that the whole of each parser is measured.
+void ParseLines(benchmark::State& state,
+                Parser* parser,
+                const std::vector<std::string>& lines) {
+  size_t bytes = 0;
+  for (const auto& line : lines)
+    bytes += line.size();
+
+  for (auto _ : state) {
+    for (const auto& line : lines) {
+      MaybeCrashReport report = parser->ParseLogEntry(line);
+      benchmark::DoNotOptimize(report);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * lines.size());
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+void BM_KernelParser(benchmark::State& state) {
+  static const base::NoDestructor<std::vector<std::string>> lines(
+      LoadLines({"TEST_ATH10K_*", "TEST_CR_CRASH", "TEST_IWLWIFI_*",
+                 "TEST_SMMU_FAULT", "TEST_WARNING*", "TEST_WIFI_WARNING"}));
+  KernelParser parser(true);
+  ParseLines(state, &parser, *lines);
+}
+BENCHMARK(BM_KernelParser);
+
+// Lines which are not about any anomaly, as most lines of the kernel log.
+void BM_KernelParserNoAnomaly(benchmark::State& state) {
+  static const base::NoDestructor<std::vector<std::string>> lines(
+      LoadLines({"TEST_MESSAGE_LOG"}));
+  KernelParser parser(true);
+  ParseLines(state, &parser, *lines);
+}
+BENCHMARK(BM_KernelParserNoAnomaly);
+
+void BM_ServiceParser(benchmark::State& state) {
+  static const base::NoDestructor<std::vector<std::string>> lines(
+      LoadLines({"TEST_SERVICE_FAILURE", "TEST_UPSTART_LOG"}));
+  ServiceParser parser(true);
+  ParseLines(state, &parser, *lines);
+}
+BENCHMARK(BM_ServiceParser);
+
+void BM_SELinuxParser(benchmark::State& state) {
+  static const base::NoDestructor<std::vector<std::string>> lines(
+      LoadLines({"TEST_SELINUX"}));
+  SELinuxParser parser(true);
+  ParseLines(state, &parser, *lines);
+}
+BENCHMARK(BM_SELinuxParser);
+
+void BM_SuspendParser(benchmark::State& state) {
+  static const base::NoDestructor<std::vector<std::string>> lines(
+      LoadLines({"TEST_SUSPEND_FAILURE"}));
+  SuspendParser parser(true);
+  ParseLines(state, &parser, *lines);
+}
+BENCHMARK(BM_SuspendParser);
+
+void BM_CryptohomeParser(benchmark::State& state) {
+  static const base::NoDestructor<std::vector<std::string>> lines(
+      LoadLines({"TEST_CRYPTOHOME_*"}));
+  CryptohomeParser parser;
+  ParseLines(state, &parser, *lines);
+}
+BENCHMARK(BM_CryptohomeParser);
+
+void BM_TcsdParser(benchmark::State& state) {
+  static const base::NoDestructor<std::vector<std::string>> lines(
+      LoadLines({"TEST_TCSD_*"}));
+  TcsdParser parser;
+  ParseLines(state, &parser, *lines);
+}
+BENCHMARK(BM_TcsdParser);
+
+}  // namespace
+}  // namespace anomaly
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit;
+  // Keep the parsers from logging every line they skip.
+  logging::SetMinLogLevel(logging::LOGGING_WARNING);
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -31,15 +31,21 @@ const char kHelpSwitch[] = "--help";
 const char kPrefixSwitch[] = "--prefix";
 const char kProcSwitch[] = "--proc";
 
+const char* g_exec_name;
+
+// Writes the errors to standard error, after the name of the executable.
+void PrintError(const std::string& message) {
+  std::cerr << g_exec_name << ": " << message << ".\n";
+}
+
 void PrintUsage(const Flags& flags);
 bool ParseFlags(int argc, char* argv[], Flags* flags);
 
 }  // namespace
 
-const char* g_exec_name;
-
 int main(int argc, char* argv[]) {
   g_exec_name = argv[0];
+  SetErrorHandler(&PrintError);
 
   Flags flags = {
       {kCoreSwitch, {"Stripped core dump", "core"}},
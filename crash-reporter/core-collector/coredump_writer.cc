@@ -6,8 +6,10 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/procfs.h>
 #include <sys/statvfs.h>
 #include <sys/types.h>
+#include <sys/user.h>
 #include <sysexits.h>
 #include <unistd.h>
 
@@ -27,6 +29,11 @@ namespace {
 const size_t kMaxAbsCoredumpSize = 256 * 1024 * 1024;
 const double kMaxRelCoredumpSize = 0.05;  // Percentage of free disk space.
 
+// Bytes of stack kept above the page of the stack pointer in stacks-only core
+// dumps. This must be at least what breakpad's LinuxDumper::GetStackInfo()
+// copies to the minidump.
+const ElfW(Addr) kStackToCapture = 32 * 1024;
+
 struct ScopedFd {
   explicit ScopedFd(int fd) : fd(fd) {}
   ~ScopedFd() { close(fd); }
@@ -68,6 +75,30 @@ inline bool Seek(int fd, off_t offset) {
   return lseek(fd, offset, SEEK_SET) == offset;
 }
 
+// Returns the stack pointer of the thread whose registers are in |status|, or 0
+// if it is unknown for this architecture.
+ElfW(Addr) GetStackPointer(const elf_prstatus& status) {
+#if defined(__x86_64__)
+  user_regs_struct regs;
+  memcpy(&regs, &status.pr_reg, sizeof(regs));
+  return regs.rsp;
+#elif defined(__i386__)
+  user_regs_struct regs;
+  memcpy(&regs, &status.pr_reg, sizeof(regs));
+  return regs.esp;
+#elif defined(__ARM_EABI__)
+  user_regs regs;
+  memcpy(&regs, &status.pr_reg, sizeof(regs));
+  return regs.uregs[13];  // ARM_sp
+#elif defined(__aarch64__)
+  user_regs_struct regs;
+  memcpy(&regs, &status.pr_reg, sizeof(regs));
+  return regs.sp;
+#else
+  return 0;
+#endif
+}
+
 inline int64_t GetFreeDiskSpace(const char* path) {
   struct statvfs stats;
   return TEMP_FAILURE_RETRY(statvfs(path, &stats)) != 0
@@ -123,8 +154,12 @@ class CoredumpWriter::Reader {
 
 CoredumpWriter::CoredumpWriter(int fd,
                                const char* coredump_path,
-                               const char* container_dir)
-    : fd_(fd), coredump_path_(coredump_path), container_dir_(container_dir) {}
+                               const char* container_dir,
+                               bool stacks_only)
+    : fd_(fd),
+      coredump_path_(coredump_path),
+      container_dir_(container_dir),
+      stacks_only_(stacks_only) {}
 
 int CoredumpWriter::WriteCoredump() {
   const ScopedFd dest(TEMP_FAILURE_RETRY(
@@ -163,9 +198,17 @@ int CoredumpWriter::WriteCoredump() {
     return EX_OSFILE;
 
   // Strip segments backed by mapped files, since they are not needed to
-  // generate a minidump.
+  // generate a minidump. Stacks-only core dumps also lose the anonymous
+  // segments other than the stacks, unless the stacks cannot be found.
   std::vector<Phdr> stripped_program_headers;
-  StripSegments(program_headers, file_mappings, &stripped_program_headers);
+  const std::vector<ElfW(Addr)> stack_pointers =
+      stacks_only_ ? GetStackPointers(note_buf) : std::vector<ElfW(Addr)>();
+  if (!stack_pointers.empty()) {
+    StripSegmentsToStacks(program_headers, stack_pointers,
+                          GetVdsoAddress(note_buf), &stripped_program_headers);
+  } else {
+    StripSegments(program_headers, file_mappings, &stripped_program_headers);
+  }
 
   // Calculate the core dump size limit.
   const int64_t free_disk_space = GetFreeDiskSpace(coredump_path_);
@@ -187,15 +230,17 @@ int CoredumpWriter::WriteCoredump() {
   }
 
   // Write /proc files.
-  error = WriteAuxv(note_buf);
-  if (error != EX_OK) {
-    LOG_ERROR << "Failed to write auxv";
-    return error;
-  }
-  error = WriteMaps(program_headers, file_mappings);
-  if (error != EX_OK) {
-    LOG_ERROR << "Failed to write maps";
-    return error;
+  if (container_dir_) {
+    error = WriteAuxv(note_buf);
+    if (error != EX_OK) {
+      LOG_ERROR << "Failed to write auxv";
+      return error;
+    }
+    error = WriteMaps(program_headers, file_mappings);
+    if (error != EX_OK) {
+      LOG_ERROR << "Failed to write maps";
+      return error;
+    }
   }
 
   // Write ELF header.
@@ -227,8 +272,11 @@ int CoredumpWriter::WriteCoredump() {
     const Phdr& program_header = stripped_program_headers[i];
     if (program_header.p_filesz == 0)
       continue;
+    // Segments holding a stack may start further in the original segment.
     const Phdr& program_header_original = program_headers[i];
-    if (!reader.Seek(program_header_original.p_offset)) {
+    if (!reader.Seek(program_header_original.p_offset +
+                     program_header.p_vaddr -
+                     program_header_original.p_vaddr)) {
       PLOG_ERROR << "Failed to seek segment";
       return EX_IOERR;
     }
@@ -251,8 +299,12 @@ int CoredumpWriter::ReadUntilNote(Reader* reader,
     PLOG_ERROR << "Failed to read ELF header";
     return EX_IOERR;
   }
+  if (memcmp(elf_header->e_ident, ELFMAG, SELFMAG) == 0 &&
+      elf_header->e_ident[EI_CLASS] != ElfCoreDump::kClass) {
+    LOG_ERROR << "Unsupported ELF class";
+    return EX_DATAERR;
+  }
   if (memcmp(elf_header->e_ident, ELFMAG, SELFMAG) != 0 ||
-      elf_header->e_ident[EI_CLASS] != ElfCoreDump::kClass ||
       elf_header->e_version != EV_CURRENT || elf_header->e_type != ET_CORE ||
       elf_header->e_ehsize != sizeof(Ehdr) ||
       elf_header->e_phentsize != sizeof(Phdr)) {
@@ -358,9 +410,65 @@ void CoredumpWriter::StripSegments(
     const FileRange range(out.p_vaddr, out.p_vaddr + out.p_memsz);
     if (out.p_type == PT_LOAD && file_mappings.count(range))
       out.p_filesz = 0;
+  }
+
+  LayOutSegments(stripped_program_headers);
+}
+
+void CoredumpWriter::StripSegmentsToStacks(
+    const std::vector<Phdr>& program_headers,
+    const std::vector<ElfW(Addr)>& stack_pointers,
+    ElfW(Addr) vdso_address,
+    std::vector<Phdr>* stripped_program_headers) {
+  const ElfW(Addr) page_size = getpagesize();
+  stripped_program_headers->resize(program_headers.size());
+  (*stripped_program_headers)[0] = program_headers[0];
+
+  for (size_t i = 1; i < program_headers.size(); ++i) {
+    Phdr& out = (*stripped_program_headers)[i];
+    out = program_headers[i];
+    if (out.p_type != PT_LOAD || out.p_filesz == 0)
+      continue;
+    const ElfW(Addr) start = out.p_vaddr;
+    const ElfW(Addr) end = out.p_vaddr + out.p_filesz;
+
+    // The vDSO is kept whole, as the minidump identifies it from its headers.
+    if (vdso_address >= start && vdso_address < end)
+      continue;
+
+    // Keep the range from the page of the lowest stack pointer in the segment
+    // to the end of the top of the highest one. Several threads only share a
+    // segment if they switched to a stack of their own, e.g. a sigaltstack.
+    ElfW(Addr) keep_start = end;
+    ElfW(Addr) keep_end = start;
+    for (const ElfW(Addr) stack_pointer : stack_pointers) {
+      if (stack_pointer < start || stack_pointer >= end)
+        continue;
+      const ElfW(Addr) stack_start =
+          std::max(start, stack_pointer & ~(page_size - 1));
+      keep_start = std::min(keep_start, stack_start);
+      keep_end = std::max(keep_end,
+                          std::min(end, stack_start + kStackToCapture));
+    }
+    if (keep_start >= keep_end) {
+      out.p_filesz = 0;
+      continue;
+    }
+    out.p_vaddr = keep_start;
+    out.p_paddr = 0;
+    out.p_filesz = keep_end - keep_start;
+    out.p_memsz = out.p_filesz;
+  }
+
+  LayOutSegments(stripped_program_headers);
+}
 
+void CoredumpWriter::LayOutSegments(std::vector<Phdr>* program_headers) {
+  // The first segment has type PT_NOTE, and stays where it was.
+  for (size_t i = 1; i < program_headers->size(); ++i) {
+    Phdr& out = (*program_headers)[i];
     // Calculate offset.
-    const Phdr& prev_program_header = (*stripped_program_headers)[i - 1];
+    const Phdr& prev_program_header = (*program_headers)[i - 1];
     out.p_offset = prev_program_header.p_offset + prev_program_header.p_filesz;
     // Offset alignment.
     if (out.p_align != 0 && out.p_offset % out.p_align != 0)
@@ -368,6 +476,46 @@ void CoredumpWriter::StripSegments(
   }
 }
 
+std::vector<ElfW(Addr)> CoredumpWriter::GetStackPointers(
+    const std::vector<char>& note_buf) {
+  // The kernel writes one NT_PRSTATUS note per thread.
+  std::vector<ElfW(Addr)> stack_pointers;
+  for (ElfCoreDump::Note note({note_buf.data(), note_buf.size()});
+       note.IsValid(); note = note.GetNextNote()) {
+    if (note.GetType() != NT_PRSTATUS)
+      continue;
+    const auto desc = note.GetDescription();
+    elf_prstatus status;
+    if (desc.length() < sizeof(status))
+      continue;
+    // The note is not aligned for elf_prstatus.
+    memcpy(&status, desc.data(), sizeof(status));
+    const ElfW(Addr) stack_pointer = GetStackPointer(status);
+    if (stack_pointer == 0)
+      return {};
+    stack_pointers.push_back(stack_pointer);
+  }
+  return stack_pointers;
+}
+
+ElfW(Addr) CoredumpWriter::GetVdsoAddress(const std::vector<char>& note_buf) {
+  ElfCoreDump::Note note({note_buf.data(), note_buf.size()});
+  while (note.IsValid() && note.GetType() != NT_AUXV)
+    note = note.GetNextNote();
+  if (!note.IsValid())
+    return 0;
+
+  const auto desc = note.GetDescription();
+  for (size_t offset = 0; offset + sizeof(ElfW(auxv_t)) <= desc.length();
+       offset += sizeof(ElfW(auxv_t))) {
+    ElfW(auxv_t) entry;
+    memcpy(&entry, desc.data() + offset, sizeof(entry));
+    if (entry.a_type == AT_SYSINFO_EHDR)
+      return entry.a_un.a_val;
+  }
+  return 0;
+}
+
 int CoredumpWriter::WriteAuxv(const std::vector<char>& note_buf) {
   // Locate NT_AUXV note.
   ElfCoreDump::Note note({note_buf.data(), note_buf.size()});
@@ -24,15 +24,24 @@ class CoredumpWriter {
   using FileRange = std::pair<ElfW(Addr), ElfW(Addr)>;
 
   // Core dump is read from |fd|, and written to |coredump_path|. Files needed
-  // for minidump conversion are stored in |container_dir|.
-  CoredumpWriter(int fd, const char* coredump_path, const char* container_dir);
+  // for minidump conversion are stored in |container_dir|, unless it is null
+  // because the caller has the /proc files of the process. If |stacks_only|,
+  // only the top of the thread stacks and the vDSO are kept, which is what a
+  // minidump is made of.
+  CoredumpWriter(int fd,
+                 const char* coredump_path,
+                 const char* container_dir,
+                 bool stacks_only = false);
   CoredumpWriter(const CoredumpWriter&) = delete;
   CoredumpWriter& operator=(const CoredumpWriter&) = delete;
 
-  // Returns sysexits.h exit code.
+  // Returns sysexits.h exit code: EX_DATAERR if the core dump has another ELF
+  // class than this executable, or EX_OSFILE if it is otherwise invalid.
   int WriteCoredump();
 
  private:
+  friend class CoredumpWriterTest;
+
   using Ehdr = ElfW(Ehdr);
   using Phdr = ElfW(Phdr);
 
@@ -59,6 +68,26 @@ class CoredumpWriter {
                             const FileMappings& file_mappings,
                             std::vector<Phdr>* stripped_program_headers);
 
+  // Strips all segments but the top of the stacks at |stack_pointers| and the
+  // vDSO at |vdso_address|. Segments holding a stack are narrowed down to it.
+  static void StripSegmentsToStacks(
+      const std::vector<Phdr>& program_headers,
+      const std::vector<ElfW(Addr)>& stack_pointers,
+      ElfW(Addr) vdso_address,
+      std::vector<Phdr>* stripped_program_headers);
+
+  // Sets the offsets of the segments of |program_headers| after stripping.
+  static void LayOutSegments(std::vector<Phdr>* program_headers);
+
+  // Returns the stack pointers of the threads from the NT_PRSTATUS notes of
+  // PT_NOTE segment, or nothing if they are unknown for this architecture.
+  static std::vector<ElfW(Addr)> GetStackPointers(
+      const std::vector<char>& note_buf);
+
+  // Returns the address of the vDSO from the NT_AUXV note of PT_NOTE segment,
+  // or 0 if there is none.
+  static ElfW(Addr) GetVdsoAddress(const std::vector<char>& note_buf);
+
   // Writes file in |container_dir_| in the format of /proc/[pid]/auxv.
   int WriteAuxv(const std::vector<char>& note_buf);
 
@@ -69,6 +98,7 @@ class CoredumpWriter {
   const int fd_;  // Source stream.
   const char* const coredump_path_;
   const char* const container_dir_;
+  const bool stacks_only_;
 };
 
 namespace std {
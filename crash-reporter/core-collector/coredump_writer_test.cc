@@ -0,0 +1,371 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "crash-reporter/core-collector/coredump_writer.h"
+
+#include <bits/wordsize.h>
+#include <fcntl.h>
+#include <sys/procfs.h>
+#include <sys/user.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_file.h>
+#include <base/files/scoped_temp_dir.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+using Ehdr = ElfW(Ehdr);
+using Phdr = ElfW(Phdr);
+
+// Must match kStackToCapture in coredump_writer.cc.
+const ElfW(Addr) kStackToCapture = 32 * 1024;
+
+const char kLibraryPath[] = "/lib/libc.so";
+
+#if __WORDSIZE == 64
+const unsigned char kElfClass = ELFCLASS64;
+const unsigned char kOtherElfClass = ELFCLASS32;
+#else
+const unsigned char kElfClass = ELFCLASS32;
+const unsigned char kOtherElfClass = ELFCLASS64;
+#endif
+
+// Appends a note of |type| with the |size| bytes of |desc| to |notes|, the
+// way the kernel writes them to the PT_NOTE segment.
+void AddNote(std::vector<char>* notes,
+             ElfW(Word) type,
+             const void* desc,
+             size_t size) {
+  static const char kName[] = "CORE";
+  const ElfW(Nhdr) header = {sizeof(kName), static_cast<ElfW(Word)>(size),
+                             type};
+  const char* header_bytes = reinterpret_cast<const char*>(&header);
+  notes->insert(notes->end(), header_bytes, header_bytes + sizeof(header));
+  notes->insert(notes->end(), kName, kName + sizeof(kName));
+  notes->resize((notes->size() + 3) & ~3);
+  const char* desc_bytes = static_cast<const char*>(desc);
+  notes->insert(notes->end(), desc_bytes, desc_bytes + size);
+  notes->resize((notes->size() + 3) & ~3);
+}
+
+// Appends the NT_PRSTATUS note of a thread whose stack pointer is
+// |stack_pointer| to |notes|.
+void AddThread(std::vector<char>* notes, ElfW(Addr) stack_pointer) {
+  elf_prstatus status;
+  memset(&status, 0, sizeof(status));
+#if defined(__x86_64__)
+  user_regs_struct regs = {};
+  regs.rsp = stack_pointer;
+#elif defined(__i386__)
+  user_regs_struct regs = {};
+  regs.esp = stack_pointer;
+#elif defined(__ARM_EABI__)
+  user_regs regs = {};
+  regs.uregs[13] = stack_pointer;  // ARM_sp
+#elif defined(__aarch64__)
+  user_regs_struct regs = {};
+  regs.sp = stack_pointer;
+#endif
+  memcpy(&status.pr_reg, &regs, sizeof(regs));
+  AddNote(notes, NT_PRSTATUS, &status, sizeof(status));
+}
+
+// Appends an NT_AUXV note with the vDSO at |vdso_address| to |notes|.
+void AddAuxv(std::vector<char>* notes, ElfW(Addr) vdso_address) {
+  ElfW(auxv_t) auxv[3];
+  memset(auxv, 0, sizeof(auxv));
+  auxv[0].a_type = AT_PAGESZ;
+  auxv[0].a_un.a_val = getpagesize();
+  auxv[1].a_type = AT_SYSINFO_EHDR;
+  auxv[1].a_un.a_val = vdso_address;
+  auxv[2].a_type = AT_NULL;
+  AddNote(notes, NT_AUXV, auxv, sizeof(auxv));
+}
+
+// Appends an NT_FILE note with |path| mapped at [|start|, |end|) to |notes|.
+void AddFile(std::vector<char>* notes,
+             ElfW(Addr) start,
+             ElfW(Addr) end,
+             const char* path) {
+  const ElfW(Addr) words[] = {1, static_cast<ElfW(Addr)>(getpagesize()),
+                              start, end, 0};
+  std::string desc(reinterpret_cast<const char*>(words), sizeof(words));
+  desc.append(path, strlen(path) + 1);
+  AddNote(notes, NT_FILE, desc.data(), desc.size());
+}
+
+Phdr MakeSegment(ElfW(Word) type, ElfW(Addr) vaddr, ElfW(Xword) size) {
+  Phdr segment = {};
+  segment.p_type = type;
+  segment.p_flags = PF_R | PF_W;
+  segment.p_vaddr = vaddr;
+  segment.p_filesz = size;
+  segment.p_memsz = size;
+  segment.p_align = getpagesize();
+  return segment;
+}
+
+// A core dump laid out the way the kernel writes it: the ELF header, the
+// program headers, the PT_NOTE segment and the other segments, each at the
+// next offset aligned on a page. Each word of the segments holds its own
+// address, so that copied data tells where it was read from.
+std::string MakeCore(const std::vector<char>& notes,
+                     std::vector<Phdr> segments) {
+  Ehdr header = {};
+  memcpy(header.e_ident, ELFMAG, SELFMAG);
+  header.e_ident[EI_CLASS] = kElfClass;
+  header.e_ident[EI_DATA] = ELFDATA2LSB;
+  header.e_ident[EI_VERSION] = EV_CURRENT;
+  header.e_type = ET_CORE;
+  header.e_version = EV_CURRENT;
+  header.e_phoff = sizeof(header);
+  header.e_ehsize = sizeof(header);
+  header.e_phentsize = sizeof(Phdr);
+  header.e_phnum = segments.size() + 1;
+
+  Phdr note_segment = {};
+  note_segment.p_type = PT_NOTE;
+  note_segment.p_offset = sizeof(header) + sizeof(Phdr) * header.e_phnum;
+  note_segment.p_filesz = notes.size();
+  segments.insert(segments.begin(), note_segment);
+  ElfW(Off) offset = note_segment.p_offset + note_segment.p_filesz;
+  for (size_t i = 1; i < segments.size(); i++) {
+    offset = (offset + getpagesize() - 1) & ~(getpagesize() - 1);
+    segments[i].p_offset = offset;
+    offset += segments[i].p_filesz;
+  }
+
+  std::string core(offset, '\0');
+  memcpy(&core[0], &header, sizeof(header));
+  memcpy(&core[header.e_phoff], segments.data(),
+         sizeof(Phdr) * segments.size());
+  memcpy(&core[note_segment.p_offset], notes.data(), notes.size());
+  for (size_t i = 1; i < segments.size(); i++) {
+    for (ElfW(Xword) j = 0; j < segments[i].p_filesz; j += sizeof(ElfW(Addr))) {
+      const ElfW(Addr) word = segments[i].p_vaddr + j;
+      memcpy(&core[segments[i].p_offset + j], &word, sizeof(word));
+    }
+  }
+  return core;
+}
+
+}  // namespace
+
+class CoredumpWriterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    page_size_ = getpagesize();
+  }
+
+  static void StripSegmentsToStacks(
+      const std::vector<Phdr>& program_headers,
+      const std::vector<ElfW(Addr)>& stack_pointers,
+      ElfW(Addr) vdso_address,
+      std::vector<Phdr>* stripped_program_headers) {
+    CoredumpWriter::StripSegmentsToStacks(program_headers, stack_pointers,
+                                          vdso_address,
+                                          stripped_program_headers);
+  }
+
+  static std::vector<ElfW(Addr)> GetStackPointers(
+      const std::vector<char>& note_buf) {
+    return CoredumpWriter::GetStackPointers(note_buf);
+  }
+
+  static ElfW(Addr) GetVdsoAddress(const std::vector<char>& note_buf) {
+    return CoredumpWriter::GetVdsoAddress(note_buf);
+  }
+
+  // Writes the stacks-only core dump of |core| to |path|, and
+  // returns the result of CoredumpWriter::WriteCoredump().
+  int WriteStacks(const std::string& core, const base::FilePath& path) {
+    const base::FilePath core_path = temp_dir_.GetPath().Append("input");
+    if (base::WriteFile(core_path, core.data(), core.size()) !=
+        static_cast<int>(core.size())) {
+      return EX_IOERR;
+    }
+    base::ScopedFD fd(open(core_path.value().c_str(), O_RDONLY | O_CLOEXEC));
+    CoredumpWriter writer(fd.get(), path.value().c_str(),
+                          nullptr /* container_dir */, true /* stacks_only */);
+    return writer.WriteCoredump();
+  }
+
+  base::ScopedTempDir temp_dir_;
+  ElfW(Addr) page_size_;
+};
+
+TEST_F(CoredumpWriterTest, GetStackPointers) {
+  std::vector<char> notes;
+  AddThread(&notes, 0x7ffd1000);
+  AddAuxv(&notes, 0x7fff0000);
+  AddThread(&notes, 0x7f002468);
+  // A note too short for the registers of a thread is skipped.
+  const char truncated[8] = {};
+  AddNote(&notes, NT_PRSTATUS, truncated, sizeof(truncated));
+  EXPECT_EQ(std::vector<ElfW(Addr)>({0x7ffd1000, 0x7f002468}),
+            GetStackPointers(notes));
+
+  EXPECT_TRUE(GetStackPointers(std::vector<char>()).empty());
+}
+
+TEST_F(CoredumpWriterTest, GetVdsoAddress) {
+  std::vector<char> notes;
+  AddThread(&notes, 0x7ffd1000);
+  EXPECT_EQ(0, GetVdsoAddress(notes));
+
+  AddAuxv(&notes, 0x7fff0000);
+  EXPECT_EQ(0x7fff0000, GetVdsoAddress(notes));
+}
+
+TEST_F(CoredumpWriterTest, StripSegmentsToStacks) {
+  const ElfW(Addr) stack = 0x200000;
+  const ElfW(Addr) alt_stack = 0x300000;
+  const ElfW(Addr) vdso = 0x400000;
+  std::vector<Phdr> segments = {
+      MakeSegment(PT_NOTE, 0, 0x100),
+      MakeSegment(PT_LOAD, 0x100000, 4 * page_size_),
+      MakeSegment(PT_LOAD, stack, 16 * page_size_),
+      MakeSegment(PT_LOAD, alt_stack, 4 * page_size_),
+      MakeSegment(PT_LOAD, vdso, 2 * page_size_),
+      MakeSegment(PT_LOAD, 0x500000, 0),
+  };
+  segments[0].p_offset = 0x400;
+  segments[0].p_align = 0;
+  const std::vector<ElfW(Addr)> stack_pointers = {
+      stack + 5 * page_size_ + 0x123,
+      // Two threads on the same segment, the second near its end.
+      alt_stack + page_size_ + 0x10,
+      alt_stack + 3 * page_size_ + 0x20,
+  };
+
+  std::vector<Phdr> stripped;
+  StripSegmentsToStacks(segments, stack_pointers, vdso + 0x10, &stripped);
+  ASSERT_EQ(segments.size(), stripped.size());
+
+  // The PT_NOTE segment is unchanged.
+  EXPECT_EQ(0x400, stripped[0].p_offset);
+  EXPECT_EQ(0x100, stripped[0].p_filesz);
+
+  // Segments without a stack are dropped.
+  EXPECT_EQ(0x100000, stripped[1].p_vaddr);
+  EXPECT_EQ(0, stripped[1].p_filesz);
+
+  // A stack is kept from the page of its stack pointer.
+  EXPECT_EQ(stack + 5 * page_size_, stripped[2].p_vaddr);
+  EXPECT_EQ(kStackToCapture, stripped[2].p_filesz);
+  EXPECT_EQ(kStackToCapture, stripped[2].p_memsz);
+
+  // Stacks sharing a segment are kept together, up to its end.
+  EXPECT_EQ(alt_stack + page_size_, stripped[3].p_vaddr);
+  EXPECT_EQ(3 * page_size_, stripped[3].p_filesz);
+
+  // The vDSO is kept whole.
+  EXPECT_EQ(vdso, stripped[4].p_vaddr);
+  EXPECT_EQ(2 * page_size_, stripped[4].p_filesz);
+
+  EXPECT_EQ(0, stripped[5].p_filesz);
+
+  // The remaining segments are laid out after each other, aligned on pages.
+  ElfW(Off) offset = 0x400 + 0x100;
+  for (size_t i = 1; i < stripped.size(); i++) {
+    offset = (offset + page_size_ - 1) & ~(page_size_ - 1);
+    EXPECT_EQ(offset, stripped[i].p_offset) << "segment " << i;
+    offset += stripped[i].p_filesz;
+  }
+}
+
+TEST_F(CoredumpWriterTest, WriteCoredumpStacksOnly) {
+  const ElfW(Addr) library = 0x100000;
+  const ElfW(Addr) stack = 0x200000;
+  const ElfW(Addr) vdso = 0x400000;
+  const ElfW(Addr) stack_pointer = stack + 5 * page_size_ + 0x123;
+  std::vector<char> notes;
+  AddThread(&notes, stack_pointer);
+  AddAuxv(&notes, vdso);
+  AddFile(&notes, library, library + 2 * page_size_, kLibraryPath);
+  const std::string core =
+      MakeCore(notes, {
+                          MakeSegment(PT_LOAD, library, 2 * page_size_),
+                          MakeSegment(PT_LOAD, stack, 16 * page_size_),
+                          MakeSegment(PT_LOAD, 0x300000, 8 * page_size_),
+                          MakeSegment(PT_LOAD, vdso, 2 * page_size_),
+                      });
+
+  const base::FilePath path = temp_dir_.GetPath().Append("core");
+  ASSERT_EQ(EX_OK, WriteStacks(core, path));
+  std::string stripped;
+  ASSERT_TRUE(base::ReadFileToString(path, &stripped));
+  EXPECT_LT(stripped.size(), core.size());
+
+  // The ELF header and the notes are copied as they are.
+  ASSERT_GE(stripped.size(), sizeof(Ehdr));
+  EXPECT_EQ(0, memcmp(core.data(), stripped.data(), sizeof(Ehdr)));
+  Ehdr header;
+  memcpy(&header, stripped.data(), sizeof(header));
+  ASSERT_EQ(5, header.e_phnum);
+  std::vector<Phdr> segments(header.e_phnum);
+  ASSERT_GE(stripped.size(), header.e_phoff + sizeof(Phdr) * segments.size());
+  memcpy(segments.data(), &stripped[header.e_phoff],
+         sizeof(Phdr) * segments.size());
+  ASSERT_EQ(PT_NOTE, segments[0].p_type);
+  ASSERT_EQ(notes.size(), segments[0].p_filesz);
+  EXPECT_EQ(0, memcmp(notes.data(), &stripped[segments[0].p_offset],
+                      notes.size()));
+
+  EXPECT_EQ(0, segments[1].p_filesz);
+  EXPECT_EQ(stack + 5 * page_size_, segments[2].p_vaddr);
+  EXPECT_EQ(kStackToCapture, segments[2].p_filesz);
+  EXPECT_EQ(0, segments[3].p_filesz);
+  EXPECT_EQ(vdso, segments[4].p_vaddr);
+  EXPECT_EQ(2 * page_size_, segments[4].p_filesz);
+
+  // The kept data is read from where it was in the original segments, and
+  // written at the offsets of the stripped segments.
+  for (size_t i = 1; i < segments.size(); i++) {
+    const Phdr& segment = segments[i];
+    if (segment.p_filesz == 0)
+      continue;
+    EXPECT_EQ(0, segment.p_offset % page_size_) << "segment " << i;
+    ASSERT_GE(stripped.size(), segment.p_offset + segment.p_filesz);
+    for (ElfW(Xword) j = 0; j < segment.p_filesz; j += page_size_) {
+      ElfW(Addr) word;
+      memcpy(&word, &stripped[segment.p_offset + j], sizeof(word));
+      EXPECT_EQ(segment.p_vaddr + j, word)
+          << "segment " << i << " at " << j;
+    }
+  }
+}
+
+TEST_F(CoredumpWriterTest, WriteCoredumpInvalid) {
+  std::vector<char> notes;
+  AddThread(&notes, 0x200000);
+  AddFile(&notes, 0x100000, 0x101000, kLibraryPath);
+  const std::string core =
+      MakeCore(notes, {MakeSegment(PT_LOAD, 0x200000, page_size_)});
+
+  // A core dump of the other ELF class.
+  std::string other_class = core;
+  other_class[EI_CLASS] = kOtherElfClass;
+  EXPECT_EQ(EX_DATAERR,
+            WriteStacks(other_class, temp_dir_.GetPath().Append("class")));
+
+  std::string bad_magic = core;
+  bad_magic[EI_MAG0] = 0;
+  EXPECT_EQ(EX_OSFILE,
+            WriteStacks(bad_magic, temp_dir_.GetPath().Append("magic")));
+
+  // A core dump without its segments.
+  EXPECT_EQ(EX_IOERR,
+            WriteStacks(core.substr(0, core.size() / 2),
+                        temp_dir_.GetPath().Append("truncated")));
+}
@@ -0,0 +1,25 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "crash-reporter/core-collector/logging.h"
+
+#include <iostream>
+
+namespace {
+
+void WriteToStderr(const std::string& message) {
+  std::cerr << message << ".\n";
+}
+
+ErrorHandler g_error_handler = &WriteToStderr;
+
+}  // namespace
+
+void SetErrorHandler(ErrorHandler handler) {
+  g_error_handler = handler;
+}
+
+void HandleError(const std::string& message) {
+  g_error_handler(message);
+}
@@ -8,37 +8,46 @@
 #include <errno.h>
 
 #include <cstring>  // For strerror.
-#include <iostream>
+#include <sstream>
 #include <string>
 
 #define LOG_ERROR ErrorMessage()
 #define PLOG_ERROR ErrorMessage(strerror(errno))
 
-extern const char* g_exec_name;
+// Receives the messages of LOG_ERROR and PLOG_ERROR.
+using ErrorHandler = void (*)(const std::string& message);
+
+// Sends the messages of LOG_ERROR and PLOG_ERROR to |handler|. They are
+// written to standard error until a handler is set.
+void SetErrorHandler(ErrorHandler handler);
+
+// Sends |message| to the handler set by SetErrorHandler().
+void HandleError(const std::string& message);
 
 class ErrorMessage {
  public:
   ErrorMessage() : ErrorMessage(std::string()) {}
 
-  explicit ErrorMessage(const std::string& os_error) : os_error_(os_error) {
-    std::cerr << g_exec_name << ": ";
-  }
+  explicit ErrorMessage(const std::string& os_error) : os_error_(os_error) {}
 
   ~ErrorMessage() {
     if (!os_error_.empty())
-      std::cerr << ": " << os_error_;
+      stream_ << ": " << os_error_;
 
-    std::cerr << ".\n";
+    HandleError(stream_.str());
   }
 
+  std::ostream& stream() const { return stream_; }
+
  private:
   const std::string os_error_;
+  mutable std::ostringstream stream_;
 };
 
 template <typename Type>
 inline const ErrorMessage& operator<<(const ErrorMessage& message,
                                       const Type& value) {
-  std::cerr << value;
+  message.stream() << value;
   return message;
 }
 
@@ -14,10 +14,12 @@
 
 #include <base/at_exit.h>
 #include <base/files/file.h>
+#include <base/files/file_descriptor_watcher_posix.h>
 #include <base/files/file_path.h>
 #include <base/files/file_util.h>
 #include <base/logging.h>
 #include <base/strings/string_number_conversions.h>
+#include <base/task/single_thread_task_executor.h>
 #include <base/time/default_clock.h>
 #include <brillo/syslog_logging.h>
 #include <libminijail.h>
@@ -87,6 +89,10 @@ int RunChildMain(int argc, char* argv[]) {
     }
   }
 
+  // Concurrent uploads are run by the task executor.
+  base::SingleThreadTaskExecutor task_executor(base::MessagePumpType::IO);
+  base::FileDescriptorWatcher watcher(task_executor.task_runner());
+
   auto metrics_lib = std::make_unique<MetricsLibrary>();
   util::Sender::Options options;
   options.max_spread_time = flags.max_spread_time;
@@ -101,6 +107,7 @@ int RunChildMain(int argc, char* argv[]) {
   options.test_mode = flags.test_mode;
   options.upload_old_reports = flags.upload_old_reports;
   options.force_upload_on_test_images = flags.force_upload_on_test_images;
+  options.max_concurrent_uploads = flags.max_concurrent_uploads;
   util::Sender sender(std::move(metrics_lib), std::move(clock), options);
 
   // If you add sigificant code past this point, consider updating
@@ -16,12 +16,14 @@
 #include <utility>
 #include <vector>
 
+#include <base/bind.h>
 #include <base/check.h>
 #include <base/files/file_enumerator.h>
 #include <base/files/file_util.h>
 #include <base/json/json_writer.h>
 #include <base/logging.h>
 #include <base/notreached.h>
+#include <base/run_loop.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/string_split.h>
 #include <base/strings/string_util.h>
@@ -32,6 +34,7 @@
 #include <brillo/files/file_util.h>
 #include <brillo/files/safe_fd.h>
 #include <brillo/http/http_proxy.h>
+#include <brillo/http/http_request.h>
 #include <brillo/http/http_transport.h>
 #include <brillo/http/http_utils.h>
 #include <brillo/mime_utils.h>
@@ -42,6 +45,7 @@
 #include "crash-reporter/constants.h"
 #include "crash-reporter/crash_sender.pb.h"
 #include "crash-reporter/crash_sender_paths.h"
+#include "crash-reporter/gzip_input_stream.h"
 #include "crash-reporter/paths.h"
 #include "crash-reporter/util.h"
 
@@ -117,6 +121,8 @@ void ParseCommandLine(int argc,
   DEFINE_bool(force_upload_on_test_images, false,
               "If set, upload even on test images. Still respects consent. "
               "(Use either the mock-consent file or normal consent settings.)");
+  DEFINE_int32(max_concurrent_uploads, kMaxConcurrentUploads,
+               "Max number of crash reports to upload at the same time");
 
   brillo::FlagHelper::Init(argc, argv, "Chromium OS Crash Sender");
   if (FLAGS_max_spread_time < 0) {
@@ -124,6 +130,11 @@ void ParseCommandLine(int argc,
                << FLAGS_max_spread_time;
     exit(EXIT_FAILURE);
   }
+  if (FLAGS_max_concurrent_uploads < 1) {
+    LOG(ERROR) << "Invalid value for max concurrent uploads: "
+               << FLAGS_max_concurrent_uploads;
+    exit(EXIT_FAILURE);
+  }
   flags->max_spread_time = base::Seconds(FLAGS_max_spread_time);
   flags->crash_directory = FLAGS_crash_directory;
   flags->ignore_rate_limits = FLAGS_ignore_rate_limits;
@@ -133,6 +144,7 @@ void ParseCommandLine(int argc,
   flags->test_mode = FLAGS_test_mode;
   flags->upload_old_reports = FLAGS_upload_old_reports;
   flags->force_upload_on_test_images = FLAGS_force_upload_on_test_images;
+  flags->max_concurrent_uploads = FLAGS_max_concurrent_uploads;
   if (flags->test_mode) {
     // The pause file is intended to pause the cronjob crash_sender during
     // tests, not the crash_sender invoked by the test code.
@@ -316,11 +328,12 @@ bool IsBelowRate(const base::FilePath& timestamps_dir,
   return current_rate < max_crash_rate || current_bytes < max_crash_bytes;
 }
 
-void RecordSendAttempt(const base::FilePath& timestamps_dir, int bytes) {
+base::FilePath RecordSendAttempt(const base::FilePath& timestamps_dir,
+                                 int bytes) {
   if (!base::CreateDirectory(timestamps_dir)) {
     PLOG(ERROR) << "Failed to create a timestamps directory: "
                 << timestamps_dir.value();
-    return;
+    return base::FilePath();
   }
 
   base::FilePath temp_file_path;
@@ -328,12 +341,30 @@ void RecordSendAttempt(const base::FilePath& timestamps_dir, int bytes) {
       base::CreateAndOpenTemporaryStreamInDir(timestamps_dir, &temp_file_path));
   if (temp_file == nullptr) {
     PLOG(ERROR) << "Failed to create a file in " << timestamps_dir.value();
-  } else {
-    crash::SendRecord record;
-    record.set_size(bytes);
-    std::string serialized;
-    record.SerializeToString(&serialized);
-    fwrite(serialized.c_str(), 1, serialized.size(), temp_file.get());
+    return base::FilePath();
+  }
+  crash::SendRecord record;
+  record.set_size(bytes);
+  std::string serialized;
+  record.SerializeToString(&serialized);
+  fwrite(serialized.c_str(), 1, serialized.size(), temp_file.get());
+  return temp_file_path;
+}
+
+void UpdateSendAttempt(const base::FilePath& record_file, int bytes) {
+  // The record keeps its modification time, which dates the attempt.
+  base::File::Info info;
+  if (!base::GetFileInfo(record_file, &info)) {
+    PLOG(ERROR) << "Failed to get file info: " << record_file.value();
+    return;
+  }
+  crash::SendRecord record;
+  record.set_size(bytes);
+  std::string serialized;
+  record.SerializeToString(&serialized);
+  if (!base::WriteFile(record_file, serialized) ||
+      !base::TouchFile(record_file, info.last_accessed, info.last_modified)) {
+    PLOG(ERROR) << "Failed to update " << record_file.value();
   }
 }
 
@@ -351,7 +382,9 @@ Sender::Sender(std::unique_ptr<MetricsLibraryInterface> metrics_lib,
       allow_dev_sending_(options.allow_dev_sending),
       test_mode_(options.test_mode),
       upload_old_reports_(options.upload_old_reports),
-      force_upload_on_test_images_(options.force_upload_on_test_images) {}
+      force_upload_on_test_images_(options.force_upload_on_test_images),
+      max_concurrent_uploads_(options.max_concurrent_uploads),
+      upload_url_(options.upload_url) {}
 
 bool Sender::HasCrashUploadingConsent() {
   if (util::HasMockConsent()) {
@@ -478,6 +511,12 @@ void Sender::SendCrashes(const std::vector<MetaFile>& crash_meta_files) {
   if (crash_meta_files.empty())
     return;
 
+  // Test mode and mock sends never reach the network.
+  if (max_concurrent_uploads_ > 1 && !test_mode_ && !IsMock()) {
+    SendCrashesConcurrently(crash_meta_files);
+    return;
+  }
+
   std::string client_id = GetClientId();
 
   base::File lock(AcquireLockFileOrDie());
@@ -511,42 +550,117 @@ void Sender::SendCrashes(const std::vector<MetaFile>& crash_meta_files) {
       // destructor).
       ScopedProcessingFile processing(meta_file);
 
-      // This should be checked inside of the loop, since the device can disable
-      // metrics while sending crash reports with an interval up to
-      // max_spread_time_ between sends. We only need to check if metrics are
-      // enabled and not guest mode because in guest mode, it always indicates
-      // that metrics are disabled.
-      if (!HasCrashUploadingConsent()) {
-        LOG(INFO) << "Metrics disabled or guest mode entered, delaying crash "
-                  << "sending";
+      const SendDecision decision = CheckBeforeSending(meta_file);
+      if (decision == SendDecision::kStop)
         return;
-      }
+      if (decision == SendDecision::kSkip)
+        continue;
 
-      // User-specific crash reports become inaccessible if the user signs out
-      // while sleeping, thus we need to check if the metadata is still
-      // accessible.
-      if (!base::PathExists(meta_file)) {
-        LOG(INFO) << "Metadata is no longer accessible: " << meta_file.value();
+      const CrashDetails details = {
+          .meta_file = meta_file,
+          .payload_file = info.payload_file,
+          .payload_kind = info.payload_kind,
+          .client_id = client_id,
+          .metadata = info.metadata,
+      };
+      FinishSending(meta_file, RequestToSendCrash(details));
+    }
+  }
+}
+
+struct Sender::Upload {
+  explicit Upload(const CrashDetails& details) : details(details) {}
+
+  // Refers to the metadata of the crash, which outlives the upload.
+  const CrashDetails details;
+  std::string product_name;
+  std::unique_ptr<ScopedProcessingFile> processing;
+  // The send attempt, recorded with an upper bound of its size until it is
+  // known.
+  base::FilePath send_record;
+  // Updated as the compressed body of the request is sent.
+  uint64_t compressed_size = 0;
+  // Called once the upload is done, with either |response| or |error| set.
+  base::OnceClosure on_done;
+  bool done = false;
+  std::unique_ptr<brillo::http::Response> response;
+  brillo::ErrorPtr error;
+
+  void OnSuccess(brillo::http::RequestID /* request_id */,
+                 std::unique_ptr<brillo::http::Response> upload_response) {
+    response = std::move(upload_response);
+    Done();
+  }
+
+  void OnError(brillo::http::RequestID /* request_id */,
+               const brillo::Error* upload_error) {
+    error = upload_error->Clone();
+    Done();
+  }
+
+  void Done() {
+    done = true;
+    if (on_done)
+      std::move(on_done).Run();
+  }
+};
+
+void Sender::SendCrashesConcurrently(
+    const std::vector<MetaFile>& crash_meta_files) {
+  std::string client_id = GetClientId();
+  // All the uploads go through the same transport, so that its connections to
+  // the server are reused from one report to the next.
+  std::shared_ptr<brillo::http::Transport> transport;
+
+  base::File lock(AcquireLockFileOrDie());
+  for (size_t begin = 0; begin < crash_meta_files.size();
+       begin += max_concurrent_uploads_) {
+    const size_t end = std::min(crash_meta_files.size(),
+                                begin + max_concurrent_uploads_);
+
+    // Sleep once for the whole batch, as long as its longest sleep time so
+    // that the hold-off time of each of its reports is respected.
+    base::TimeDelta sleep_time;
+    std::vector<bool> evaluated(end - begin);
+    for (size_t i = begin; i < end; i++) {
+      const base::FilePath& meta_file = crash_meta_files[i].first;
+      LOG(INFO) << "Evaluating crash report: " << meta_file.value();
+      base::TimeDelta report_sleep_time;
+      if (!GetSleepTime(meta_file, max_spread_time_, hold_off_time_,
+                        &report_sleep_time)) {
+        LOG(WARNING) << "Failed to compute sleep time for "
+                     << meta_file.value();
         continue;
       }
+      evaluated[i - begin] = true;
+      sleep_time = std::max(sleep_time, report_sleep_time);
+    }
 
-      const base::FilePath timestamps_dir =
-          paths::Get(paths::kTimestampsDirectory);
-      if (!IsBelowRate(timestamps_dir, max_crash_rate_, max_crash_bytes_)) {
-        LOG(WARNING) << "Cannot send more crashes. Sending "
-                     << meta_file.value()
-                     << " would exceed the max daily rate of "
-                     << max_crash_rate_ << " crashes and " << max_crash_bytes_
-                     << " bytes";
-        return;
-      }
+    LOG(INFO) << "Scheduled to send " << end - begin << " crash reports in "
+              << sleep_time.InSeconds() << "s";
+    lock.Close();  // Don't hold lock during sleep.
+    base::PlatformThread::Sleep(sleep_time);
+    lock = AcquireLockFileOrDie();
 
-      // If we are offline, then don't try to send any crashes.
-      if (!IsMock() && !IsNetworkOnline()) {
-        LOG(INFO) << "Stopping crash sending; network is offline";
-        return;
-      }
+    std::vector<std::unique_ptr<Upload>> uploads;
+    bool stop = false;
+    for (size_t i = begin; i < end && !stop; i++) {
+      if (!evaluated[i - begin])
+        continue;
+      const base::FilePath& meta_file = crash_meta_files[i].first;
+      const CrashInfo& info = crash_meta_files[i].second;
+      // Mark the crash as being processed until its upload is finished.
+      auto processing = std::make_unique<ScopedProcessingFile>(meta_file);
+      const SendDecision decision = CheckBeforeSending(meta_file);
+      if (decision == SendDecision::kStop)
+        stop = true;
+      if (decision != SendDecision::kSend)
+        continue;
 
+      if (!transport) {
+        ResolveProxyServers();
+        transport = GetTransport();
+      }
       const CrashDetails details = {
           .meta_file = meta_file,
           .payload_file = info.payload_file,
@@ -554,23 +668,141 @@ void Sender::SendCrashes(const std::vector<MetaFile>& crash_meta_files) {
           .client_id = client_id,
           .metadata = info.metadata,
       };
-      Sender::CrashRemoveReason result = RequestToSendCrash(details);
-      if (SenderBase::CrashRemoveReason::kRetryUploading == result) {
-        LOG(WARNING) << "Failed to send " << meta_file.value()
-                     << ", not removing; will retry later";
+      std::unique_ptr<Upload> upload = StartUpload(details, transport);
+      if (!upload) {
+        FinishSending(meta_file, CrashRemoveReason::kRetryUploading);
         continue;
       }
-      if (SenderBase::CrashRemoveReason::kFinishedUploading == result) {
-        LOG(INFO) << "Successfully sent crash " << meta_file.value()
-                  << " and removing.";
-      } else {
-        LOG(WARNING) << "Failed to send " << meta_file.value()
-                     << " due to error code " << result << ". Removing";
-      }
-      RecordCrashRemoveReason(result);
-      RemoveReportFiles(meta_file);
+      upload->processing = std::move(processing);
+      uploads.push_back(std::move(upload));
+    }
+
+    // Wait for all the uploads of the batch to finish.
+    base::RunLoop run_loop;
+    size_t pending_uploads = 0;
+    for (auto& upload : uploads) {
+      if (upload->done)
+        continue;
+      pending_uploads++;
+      upload->on_done = base::BindOnce(
+          [](size_t* pending_uploads, base::OnceClosure quit) {
+            if (--*pending_uploads == 0)
+              std::move(quit).Run();
+          },
+          &pending_uploads, run_loop.QuitClosure());
+    }
+    if (pending_uploads > 0)
+      run_loop.Run();
+
+    for (auto& upload : uploads) {
+      if (!upload->send_record.empty())
+        UpdateSendAttempt(upload->send_record,
+                          static_cast<int>(upload->compressed_size));
+      FinishSending(upload->details.meta_file,
+                    HandleUploadResponse(upload->details, upload->product_name,
+                                         std::move(upload->response),
+                                         upload->error.get()));
     }
+    if (stop)
+      return;
+  }
+}
+
+std::unique_ptr<Sender::Upload> Sender::StartUpload(
+    const CrashDetails& details,
+    std::shared_ptr<brillo::http::Transport> transport) {
+  auto upload = std::make_unique<Upload>(details);
+  std::unique_ptr<brillo::http::FormData> form_data =
+      CreateCrashFormData(details, &upload->product_name);
+  if (!form_data)
+    return nullptr;
+
+  // The payload files are read from disk and compressed as they are sent,
+  // rather than compressed in memory beforehand.
+  const std::string content_type = form_data->GetContentType();
+  brillo::StreamPtr form_stream = form_data->ExtractDataStream();
+  const uint64_t uncompressed_size = form_stream->GetSize();
+  brillo::ErrorPtr error;
+  brillo::StreamPtr body = GzipInputStream::Create(
+      std::move(form_stream), &upload->compressed_size, &error);
+  if (!body) {
+    LOG(ERROR) << "Failed compressing crash data for upload: "
+               << error->GetMessage();
+    return nullptr;
+  }
+
+  // Record the send attempt even if it fails, and before it starts, so that
+  // the rate limit accounts for the uploads in progress. The compressed size
+  // is not known yet: the uncompressed size is an upper bound in practice.
+  upload->send_record =
+      RecordSendAttempt(paths::Get(paths::kTimestampsDirectory),
+                        static_cast<int>(uncompressed_size));
+
+  // Upload objects outlive their requests, see SendCrashesConcurrently().
+  Upload* raw_upload = upload.get();
+  brillo::http::SendRequest(
+      brillo::http::request_type::kPost, GetUploadUrl(), std::move(body),
+      content_type, {{brillo::http::request_header::kContentEncoding, "gzip"}},
+      transport,
+      base::Bind(&Upload::OnSuccess, base::Unretained(raw_upload)),
+      base::Bind(&Upload::OnError, base::Unretained(raw_upload)));
+  return upload;
+}
+
+Sender::SendDecision Sender::CheckBeforeSending(
+    const base::FilePath& meta_file) {
+  // This should be checked right before each send, since the device can
+  // disable metrics while sending crash reports with an interval up to
+  // max_spread_time_ between sends. We only need to check if metrics are
+  // enabled and not guest mode because in guest mode, it always indicates
+  // that metrics are disabled.
+  if (!HasCrashUploadingConsent()) {
+    LOG(INFO) << "Metrics disabled or guest mode entered, delaying crash "
+              << "sending";
+    return SendDecision::kStop;
+  }
+
+  // User-specific crash reports become inaccessible if the user signs out
+  // while sleeping, thus we need to check if the metadata is still
+  // accessible.
+  if (!base::PathExists(meta_file)) {
+    LOG(INFO) << "Metadata is no longer accessible: " << meta_file.value();
+    return SendDecision::kSkip;
   }
+
+  const base::FilePath timestamps_dir = paths::Get(paths::kTimestampsDirectory);
+  if (!IsBelowRate(timestamps_dir, max_crash_rate_, max_crash_bytes_)) {
+    LOG(WARNING) << "Cannot send more crashes. Sending " << meta_file.value()
+                 << " would exceed the max daily rate of " << max_crash_rate_
+                 << " crashes and " << max_crash_bytes_ << " bytes";
+    return SendDecision::kStop;
+  }
+
+  // If we are offline, then don't try to send any crashes.
+  if (!IsMock() && !IsNetworkOnline()) {
+    LOG(INFO) << "Stopping crash sending; network is offline";
+    return SendDecision::kStop;
+  }
+
+  return SendDecision::kSend;
+}
+
+void Sender::FinishSending(const base::FilePath& meta_file,
+                           SenderBase::CrashRemoveReason result) {
+  if (SenderBase::CrashRemoveReason::kRetryUploading == result) {
+    LOG(WARNING) << "Failed to send " << meta_file.value()
+                 << ", not removing; will retry later";
+    return;
+  }
+  if (SenderBase::CrashRemoveReason::kFinishedUploading == result) {
+    LOG(INFO) << "Successfully sent crash " << meta_file.value()
+              << " and removing.";
+  } else {
+    LOG(WARNING) << "Failed to send " << meta_file.value()
+                 << " due to error code " << result << ". Removing";
+  }
+  RecordCrashRemoveReason(result);
+  RemoveReportFiles(meta_file);
 }
 
 std::unique_ptr<brillo::http::FormData> Sender::CreateCrashFormData(
@@ -796,8 +1028,6 @@ SenderBase::CrashRemoveReason Sender::RequestToSendCrash(
     return CrashRemoveReason::kFinishedUploading;
   }
 
-  std::string report_id;
-
   auto stream_data = form_data->ExtractDataStream();
   uint64_t uncompressed_size = stream_data->GetSize();
   // Compress the data before sending it to the server. We compress the entire
@@ -828,12 +1058,7 @@ SenderBase::CrashRemoveReason Sender::RequestToSendCrash(
       return CrashRemoveReason::kFinishedUploading;
     }
   } else {
-    // Determine the proxy server if it's not given from the options.
-    if (proxy_servers_.empty()) {
-      EnsureDBusIsReady();
-      brillo::http::GetChromeProxyServers(bus_, kReportUploadProdUrl,
-                                          &proxy_servers_);
-    }
+    ResolveProxyServers();
   }
 
   std::shared_ptr<brillo::http::Transport> transport = GetTransport();
@@ -842,9 +1067,8 @@ SenderBase::CrashRemoveReason Sender::RequestToSendCrash(
   std::unique_ptr<brillo::http::Response> response;
   if (!compressed_form_data.empty()) {
     response = brillo::http::PostBinaryAndBlock(
-        allow_dev_sending_ ? kReportUploadStagingUrl : kReportUploadProdUrl,
-        compressed_form_data.data(), compressed_form_data.size(),
-        form_data->GetContentType(),
+        GetUploadUrl(), compressed_form_data.data(),
+        compressed_form_data.size(), form_data->GetContentType(),
         {{brillo::http::request_header::kContentEncoding, "gzip"}}, transport,
         &upload_error);
   } else {
@@ -859,10 +1083,35 @@ SenderBase::CrashRemoveReason Sender::RequestToSendCrash(
       return CrashRemoveReason::kRetryUploading;
     }
     response = brillo::http::PostFormDataAndBlock(
-        allow_dev_sending_ ? kReportUploadStagingUrl : kReportUploadProdUrl,
-        std::move(form_data), {} /* headers */, transport, &upload_error);
+        GetUploadUrl(), std::move(form_data), {} /* headers */, transport,
+        &upload_error);
   }
 
+  return HandleUploadResponse(details, std::move(product_name),
+                              std::move(response), upload_error.get());
+}
+
+void Sender::ResolveProxyServers() {
+  // Determine the proxy server if it's not given from the options. The
+  // upload URL given by the options is reached without proxy.
+  if (proxy_servers_.empty() && upload_url_.empty()) {
+    EnsureDBusIsReady();
+    brillo::http::GetChromeProxyServers(bus_, kReportUploadProdUrl,
+                                        &proxy_servers_);
+  }
+}
+
+std::string Sender::GetUploadUrl() const {
+  if (!upload_url_.empty())
+    return upload_url_;
+  return allow_dev_sending_ ? kReportUploadStagingUrl : kReportUploadProdUrl;
+}
+
+SenderBase::CrashRemoveReason Sender::HandleUploadResponse(
+    const CrashDetails& details,
+    std::string product_name,
+    std::unique_ptr<brillo::http::Response> response,
+    const brillo::Error* upload_error) {
   if (!response) {
     LOG(ERROR) << "Crash sending failed with error: "
                << upload_error->GetMessage();
@@ -882,7 +1131,7 @@ SenderBase::CrashRemoveReason Sender::RequestToSendCrash(
     return CrashRemoveReason::kRetryUploading;
   }
 
-  report_id = response->ExtractDataAsString();
+  const std::string report_id = response->ExtractDataAsString();
 
   if (product_name == "Chrome_ChromeOS")
     product_name = "Chrome";
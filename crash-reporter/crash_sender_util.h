@@ -48,6 +48,10 @@ constexpr int kMaxCrashBytes = 24 * 1024 * 1024;
 // immediately.
 constexpr int kMaxSpreadTimeInSeconds = 600;
 
+// Default maximum number of crash reports uploaded at the same time. With 1,
+// the reports are sent one after the other.
+constexpr int kMaxConcurrentUploads = 1;
+
 // Parsed command line flags.
 struct CommandLineFlags {
   base::TimeDelta max_spread_time;
@@ -59,6 +63,7 @@ struct CommandLineFlags {
   bool test_mode = false;
   bool upload_old_reports = false;
   bool force_upload_on_test_images = false;
+  int max_concurrent_uploads = kMaxConcurrentUploads;
 };
 
 // Represents a metadata file name, and its parsed metadata.
@@ -119,8 +124,15 @@ bool IsBelowRate(const base::FilePath& timestamps_dir,
 
 // Records a crash send attempt so that IsBelowRate knows about it.
 // |timestamps_dir| should be the same directory passed to IsBelowRate().
-// |bytes| is the number of bytes sent over the network.
-void RecordSendAttempt(const base::FilePath& timestamps_dir, int bytes);
+// |bytes| is the number of bytes sent over the network. Returns the file of the
+// record, or an empty path on errors.
+base::FilePath RecordSendAttempt(const base::FilePath& timestamps_dir,
+                                 int bytes);
+
+// Replaces the number of bytes of the send attempt recorded in |record_file|
+// by RecordSendAttempt() with |bytes|, for sends whose size is only known once
+// they are over.
+void UpdateSendAttempt(const base::FilePath& record_file, int bytes);
 
 // A helper class for sending crashes. The behaviors can be customized with
 // Options class for unit testing.
@@ -165,6 +177,16 @@ class Sender : public SenderBase {
     // If true, always upload on test images and add a flag to the metadata
     // indicating that it's from a test image.
     bool force_upload_on_test_images = false;
+
+    // Maximum number of crash reports uploaded at the same time. Above 1,
+    // the reports are sent in batches of that many, over connections kept
+    // alive from one report to the next, and compressed as they are read from
+    // disk.
+    int max_concurrent_uploads = kMaxConcurrentUploads;
+
+    // URL to send the crash reports to instead of the crash server, e.g. a
+    // local test server. It is reached without proxy.
+    std::string upload_url;
   };
 
   Sender(std::unique_ptr<MetricsLibraryInterface> metrics_lib,
@@ -191,7 +213,7 @@ class Sender : public SenderBase {
 
   // Sends each crash in |crash_meta_files|, in multiple steps:
   //
-  // For each meta file:
+  // For each meta file, or batch of up to |max_concurrent_uploads| meta files:
   // - Sleeps to avoid overloading the network
   // - Checks if the device enters guest mode, and stops if entered.
   // - Enforces the rate limit per 24 hours.
@@ -213,6 +235,13 @@ class Sender : public SenderBase {
   FRIEND_TEST(CrashSenderUtilTest, RemoveReportFiles);
   FRIEND_TEST(CrashSenderUtilTest, FailRemoveReportFilesSendsMetric);
 
+  // What to do with a crash report, according to the checks made right before
+  // sending it.
+  enum class SendDecision { kSend, kSkip, kStop };
+
+  // A crash report being uploaded by SendCrashesConcurrently().
+  struct Upload;
+
   // Removes report files associated with the given meta file.
   // More specifically, if "foo.meta" is given, "foo.*" will be removed.
   void RemoveReportFiles(const base::FilePath& meta_file);
@@ -231,6 +260,40 @@ class Sender : public SenderBase {
   // remove the crash report using the returned removal reason code.
   SenderBase::CrashRemoveReason RequestToSendCrash(const CrashDetails& details);
 
+  // Sends the crashes of |crash_meta_files| as SendCrashes() does, in batches
+  // of up to |max_concurrent_uploads_| concurrent uploads.
+  void SendCrashesConcurrently(const std::vector<MetaFile>& crash_meta_files);
+
+  // Starts uploading the crash report of |details| over |transport|, and
+  // records the send attempt. Returns null if the report cannot be sent now.
+  std::unique_ptr<Upload> StartUpload(
+      const CrashDetails& details,
+      std::shared_ptr<brillo::http::Transport> transport);
+
+  // Checks whether the crash report of |meta_file| should be sent now, or
+  // skipped, or whether no more crash reports should be sent.
+  SendDecision CheckBeforeSending(const base::FilePath& meta_file);
+
+  // Looks up the proxy servers to the crash server, if not known yet.
+  void ResolveProxyServers();
+
+  // Returns the URL to send crash reports to.
+  std::string GetUploadUrl() const;
+
+  // Returns the result of the upload of the crash report of |details| from the
+  // |response| of the server, or |upload_error| if there was no response, and
+  // records successful uploads in the Chrome uploads.log file.
+  SenderBase::CrashRemoveReason HandleUploadResponse(
+      const CrashDetails& details,
+      std::string product_name,
+      std::unique_ptr<brillo::http::Response> response,
+      const brillo::Error* upload_error);
+
+  // Logs the |result| of sending the crash report of |meta_file|, and removes
+  // it unless the upload should be retried.
+  void FinishSending(const base::FilePath& meta_file,
+                     SenderBase::CrashRemoveReason result);
+
   // Returns true if we have consent to send crashes to Google.
   bool HasCrashUploadingConsent();
 
@@ -254,6 +317,8 @@ class Sender : public SenderBase {
   const bool test_mode_;
   const bool upload_old_reports_;
   const bool force_upload_on_test_images_;
+  const int max_concurrent_uploads_;
+  const std::string upload_url_;
 };
 
 }  // namespace util
@@ -4,15 +4,20 @@
 
 #include "crash-reporter/crash_sender_util.h"
 
+#include <arpa/inet.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <netinet/in.h>
 #include <stdlib.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -24,14 +29,18 @@
 #include <base/files/file.h>
 #include <base/files/file_enumerator.h>
 #include <base/files/file_util.h>
+#include <base/files/scoped_file.h>
 #include <base/files/scoped_temp_dir.h>
 #include <base/json/json_reader.h>
 #include <base/logging.h>
 #include <base/macros.h>
+#include <base/posix/eintr_wrapper.h>
 #include <base/strings/strcat.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/string_split.h>
 #include <base/strings/string_util.h>
+#include <base/strings/stringprintf.h>
+#include <base/test/task_environment.h>
 #include <base/time/time.h>
 #include <base/values.h>
 #include <brillo/flag_helper.h>
@@ -46,6 +55,7 @@
 #include <metrics/metrics_library_mock.h>
 #include <shill/dbus-proxy-mocks.h>
 
+#include "crash-reporter/crash_sender.pb.h"
 #include "crash-reporter/crash_sender_base.h"
 #include "crash-reporter/crash_sender_paths.h"
 #include "crash-reporter/paths.h"
@@ -209,6 +219,174 @@ bool GetShillProperties(
   return true;
 }
 
+// HTTP server on the loopback interface receiving the crash reports sent with
+// chunked transfer encoding, which is what uploads of unknown size use. Each
+// connection is served by its own thread, so that uploads can be concurrent.
+class LocalUploadServer {
+ public:
+  LocalUploadServer() {
+    listen_fd_.reset(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    CHECK(listen_fd_.is_valid());
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_size = sizeof(address);
+    CHECK_EQ(bind(listen_fd_.get(), reinterpret_cast<sockaddr*>(&address),
+                  address_size),
+             0);
+    CHECK_EQ(listen(listen_fd_.get(), SOMAXCONN), 0);
+    CHECK_EQ(getsockname(listen_fd_.get(),
+                         reinterpret_cast<sockaddr*>(&address), &address_size),
+             0);
+    port_ = ntohs(address.sin_port);
+    accept_thread_ = std::thread(&LocalUploadServer::Accept, this);
+  }
+  LocalUploadServer(const LocalUploadServer&) = delete;
+  LocalUploadServer& operator=(const LocalUploadServer&) = delete;
+
+  ~LocalUploadServer() {
+    // Interrupts accept() and the reads of the connections.
+    shutdown(listen_fd_.get(), SHUT_RDWR);
+    accept_thread_.join();
+    std::vector<std::thread> threads;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const base::ScopedFD& fd : connections_)
+        shutdown(fd.get(), SHUT_RDWR);
+      threads.swap(threads_);
+    }
+    for (std::thread& thread : threads)
+      thread.join();
+  }
+
+  std::string url() const {
+    return base::StringPrintf("http://127.0.0.1:%d/cr/report", port_);
+  }
+
+  size_t connection_count() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return connections_.size();
+  }
+
+  // The bodies of the requests received so far, as sent.
+  std::vector<std::string> bodies() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bodies_;
+  }
+
+  // Makes the server answer the next requests with |status|, e.g.
+  // "500 Internal Server Error", rather than with a report ID.
+  void set_status(const std::string& status) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    status_ = status;
+  }
+
+ private:
+  void Accept() {
+    while (true) {
+      const int fd =
+          HANDLE_EINTR(accept4(listen_fd_.get(), nullptr, nullptr, 0));
+      if (fd < 0)
+        return;
+      std::lock_guard<std::mutex> lock(mutex_);
+      connections_.emplace_back(fd);
+      threads_.emplace_back(&LocalUploadServer::Serve, this, fd);
+    }
+  }
+
+  // Serves the requests of a connection until it is closed.
+  void Serve(int fd) {
+    std::string buffer;
+    std::string headers;
+    while (ReadUntil(fd, "\r\n\r\n", &buffer, &headers)) {
+      if (headers.find("Expect: 100-continue") != std::string::npos &&
+          !base::WriteFileDescriptor(fd, "HTTP/1.1 100 Continue\r\n\r\n")) {
+        return;
+      }
+      std::string body;
+      std::string size_line;
+      while (true) {
+        if (!ReadUntil(fd, "\r\n", &buffer, &size_line))
+          return;
+        const size_t chunk_size = strtoul(size_line.c_str(), nullptr, 16);
+        std::string chunk;
+        if (chunk_size == 0) {
+          // There are no trailers: the last chunk is followed by a CRLF.
+          if (!ReadUntil(fd, "\r\n", &buffer, &chunk))
+            return;
+          break;
+        }
+        // Each chunk is followed by a CRLF.
+        if (!ReadSize(fd, chunk_size + 2, &buffer, &chunk))
+          return;
+        body.append(chunk, 0, chunk_size);
+      }
+      std::string response;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bodies_.push_back(std::move(body));
+        const std::string report_id = status_ == kOkStatus ? "123" : "";
+        response = base::StringPrintf(
+            "HTTP/1.1 %s\r\nContent-Length: %zu\r\n\r\n%s", status_.c_str(),
+            report_id.size(), report_id.c_str());
+      }
+      if (!base::WriteFileDescriptor(fd, response))
+        return;
+    }
+  }
+
+  // Reads from |fd| until |buffer| has at least |size| more bytes.
+  static bool Fill(int fd, size_t size, std::string* buffer) {
+    while (buffer->size() < size) {
+      char data[4096];
+      const ssize_t size_read = HANDLE_EINTR(read(fd, data, sizeof(data)));
+      if (size_read <= 0)
+        return false;
+      buffer->append(data, size_read);
+    }
+    return true;
+  }
+
+  // Moves the first |size| bytes received on |fd| to |data|.
+  static bool ReadSize(int fd,
+                       size_t size,
+                       std::string* buffer,
+                       std::string* data) {
+    if (!Fill(fd, size, buffer))
+      return false;
+    data->assign(*buffer, 0, size);
+    buffer->erase(0, size);
+    return true;
+  }
+
+  // Moves the data received on |fd| up to |delimiter| to |data|, and drops
+  // the delimiter.
+  static bool ReadUntil(int fd,
+                        const std::string& delimiter,
+                        std::string* buffer,
+                        std::string* data) {
+    size_t end;
+    while ((end = buffer->find(delimiter)) == std::string::npos) {
+      if (!Fill(fd, buffer->size() + 1, buffer))
+        return false;
+    }
+    data->assign(*buffer, 0, end);
+    buffer->erase(0, end + delimiter.size());
+    return true;
+  }
+
+  base::ScopedFD listen_fd_;
+  int port_;
+  std::thread accept_thread_;
+  std::mutex mutex_;
+  std::vector<base::ScopedFD> connections_;
+  std::vector<std::thread> threads_;
+  std::vector<std::string> bodies_;
+  std::string status_ = kOkStatus;
+
+  static constexpr char kOkStatus[] = "200 OK";
+};
+
 class CrashSenderUtilTest : public testing::Test {
  protected:
   void SetUp() override {
@@ -627,6 +805,7 @@ TEST_F(CrashSenderUtilTest, ParseCommandLine_NoFlags) {
   EXPECT_FALSE(flags.allow_dev_sending);
   EXPECT_FALSE(flags.ignore_pause_file);
   EXPECT_FALSE(flags.upload_old_reports);
+  EXPECT_EQ(flags.max_concurrent_uploads, kMaxConcurrentUploads);
 }
 
 TEST_F(CrashSenderUtilDeathTest, ParseCommandLine_InvalidMaxSpreadTime) {
@@ -775,6 +954,27 @@ TEST_F(CrashSenderUtilTest, ParseCommandLine_ForceUploadOnTestImages) {
   EXPECT_TRUE(flags.force_upload_on_test_images);
 }
 
+TEST_F(CrashSenderUtilDeathTest, ParseCommandLine_InvalidMaxConcurrentUploads) {
+  const char* argv[] = {"crash_sender", "--max_concurrent_uploads=0"};
+  base::CommandLine command_line(std::size(argv), argv);
+  brillo::FlagHelper::GetInstance()->set_command_line_for_testing(
+      &command_line);
+  CommandLineFlags flags;
+  EXPECT_DEATH(ParseCommandLine(std::size(argv), argv, &flags),
+               "Invalid value for max concurrent uploads: 0");
+}
+
+TEST_F(CrashSenderUtilTest, ParseCommandLine_MaxConcurrentUploads) {
+  const char* argv[] = {"crash_sender", "--max_concurrent_uploads=4"};
+  base::CommandLine command_line(std::size(argv), argv);
+  brillo::FlagHelper::GetInstance()->set_command_line_for_testing(
+      &command_line);
+  CommandLineFlags flags;
+  ParseCommandLine(std::size(argv), argv, &flags);
+  EXPECT_EQ(flags.max_concurrent_uploads, 4);
+  EXPECT_EQ(flags.max_spread_time.InSeconds(), kMaxSpreadTimeInSeconds);
+}
+
 TEST_F(CrashSenderUtilTest, DoesPauseFileExist) {
   EXPECT_FALSE(DoesPauseFileExist());
 
@@ -1490,6 +1690,37 @@ TEST_F(CrashSenderUtilTest, IsBelowRateReachesMaxBytes) {
   EXPECT_TRUE(IsBelowRate(timestamp_dir, kMaxRate, kMaxBytes));
 }
 
+TEST_F(CrashSenderUtilTest, UpdateSendAttempt) {
+  const base::FilePath timestamp_dir = test_dir_.Append("UpdateSendAttempt");
+  const base::FilePath record_file = RecordSendAttempt(timestamp_dir, 1000);
+  ASSERT_FALSE(record_file.empty());
+  const base::Time attempt_time = base::Time::Now() - base::Hours(1);
+  ASSERT_TRUE(test_util::TouchFileHelper(record_file, attempt_time));
+
+  UpdateSendAttempt(record_file, 10);
+
+  // The record has the new size, and is still dated by the attempt.
+  std::string serialized;
+  ASSERT_TRUE(base::ReadFileToString(record_file, &serialized));
+  crash::SendRecord record;
+  ASSERT_TRUE(record.ParseFromString(serialized));
+  EXPECT_EQ(10, record.size());
+  base::File::Info info;
+  ASSERT_TRUE(base::GetFileInfo(record_file, &info));
+  EXPECT_EQ(attempt_time.ToTimeT(), info.last_modified.ToTimeT());
+  EXPECT_EQ(std::vector<base::FilePath>({record_file}),
+            GetFileNamesIn(timestamp_dir));
+
+  // The rate limit counts the new size.
+  EXPECT_TRUE(IsBelowRate(timestamp_dir, 1, 11));
+  EXPECT_FALSE(IsBelowRate(timestamp_dir, 1, 10));
+
+  // A missing record is not created.
+  const base::FilePath missing_file = timestamp_dir.Append("missing");
+  UpdateSendAttempt(missing_file, 10);
+  EXPECT_FALSE(base::PathExists(missing_file));
+}
+
 TEST_F(CrashSenderUtilTest, SortReports) {
   // Crashes from oldest to youngest will be a, b, c.
   CrashInfo crash_info_a;
@@ -2202,6 +2433,208 @@ TEST_F(CrashSenderUtilDeathTest, LockFileDiesIfFileIsLocked) {
             << "; time is " << base::Time::Now();
 }
 
+// Metrics library whose consent is revoked after it is checked
+// |consent_count| times.
+class RevokedConsentMetricsLibrary : public MetricsLibraryMock {
+ public:
+  explicit RevokedConsentMetricsLibrary(int consent_count)
+      : consent_count_(consent_count) {}
+
+  bool AreMetricsEnabled() override { return consent_count_-- > 0; }
+
+ private:
+  int consent_count_;
+};
+
+// Tests of SendCrashes() with concurrent uploads to a LocalUploadServer.
+class SendCrashesConcurrentlyTest : public CrashSenderUtilTest {
+ protected:
+  static constexpr int kCrashCount = 5;
+
+  void SetUp() override {
+    CrashSenderUtilTest::SetUp();
+    g_connection_state = &connection_state_;
+    // Establish the client ID.
+    ASSERT_TRUE(CreateClientIdFile());
+    ASSERT_TRUE(SetConditions(kOfficialBuild, kSignInMode, kMetricsEnabled));
+
+    // Create the system crash directory, and crash files in it.
+    const base::FilePath system_dir = paths::Get(paths::kSystemCrashDirectory);
+    ASSERT_TRUE(base::CreateDirectory(system_dir));
+    for (int i = 0; i < kCrashCount; i++) {
+      const std::string name =
+          base::StringPrintf("%d.%d.%d.%d.%d", i, i, i, i, i);
+      const base::FilePath meta_file = system_dir.Append(name + ".meta");
+      const base::FilePath log = system_dir.Append(name + ".log");
+      const std::string meta = base::StringPrintf(
+          "payload=%s.log\n"
+          "exec_name=exec_%d\n"
+          "upload_var_prod=prod_%d\n"
+          "done=1\n",
+          name.c_str(), i, i);
+      ASSERT_TRUE(test_util::CreateFile(meta_file, meta));
+      ASSERT_TRUE(test_util::CreateFile(
+          log, base::StringPrintf("log of crash %d\n", i)));
+      CrashInfo info;
+      EXPECT_TRUE(info.metadata.LoadFromString(meta));
+      info.payload_file = log;
+      info.payload_kind = "log";
+      info.last_modified = test_util::GetDefaultTime();
+      crashes_to_send_.emplace_back(meta_file, std::move(info));
+    }
+  }
+
+  // Returns a sender uploading |max_concurrent_uploads| reports at a time to
+  // |server_|.
+  std::unique_ptr<Sender> CreateSender(
+      std::unique_ptr<MetricsLibraryMock> metrics_lib,
+      int max_concurrent_uploads,
+      int max_crash_rate = kMaxCrashRate) {
+    auto mock =
+        std::make_unique<org::chromium::SessionManagerInterfaceProxyMock>();
+    test_util::SetActiveSessions(mock.get(), {});
+    auto shill_mock =
+        std::make_unique<org::chromium::flimflam::ManagerProxyMock>();
+    EXPECT_CALL(*shill_mock, GetProperties(_, _, _))
+        .WillRepeatedly(DoAll(Invoke(&GetShillProperties), Return(true)));
+
+    Sender::Options options;
+    options.session_manager_proxy = mock.release();
+    options.shill_proxy = shill_mock.release();
+    options.max_spread_time = base::TimeDelta();
+    options.hold_off_time = base::TimeDelta();
+    options.always_write_uploads_log = true;
+    options.upload_url = server_.url();
+    options.max_concurrent_uploads = max_concurrent_uploads;
+    options.max_crash_rate = max_crash_rate;
+    // Only the crash rate limits the uploads.
+    options.max_crash_bytes = 0;
+    return std::make_unique<Sender>(
+        std::move(metrics_lib), std::make_unique<test_util::AdvancingClock>(),
+        options);
+  }
+
+  // Returns how many times each crash was received by |server_|.
+  std::vector<int> GetReceivedCrashes() {
+    std::vector<int> received(kCrashCount);
+    for (const std::string& body : server_.bodies()) {
+      std::string decompressed;
+      EXPECT_TRUE(test_util::Gunzip(body, &decompressed));
+      for (int i = 0; i < kCrashCount; i++) {
+        if (decompressed.find(base::StringPrintf("log of crash %d\n", i)) !=
+            std::string::npos) {
+          received[i]++;
+        }
+      }
+    }
+    return received;
+  }
+
+  // Expects the first |removed_count| crashes to be removed, and the other
+  // ones to be kept for later.
+  void ExpectRemovedCrashes(int removed_count) {
+    for (int i = 0; i < kCrashCount; i++) {
+      const MetaFile& crash = crashes_to_send_[i];
+      EXPECT_EQ(i >= removed_count, base::PathExists(crash.first))
+          << crash.first.value();
+      EXPECT_EQ(i >= removed_count,
+                base::PathExists(crash.second.payload_file))
+          << crash.second.payload_file.value();
+      EXPECT_FALSE(
+          base::PathExists(crash.first.ReplaceExtension(".processing")));
+    }
+  }
+
+  // Concurrent uploads are run by the message loop.
+  base::test::TaskEnvironment task_environment_{
+      base::test::TaskEnvironment::MainThreadType::IO};
+  LocalUploadServer server_;
+  std::string connection_state_ = "online";
+  std::vector<MetaFile> crashes_to_send_;
+};
+
+TEST_F(SendCrashesConcurrentlyTest, SendCrashes) {
+  EXPECT_CALL(
+      *metrics_lib_,
+      SendEnumToUMA("Platform.CrOS.CrashSenderRemoveReason",
+                    Sender::kFinishedUploading, Sender::kSendReasonCount))
+      .Times(kCrashCount);
+  CreateSender(std::move(metrics_lib_), 2)->SendCrashes(crashes_to_send_);
+
+  // All the crashes were sent and removed.
+  ExpectRemovedCrashes(kCrashCount);
+  std::string contents;
+  ASSERT_TRUE(
+      base::ReadFileToString(paths::Get(paths::kChromeCrashLog), &contents));
+  std::vector<base::Optional<base::Value>> rows =
+      ParseChromeUploadsLog(contents);
+  ASSERT_EQ(kCrashCount, rows.size());
+  for (const auto& row : rows) {
+    ASSERT_TRUE(row.has_value());
+    EXPECT_EQ("123", row->FindKey("upload_id")->GetString());
+  }
+
+  // Each report was received once, compressed.
+  EXPECT_EQ(std::vector<int>(kCrashCount, 1), GetReceivedCrashes());
+
+  // The connections of the first batch were reused by the next ones.
+  EXPECT_LE(server_.connection_count(), 2u);
+}
+
+TEST_F(SendCrashesConcurrentlyTest, RateLimitInBatch) {
+  // The limit is reached by the third report of the first batch: the reports
+  // before it are uploaded, and the other ones are kept.
+  EXPECT_CALL(
+      *metrics_lib_,
+      SendEnumToUMA("Platform.CrOS.CrashSenderRemoveReason",
+                    Sender::kFinishedUploading, Sender::kSendReasonCount))
+      .Times(2);
+  CreateSender(std::move(metrics_lib_), 4, 2)->SendCrashes(crashes_to_send_);
+
+  ExpectRemovedCrashes(2);
+  EXPECT_EQ(std::vector<int>({1, 1, 0, 0, 0}), GetReceivedCrashes());
+  EXPECT_EQ(2, GetFileNamesIn(paths::Get(paths::kTimestampsDirectory)).size());
+}
+
+TEST_F(SendCrashesConcurrentlyTest, ServerError) {
+  // Reports rejected by the server are kept, and the next reports are still
+  // sent.
+  server_.set_status("500 Internal Server Error");
+  EXPECT_CALL(*metrics_lib_, SendEnumToUMA(_, _, _)).Times(0);
+  CreateSender(std::move(metrics_lib_), 2)->SendCrashes(crashes_to_send_);
+  ExpectRemovedCrashes(0);
+  EXPECT_EQ(std::vector<int>(kCrashCount, 1), GetReceivedCrashes());
+  EXPECT_FALSE(base::PathExists(paths::Get(paths::kChromeCrashLog)));
+
+  // They are sent again on the next run.
+  server_.set_status("200 OK");
+  auto metrics_lib = std::make_unique<MetricsLibraryMock>();
+  EXPECT_CALL(
+      *metrics_lib,
+      SendEnumToUMA("Platform.CrOS.CrashSenderRemoveReason",
+                    Sender::kFinishedUploading, Sender::kSendReasonCount))
+      .Times(kCrashCount);
+  CreateSender(std::move(metrics_lib), 2)->SendCrashes(crashes_to_send_);
+  ExpectRemovedCrashes(kCrashCount);
+  EXPECT_EQ(std::vector<int>(kCrashCount, 2), GetReceivedCrashes());
+}
+
+TEST_F(SendCrashesConcurrentlyTest, ConsentRevokedBetweenBatches) {
+  // Consent is checked before each upload: it is revoked once the first
+  // batch of two reports has started.
+  auto metrics_lib = std::make_unique<RevokedConsentMetricsLibrary>(2);
+  EXPECT_CALL(
+      *metrics_lib,
+      SendEnumToUMA("Platform.CrOS.CrashSenderRemoveReason",
+                    Sender::kFinishedUploading, Sender::kSendReasonCount))
+      .Times(2);
+  CreateSender(std::move(metrics_lib), 2)->SendCrashes(crashes_to_send_);
+
+  // The first batch was uploaded, and the next ones weren't.
+  ExpectRemovedCrashes(2);
+  EXPECT_EQ(std::vector<int>({1, 1, 0, 0, 0}), GetReceivedCrashes());
+}
+
 class IsNetworkOnlineTest : public CrashSenderUtilTest {
  public:
   void TestIsNetworkOnline(std::string connection_state,
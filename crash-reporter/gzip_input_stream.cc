@@ -0,0 +1,204 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "crash-reporter/gzip_input_stream.h"
+
+#include <string.h>
+
+#include <memory>
+#include <utility>
+
+#include <base/bind.h>
+#include <base/check.h>
+#include <base/logging.h>
+#include <brillo/message_loops/message_loop.h>
+#include <brillo/streams/stream_errors.h>
+#include <brillo/streams/stream_utils.h>
+
+namespace util {
+
+namespace {
+
+// Using a window size of 31 sets us to gzip mode (16) + default window size
+// (15), as GzipStream() does.
+constexpr int kDefaultWindowSize = 15;
+constexpr int kWindowSizeGzipAdd = 16;
+constexpr int kDefaultMemLevel = 8;
+
+}  // namespace
+
+// static
+brillo::StreamPtr GzipInputStream::Create(brillo::StreamPtr source,
+                                          uint64_t* compressed_size,
+                                          brillo::ErrorPtr* error) {
+  CHECK(source);
+  if (!source->CanRead()) {
+    brillo::Error::AddTo(error, FROM_HERE, brillo::errors::stream::kDomain,
+                         brillo::errors::stream::kOperationNotSupported,
+                         "The source stream is not readable");
+    return nullptr;
+  }
+  std::unique_ptr<GzipInputStream> stream(
+      new GzipInputStream(std::move(source), compressed_size));
+  const int result = deflateInit2(
+      &stream->deflate_stream_, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+      kDefaultWindowSize + kWindowSizeGzipAdd, kDefaultMemLevel,
+      Z_DEFAULT_STRATEGY);
+  if (result != Z_OK) {
+    brillo::Error::AddToPrintf(error, FROM_HERE,
+                               brillo::errors::stream::kDomain, "zlib_error",
+                               "Error initializing zlib: error code %d",
+                               result);
+    // deflateEnd() must not be called on the stream.
+    stream->source_.reset();
+    return nullptr;
+  }
+  return stream;
+}
+
+GzipInputStream::GzipInputStream(brillo::StreamPtr source,
+                                 uint64_t* compressed_size)
+    : source_(std::move(source)), compressed_size_(compressed_size) {
+  memset(&deflate_stream_, 0, sizeof(deflate_stream_));
+  deflate_stream_.zalloc = Z_NULL;
+  deflate_stream_.zfree = Z_NULL;
+}
+
+GzipInputStream::~GzipInputStream() {
+  CloseBlocking(nullptr);
+}
+
+bool GzipInputStream::IsOpen() const {
+  return source_ != nullptr;
+}
+
+bool GzipInputStream::SetSizeBlocking(uint64_t /* size */,
+                                      brillo::ErrorPtr* error) {
+  return brillo::stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+uint64_t GzipInputStream::GetPosition() const {
+  return deflate_stream_.total_out;
+}
+
+bool GzipInputStream::Seek(int64_t /* offset */,
+                           Whence /* whence */,
+                           uint64_t* /* new_position */,
+                           brillo::ErrorPtr* error) {
+  return brillo::stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool GzipInputStream::ReadNonBlocking(void* buffer,
+                                      size_t size_to_read,
+                                      size_t* size_read,
+                                      bool* end_of_stream,
+                                      brillo::ErrorPtr* error) {
+  if (!IsOpen())
+    return brillo::stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  deflate_stream_.next_out = static_cast<Bytef*>(buffer);
+  deflate_stream_.avail_out = size_to_read;
+  while (deflate_stream_.avail_out > 0 && !ended_) {
+    if (deflate_stream_.avail_in == 0 && !source_ended_) {
+      size_t input_size = 0;
+      if (!source_->ReadNonBlocking(input_, sizeof(input_), &input_size,
+                                    &source_ended_, error)) {
+        return false;
+      }
+      // Return what was compressed so far rather than block on the source.
+      if (input_size == 0 && !source_ended_)
+        break;
+      deflate_stream_.next_in = input_;
+      deflate_stream_.avail_in = input_size;
+    }
+    // Finish the stream once all the source is read, else deflateEnd() may
+    // discard some compressed data.
+    const int result =
+        deflate(&deflate_stream_, source_ended_ ? Z_FINISH : Z_NO_FLUSH);
+    if (result == Z_STREAM_END) {
+      ended_ = true;
+    } else if (result != Z_OK && result != Z_BUF_ERROR) {
+      // Z_BUF_ERROR only means that no progress was possible, which is not
+      // fatal. See discussion at https://zlib.net/zlib_how.html
+      brillo::Error::AddToPrintf(error, FROM_HERE,
+                                 brillo::errors::stream::kDomain, "zlib_error",
+                                 "Error compressing data: error code %d",
+                                 result);
+      return false;
+    }
+  }
+  *size_read = size_to_read - deflate_stream_.avail_out;
+  if (compressed_size_)
+    *compressed_size_ = deflate_stream_.total_out;
+  if (end_of_stream)
+    *end_of_stream = ended_ && *size_read == 0 && size_to_read != 0;
+  return true;
+}
+
+bool GzipInputStream::WriteNonBlocking(const void* /* buffer */,
+                                       size_t /* size_to_write */,
+                                       size_t* /* size_written */,
+                                       brillo::ErrorPtr* error) {
+  return brillo::stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool GzipInputStream::FlushBlocking(brillo::ErrorPtr* error) {
+  if (!IsOpen())
+    return brillo::stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  return true;
+}
+
+bool GzipInputStream::CloseBlocking(brillo::ErrorPtr* error) {
+  if (!IsOpen())
+    return true;
+  deflateEnd(&deflate_stream_);
+  const bool success = source_->CloseBlocking(error);
+  source_.reset();
+  return success;
+}
+
+bool GzipInputStream::WaitForData(
+    AccessMode mode,
+    const base::Callback<void(AccessMode)>& callback,
+    brillo::ErrorPtr* error) {
+  if (!IsOpen())
+    return brillo::stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (brillo::stream_utils::IsWriteAccessMode(mode))
+    return brillo::stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  // Compressed data is available as soon as the source has some.
+  if (!source_ended_)
+    return source_->WaitForData(mode, callback, error);
+
+  brillo::MessageLoop::current()->PostTask(FROM_HERE,
+                                           base::BindOnce(callback, mode));
+  return true;
+}
+
+bool GzipInputStream::WaitForDataBlocking(AccessMode in_mode,
+                                          base::TimeDelta timeout,
+                                          AccessMode* out_mode,
+                                          brillo::ErrorPtr* error) {
+  if (!IsOpen())
+    return brillo::stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (brillo::stream_utils::IsWriteAccessMode(in_mode))
+    return brillo::stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  if (!source_ended_)
+    return source_->WaitForDataBlocking(in_mode, timeout, out_mode, error);
+
+  if (out_mode)
+    *out_mode = in_mode;
+  return true;
+}
+
+void GzipInputStream::CancelPendingAsyncOperations() {
+  if (IsOpen())
+    source_->CancelPendingAsyncOperations();
+  Stream::CancelPendingAsyncOperations();
+}
+
+}  // namespace util
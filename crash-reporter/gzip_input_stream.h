@@ -0,0 +1,97 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CRASH_REPORTER_GZIP_INPUT_STREAM_H_
+#define CRASH_REPORTER_GZIP_INPUT_STREAM_H_
+
+#include <zlib.h>
+
+#include <cstdint>
+
+#include <base/callback.h>
+#include <base/time/time.h>
+#include <brillo/streams/stream.h>
+
+namespace util {
+
+// GzipInputStream is a read-only stream of the gzip compression of a source
+// stream, compressed as it is read. Unlike GzipStream(), the compressed data
+// is never all in memory, so that it can be sent as it is produced. Its size
+// is unknown until the end of the stream is read.
+class GzipInputStream : public brillo::Stream {
+ public:
+  // Creates a stream of the compression of |source|, which it owns. Unless
+  // it is null, |compressed_size| is kept up to date with the number of bytes
+  // read from the stream, and must outlive it: the stream may be owned by a
+  // request which is destroyed with no notice. Returns null on errors.
+  static brillo::StreamPtr Create(brillo::StreamPtr source,
+                                  uint64_t* compressed_size,
+                                  brillo::ErrorPtr* error);
+
+  GzipInputStream(const GzipInputStream&) = delete;
+  GzipInputStream& operator=(const GzipInputStream&) = delete;
+  ~GzipInputStream() override;
+
+  // == Stream capabilities ===================================================
+  bool IsOpen() const override;
+  bool CanRead() const override { return true; }
+  bool CanWrite() const override { return false; }
+  bool CanSeek() const override { return false; }
+  bool CanGetSize() const override { return false; }
+
+  // == Stream size operations ================================================
+  uint64_t GetSize() const override { return 0; }
+  bool SetSizeBlocking(uint64_t size, brillo::ErrorPtr* error) override;
+  uint64_t GetRemainingSize() const override { return 0; }
+
+  // == Seek operations =======================================================
+  // Returns the number of compressed bytes read so far.
+  uint64_t GetPosition() const override;
+  bool Seek(int64_t offset,
+            Whence whence,
+            uint64_t* new_position,
+            brillo::ErrorPtr* error) override;
+
+  // == Read operations =======================================================
+  bool ReadNonBlocking(void* buffer,
+                       size_t size_to_read,
+                       size_t* size_read,
+                       bool* end_of_stream,
+                       brillo::ErrorPtr* error) override;
+
+  // == Write operations ======================================================
+  bool WriteNonBlocking(const void* buffer,
+                        size_t size_to_write,
+                        size_t* size_written,
+                        brillo::ErrorPtr* error) override;
+
+  // == Finalizing/closing streams  ===========================================
+  bool FlushBlocking(brillo::ErrorPtr* error) override;
+  bool CloseBlocking(brillo::ErrorPtr* error) override;
+
+  // == Data availability monitoring ==========================================
+  bool WaitForData(AccessMode mode,
+                   const base::Callback<void(AccessMode)>& callback,
+                   brillo::ErrorPtr* error) override;
+  bool WaitForDataBlocking(AccessMode in_mode,
+                           base::TimeDelta timeout,
+                           AccessMode* out_mode,
+                           brillo::ErrorPtr* error) override;
+  void CancelPendingAsyncOperations() override;
+
+ private:
+  GzipInputStream(brillo::StreamPtr source, uint64_t* compressed_size);
+
+  brillo::StreamPtr source_;
+  uint64_t* const compressed_size_;
+  z_stream deflate_stream_;
+  // Data read from |source_| which is not compressed yet.
+  uint8_t input_[4096];
+  bool source_ended_ = false;
+  bool ended_ = false;
+};
+
+}  // namespace util
+
+#endif  // CRASH_REPORTER_GZIP_INPUT_STREAM_H_
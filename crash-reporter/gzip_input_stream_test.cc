@@ -0,0 +1,127 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "crash-reporter/gzip_input_stream.h"
+
+#include <string>
+
+#include <base/files/file_path.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/strings/string_number_conversions.h>
+#include <brillo/streams/file_stream.h>
+#include <brillo/streams/memory_stream.h>
+#include <gtest/gtest.h>
+
+#include "crash-reporter/test_util.h"
+
+namespace util {
+namespace {
+
+// Compressible data, with some variety so that it's not all a single run.
+std::string CreateContent(size_t size) {
+  std::string content;
+  for (int i = 0; content.size() < size; i++)
+    content += base::NumberToString(i) + " ";
+  content.resize(size);
+  return content;
+}
+
+// Reads all of |stream|, |read_size| bytes at most at a time.
+bool ReadAll(brillo::Stream* stream, size_t read_size, std::string* output) {
+  output->clear();
+  std::string buffer(read_size, '\0');
+  while (true) {
+    size_t size_read = 0;
+    if (!stream->ReadBlocking(&buffer[0], buffer.size(), &size_read, nullptr))
+      return false;
+    if (size_read == 0)
+      return true;
+    output->append(buffer, 0, size_read);
+  }
+}
+
+}  // namespace
+
+TEST(GzipInputStreamTest, Compress) {
+  const std::string content = CreateContent(100000);
+  uint64_t compressed_size = 0;
+  brillo::StreamPtr stream = GzipInputStream::Create(
+      brillo::MemoryStream::OpenCopyOf(content, nullptr), &compressed_size,
+      nullptr);
+  ASSERT_TRUE(stream);
+  EXPECT_TRUE(stream->CanRead());
+  EXPECT_FALSE(stream->CanWrite());
+  EXPECT_FALSE(stream->CanSeek());
+  EXPECT_FALSE(stream->CanGetSize());
+
+  std::string compressed;
+  ASSERT_TRUE(ReadAll(stream.get(), 4096, &compressed));
+  EXPECT_LT(compressed.size(), content.size());
+  EXPECT_EQ(compressed_size, compressed.size());
+  EXPECT_EQ(stream->GetPosition(), compressed.size());
+
+  std::string decompressed;
+  ASSERT_TRUE(test_util::Gunzip(compressed, &decompressed));
+  EXPECT_EQ(decompressed, content);
+}
+
+TEST(GzipInputStreamTest, CompressInSmallReads) {
+  const std::string content = CreateContent(10000);
+  brillo::StreamPtr stream = GzipInputStream::Create(
+      brillo::MemoryStream::OpenCopyOf(content, nullptr), nullptr, nullptr);
+  ASSERT_TRUE(stream);
+
+  std::string compressed;
+  ASSERT_TRUE(ReadAll(stream.get(), 1, &compressed));
+  std::string decompressed;
+  ASSERT_TRUE(test_util::Gunzip(compressed, &decompressed));
+  EXPECT_EQ(decompressed, content);
+}
+
+TEST(GzipInputStreamTest, CompressEmpty) {
+  uint64_t compressed_size = 0;
+  brillo::StreamPtr stream = GzipInputStream::Create(
+      brillo::MemoryStream::OpenCopyOf(std::string(), nullptr),
+      &compressed_size, nullptr);
+  ASSERT_TRUE(stream);
+
+  std::string compressed;
+  ASSERT_TRUE(ReadAll(stream.get(), 4096, &compressed));
+  // Even empty gzip data has a header and a trailer.
+  EXPECT_FALSE(compressed.empty());
+  EXPECT_EQ(compressed_size, compressed.size());
+  std::string decompressed;
+  ASSERT_TRUE(test_util::Gunzip(compressed, &decompressed));
+  EXPECT_TRUE(decompressed.empty());
+}
+
+TEST(GzipInputStreamTest, NotReadableSource) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  brillo::StreamPtr source = brillo::FileStream::Open(
+      temp_dir.GetPath().Append("output"), brillo::Stream::AccessMode::WRITE,
+      brillo::FileStream::Disposition::CREATE_ALWAYS, nullptr);
+  ASSERT_TRUE(source);
+
+  brillo::ErrorPtr error;
+  EXPECT_FALSE(GzipInputStream::Create(std::move(source), nullptr, &error));
+  EXPECT_TRUE(error);
+}
+
+TEST(GzipInputStreamTest, Close) {
+  brillo::StreamPtr stream = GzipInputStream::Create(
+      brillo::MemoryStream::OpenCopyOf(CreateContent(100), nullptr), nullptr,
+      nullptr);
+  ASSERT_TRUE(stream);
+  EXPECT_TRUE(stream->CloseBlocking(nullptr));
+  EXPECT_FALSE(stream->IsOpen());
+
+  char buffer[16];
+  size_t size_read = 0;
+  bool end_of_stream = false;
+  EXPECT_FALSE(stream->ReadNonBlocking(buffer, sizeof(buffer), &size_read,
+                                       &end_of_stream, nullptr));
+}
+
+}  // namespace util
@@ -4,6 +4,8 @@
 
 #include "crash-reporter/test_util.h"
 
+#include <zlib.h>
+
 #include <base/check.h>
 #include <base/files/file_enumerator.h>
 #include <base/files/file_util.h>
@@ -108,4 +110,25 @@ bool TouchFileHelper(const base::FilePath& file_name,
   return base::TouchFile(file_name, modified_time, modified_time);
 }
 
+bool Gunzip(base::StringPiece compressed, std::string* output) {
+  z_stream stream = {};
+  // 16 selects the gzip format, with the default window size (15).
+  if (inflateInit2(&stream, 15 + 16) != Z_OK)
+    return false;
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  stream.avail_in = compressed.size();
+  output->clear();
+  int result;
+  do {
+    char buffer[4096];
+    stream.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream.avail_out = sizeof(buffer);
+    result = inflate(&stream, Z_NO_FLUSH);
+    output->append(buffer, sizeof(buffer) - stream.avail_out);
+  } while (result == Z_OK);
+  inflateEnd(&stream);
+  return result == Z_STREAM_END && stream.avail_in == 0;
+}
+
 }  // namespace test_util
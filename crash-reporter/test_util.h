@@ -72,6 +72,10 @@ base::FilePath GetTestDataPath(const std::string& name);
 // Helper function for calling base::TouchFile() concisely for tests.
 bool TouchFileHelper(const base::FilePath& file_name, base::Time modified_time);
 
+// Decompresses the gzip |compressed| data into |output|. Returns false if it
+// is not complete gzip data.
+bool Gunzip(base::StringPiece compressed, std::string* output);
+
 }  // namespace test_util
 
 #endif  // CRASH_REPORTER_TEST_UTIL_H_
@@ -8,6 +8,8 @@
 #include <elf.h>
 #include <fcntl.h>
 #include <stdint.h>
+#include <sys/wait.h>
+#include <sysexits.h>
 
 #include <unordered_set>
 #include <utility>
@@ -22,6 +24,8 @@
 #include <brillo/process/process.h>
 
 #include "crash-reporter/constants.h"
+#include "crash-reporter/core-collector/coredump_writer.h"
+#include "crash-reporter/core-collector/logging.h"
 #include "crash-reporter/user_collector_base.h"
 #include "crash-reporter/util.h"
 #include "crash-reporter/vm_support.h"
@@ -77,6 +81,27 @@ bool LockCorePattern() {
   return true;
 }
 
+// Logs the errors of CoredumpWriter, which go to standard error by default.
+// There is no standard error when the kernel runs us.
+void LogCoredumpWriterError(const std::string& message) {
+  LOG(ERROR) << message;
+}
+
+// Returns kErrorNone if core2md can convert a core file of the ELF class
+// |elf_class| on this platform.
+UserCollector::ErrorType CheckCoreFileClass(unsigned char elf_class) {
+#if __WORDSIZE == 64
+  // TODO(benchan, mkrebs): Remove this check once core2md can
+  // handles both 32-bit and 64-bit ELF on a 64-bit platform.
+  if (elf_class == ELFCLASS32) {
+    LOG(ERROR) << "Conversion of 32-bit core file on 64-bit platform is "
+               << "currently not supported";
+    return UserCollector::kErrorUnsupported32BitCoreFile;
+  }
+#endif
+  return UserCollector::kErrorNone;
+}
+
 }  // namespace
 
 UserCollector::UserCollector()
@@ -291,17 +316,7 @@ UserCollector::ErrorType UserCollector::ValidateCoreFile(
     return kErrorInvalidCoreFile;
   }
 
-#if __WORDSIZE == 64
-  // TODO(benchan, mkrebs): Remove this check once core2md can
-  // handles both 32-bit and 64-bit ELF on a 64-bit platform.
-  if (e_ident[EI_CLASS] == ELFCLASS32) {
-    LOG(ERROR) << "Conversion of 32-bit core file on 64-bit platform is "
-               << "currently not supported";
-    return kErrorUnsupported32BitCoreFile;
-  }
-#endif
-
-  return kErrorNone;
+  return CheckCoreFileClass(e_ident[EI_CLASS]);
 }
 
 // Copy off all stdin to a core file.
@@ -372,6 +387,71 @@ bool UserCollector::RunCoreToMinidump(const FilePath& core_path,
   return true;
 }
 
+UserCollector::ErrorType UserCollector::StreamStdinToMinidump(
+    const FilePath& core_path,
+    const FilePath& procfs_directory,
+    const FilePath& minidump_path,
+    const FilePath& temp_directory) {
+  // We need to write the stripped core to an actual file for core2md.
+  if (crash_sending_mode_ == kCrashLoopSendingMode) {
+    LOG(ERROR) << "Cannot write core file in kCrashLoopSendingMode";
+    return kErrorReadCoreData;
+  }
+
+  // Only the thread stacks are kept from the core read from stdin, which is
+  // a small fraction of it. The core comes from the crashed process, so it is
+  // parsed in a child process, as it is converted in core2md.
+  const pid_t child = fork();
+  if (child < 0) {
+    PLOG(ERROR) << "Could not fork to write core file";
+    return kErrorReadCoreData;
+  }
+  if (child == 0) {
+    SetErrorHandler(&LogCoredumpWriterError);
+    // The /proc files of the process are already in |procfs_directory|, so
+    // the writer doesn't write them.
+    CoredumpWriter writer(STDIN_FILENO, core_path.value().c_str(),
+                          nullptr /* container_dir */, true /* stacks_only */);
+    _exit(writer.WriteCoredump());
+  }
+
+  int status = 0;
+  if (HANDLE_EINTR(waitpid(child, &status, 0)) < 0) {
+    PLOG(ERROR) << "Could not wait for core file writer";
+    return kErrorReadCoreData;
+  }
+  if (!WIFEXITED(status)) {
+    LOG(ERROR) << "Core file writer failed [status=" << status << "]";
+    base::DeleteFile(core_path);
+    return kErrorInvalidCoreFile;
+  }
+  const int result = WEXITSTATUS(status);
+  if (result == EX_DATAERR) {
+    // The core file has another ELF class than this executable.
+    const ErrorType error =
+        CheckCoreFileClass(__WORDSIZE == 64 ? ELFCLASS32 : ELFCLASS64);
+    if (error != kErrorNone) {
+      return error;
+    }
+  }
+  if (result == EX_DATAERR || result == EX_OSFILE) {
+    LOG(ERROR) << "Invalid core file";
+    return kErrorInvalidCoreFile;
+  }
+  if (result != EX_OK) {
+    LOG(ERROR) << "Could not write core file [result=" << result << "]";
+    // If the file system was full, make sure we remove any remnants.
+    base::DeleteFile(core_path);
+    return kErrorReadCoreData;
+  }
+
+  if (!RunCoreToMinidump(core_path, procfs_directory, minidump_path,
+                         temp_directory)) {
+    return kErrorCore2MinidumpConversion;
+  }
+  return kErrorNone;
+}
+
 bool UserCollector::RunFilter(pid_t pid) {
   int mode;
   int exec_mode = base::FILE_PERMISSION_EXECUTE_BY_USER |
@@ -434,6 +514,16 @@ UserCollector::ErrorType UserCollector::ConvertCoreToMinidump(
   bool proc_files_usable =
       CopyOffProcFiles(pid, container_dir) && ValidateProcFiles(container_dir);
 
+  // Developer images keep the whole core file for debugging. Otherwise, only
+  // what the minidump needs is kept as the core is read, rather than spooling
+  // all of it to disk.
+  if (proc_files_usable && !util::IsDeveloperImage()) {
+    return StreamStdinToMinidump(core_path,
+                                 container_dir,  // procfs directory
+                                 minidump_path,
+                                 container_dir);  // temporary directory
+  }
+
   if (!CopyStdinToCoreFile(core_path)) {
     return kErrorReadCoreData;
   }
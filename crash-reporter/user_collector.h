@@ -82,6 +82,8 @@ class UserCollector : public UserCollectorBase {
   FRIEND_TEST(UserCollectorTest, ShouldDumpUserConsentProductionImage);
   FRIEND_TEST(UserCollectorTest, ValidateProcFiles);
   FRIEND_TEST(UserCollectorTest, ValidateCoreFile);
+  FRIEND_TEST(UserCollectorTest, StreamStdinToMinidump);
+  FRIEND_TEST(UserCollectorTest, StreamStdinToMinidumpInvalidCoreFile);
 
   std::string GetPattern(bool enabled, bool early) const;
   bool SetUpInternal(bool enabled, bool early);
@@ -107,6 +109,14 @@ class UserCollector : public UserCollectorBase {
                          const base::FilePath& minidump_path,
                          const base::FilePath& temp_directory);
 
+  // Reads the core file from stdin, writes the parts of it needed by the
+  // minidump to |core_path|, and converts it with core2md to the minidump at
+  // |minidump_path|, like RunCoreToMinidump().
+  ErrorType StreamStdinToMinidump(const base::FilePath& core_path,
+                                  const base::FilePath& procfs_directory,
+                                  const base::FilePath& minidump_path,
+                                  const base::FilePath& temp_directory);
+
   bool RunFilter(pid_t pid);
 
   bool ShouldDump(pid_t pid,
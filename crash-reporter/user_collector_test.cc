@@ -6,11 +6,15 @@
 
 #include <bits/wordsize.h>
 #include <elf.h>
+#include <fcntl.h>
+#include <link.h>
 #include <unistd.h>
 
+#include <cstring>
 #include <vector>
 
 #include <base/files/file_util.h>
+#include <base/files/scoped_file.h>
 #include <base/files/scoped_temp_dir.h>
 #include <base/strings/string_split.h>
 #include <brillo/syslog_logging.h>
@@ -38,6 +42,40 @@ const char kChromeIgnoreMsg[] =
     "ignoring call by kernel - chrome crash; "
     "waiting for chrome to call us directly";
 
+// Returns a core file with an ELF header of class |elf_class|, whose only
+// segment is the PT_NOTE one, with an NT_FILE note without files.
+std::string MakeCoreFile(unsigned char elf_class) {
+  ElfW(Ehdr) header = {};
+  memcpy(header.e_ident, ELFMAG, SELFMAG);
+  header.e_ident[EI_CLASS] = elf_class;
+  header.e_ident[EI_DATA] = ELFDATA2LSB;
+  header.e_ident[EI_VERSION] = EV_CURRENT;
+  header.e_type = ET_CORE;
+  header.e_version = EV_CURRENT;
+  header.e_phoff = sizeof(header);
+  header.e_ehsize = sizeof(header);
+  header.e_phentsize = sizeof(ElfW(Phdr));
+  header.e_phnum = 1;
+
+  // The count of files, and the page size.
+  const ElfW(Addr) files[] = {0, 4096};
+  const char name[8] = "CORE";
+  const ElfW(Nhdr) note = {sizeof("CORE"), sizeof(files), NT_FILE};
+
+  ElfW(Phdr) segment = {};
+  segment.p_type = PT_NOTE;
+  segment.p_offset = sizeof(header) + sizeof(segment);
+  segment.p_filesz = sizeof(note) + sizeof(name) + sizeof(files);
+
+  std::string core;
+  core.append(reinterpret_cast<const char*>(&header), sizeof(header));
+  core.append(reinterpret_cast<const char*>(&segment), sizeof(segment));
+  core.append(reinterpret_cast<const char*>(&note), sizeof(note));
+  core.append(name, sizeof(name));
+  core.append(reinterpret_cast<const char*>(files), sizeof(files));
+  return core;
+}
+
 }  // namespace
 
 class UserCollectorMock : public UserCollector {
@@ -85,7 +123,23 @@ class UserCollectorTest : public ::testing::Test {
     brillo::ClearLog();
   }
 
+  void TearDown() {
+    if (saved_stdin_.is_valid())
+      dup2(saved_stdin_.get(), STDIN_FILENO);
+  }
+
  protected:
+  // Makes |core| the standard input, from which the kernel pipes core files.
+  void SetStdin(const std::string& core) {
+    const FilePath stdin_path = test_dir_.Append("stdin");
+    ASSERT_TRUE(test_util::CreateFile(stdin_path, core));
+    base::ScopedFD stdin_fd(open(stdin_path.value().c_str(), O_RDONLY));
+    ASSERT_TRUE(stdin_fd.is_valid());
+    if (!saved_stdin_.is_valid())
+      saved_stdin_.reset(dup(STDIN_FILENO));
+    ASSERT_EQ(STDIN_FILENO, dup2(stdin_fd.get(), STDIN_FILENO));
+  }
+
   void ExpectFileEquals(const char* golden, const FilePath& file_path) {
     std::string contents;
     EXPECT_TRUE(base::ReadFileToString(file_path, &contents));
@@ -118,6 +172,7 @@ class UserCollectorTest : public ::testing::Test {
   FilePath test_core_pattern_file_;
   FilePath test_core_pipe_limit_file_;
   base::ScopedTempDir scoped_temp_dir_;
+  base::ScopedFD saved_stdin_;
 };
 
 TEST_F(UserCollectorTest, EnableOK) {
@@ -604,3 +659,63 @@ TEST_F(UserCollectorTest, ValidateCoreFile) {
   EXPECT_EQ(UserCollector::kErrorInvalidCoreFile,
             collector_.ValidateCoreFile(core_file));
 }
+
+TEST_F(UserCollectorTest, StreamStdinToMinidump) {
+  const FilePath core_path = test_dir_.Append("core");
+  const FilePath minidump_path = test_dir_.Append("minidump");
+#if __WORDSIZE == 32
+  const std::string core = MakeCoreFile(ELFCLASS32);
+#else
+  const std::string core = MakeCoreFile(ELFCLASS64);
+#endif
+
+  // The core file is written, then converted by core2md.
+  collector_.Initialize(kFilePath, true /* core2md_failure */, false, false);
+  SetStdin(core);
+  EXPECT_EQ(UserCollector::kErrorCore2MinidumpConversion,
+            collector_.StreamStdinToMinidump(core_path, test_dir_,
+                                             minidump_path, test_dir_));
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(core_path, &contents));
+  EXPECT_EQ(core, contents);
+  EXPECT_FALSE(base::PathExists(minidump_path));
+
+  // A core file that cannot be read whole is removed.
+  ASSERT_TRUE(base::DeleteFile(core_path));
+  SetStdin(core.substr(0, sizeof(ElfW(Ehdr))));
+  EXPECT_EQ(UserCollector::kErrorReadCoreData,
+            collector_.StreamStdinToMinidump(core_path, test_dir_,
+                                             minidump_path, test_dir_));
+  EXPECT_FALSE(base::PathExists(core_path));
+  EXPECT_TRUE(FindLog("Could not write core file"));
+}
+
+TEST_F(UserCollectorTest, StreamStdinToMinidumpInvalidCoreFile) {
+  const FilePath core_path = test_dir_.Append("core");
+  const FilePath minidump_path = test_dir_.Append("minidump");
+#if __WORDSIZE == 32
+  std::string core = MakeCoreFile(ELFCLASS32);
+#else
+  std::string core = MakeCoreFile(ELFCLASS64);
+#endif
+
+#if __WORDSIZE == 64
+  // 32-bit core file on 64-bit platform
+  core[EI_CLASS] = ELFCLASS32;
+  SetStdin(core);
+  EXPECT_EQ(UserCollector::kErrorUnsupported32BitCoreFile,
+            collector_.StreamStdinToMinidump(core_path, test_dir_,
+                                             minidump_path, test_dir_));
+  EXPECT_TRUE(FindLog("Conversion of 32-bit core file"));
+  core[EI_CLASS] = ELFCLASS64;
+  ASSERT_TRUE(base::DeleteFile(core_path));
+#endif
+
+  core[EI_MAG0] = 0;
+  SetStdin(core);
+  EXPECT_EQ(UserCollector::kErrorInvalidCoreFile,
+            collector_.StreamStdinToMinidump(core_path, test_dir_,
+                                             minidump_path, test_dir_));
+  EXPECT_TRUE(FindLog("Invalid core file"));
+  EXPECT_FALSE(base::PathExists(minidump_path));
+}
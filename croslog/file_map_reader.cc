@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <unistd.h>
 
+#include "croslog/line_splitter.h"
 #include "croslog/log_line_reader.h"
 
 #include <base/check.h>
@@ -199,6 +200,36 @@ std::pair<const uint8_t*, uint64_t> FileMapReader::MappedBuffer::GetBuffer(
   return std::make_pair(buffer, std::min(length, buffer_remaining_length));
 }
 
+uint64_t FileMapReader::MappedBuffer::FindLineFeed(uint64_t start_pos,
+                                                   uint64_t end_pos) const {
+  DCHECK_LE(start_pos, end_pos);
+  if (start_pos == end_pos)
+    return end_pos;
+
+  const std::pair<const uint8_t*, uint64_t> buffer =
+      GetBuffer(start_pos, end_pos - start_pos);
+  const uint8_t* begin = buffer.first;
+  const uint8_t* lf = croslog::FindLineFeed(begin, begin + buffer.second);
+  if (lf == nullptr)
+    return start_pos + buffer.second;
+  return start_pos + (lf - begin);
+}
+
+uint64_t FileMapReader::MappedBuffer::FindLineStart(uint64_t start_pos,
+                                                    uint64_t end_pos) const {
+  DCHECK_LE(start_pos, end_pos);
+  if (start_pos == end_pos)
+    return start_pos;
+
+  const std::pair<const uint8_t*, uint64_t> buffer =
+      GetBuffer(start_pos, end_pos - start_pos);
+  const uint8_t* begin = buffer.first;
+  const uint8_t* lf = croslog::FindLastLineFeed(begin, begin + buffer.second);
+  if (lf == nullptr)
+    return start_pos;
+  return start_pos + (lf - begin) + 1;
+}
+
 // ============================================================================
 // FileMapReader implementation:
 
@@ -58,6 +58,14 @@ class FileMapReader {
       return buffer_[position - buffer_start_];
     }
 
+    // Returns the position of the first LF in [start_pos, end_pos), or
+    // |end_pos| if there is none. The range must be within the mapped range.
+    uint64_t FindLineFeed(uint64_t start_pos, uint64_t end_pos) const;
+
+    // Returns the position just after the last LF in [start_pos, end_pos), or
+    // |start_pos| if there is none. The range must be within the mapped range.
+    uint64_t FindLineStart(uint64_t start_pos, uint64_t end_pos) const;
+
     // Returns true if the mmap succeeded and the mapped buffer is valid.
     bool valid() const { return buffer_ != nullptr; }
 
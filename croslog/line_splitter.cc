@@ -0,0 +1,191 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "croslog/line_splitter.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CROSLOG_LINE_SPLITTER_X86 1
+#endif
+
+#include <base/check.h>
+#include <base/check_op.h>
+
+namespace croslog {
+
+namespace {
+
+constexpr char kLineFeed = '\n';
+
+// Scalar implementation. memchr() and memrchr() of libc are already optimized
+// on most architectures.
+
+const uint8_t* FindLineFeedScalar(const uint8_t* begin, const uint8_t* end) {
+  return static_cast<const uint8_t*>(memchr(begin, kLineFeed, end - begin));
+}
+
+const uint8_t* FindLastLineFeedScalar(const uint8_t* begin,
+                                      const uint8_t* end) {
+  return static_cast<const uint8_t*>(memrchr(begin, kLineFeed, end - begin));
+}
+
+#if defined(CROSLOG_LINE_SPLITTER_X86)
+
+// SSE2 implementation: compares 16 bytes at once.
+
+__attribute__((target("sse2"))) const uint8_t* FindLineFeedSse2(
+    const uint8_t* begin, const uint8_t* end) {
+  const __m128i lf = _mm_set1_epi8(kLineFeed);
+  const uint8_t* p = begin;
+  for (; end - p >= 16; p += 16) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, lf));
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+  for (; p < end; p++) {
+    if (*p == kLineFeed)
+      return p;
+  }
+  return nullptr;
+}
+
+__attribute__((target("sse2"))) const uint8_t* FindLastLineFeedSse2(
+    const uint8_t* begin, const uint8_t* end) {
+  const __m128i lf = _mm_set1_epi8(kLineFeed);
+  const uint8_t* p = end;
+  for (; p - begin >= 16; p -= 16) {
+    const __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p - 16));
+    const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, lf));
+    if (mask != 0)
+      return p - 16 + (31 - __builtin_clz(mask));
+  }
+  while (p > begin) {
+    p--;
+    if (*p == kLineFeed)
+      return p;
+  }
+  return nullptr;
+}
+
+// AVX2 implementation: compares 32 bytes at once. The remainder is handled by
+// the SSE2 one, which AVX2 CPUs always support.
+
+__attribute__((target("avx2"))) const uint8_t* FindLineFeedAvx2(
+    const uint8_t* begin, const uint8_t* end) {
+  const __m256i lf = _mm256_set1_epi8(kLineFeed);
+  const uint8_t* p = begin;
+  for (; end - p >= 32; p += 32) {
+    const __m256i chunk =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const uint32_t mask = static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, lf)));
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+  return FindLineFeedSse2(p, end);
+}
+
+__attribute__((target("avx2"))) const uint8_t* FindLastLineFeedAvx2(
+    const uint8_t* begin, const uint8_t* end) {
+  const __m256i lf = _mm256_set1_epi8(kLineFeed);
+  const uint8_t* p = end;
+  for (; p - begin >= 32; p -= 32) {
+    const __m256i chunk =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p - 32));
+    const uint32_t mask = static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, lf)));
+    if (mask != 0)
+      return p - 32 + (31 - __builtin_clz(mask));
+  }
+  return FindLastLineFeedSse2(begin, p);
+}
+
+#endif  // defined(CROSLOG_LINE_SPLITTER_X86)
+
+struct Implementation {
+  LineSplitterImpl impl;
+  const uint8_t* (*find_line_feed)(const uint8_t*, const uint8_t*);
+  const uint8_t* (*find_last_line_feed)(const uint8_t*, const uint8_t*);
+};
+
+bool IsSupported(LineSplitterImpl impl) {
+  switch (impl) {
+    case LineSplitterImpl::SCALAR:
+      return true;
+#if defined(CROSLOG_LINE_SPLITTER_X86)
+    case LineSplitterImpl::SSE2:
+      return __builtin_cpu_supports("sse2");
+    case LineSplitterImpl::AVX2:
+      return __builtin_cpu_supports("avx2");
+#else
+    case LineSplitterImpl::SSE2:
+    case LineSplitterImpl::AVX2:
+      return false;
+#endif
+  }
+  return false;
+}
+
+Implementation GetImplementation(LineSplitterImpl impl) {
+  DCHECK(IsSupported(impl));
+  switch (impl) {
+#if defined(CROSLOG_LINE_SPLITTER_X86)
+    case LineSplitterImpl::SSE2:
+      return {impl, &FindLineFeedSse2, &FindLastLineFeedSse2};
+    case LineSplitterImpl::AVX2:
+      return {impl, &FindLineFeedAvx2, &FindLastLineFeedAvx2};
+#endif
+    default:
+      return {LineSplitterImpl::SCALAR, &FindLineFeedScalar,
+              &FindLastLineFeedScalar};
+  }
+}
+
+Implementation GetBestImplementation() {
+  if (IsSupported(LineSplitterImpl::AVX2))
+    return GetImplementation(LineSplitterImpl::AVX2);
+  if (IsSupported(LineSplitterImpl::SSE2))
+    return GetImplementation(LineSplitterImpl::SSE2);
+  return GetImplementation(LineSplitterImpl::SCALAR);
+}
+
+// Returns the implementation in use, which is selected on the first call
+// rather than in a static initializer. This is not constant for testing.
+Implementation& GetCurrentImplementation() {
+  static Implementation implementation = GetBestImplementation();
+  return implementation;
+}
+
+}  // namespace
+
+const uint8_t* FindLineFeed(const uint8_t* begin, const uint8_t* end) {
+  DCHECK_LE(begin, end);
+  if (begin == end)
+    return nullptr;
+  return GetCurrentImplementation().find_line_feed(begin, end);
+}
+
+const uint8_t* FindLastLineFeed(const uint8_t* begin, const uint8_t* end) {
+  DCHECK_LE(begin, end);
+  if (begin == end)
+    return nullptr;
+  return GetCurrentImplementation().find_last_line_feed(begin, end);
+}
+
+LineSplitterImpl GetLineSplitterImpl() {
+  return GetCurrentImplementation().impl;
+}
+
+bool SetLineSplitterImplForTest(LineSplitterImpl impl) {
+  if (!IsSupported(impl))
+    return false;
+  GetCurrentImplementation() = GetImplementation(impl);
+  return true;
+}
+
+}  // namespace croslog
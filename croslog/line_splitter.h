@@ -0,0 +1,38 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CROSLOG_LINE_SPLITTER_H_
+#define CROSLOG_LINE_SPLITTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace croslog {
+
+// Utilities to find line boundaries (LF) in a buffer. The fastest
+// implementation supported by the CPU (AVX2, SSE2 or the scalar one) is
+// picked on the first use.
+
+enum class LineSplitterImpl {
+  SCALAR,
+  SSE2,
+  AVX2,
+};
+
+// Returns the first LF in [begin, end), or nullptr if there is none.
+const uint8_t* FindLineFeed(const uint8_t* begin, const uint8_t* end);
+
+// Returns the last LF in [begin, end), or nullptr if there is none.
+const uint8_t* FindLastLineFeed(const uint8_t* begin, const uint8_t* end);
+
+// Returns the implementation in use.
+LineSplitterImpl GetLineSplitterImpl();
+
+// Switches the implementation. Returns false if |impl| is not supported by
+// the CPU.
+bool SetLineSplitterImplForTest(LineSplitterImpl impl);
+
+}  // namespace croslog
+
+#endif  // CROSLOG_LINE_SPLITTER_H_
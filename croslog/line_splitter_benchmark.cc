@@ -0,0 +1,143 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures lines/sec of splitting the syslog corpora in croslog/testdata with
+// each line splitter implementation, and of reading them with LogLineReader.
+// Usage (from the croslog directory):
+//   croslog_line_splitter_benchmark [benchmark flags]
+
+#include <string>
+#include <tuple>
+
+#include "base/at_exit.h"
+#include "base/check.h"
+#include "base/files/file_enumerator.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/no_destructor.h"
+#include "benchmark/benchmark.h"
+
+#include "croslog/line_splitter.h"
+#include "croslog/log_line_reader.h"
+
+namespace croslog {
+
+namespace {
+
+// Size of the corpus, made by repeating the test data.
+constexpr size_t kCorpusSize = 16 * 1024 * 1024;
+
+const std::string& GetCorpus() {
+  static const base::NoDestructor<std::string> corpus([] {
+    std::string testdata;
+    base::FileEnumerator files(base::FilePath("./testdata"),
+                               /*recursive=*/false,
+                               base::FileEnumerator::FILES);
+    for (base::FilePath path = files.Next(); !path.empty();
+         path = files.Next()) {
+      std::string content;
+      CHECK(base::ReadFileToString(path, &content));
+      testdata += content;
+      if (!testdata.empty() && testdata.back() != '\n')
+        testdata += '\n';
+    }
+    CHECK(!testdata.empty()) << "Run this in the croslog directory.";
+
+    std::string corpus;
+    while (corpus.size() < kCorpusSize)
+      corpus += testdata;
+    return corpus;
+  }());
+  return *corpus;
+}
+
+// The byte-by-byte scan which LogLineReader used to do, as the baseline.
+void BM_SplitLinesBytewise(benchmark::State& state) {
+  const std::string& corpus = GetCorpus();
+  int64_t lines = 0;
+  for (auto _ : state) {
+    size_t line_start = 0;
+    for (size_t i = 0; i < corpus.size(); i++) {
+      if (corpus[i] == '\n') {
+        benchmark::DoNotOptimize(line_start);
+        line_start = i + 1;
+        lines++;
+      }
+    }
+  }
+  state.SetItemsProcessed(lines);
+  state.SetBytesProcessed(state.iterations() * corpus.size());
+}
+BENCHMARK(BM_SplitLinesBytewise);
+
+void BM_SplitLines(benchmark::State& state) {
+  const LineSplitterImpl impl = static_cast<LineSplitterImpl>(state.range(0));
+  const LineSplitterImpl default_impl = GetLineSplitterImpl();
+  if (!SetLineSplitterImplForTest(impl)) {
+    state.SkipWithError("Not supported on this CPU.");
+    return;
+  }
+
+  const std::string& corpus = GetCorpus();
+  const uint8_t* begin = reinterpret_cast<const uint8_t*>(corpus.data());
+  const uint8_t* end = begin + corpus.size();
+  int64_t lines = 0;
+  for (auto _ : state) {
+    const uint8_t* line_start = begin;
+    while (const uint8_t* lf = FindLineFeed(line_start, end)) {
+      benchmark::DoNotOptimize(line_start);
+      line_start = lf + 1;
+      lines++;
+    }
+  }
+  state.SetItemsProcessed(lines);
+  state.SetBytesProcessed(state.iterations() * corpus.size());
+  SetLineSplitterImplForTest(default_impl);
+}
+BENCHMARK(BM_SplitLines)
+    ->Arg(static_cast<int>(LineSplitterImpl::SCALAR))
+    ->Arg(static_cast<int>(LineSplitterImpl::SSE2))
+    ->Arg(static_cast<int>(LineSplitterImpl::AVX2));
+
+void BM_LogLineReaderForward(benchmark::State& state) {
+  const std::string& corpus = GetCorpus();
+  int64_t lines = 0;
+  for (auto _ : state) {
+    LogLineReader reader(LogLineReader::Backend::MEMORY_FOR_TEST);
+    reader.OpenMemoryBufferForTest(corpus.data(), corpus.size());
+    while (std::get<1>(reader.Forward()) ==
+           LogLineReader::ReadResult::NO_ERROR) {
+      lines++;
+    }
+  }
+  state.SetItemsProcessed(lines);
+}
+BENCHMARK(BM_LogLineReaderForward);
+
+void BM_LogLineReaderBackward(benchmark::State& state) {
+  const std::string& corpus = GetCorpus();
+  int64_t lines = 0;
+  for (auto _ : state) {
+    LogLineReader reader(LogLineReader::Backend::MEMORY_FOR_TEST);
+    reader.OpenMemoryBufferForTest(corpus.data(), corpus.size());
+    reader.SetPositionLast();
+    while (std::get<1>(reader.Backward()) ==
+           LogLineReader::ReadResult::NO_ERROR) {
+      lines++;
+    }
+  }
+  state.SetItemsProcessed(lines);
+}
+BENCHMARK(BM_LogLineReaderBackward);
+
+}  // namespace
+
+}  // namespace croslog
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit;
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,100 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "croslog/line_splitter.h"
+
+#include <string>
+
+#include "base/rand_util.h"
+#include "gtest/gtest.h"
+
+namespace croslog {
+
+namespace {
+
+const uint8_t* FindLineFeedReference(const uint8_t* begin, const uint8_t* end) {
+  for (const uint8_t* p = begin; p < end; p++) {
+    if (*p == '\n')
+      return p;
+  }
+  return nullptr;
+}
+
+const uint8_t* FindLastLineFeedReference(const uint8_t* begin,
+                                         const uint8_t* end) {
+  for (const uint8_t* p = end; p > begin; p--) {
+    if (*(p - 1) == '\n')
+      return p - 1;
+  }
+  return nullptr;
+}
+
+// Returns a random buffer with sparse LFs.
+std::string MakeRandomBuffer(size_t length) {
+  std::string buffer(length, ' ');
+  for (char& c : buffer)
+    c = base::RandInt(0, 40) == 0 ? '\n' : 'a' + base::RandInt(0, 25);
+  return buffer;
+}
+
+}  // namespace
+
+class LineSplitterTest : public ::testing::TestWithParam<LineSplitterImpl> {
+ public:
+  LineSplitterTest() = default;
+  LineSplitterTest(const LineSplitterTest&) = delete;
+  LineSplitterTest& operator=(const LineSplitterTest&) = delete;
+
+  void SetUp() override {
+    default_impl_ = GetLineSplitterImpl();
+    if (!SetLineSplitterImplForTest(GetParam()))
+      GTEST_SKIP() << "Not supported on this CPU.";
+  }
+
+  void TearDown() override { SetLineSplitterImplForTest(default_impl_); }
+
+ private:
+  LineSplitterImpl default_impl_;
+};
+
+TEST_P(LineSplitterTest, Empty) {
+  const uint8_t buffer[] = {'a'};
+  EXPECT_EQ(nullptr, FindLineFeed(buffer, buffer));
+  EXPECT_EQ(nullptr, FindLastLineFeed(buffer, buffer));
+}
+
+TEST_P(LineSplitterTest, MatchesReference) {
+  for (size_t length = 0; length < 200; length++) {
+    const std::string buffer = MakeRandomBuffer(length);
+    const uint8_t* begin = reinterpret_cast<const uint8_t*>(buffer.data());
+    // Checks all the unaligned sub-ranges starting or ending at the edges.
+    for (size_t i = 0; i <= length; i++) {
+      EXPECT_EQ(FindLineFeedReference(begin + i, begin + length),
+                FindLineFeed(begin + i, begin + length));
+      EXPECT_EQ(FindLastLineFeedReference(begin, begin + i),
+                FindLastLineFeed(begin, begin + i));
+    }
+  }
+}
+
+TEST_P(LineSplitterTest, Lines) {
+  const std::string buffer = "A\n\nBC\nD";
+  const uint8_t* begin = reinterpret_cast<const uint8_t*>(buffer.data());
+  const uint8_t* end = begin + buffer.size();
+  EXPECT_EQ(begin + 1, FindLineFeed(begin, end));
+  EXPECT_EQ(begin + 2, FindLineFeed(begin + 2, end));
+  EXPECT_EQ(begin + 5, FindLineFeed(begin + 3, end));
+  EXPECT_EQ(nullptr, FindLineFeed(begin + 6, end));
+  EXPECT_EQ(begin + 5, FindLastLineFeed(begin, end));
+  EXPECT_EQ(begin + 2, FindLastLineFeed(begin, begin + 5));
+  EXPECT_EQ(nullptr, FindLastLineFeed(begin, begin + 1));
+}
+
+INSTANTIATE_TEST_SUITE_P(LineSplitterTestAllImpls,
+                         LineSplitterTest,
+                         ::testing::Values(LineSplitterImpl::SCALAR,
+                                           LineSplitterImpl::SSE2,
+                                           LineSplitterImpl::AVX2));
+
+}  // namespace croslog
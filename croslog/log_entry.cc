@@ -40,4 +40,9 @@ void LogEntry::AppendLinesToMessage(const std::list<std::string>& lines) {
   }
 }
 
+LogEntry LogEntryView::ToLogEntry() const {
+  return LogEntry(time, severity, tag.as_string(), pid, message.as_string(),
+                  entire_line.as_string());
+}
+
 }  // namespace croslog
@@ -48,6 +48,21 @@ class LogEntry {
   std::string entire_line_;
 };
 
+// A parsed log line which refers to the buffer of the line instead of owning
+// copies of its parts. The view is valid only while the buffer is alive, so
+// it has to be materialized into a LogEntry to outlive it.
+struct LogEntryView {
+  base::Time time;
+  Severity severity = Severity::UNSPECIFIED;
+  base::StringPiece tag;
+  int pid = -1;
+  base::StringPiece message;
+  base::StringPiece entire_line;
+
+  // Returns a LogEntry owning copies of the strings.
+  LogEntry ToLogEntry() const;
+};
+
 }  // namespace croslog
 
 #endif  // CROSLOG_LOG_ENTRY_H_
@@ -0,0 +1,118 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "croslog/log_entry_prefetcher.h"
+
+#include <utility>
+
+#include "base/bind.h"
+#include "base/task/thread_pool.h"
+
+#include <base/check.h>
+
+namespace croslog {
+
+LogEntryPrefetcher::LogEntryPrefetcher(LogEntryReader* reader,
+                                       size_t capacity)
+    : reader_(reader),
+      capacity_(capacity),
+      task_runner_(base::ThreadPool::CreateSequencedTaskRunner(
+          {base::TaskPriority::USER_BLOCKING, base::MayBlock()})) {
+  DCHECK(reader_);
+  DCHECK_LT(0u, capacity_);
+}
+
+LogEntryPrefetcher::~LogEntryPrefetcher() {
+  DCHECK(!fetching_);
+}
+
+MaybeLogEntry LogEntryPrefetcher::GetNextEntry() {
+  base::AutoLock lock(lock_);
+  started_ = true;
+
+  while (entries_.empty() && !reached_end_) {
+    if (!fetching_)
+      ScheduleFetchLocked();
+    condition_.Wait();
+  }
+
+  if (entries_.empty()) {
+    // No more entry.
+    return base::nullopt;
+  }
+
+  MaybeLogEntry entry(std::move(entries_.front()));
+  entries_.pop_front();
+
+  // Refills the queue before it gets empty.
+  if (!fetching_ && !reached_end_ && entries_.size() <= capacity_ / 2)
+    ScheduleFetchLocked();
+
+  return entry;
+}
+
+void LogEntryPrefetcher::Stop() {
+  size_t unconsumed_entries;
+  {
+    base::AutoLock lock(lock_);
+    if (!started_)
+      return;
+
+    cancelled_ = true;
+    while (fetching_)
+      condition_.Wait();
+
+    unconsumed_entries = entries_.size();
+    entries_.clear();
+    started_ = false;
+    cancelled_ = false;
+    reached_end_ = false;
+  }
+
+  // The worker is idle. Moves the reader back over the entries which have been
+  // read but not consumed.
+  for (size_t i = 0; i < unconsumed_entries; i++)
+    reader_->GetPreviousEntry();
+}
+
+void LogEntryPrefetcher::ScheduleFetchLocked() {
+  lock_.AssertAcquired();
+  DCHECK(!fetching_);
+  fetching_ = true;
+  task_runner_->PostTask(
+      FROM_HERE,
+      base::BindOnce(&LogEntryPrefetcher::Fetch, base::WrapRefCounted(this)));
+}
+
+void LogEntryPrefetcher::Fetch() {
+  while (true) {
+    {
+      base::AutoLock lock(lock_);
+      DCHECK(fetching_);
+      if (cancelled_ || entries_.size() >= capacity_) {
+        fetching_ = false;
+        condition_.Signal();
+        return;
+      }
+    }
+
+    // Reads and parses without the lock, so that the main thread can consume
+    // the entries in the meantime.
+    MaybeLogEntry entry = reader_->GetNextEntry();
+
+    base::AutoLock lock(lock_);
+    if (!entry.has_value()) {
+      reached_end_ = true;
+      fetching_ = false;
+      condition_.Signal();
+      return;
+    }
+    // The entry is queued even when cancelled, since the reader has passed it
+    // and Stop() rewinds the reader by the number of queued entries.
+    entries_.push_back(std::move(*entry));
+    condition_.Signal();
+  }
+}
+
+}  // namespace croslog
@@ -0,0 +1,74 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CROSLOG_LOG_ENTRY_PREFETCHER_H_
+#define CROSLOG_LOG_ENTRY_PREFETCHER_H_
+
+#include <deque>
+
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_refptr.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "base/task/sequenced_task_runner.h"
+
+#include "croslog/log_entry.h"
+#include "croslog/log_entry_reader.h"
+
+namespace croslog {
+
+/*
+ * This class is responsible for
+ * - Reading and parsing the next entries of a LogEntryReader ahead on a worker
+ *   thread, into a bounded queue.
+ * - Rewinding the reader to the first entry not consumed yet when stopped, so
+ *   that the reader can be used directly again.
+ * The prefetcher must be stopped before the reader is accessed directly or
+ * destroyed. It must not be used for a reader which watches file changes,
+ * since the change events are handled on the main thread.
+ */
+class LogEntryPrefetcher
+    : public base::RefCountedThreadSafe<LogEntryPrefetcher> {
+ public:
+  // |reader| must outlive the prefetcher. Prefetching uses the thread pool,
+  // which must be started.
+  LogEntryPrefetcher(LogEntryReader* reader, size_t capacity);
+  LogEntryPrefetcher(const LogEntryPrefetcher&) = delete;
+  LogEntryPrefetcher& operator=(const LogEntryPrefetcher&) = delete;
+
+  // Returns the next entry like LogEntryReader::GetNextEntry(). Starts
+  // prefetching if not yet, and blocks until the entry is read.
+  MaybeLogEntry GetNextEntry();
+
+  // Stops prefetching and rewinds the reader to the position just after the
+  // last entry returned by GetNextEntry(). Blocks until the worker finishes.
+  void Stop();
+
+ private:
+  friend class base::RefCountedThreadSafe<LogEntryPrefetcher>;
+  ~LogEntryPrefetcher();
+
+  // Posts a Fetch() task. |lock_| must be held.
+  void ScheduleFetchLocked();
+  // Fills the queue up to |capacity_|. Runs on the worker.
+  void Fetch();
+
+  LogEntryReader* const reader_;
+  const size_t capacity_;
+  const scoped_refptr<base::SequencedTaskRunner> task_runner_;
+
+  base::Lock lock_;
+  base::ConditionVariable condition_{&lock_};
+  // Fields below are guarded by |lock_|. |reader_| is accessed only by the
+  // worker while |fetching_| is true.
+  std::deque<LogEntry> entries_;
+  bool started_ = false;
+  bool fetching_ = false;
+  bool cancelled_ = false;
+  bool reached_end_ = false;
+};
+
+}  // namespace croslog
+
+#endif  // CROSLOG_LOG_ENTRY_PREFETCHER_H_
@@ -4,6 +4,7 @@
 
 #include "croslog/log_entry_reader.h"
 
+#include <algorithm>
 #include <list>
 #include <utility>
 
@@ -20,6 +21,7 @@ LogEntryReader::LogEntryReader(base::FilePath log_file,
     : file_path_(log_file),
       line_reader_(install_change_watcher ? LogLineReader::Backend::FILE_FOLLOW
                                           : LogLineReader::Backend::FILE),
+      index_(log_file),
       parser_(std::move(parser_in)) {
   line_reader_.OpenFile(std::move(log_file));
 }
@@ -102,9 +104,22 @@ MaybeLogEntry LogEntryReader::GetNextEntry() {
 }
 
 void LogEntryReader::SetPositionLast() {
+  next_entry_.reset();
   line_reader_.SetPositionLast();
 }
 
+void LogEntryReader::SetPositionAt(base::Time time) {
+  next_entry_.reset();
+  if (!index_.Update(parser_.get())) {
+    line_reader_.SetPosition(0);
+    return;
+  }
+  // The index may cover more than |line_reader_| has seen, if the file has
+  // grown since.
+  line_reader_.SetPosition(
+      std::min(index_.FindOffset(time), line_reader_.GetFileSize()));
+}
+
 void LogEntryReader::AddObserver(LogLineReader::Observer* obs) {
   line_reader_.AddObserver(obs);
 }
@@ -10,8 +10,10 @@
 #include <vector>
 
 #include "base/files/file_path.h"
+#include "base/time/time.h"
 
 #include "croslog/log_entry.h"
+#include "croslog/log_index.h"
 #include "croslog/log_line_reader.h"
 #include "croslog/log_parser.h"
 
@@ -40,6 +42,10 @@ class LogEntryReader {
 
   // Moves the current position to the current end of the file.
   void SetPositionLast();
+  // Moves the current position before the first entry at or after |time|,
+  // using the index of the file. Entries older than |time| may still be read
+  // after this, since the index is sparse.
+  void SetPositionAt(base::Time time);
 
   // Returns the file path of the target.
   const base::FilePath& file_path() const { return file_path_; }
@@ -52,6 +58,7 @@ class LogEntryReader {
  private:
   base::FilePath file_path_;
   LogLineReader line_reader_;
+  LogIndex index_;
   MaybeLogEntry next_entry_;
   std::unique_ptr<LogParser> parser_;
 };
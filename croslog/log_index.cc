@@ -0,0 +1,225 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "croslog/log_index.h"
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <utility>
+
+#include "base/files/file_util.h"
+#include "base/files/important_file_writer.h"
+#include "base/pickle.h"
+#include "base/strings/string_piece.h"
+#include "base/strings/string_util.h"
+
+#include "croslog/log_line_reader.h"
+
+#include <base/check_op.h>
+#include <base/logging.h>
+
+namespace croslog {
+
+namespace {
+// Directory to persist the index files.
+base::FilePath* g_index_directory = nullptr;
+// Default directory to persist the index files.
+constexpr char kDefaultIndexDirectory[] = "/var/cache/croslog";
+// Interval of checkpoints in lines.
+uint32_t g_lines_per_checkpoint = 4096;
+
+// Header of the index file.
+constexpr uint32_t kIndexMagic = 0x58494C43;  // "CLIX"
+constexpr uint32_t kIndexVersion = 2;
+
+base::FilePath GetIndexDirectory() {
+  if (g_index_directory)
+    return *g_index_directory;
+  return base::FilePath(kDefaultIndexDirectory);
+}
+
+// Returns the path of the index file for |log_file|, e.g.
+// "/var/cache/croslog/_var_log_messages.index".
+base::FilePath GetIndexFilePath(const base::FilePath& log_file) {
+  std::string name;
+  base::ReplaceChars(log_file.value(), "/", "_", &name);
+  return GetIndexDirectory().Append(name + ".index");
+}
+
+// Times are persisted as microseconds since the Windows epoch.
+int64_t ToMicroseconds(base::Time time) {
+  return time.ToDeltaSinceWindowsEpoch().InMicroseconds();
+}
+
+base::Time FromMicroseconds(int64_t microseconds) {
+  return base::Time::FromDeltaSinceWindowsEpoch(
+      base::TimeDelta::FromMicroseconds(microseconds));
+}
+}  // namespace
+
+// static
+void LogIndex::SetIndexDirectoryForTest(const base::FilePath& directory) {
+  delete g_index_directory;
+  g_index_directory = new base::FilePath(directory);
+}
+
+// static
+void LogIndex::SetLinesPerCheckpointForTest(uint32_t lines_per_checkpoint) {
+  CHECK_GT(lines_per_checkpoint, 0);
+  g_lines_per_checkpoint = lines_per_checkpoint;
+}
+
+LogIndex::LogIndex(const base::FilePath& log_file)
+    : log_file_(log_file), index_file_(GetIndexFilePath(log_file)) {}
+
+bool LogIndex::Update(LogParser* parser) {
+  DCHECK(parser);
+
+  LogLineReader reader(LogLineReader::Backend::FILE);
+  reader.OpenFile(log_file_);
+  if (!reader.is_open())
+    return false;
+
+  if (!loaded_) {
+    loaded_ = true;
+    Load();
+  }
+
+  const int64_t file_size = reader.GetFileSize();
+  if (inode_ != reader.file_inode() || indexed_size_ > file_size) {
+    // The file is rotated or truncated.
+    Reset(reader.file_inode());
+  }
+  if (indexed_size_ == file_size)
+    return true;
+
+  // Scans only the appended lines.
+  const size_t previous_checkpoints = checkpoints_.size();
+  const int64_t previous_indexed_size = indexed_size_;
+  reader.SetPosition(indexed_size_);
+  while (true) {
+    const int64_t line_start = reader.position();
+    auto [line, result] = reader.Forward();
+    if (result != LogLineReader::ReadResult::NO_ERROR) {
+      // EOF. The last incomplete line is left for the next update.
+      break;
+    }
+
+    // Continuation lines of a multi-line entry fail to parse.
+    const base::Optional<base::Time> time = parser->ParseEntryTime(line);
+    if (time.has_value())
+      max_time_ = std::max(max_time_, *time);
+
+    if (lines_since_checkpoint_ < g_lines_per_checkpoint) {
+      lines_since_checkpoint_++;
+      continue;
+    }
+
+    // Checkpoints must be at the first line of an entry.
+    if (!time.has_value())
+      continue;
+
+    checkpoints_.push_back({*time, max_time_, line_start});
+    lines_since_checkpoint_ = 1;
+  }
+  indexed_size_ = reader.position();
+
+  if (checkpoints_.size() != previous_checkpoints ||
+      indexed_size_ != previous_indexed_size) {
+    Save();
+  }
+  return true;
+}
+
+int64_t LogIndex::FindOffset(base::Time time) const {
+  // Finds the last checkpoint with all the entries up to it strictly before
+  // |time|, so that the entries with the same time preceding the next
+  // checkpoint are not skipped. |max_time| is sorted even if the clock went
+  // backward.
+  auto it = std::partition_point(checkpoints_.begin(), checkpoints_.end(),
+                                 [time](const Checkpoint& checkpoint) {
+                                   return checkpoint.max_time < time;
+                                 });
+  if (it == checkpoints_.begin())
+    return 0;
+  return std::prev(it)->offset;
+}
+
+bool LogIndex::Load() {
+  std::string data;
+  if (!base::ReadFileToString(index_file_, &data))
+    return false;
+
+  base::Pickle pickle(data.data(), data.size());
+  base::PickleIterator iter(pickle);
+  uint32_t magic, version, lines_since_checkpoint;
+  uint64_t inode, count;
+  int64_t indexed_size, max_time_us;
+  if (!iter.ReadUInt32(&magic) || magic != kIndexMagic ||
+      !iter.ReadUInt32(&version) || version != kIndexVersion ||
+      !iter.ReadUInt64(&inode) || !iter.ReadInt64(&indexed_size) ||
+      !iter.ReadUInt32(&lines_since_checkpoint) ||
+      !iter.ReadInt64(&max_time_us) || !iter.ReadUInt64(&count)) {
+    LOG(WARNING) << "Ignoring the broken index file: " << index_file_;
+    return false;
+  }
+
+  std::vector<Checkpoint> checkpoints;
+  for (uint64_t i = 0; i < count; i++) {
+    int64_t time_us, checkpoint_max_time_us, offset;
+    if (!iter.ReadInt64(&time_us) || !iter.ReadInt64(&checkpoint_max_time_us) ||
+        !iter.ReadInt64(&offset) || offset >= indexed_size) {
+      LOG(WARNING) << "Ignoring the broken index file: " << index_file_;
+      return false;
+    }
+    checkpoints.push_back(
+        {FromMicroseconds(time_us), FromMicroseconds(checkpoint_max_time_us),
+         offset});
+  }
+
+  inode_ = inode;
+  indexed_size_ = indexed_size;
+  lines_since_checkpoint_ = lines_since_checkpoint;
+  max_time_ = FromMicroseconds(max_time_us);
+  checkpoints_ = std::move(checkpoints);
+  return true;
+}
+
+bool LogIndex::Save() const {
+  base::Pickle pickle;
+  pickle.WriteUInt32(kIndexMagic);
+  pickle.WriteUInt32(kIndexVersion);
+  pickle.WriteUInt64(inode_);
+  pickle.WriteInt64(indexed_size_);
+  pickle.WriteUInt32(lines_since_checkpoint_);
+  pickle.WriteInt64(ToMicroseconds(max_time_));
+  pickle.WriteUInt64(checkpoints_.size());
+  for (const Checkpoint& checkpoint : checkpoints_) {
+    pickle.WriteInt64(ToMicroseconds(checkpoint.time));
+    pickle.WriteInt64(ToMicroseconds(checkpoint.max_time));
+    pickle.WriteInt64(checkpoint.offset);
+  }
+
+  // The index is an optional cache. Failing to write it (e.g. the directory is
+  // not writable for the user) only makes the next run slower.
+  const base::StringPiece data(static_cast<const char*>(pickle.data()),
+                               pickle.size());
+  if (!base::CreateDirectory(index_file_.DirName()) ||
+      !base::ImportantFileWriter::WriteFileAtomically(index_file_, data)) {
+    VLOG(1) << "Failed to write the index file: " << index_file_;
+    return false;
+  }
+  return true;
+}
+
+void LogIndex::Reset(ino_t inode) {
+  inode_ = inode;
+  indexed_size_ = 0;
+  lines_since_checkpoint_ = 0;
+  max_time_ = base::Time();
+  checkpoints_.clear();
+}
+
+}  // namespace croslog
@@ -0,0 +1,94 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CROSLOG_LOG_INDEX_H_
+#define CROSLOG_LOG_INDEX_H_
+
+#include <sys/types.h>
+
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/time/time.h"
+
+#include "croslog/log_parser.h"
+
+namespace croslog {
+
+/*
+ * Sparse index of a log file, which maps the time of an entry to its offset
+ * every some lines, so that the reader can seek to a time directly instead of
+ * reading the whole file line by line.
+ * - The index is built incrementally: only lines appended since the last
+ *   update are scanned.
+ * - The index is persisted across runs in the index directory, keyed by the
+ *   inode and the indexed size of the log file. It is discarded when the file
+ *   is rotated (inode changes) or shrunk.
+ * - Entries are mostly in chronological order in a file, but the clock may go
+ *   backward. Each checkpoint keeps the latest time of the entries up to it,
+ *   so that seeking never skips an entry.
+ */
+class LogIndex {
+ public:
+  struct Checkpoint {
+    base::Time time;
+    // Latest time of the entries up to this one, which never decreases from a
+    // checkpoint to the next.
+    base::Time max_time;
+    // Offset of the beginning of the first line of the entry.
+    int64_t offset;
+  };
+
+  // Sets the directory to persist the index files.
+  static void SetIndexDirectoryForTest(const base::FilePath& directory);
+  // Sets the interval of checkpoints in lines.
+  static void SetLinesPerCheckpointForTest(uint32_t lines_per_checkpoint);
+
+  explicit LogIndex(const base::FilePath& log_file);
+  LogIndex(const LogIndex&) = delete;
+  LogIndex& operator=(const LogIndex&) = delete;
+
+  // Brings the index up to date with the log file, using |parser| to read the
+  // time of entries. The persisted index is loaded on the first call and the
+  // index is written back if it has grown. Returns false if the log file can't
+  // be read.
+  bool Update(LogParser* parser);
+
+  // Returns the offset of a line from which reading forward yields all the
+  // entries at or after |time|. Returns 0 if there is no such checkpoint.
+  int64_t FindOffset(base::Time time) const;
+
+  // Returns the size of the log file covered by the index.
+  int64_t indexed_size() const { return indexed_size_; }
+
+  const std::vector<Checkpoint>& checkpoints() const { return checkpoints_; }
+
+ private:
+  // Loads the persisted index. Returns false if there is no valid index.
+  bool Load();
+  // Writes the index to the index file atomically.
+  bool Save() const;
+  // Drops the index for the file with |inode|.
+  void Reset(ino_t inode);
+
+  const base::FilePath log_file_;
+  const base::FilePath index_file_;
+  bool loaded_ = false;
+
+  // Key of the index: the inode of the log file and the size of it up to the
+  // end of the last line indexed.
+  ino_t inode_ = 0;
+  int64_t indexed_size_ = 0;
+  // Lines read after the last checkpoint.
+  uint32_t lines_since_checkpoint_ = 0;
+  // Latest time of the entries indexed.
+  base::Time max_time_;
+
+  // Checkpoints in the order of offset.
+  std::vector<Checkpoint> checkpoints_;
+};
+
+}  // namespace croslog
+
+#endif  // CROSLOG_LOG_INDEX_H_
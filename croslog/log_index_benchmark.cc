@@ -0,0 +1,165 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Compares seeking to a time in a large synthetic log by reading it line by
+// line against seeking with LogIndex.
+// Usage: croslog_log_index_benchmark [--log_size_mb=1024] [benchmark flags]
+
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "base/at_exit.h"
+#include "base/check.h"
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_util.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "benchmark/benchmark.h"
+
+#include "croslog/log_entry_reader.h"
+#include "croslog/log_index.h"
+#include "croslog/log_parser_syslog.h"
+
+namespace croslog {
+
+namespace {
+
+constexpr char kLogSizeFlag[] = "--log_size_mb=";
+
+base::FilePath* g_log_file = nullptr;
+int g_log_lines = 0;
+
+// Returns the time of the |index|-th line in the synthetic log.
+base::Time GetLineTime(int index) {
+  return base::Time::UnixEpoch() + base::TimeDelta::FromDays(18400) +
+         base::TimeDelta::FromMilliseconds(index);
+}
+
+// Writes a synthetic syslog of about |size_mb| MiB and returns the number of
+// lines written.
+int WriteSyntheticLog(const base::FilePath& path, int size_mb) {
+  base::File file(path,
+                  base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE);
+  CHECK(file.IsValid());
+
+  const int64_t target_size = static_cast<int64_t>(size_mb) * 1024 * 1024;
+  int64_t written = 0;
+  int lines = 0;
+  std::string chunk;
+  while (written < target_size) {
+    base::Time::Exploded exploded;
+    GetLineTime(lines).UTCExplode(&exploded);
+    chunk += base::StringPrintf(
+        "%04d-%02d-%02dT%02d:%02d:%02d.%03d000Z INFO shill[%d]: "
+        "[INFO:manager.cc(%d)] Service %d state changed, line %d\n",
+        exploded.year, exploded.month, exploded.day_of_month, exploded.hour,
+        exploded.minute, exploded.second, exploded.millisecond,
+        1000 + lines % 7, lines % 3000, lines % 40, lines);
+    lines++;
+    if (chunk.size() >= 1024 * 1024) {
+      CHECK_EQ(static_cast<int>(chunk.size()),
+               file.WriteAtCurrentPos(chunk.data(), chunk.size()));
+      written += chunk.size();
+      chunk.clear();
+    }
+  }
+  return lines;
+}
+
+// Reads entries until the first one at or after |time|.
+void ReadUntil(LogEntryReader* reader, base::Time time) {
+  while (true) {
+    MaybeLogEntry e = reader->GetNextEntry();
+    CHECK(e.has_value());
+    if (e->time() >= time)
+      break;
+  }
+}
+
+// Seeks to the time at |range(0)| percent of the log by reading it forward.
+void BM_SeekLinear(benchmark::State& state) {
+  const base::Time target = GetLineTime(g_log_lines * state.range(0) / 100);
+  for (auto _ : state) {
+    LogEntryReader reader(*g_log_file, std::make_unique<LogParserSyslog>(),
+                          false);
+    ReadUntil(&reader, target);
+  }
+}
+BENCHMARK(BM_SeekLinear)
+    ->Unit(benchmark::kMillisecond)
+    ->Arg(10)
+    ->Arg(50)
+    ->Arg(90);
+
+// Seeks to the time at |range(0)| percent of the log with the persisted index.
+void BM_SeekIndexed(benchmark::State& state) {
+  const base::Time target = GetLineTime(g_log_lines * state.range(0) / 100);
+  {
+    // Builds the index beforehand, as a previous run would have.
+    LogIndex index(*g_log_file);
+    LogParserSyslog parser;
+    CHECK(index.Update(&parser));
+  }
+  for (auto _ : state) {
+    LogEntryReader reader(*g_log_file, std::make_unique<LogParserSyslog>(),
+                          false);
+    reader.SetPositionAt(target);
+    ReadUntil(&reader, target);
+  }
+}
+BENCHMARK(BM_SeekIndexed)
+    ->Unit(benchmark::kMillisecond)
+    ->Arg(10)
+    ->Arg(50)
+    ->Arg(90);
+
+// Builds the index from scratch (the cost paid once per log file).
+void BM_BuildIndex(benchmark::State& state) {
+  base::ScopedTempDir index_dir;
+  CHECK(index_dir.CreateUniqueTempDir());
+  LogIndex::SetIndexDirectoryForTest(index_dir.GetPath());
+  for (auto _ : state) {
+    state.PauseTiming();
+    CHECK(index_dir.Delete());
+    CHECK(index_dir.CreateUniqueTempDir());
+    LogIndex::SetIndexDirectoryForTest(index_dir.GetPath());
+    state.ResumeTiming();
+
+    LogIndex index(*g_log_file);
+    LogParserSyslog parser;
+    CHECK(index.Update(&parser));
+  }
+}
+BENCHMARK(BM_BuildIndex)->Unit(benchmark::kMillisecond)->Iterations(1);
+
+}  // namespace
+
+}  // namespace croslog
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit;
+
+  int log_size_mb = 1024;
+  for (int i = 1; i < argc; i++) {
+    if (base::StartsWith(argv[i], croslog::kLogSizeFlag))
+      CHECK(base::StringToInt(argv[i] + strlen(croslog::kLogSizeFlag),
+                              &log_size_mb));
+  }
+
+  base::ScopedTempDir temp_dir;
+  CHECK(temp_dir.CreateUniqueTempDir());
+  base::FilePath log_file = temp_dir.GetPath().Append("messages");
+  croslog::g_log_file = &log_file;
+  croslog::g_log_lines = croslog::WriteSyntheticLog(log_file, log_size_mb);
+  croslog::LogIndex::SetIndexDirectoryForTest(
+      temp_dir.GetPath().Append("index"));
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,208 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "croslog/log_index.h"
+
+#include <memory>
+#include <string>
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "gtest/gtest.h"
+
+#include "croslog/log_entry_reader.h"
+#include "croslog/log_parser_syslog.h"
+
+namespace croslog {
+
+namespace {
+
+// Returns a syslog line of the |second|-th second since 2020-05-25 00:00:00Z.
+std::string MakeLine(int second) {
+  return base::StringPrintf(
+      "2020-05-25T00:%02d:%02d.000000Z INFO sshd[%03d]: message %03d\n",
+      second / 60, second % 60, second, second);
+}
+
+base::Time MakeTime(int second) {
+  base::Time time;
+  EXPECT_TRUE(base::Time::FromString(
+      base::StringPrintf("2020-05-25T00:%02d:%02d.000000Z", second / 60,
+                         second % 60)
+          .c_str(),
+      &time));
+  return time;
+}
+
+}  // namespace
+
+class LogIndexTest : public ::testing::Test {
+ public:
+  LogIndexTest() = default;
+  LogIndexTest(const LogIndexTest&) = delete;
+  LogIndexTest& operator=(const LogIndexTest&) = delete;
+
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    log_file_ = temp_dir_.GetPath().Append("messages");
+    LogIndex::SetIndexDirectoryForTest(temp_dir_.GetPath().Append("index"));
+    LogIndex::SetLinesPerCheckpointForTest(2);
+  }
+
+  void TearDown() override { LogIndex::SetLinesPerCheckpointForTest(4096); }
+
+  // Writes the lines of [begin, end) seconds to the log file.
+  void WriteLines(int begin, int end, bool append) {
+    std::string content;
+    for (int i = begin; i < end; i++)
+      content += MakeLine(i);
+    if (append)
+      ASSERT_TRUE(base::AppendToFile(log_file_, content));
+    else
+      ASSERT_EQ(static_cast<int>(content.size()),
+                base::WriteFile(log_file_, content.data(), content.size()));
+  }
+
+  // Returns the offset of the line of |second| in the log file.
+  int64_t OffsetOf(int second) { return MakeLine(0).size() * second; }
+
+ protected:
+  base::ScopedTempDir temp_dir_;
+  base::FilePath log_file_;
+  LogParserSyslog parser_;
+};
+
+TEST_F(LogIndexTest, Update) {
+  WriteLines(0, 10, /*append=*/false);
+
+  LogIndex index(log_file_);
+  EXPECT_TRUE(index.Update(&parser_));
+  EXPECT_EQ(OffsetOf(10), index.indexed_size());
+
+  // Checkpoints every 2 lines.
+  ASSERT_EQ(4u, index.checkpoints().size());
+  for (int i = 0; i < 4; i++) {
+    EXPECT_EQ(MakeTime(i * 2 + 2), index.checkpoints()[i].time);
+    EXPECT_EQ(OffsetOf(i * 2 + 2), index.checkpoints()[i].offset);
+  }
+
+  EXPECT_EQ(0, index.FindOffset(MakeTime(0)));
+  EXPECT_EQ(0, index.FindOffset(MakeTime(2)));
+  EXPECT_EQ(OffsetOf(2), index.FindOffset(MakeTime(3)));
+  EXPECT_EQ(OffsetOf(6), index.FindOffset(MakeTime(7)));
+  EXPECT_EQ(OffsetOf(8), index.FindOffset(MakeTime(100)));
+}
+
+TEST_F(LogIndexTest, ClockGoesBackward) {
+  // The clock goes back from 50s to 10s between the checkpoints of the lines
+  // 2 and 4, which are both before 40s.
+  std::string content;
+  for (int second : {0, 1, 2, 50, 10, 11, 12, 13, 14, 15})
+    content += MakeLine(second);
+  ASSERT_EQ(static_cast<int>(content.size()),
+            base::WriteFile(log_file_, content.data(), content.size()));
+
+  LogIndex index(log_file_);
+  EXPECT_TRUE(index.Update(&parser_));
+  ASSERT_EQ(4u, index.checkpoints().size());
+  EXPECT_EQ(MakeTime(10), index.checkpoints()[1].time);
+  EXPECT_EQ(MakeTime(50), index.checkpoints()[1].max_time);
+
+  // Reading from the checkpoint of the line 2 yields the entry of 50s.
+  EXPECT_EQ(OffsetOf(2), index.FindOffset(MakeTime(40)));
+  EXPECT_EQ(OffsetOf(2), index.FindOffset(MakeTime(13)));
+  EXPECT_EQ(0, index.FindOffset(MakeTime(2)));
+}
+
+TEST_F(LogIndexTest, UpdateIncrementally) {
+  WriteLines(0, 5, /*append=*/false);
+  LogIndex index(log_file_);
+  EXPECT_TRUE(index.Update(&parser_));
+  EXPECT_EQ(2u, index.checkpoints().size());
+
+  WriteLines(5, 10, /*append=*/true);
+  EXPECT_TRUE(index.Update(&parser_));
+  EXPECT_EQ(OffsetOf(10), index.indexed_size());
+  ASSERT_EQ(4u, index.checkpoints().size());
+  EXPECT_EQ(OffsetOf(6), index.checkpoints()[2].offset);
+  EXPECT_EQ(OffsetOf(8), index.checkpoints()[3].offset);
+}
+
+TEST_F(LogIndexTest, IncompleteLastLine) {
+  WriteLines(0, 4, /*append=*/false);
+  const std::string partial = "2020-05-25T00:00:04.000000Z INFO";
+  ASSERT_TRUE(base::AppendToFile(log_file_, partial));
+
+  LogIndex index(log_file_);
+  EXPECT_TRUE(index.Update(&parser_));
+  // The incomplete line is left for the next update.
+  EXPECT_EQ(OffsetOf(4), index.indexed_size());
+}
+
+TEST_F(LogIndexTest, Persistence) {
+  WriteLines(0, 10, /*append=*/false);
+  {
+    LogIndex index(log_file_);
+    EXPECT_TRUE(index.Update(&parser_));
+  }
+
+  // The index is loaded from the index file without scanning the log file,
+  // so the checkpoints are kept even with a different interval.
+  LogIndex::SetLinesPerCheckpointForTest(100);
+  LogIndex index(log_file_);
+  EXPECT_TRUE(index.Update(&parser_));
+  EXPECT_EQ(OffsetOf(10), index.indexed_size());
+  ASSERT_EQ(4u, index.checkpoints().size());
+  EXPECT_EQ(MakeTime(8), index.checkpoints()[3].time);
+  EXPECT_EQ(MakeTime(8), index.checkpoints()[3].max_time);
+}
+
+TEST_F(LogIndexTest, Rotation) {
+  WriteLines(0, 10, /*append=*/false);
+  {
+    LogIndex index(log_file_);
+    EXPECT_TRUE(index.Update(&parser_));
+  }
+
+  // Replaces the file with a new one with a different inode.
+  ASSERT_TRUE(base::Move(log_file_, temp_dir_.GetPath().Append("messages.1")));
+  WriteLines(100, 105, /*append=*/false);
+
+  LogIndex index(log_file_);
+  EXPECT_TRUE(index.Update(&parser_));
+  EXPECT_EQ(OffsetOf(5), index.indexed_size());
+  ASSERT_EQ(2u, index.checkpoints().size());
+  EXPECT_EQ(MakeTime(102), index.checkpoints()[0].time);
+}
+
+TEST_F(LogIndexTest, NonExistentFile) {
+  LogIndex index(log_file_);
+  EXPECT_FALSE(index.Update(&parser_));
+  EXPECT_EQ(0, index.FindOffset(MakeTime(0)));
+}
+
+TEST_F(LogIndexTest, LogEntryReaderSetPositionAt) {
+  WriteLines(0, 10, /*append=*/false);
+
+  LogEntryReader reader(log_file_, std::make_unique<LogParserSyslog>(), false);
+  reader.SetPositionAt(MakeTime(5));
+  {
+    // Reading starts from the checkpoint preceding the time.
+    MaybeLogEntry e = reader.GetNextEntry();
+    ASSERT_TRUE(e.has_value());
+    EXPECT_EQ(MakeTime(4), e->time());
+  }
+
+  reader.SetPositionAt(MakeTime(0));
+  {
+    MaybeLogEntry e = reader.GetNextEntry();
+    ASSERT_TRUE(e.has_value());
+    EXPECT_EQ(MakeTime(0), e->time());
+  }
+}
+
+}  // namespace croslog
@@ -105,8 +105,7 @@ void LogLineReader::SetPositionLast() {
   CHECK(buffer->valid()) << "Mmap failed. Maybe the file has been truncated.";
 
   // Traverses in reverse order to find the last LF.
-  while (pos_ > pos_traversal_start && buffer->GetChar(pos_ - 1) != '\n')
-    pos_--;
+  pos_ = buffer->FindLineStart(pos_traversal_start, pos_);
 
   if (pos_ != 0 && pos_ <= pos_traversal_start) {
     LOG(ERROR) << "The last line is too long to handle (more than: "
@@ -117,6 +116,12 @@ void LogLineReader::SetPositionLast() {
   }
 }
 
+void LogLineReader::SetPosition(int64_t pos) {
+  CHECK_GE(pos, 0);
+  CHECK_LE(pos, reader_->GetFileSize());
+  pos_ = pos;
+}
+
 // Ensure the file path is initialized.
 void LogLineReader::ReloadRotatedFile() {
   CHECK(backend_mode_ == Backend::FILE_FOLLOW);
@@ -184,12 +189,7 @@ std::tuple<std::string, LogLineReader::ReadResult> LogLineReader::Forward() {
   }
 
   // Finds the next LF (end of line).
-  int64_t pos_line_end = pos_;
-
-  while (pos_line_end < pos_traversal_end &&
-         buffer->GetChar(pos_line_end) != '\n') {
-    pos_line_end++;
-  }
+  int64_t pos_line_end = buffer->FindLineFeed(pos_, pos_traversal_end);
 
   if (pos_line_end == reader_->GetFileSize()) {
     // Reaches EOF without '\n'.
@@ -263,11 +263,7 @@ std::tuple<std::string, LogLineReader::ReadResult> LogLineReader::Backward() {
   }
 
   // Finds the next LF (at the beginning of the line).
-  int64_t last_start = pos_ - 1;
-  while (last_start > pos_traversal_start &&
-         buffer->GetChar(last_start - 1) != '\n') {
-    last_start--;
-  }
+  int64_t last_start = buffer->FindLineStart(pos_traversal_start, pos_ - 1);
 
   // Ensures the next LF is found.
   if (last_start != 0 && last_start <= pos_traversal_start) {
@@ -70,6 +70,9 @@ class LogLineReader : public FileChangeWatcher::Observer {
 
   // Set the position to read last.
   void SetPositionLast();
+  // Set the position to read next. |pos| must be at the beginning of a line
+  // and in the interval of [0, file size].
+  void SetPosition(int64_t pos);
   // Add a observer to retrieve file change events.
   void AddObserver(Observer* obs);
   // Remove a observer to retrieve file change events.
@@ -81,6 +84,15 @@ class LogLineReader : public FileChangeWatcher::Observer {
   // Returns the file path of the target.
   const base::FilePath& file_path() const { return file_path_; }
 
+  // Returns true if the file (or the memory buffer) is opened successfully.
+  bool is_open() const { return reader_ != nullptr; }
+
+  // Returns the inode of the target file, or 0 for the memory buffer.
+  ino_t file_inode() const { return file_inode_; }
+
+  // Returns the size of the target as of the last file change event.
+  int64_t GetFileSize() const { return reader_->GetFileSize(); }
+
  private:
   void ReloadRotatedFile();
   void OnFileContentMaybeChanged() override;
@@ -39,4 +39,22 @@ MaybeLogEntry LogParser::Parse(std::string&& entire_line) {
   return ParseInternal(std::move(entire_line));
 }
 
+base::Optional<base::Time> LogParser::ParseEntryTime(
+    base::StringPiece entire_line) {
+  // Same as Parse() for crbug.com/1132182, without the warning.
+  size_t null_len = 0;
+  while (null_len < entire_line.size() && entire_line[null_len] == '\0')
+    null_len++;
+
+  return ParseEntryTimeInternal(entire_line.substr(null_len));
+}
+
+base::Optional<base::Time> LogParser::ParseEntryTimeInternal(
+    base::StringPiece entire_line) {
+  MaybeLogEntry entry = ParseInternal(entire_line.as_string());
+  if (!entry.has_value())
+    return base::nullopt;
+  return entry->time();
+}
+
 }  // namespace croslog
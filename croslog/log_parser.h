@@ -10,6 +10,8 @@
 #include <string>
 
 #include "base/optional.h"
+#include "base/strings/string_piece.h"
+#include "base/time/time.h"
 
 namespace croslog {
 
@@ -21,8 +23,15 @@ class LogParser {
 
   MaybeLogEntry Parse(std::string&& entire_line);
 
+  // Returns the time of the entry if the line is the first line of an entry,
+  // as Parse() does, without materializing the entry.
+  base::Optional<base::Time> ParseEntryTime(base::StringPiece entire_line);
+
  protected:
   virtual MaybeLogEntry ParseInternal(std::string&& entire_line) = 0;
+  // The default implementation calls ParseInternal() on a copy of the line.
+  virtual base::Optional<base::Time> ParseEntryTimeInternal(
+      base::StringPiece entire_line);
 };
 
 }  // namespace croslog
@@ -0,0 +1,160 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Compares parsing syslog lines into owning LogEntry objects against parsing
+// them into LogEntryView. The inputs are the lines of log_parser_syslog_test
+// and croslog/testdata, plus the files in the fuzzer corpus directory if given
+// (one input per file, as for croslog_log_parser_fuzzer).
+// Usage (from the croslog directory):
+//   croslog_log_parser_benchmark [--corpus_dir=DIR] [benchmark flags]
+
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/at_exit.h"
+#include "base/check.h"
+#include "base/files/file_enumerator.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/strings/string_split.h"
+#include "base/strings/string_util.h"
+#include "base/time/time.h"
+#include "benchmark/benchmark.h"
+
+#include "croslog/log_parser_syslog.h"
+
+namespace croslog {
+
+namespace {
+
+constexpr char kCorpusDirFlag[] = "--corpus_dir=";
+
+// The inputs of log_parser_syslog_test.
+constexpr const char* kTestLines[] = {
+    "2020-05-25T14:15:22.402258+09:00 ERROR tag[0123]: MESSAGE",
+    "2020-05-25T14:15:22.402258+09:00 INFO kernel: MESSAGE",
+    "2020-05-25T14:15:22.402258+09:00 ERROR tag[0123] MESSAGE",
+    "2020-05-25T14:15:22.402258+09:00 ERROR tag MESSAGE",
+    "2020-05-25T14:15:22.402258+09:00 ERROR MESSAGE",
+    "2020-05-25T14:15:22.402258+09:00 MESSAGE",
+    "2020-05-25T14:15:22.402258Z",
+    "2020-05-25T14:15:22.402258+09:00",
+    "2020-05-25T14:15:22.402258",
+    "2020-05-25T14:15:22.402258+09:0",
+    "2020-05-25T14:15:22.402258+09:00 ERROR tag[0123 MESSAGE",
+};
+
+std::vector<std::string>* g_inputs = nullptr;
+
+void LoadInputs(const base::FilePath& corpus_dir) {
+  g_inputs = new std::vector<std::string>(std::begin(kTestLines),
+                                          std::end(kTestLines));
+
+  base::FileEnumerator files(base::FilePath("./testdata"), /*recursive=*/false,
+                             base::FileEnumerator::FILES);
+  for (base::FilePath path = files.Next(); !path.empty(); path = files.Next()) {
+    std::string content;
+    CHECK(base::ReadFileToString(path, &content));
+    for (auto& line : base::SplitString(content, "\n", base::KEEP_WHITESPACE,
+                                        base::SPLIT_WANT_NONEMPTY)) {
+      g_inputs->push_back(std::move(line));
+    }
+  }
+
+  if (!corpus_dir.empty()) {
+    base::FileEnumerator corpus(corpus_dir, /*recursive=*/false,
+                                base::FileEnumerator::FILES);
+    for (base::FilePath path = corpus.Next(); !path.empty();
+         path = corpus.Next()) {
+      std::string content;
+      CHECK(base::ReadFileToString(path, &content));
+      g_inputs->push_back(std::move(content));
+    }
+  }
+}
+
+size_t GetInputsSize() {
+  size_t size = 0;
+  for (const auto& input : *g_inputs)
+    size += input.size();
+  return size;
+}
+
+// Parses into LogEntry, copying the line first since Parse() consumes it.
+void BM_Parse(benchmark::State& state) {
+  LogParserSyslog parser;
+  for (auto _ : state) {
+    for (const auto& input : *g_inputs) {
+      MaybeLogEntry entry = parser.Parse(std::string(input));
+      benchmark::DoNotOptimize(entry);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * g_inputs->size());
+  state.SetBytesProcessed(state.iterations() * GetInputsSize());
+}
+BENCHMARK(BM_Parse);
+
+void BM_ParseView(benchmark::State& state) {
+  LogParserSyslog parser;
+  LogEntryView view;
+  for (auto _ : state) {
+    for (const auto& input : *g_inputs) {
+      bool result = parser.ParseView(input, &view);
+      benchmark::DoNotOptimize(result);
+      benchmark::DoNotOptimize(view);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * g_inputs->size());
+  state.SetBytesProcessed(state.iterations() * GetInputsSize());
+}
+BENCHMARK(BM_ParseView);
+
+// The time parser which LogParserSyslog used to use, as the baseline of the
+// time parsing part.
+void BM_TimeFromString(benchmark::State& state) {
+  const char kTime[] = "2020-05-25T14:15:22.402258+09:00";
+  base::Time time;
+  for (auto _ : state) {
+    bool result = base::Time::FromString(kTime, &time);
+    benchmark::DoNotOptimize(result);
+    benchmark::DoNotOptimize(time);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TimeFromString);
+
+void BM_ParseViewTimeOnly(benchmark::State& state) {
+  LogParserSyslog parser;
+  LogEntryView view;
+  const std::string line = "2020-05-25T14:15:22.402258+09:00 ";
+  for (auto _ : state) {
+    bool result = parser.ParseView(line, &view);
+    benchmark::DoNotOptimize(result);
+    benchmark::DoNotOptimize(view);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseViewTimeOnly);
+
+}  // namespace
+
+}  // namespace croslog
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit;
+
+  base::FilePath corpus_dir;
+  for (int i = 1; i < argc; i++) {
+    if (base::StartsWith(argv[i], croslog::kCorpusDirFlag))
+      corpus_dir = base::FilePath(argv[i] + strlen(croslog::kCorpusDirFlag));
+  }
+  croslog::LoadInputs(corpus_dir);
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -29,6 +29,9 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
   LogParserAudit().Parse(std::string(data_string));
   LogParserSyslog().Parse(std::string(data_string));
 
+  LogEntryView view;
+  LogParserSyslog().ParseView(data_string, &view);
+
   return 0;
 }
 
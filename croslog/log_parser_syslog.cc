@@ -17,35 +17,110 @@ namespace {
 constexpr size_t kTimeStringLengthWithTimeZone = 32;
 // The length of time string like "2020-05-25T00:00:00.000000Z".
 constexpr size_t kTimeStringLengthUTC = 27;
+// The position of the time-zone designator in the time string.
+constexpr size_t kTimeZonePos = 26;
+
+// Parses |length| decimal digits at |pos|. Returns false if any of them is not
+// a digit.
+bool ParseDigits(base::StringPiece str, size_t pos, size_t length, int* out) {
+  int value = 0;
+  for (size_t i = pos; i < pos + length; i++) {
+    if (str[i] < '0' || str[i] > '9')
+      return false;
+    value = value * 10 + (str[i] - '0');
+  }
+  *out = value;
+  return true;
+}
 
-int ParseTime(const std::string& entire_line, base::Time* time) {
-  DCHECK_NE(nullptr, time);
+bool IsLeapYear(int year) {
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
 
-  if (entire_line[26] == 'Z') {
-    // Case of UTC time format like "2020-05-25T00:00:00.000000Z".
-    if (entire_line.length() < kTimeStringLengthUTC)
-      return -1;
-    std::string log_time = entire_line.substr(0, kTimeStringLengthUTC);
+int DaysInMonth(int year, int month) {
+  constexpr int kDaysInMonth[] = {31, 28, 31, 30, 31, 30,
+                                  31, 31, 30, 31, 30, 31};
+  if (month == 2 && IsLeapYear(year))
+    return 29;
+  return kDaysInMonth[month - 1];
+}
 
-    bool result = base::Time::FromString(log_time.c_str(), time);
-    if (!result)
-      return -1;
+// Returns the number of days since 1970-01-01 of the given date in the
+// proleptic Gregorian calendar.
+int64_t DaysFromCivil(int year, int month, int day) {
+  // Counts years from March, so that the leap day is the last day of a year.
+  const int64_t y = year - (month <= 2 ? 1 : 0);
+  const int64_t era = (y >= 0 ? y : y - 399) / 400;
+  const int64_t year_of_era = y - era * 400;
+  const int64_t day_of_year =
+      (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  const int64_t day_of_era =
+      year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  // 719468 is the number of days from 0000-03-01 to 1970-01-01.
+  return era * 146097 + day_of_era - 719468;
+}
+
+// Parses the fixed-format RFC3339 time at the beginning of |entire_line|, like
+// "2020-05-25T00:00:00.000000Z" or "2020-05-25T00:00:00.000000+00:00".
+// Returns the length of the time string, or -1 on failure. This is much faster
+// than base::Time::FromString(), which accepts many other formats.
+int ParseTime(base::StringPiece entire_line, base::Time* time) {
+  DCHECK_NE(nullptr, time);
+
+  if (entire_line.length() < kTimeStringLengthUTC)
+    return -1;
 
-    return kTimeStringLengthUTC;
-  } else if (entire_line[26] == '+' || entire_line[26] == '-') {
+  int time_string_length;
+  int offset_minutes = 0;
+  if (entire_line[kTimeZonePos] == 'Z') {
+    // Case of UTC time format like "2020-05-25T00:00:00.000000Z".
+    time_string_length = kTimeStringLengthUTC;
+  } else if (entire_line[kTimeZonePos] == '+' ||
+             entire_line[kTimeZonePos] == '-') {
     // Case of format with time-zone like "2020-05-25T00:00:00.000000+00:00".
     if (entire_line.length() < kTimeStringLengthWithTimeZone)
       return -1;
-    std::string log_time = entire_line.substr(0, kTimeStringLengthWithTimeZone);
-
-    bool result = base::Time::FromString(log_time.c_str(), time);
-    if (!result)
+    int offset_hour, offset_minute;
+    if (!ParseDigits(entire_line, 27, 2, &offset_hour) ||
+        entire_line[29] != ':' ||
+        !ParseDigits(entire_line, 30, 2, &offset_minute) || offset_hour > 23 ||
+        offset_minute > 59) {
       return -1;
+    }
+    offset_minutes = offset_hour * 60 + offset_minute;
+    if (entire_line[kTimeZonePos] == '-')
+      offset_minutes = -offset_minutes;
+    time_string_length = kTimeStringLengthWithTimeZone;
+  } else {
+    return -1;
+  }
+
+  int year, month, day, hour, minute, second, microsecond;
+  if (!ParseDigits(entire_line, 0, 4, &year) || entire_line[4] != '-' ||
+      !ParseDigits(entire_line, 5, 2, &month) || entire_line[7] != '-' ||
+      !ParseDigits(entire_line, 8, 2, &day) || entire_line[10] != 'T' ||
+      !ParseDigits(entire_line, 11, 2, &hour) || entire_line[13] != ':' ||
+      !ParseDigits(entire_line, 14, 2, &minute) || entire_line[16] != ':' ||
+      !ParseDigits(entire_line, 17, 2, &second) || entire_line[19] != '.' ||
+      !ParseDigits(entire_line, 20, 6, &microsecond)) {
+    return -1;
+  }
 
-    return kTimeStringLengthWithTimeZone;
+  // A leap second (60) is accepted and rolls over to the next minute.
+  if (month < 1 || month > 12 || day < 1 || day > DaysInMonth(year, month) ||
+      hour > 23 || minute > 59 || second > 60) {
+    return -1;
   }
 
-  return -1;
+  const int64_t microseconds_since_epoch =
+      DaysFromCivil(year, month, day) * base::Time::kMicrosecondsPerDay +
+      hour * base::Time::kMicrosecondsPerHour +
+      (minute - offset_minutes) * base::Time::kMicrosecondsPerMinute +
+      second * base::Time::kMicrosecondsPerSecond + microsecond;
+  *time = base::Time::UnixEpoch() +
+          base::TimeDelta::FromMicroseconds(microseconds_since_epoch);
+
+  return time_string_length;
 }
 
 }  // namespace
@@ -54,39 +129,35 @@ namespace croslog {
 
 LogParserSyslog::LogParserSyslog() = default;
 
-MaybeLogEntry LogParserSyslog::ParseInternal(std::string&& entire_line) {
+bool LogParserSyslog::ParseView(base::StringPiece entire_line,
+                                LogEntryView* view) const {
+  DCHECK_NE(nullptr, view);
+
   if (entire_line.empty()) {
     // Returns an invalid value if the line is invalid or empty.
-    return base::nullopt;
-  }
-
-  if (entire_line.size() < kTimeStringLengthUTC) {
-    // Parse failed. Maybe this line doesn't contains a header.
-    return base::nullopt;
+    return false;
   }
 
   base::Time time;
   int message_start_pos = ParseTime(entire_line, &time);
   if (message_start_pos < 0) {
     // Parse failed. Maybe this line doesn't contains a header.
-    return base::nullopt;
+    return false;
   }
   DCHECK_LE(message_start_pos, entire_line.length());
 
-  int pos = message_start_pos;
-  if (entire_line[pos] != ' ') {
+  size_t pos = message_start_pos;
+  if (pos >= entire_line.size() || entire_line[pos] != ' ') {
     // Parse failed. Maybe this line doesn't contains a header.
-    return base::nullopt;
+    return false;
   }
 
-  std::string severity_str;
-  if (entire_line[pos] == ' ') {
-    for (int i = pos + 1; i < entire_line.size(); i++) {
-      if (entire_line[i] == ' ') {
-        severity_str = entire_line.substr(pos + 1, i - pos - 1);
-        pos = i;
-        break;
-      }
+  base::StringPiece severity_str;
+  for (size_t i = pos + 1; i < entire_line.size(); i++) {
+    if (entire_line[i] == ' ') {
+      severity_str = entire_line.substr(pos + 1, i - pos - 1);
+      pos = i;
+      break;
     }
   }
 
@@ -95,9 +166,9 @@ MaybeLogEntry LogParserSyslog::ParseInternal(std::string&& entire_line) {
     severity = SeverityFromString(severity_str);
   }
 
-  std::string tag;
+  base::StringPiece tag;
   if (entire_line[pos] == ' ') {
-    for (int i = pos + 1; i < entire_line.size(); i++) {
+    for (size_t i = pos + 1; i < entire_line.size(); i++) {
       if (entire_line[i] == '[' || entire_line[i] == ':' ||
           entire_line[i] == ' ') {
         tag = entire_line.substr(pos + 1, i - pos - 1);
@@ -109,10 +180,9 @@ MaybeLogEntry LogParserSyslog::ParseInternal(std::string&& entire_line) {
 
   int pid = -1;
   if (entire_line[pos] == '[') {
-    for (int i = pos + 1; i < entire_line.size(); i++) {
+    for (size_t i = pos + 1; i < entire_line.size(); i++) {
       if (entire_line[i] == ']') {
-        std::string pid_str = entire_line.substr(pos + 1, i - pos - 1);
-        if (!base::StringToInt(pid_str, &pid))
+        if (!base::StringToInt(entire_line.substr(pos + 1, i - pos - 1), &pid))
           pid = -1;
         pos = i + 1;
         break;
@@ -123,7 +193,7 @@ MaybeLogEntry LogParserSyslog::ParseInternal(std::string&& entire_line) {
   if (entire_line.size() > pos && entire_line[pos] == ':')
     pos++;
 
-  std::string message;
+  base::StringPiece message;
   if (entire_line.size() > pos) {
     if (entire_line[pos] == ' ') {
       ++pos;
@@ -131,14 +201,41 @@ MaybeLogEntry LogParserSyslog::ParseInternal(std::string&& entire_line) {
       // Parse failed. Maybe this line doesn't contains a header.
       // Note that the '[' character can happen when there's incomplete closing
       // brace for PID that's parsed above.
-      return base::nullopt;
+      return false;
     }
 
-    message = entire_line.substr(pos, entire_line.size() - pos);
+    message = entire_line.substr(pos);
   }
 
-  return LogEntry{time, severity,           std::move(tag),
-                  pid,  std::move(message), std::move(entire_line)};
+  view->time = time;
+  view->severity = severity;
+  view->tag = tag;
+  view->pid = pid;
+  view->message = message;
+  view->entire_line = entire_line;
+  return true;
+}
+
+MaybeLogEntry LogParserSyslog::ParseInternal(std::string&& entire_line) {
+  LogEntryView view;
+  if (!ParseView(entire_line, &view))
+    return base::nullopt;
+
+  // Only the tag and the message are copied. The line itself is moved.
+  return LogEntry{view.time,
+                  view.severity,
+                  view.tag.as_string(),
+                  view.pid,
+                  view.message.as_string(),
+                  std::move(entire_line)};
+}
+
+base::Optional<base::Time> LogParserSyslog::ParseEntryTimeInternal(
+    base::StringPiece entire_line) {
+  LogEntryView view;
+  if (!ParseView(entire_line, &view))
+    return base::nullopt;
+  return view.time;
 }
 
 }  // namespace croslog
@@ -9,6 +9,8 @@
 
 #include <string>
 
+#include "base/strings/string_piece.h"
+
 namespace croslog {
 
 class LogParserSyslog : public LogParser {
@@ -17,8 +19,15 @@ class LogParserSyslog : public LogParser {
   LogParserSyslog(const LogParserSyslog&) = delete;
   LogParserSyslog& operator=(const LogParserSyslog&) = delete;
 
+  // Parses the line without copying any part of it. On success, fills |view|
+  // with the fields which refer to |entire_line| and returns true. Unlike
+  // Parse(), this doesn't strip leading NULLs.
+  bool ParseView(base::StringPiece entire_line, LogEntryView* view) const;
+
  private:
   MaybeLogEntry ParseInternal(std::string&& entire_line) override;
+  base::Optional<base::Time> ParseEntryTimeInternal(
+      base::StringPiece entire_line) override;
 };
 
 }  // namespace croslog
@@ -9,6 +9,7 @@
 #include <utility>
 
 #include "base/files/file_path.h"
+#include "base/time/time.h"
 #include "gtest/gtest.h"
 
 #include "croslog/log_line_reader.h"
@@ -241,4 +242,91 @@ TEST_F(LogParserSyslogTest, ParseInvalid) {
   }
 }
 
+TEST_F(LogParserSyslogTest, ParseView) {
+  LogParserSyslog parser;
+
+  const std::string line =
+      "2020-05-25T14:15:22.402258+09:00 ERROR tag[0123]: MESSAGE";
+  LogEntryView view;
+  EXPECT_TRUE(parser.ParseView(line, &view));
+
+  EXPECT_EQ(TimeFromExploded(2020, 5, 25, 14, 15, 22, 402258, +9), view.time);
+  EXPECT_EQ(Severity::ERROR, view.severity);
+  EXPECT_EQ("tag", view.tag);
+  EXPECT_EQ(123, view.pid);
+  EXPECT_EQ("MESSAGE", view.message);
+
+  // The fields refer to the original buffer.
+  EXPECT_EQ(line.data(), view.entire_line.data());
+  EXPECT_EQ(line.size(), view.entire_line.size());
+  EXPECT_EQ(line.data() + 39, view.tag.data());
+  EXPECT_EQ(line.data() + 50, view.message.data());
+
+  LogEntry e = view.ToLogEntry();
+  EXPECT_EQ(line, e.entire_line());
+  EXPECT_EQ(view.time, e.time());
+  EXPECT_EQ("tag", e.tag());
+  EXPECT_EQ("MESSAGE", e.message());
+
+  EXPECT_FALSE(parser.ParseView("", &view));
+  EXPECT_FALSE(parser.ParseView("2020-05-25T14:15:22.402258+09:00", &view));
+}
+
+TEST_F(LogParserSyslogTest, ParseEntryTime) {
+  LogParserSyslog parser;
+
+  EXPECT_EQ(TimeFromExploded(2020, 5, 25, 14, 15, 22, 402258, +9),
+            parser.ParseEntryTime(
+                "2020-05-25T14:15:22.402258+09:00 ERROR tag[0123]: MESSAGE"));
+  // Leading NULLs are skipped as Parse() does.
+  const std::string line_with_nulls =
+      std::string(2, '\0') + "2020-05-25T14:15:22.402258+09:00 INFO tag: M";
+  EXPECT_EQ(TimeFromExploded(2020, 5, 25, 14, 15, 22, 402258, +9),
+            parser.ParseEntryTime(line_with_nulls));
+
+  EXPECT_FALSE(parser.ParseEntryTime("").has_value());
+  EXPECT_FALSE(parser.ParseEntryTime("continuation line").has_value());
+  EXPECT_FALSE(
+      parser.ParseEntryTime("2020-05-25T14:15:22.402258+09:00").has_value());
+}
+
+TEST_F(LogParserSyslogTest, ParseTime) {
+  LogParserSyslog parser;
+  LogEntryView view;
+
+  EXPECT_TRUE(
+      parser.ParseView("2020-05-25T05:15:22.402258Z INFO tag: M", &view));
+  EXPECT_EQ(TimeFromExploded(2020, 5, 25, 14, 15, 22, 402258, +9), view.time);
+
+  EXPECT_TRUE(
+      parser.ParseView("2020-05-24T20:45:22.402258-08:30 INFO tag: M", &view));
+  EXPECT_EQ(TimeFromExploded(2020, 5, 25, 14, 15, 22, 402258, +9), view.time);
+
+  // Leap day.
+  EXPECT_TRUE(
+      parser.ParseView("2020-02-29T23:59:59.999999+00:00 INFO tag: M", &view));
+  base::Time expected;
+  EXPECT_TRUE(
+      base::Time::FromString("2020-02-29T23:59:59.999999+00:00", &expected));
+  EXPECT_EQ(expected, view.time);
+
+  // Out-of-range fields.
+  EXPECT_FALSE(
+      parser.ParseView("2021-02-29T00:00:00.000000+00:00 INFO tag: M", &view));
+  EXPECT_FALSE(
+      parser.ParseView("2020-13-01T00:00:00.000000+00:00 INFO tag: M", &view));
+  EXPECT_FALSE(
+      parser.ParseView("2020-05-25T24:00:00.000000+00:00 INFO tag: M", &view));
+  EXPECT_FALSE(
+      parser.ParseView("2020-05-25T00:00:00.000000+24:00 INFO tag: M", &view));
+
+  // Malformed fields.
+  EXPECT_FALSE(
+      parser.ParseView("2020-05-25 00:00:00.000000+00:00 INFO tag: M", &view));
+  EXPECT_FALSE(
+      parser.ParseView("2020-05-25T00:00:00.00000a+00:00 INFO tag: M", &view));
+  EXPECT_FALSE(
+      parser.ParseView("2020-05-25T00:00:00.000000+0000 INFO tag: M", &view));
+}
+
 }  // namespace croslog
@@ -8,6 +8,7 @@
 #include <base/command_line.h>
 #include <base/logging.h>
 #include <base/task/single_thread_task_executor.h>
+#include <base/task/thread_pool/thread_pool_instance.h>
 
 #include <brillo/flag_helper.h>
 #include <brillo/syslog_logging.h>
@@ -51,9 +52,18 @@ int main(int argc, char* argv[]) {
       base::SingleThreadTaskExecutor task_executor(base::MessagePumpType::IO);
       base::AtExitManager at_exit_manager_;
 
-      // TODO(yoshiki): Implement the reader of plaintext logs.
-      croslog::ViewerPlaintext viewer(config);
-      return viewer.Run() ? 0 : 1;
+      // Worker threads to parse the logs ahead.
+      base::ThreadPoolInstance::CreateAndStartWithDefaultParams("croslog");
+
+      bool result;
+      {
+        // TODO(yoshiki): Implement the reader of plaintext logs.
+        croslog::ViewerPlaintext viewer(config);
+        result = viewer.Run();
+      }
+
+      base::ThreadPoolInstance::Get()->Shutdown();
+      return result ? 0 : 1;
     }
   }
 }
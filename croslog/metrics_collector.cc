@@ -141,7 +141,12 @@ const char kUserLogMaximumThroughput[] =
 
 class MetricsCollector {
  public:
-  MetricsCollector() { metrics_library_.Init(); }
+  MetricsCollector() {
+    metrics_library_.Init();
+    // All the samples are sent in one run, so they are written to the events
+    // file at once.
+    metrics_library_.EnableBatching();
+  }
 
   void Run() {
     // [Entire system log directory] Total file size.
@@ -294,6 +299,9 @@ class MetricsCollector {
                   << " bytes per day.";
       }
     }
+
+    if (!metrics_library_.Flush())
+      LOG(ERROR) << "Failed to write the metrics";
   }
 
  private:
@@ -4,10 +4,12 @@
 
 #include "croslog/multiplexer.h"
 
+#include <algorithm>
 #include <utility>
 
 #include "base/optional.h"
 #include "base/strings/string_util.h"
+#include "base/task/thread_pool/thread_pool_instance.h"
 
 #include "croslog/log_parser_syslog.h"
 
@@ -15,27 +17,67 @@
 
 namespace croslog {
 
+namespace {
+
+// Number of entries read ahead for each source.
+constexpr size_t kPrefetchCapacity = 256;
+
+}  // anonymous namespace
+
 Multiplexer::LogSource::LogSource(base::FilePath log_file,
                                   std::unique_ptr<LogParser> parser_in,
-                                  bool install_change_watcher)
-    : reader(log_file, std::move(parser_in), install_change_watcher) {}
+                                  bool install_change_watcher,
+                                  size_t index_in)
+    : index(index_in),
+      reader(log_file, std::move(parser_in), install_change_watcher) {
+  // File change events are handled on the main thread, so the sources
+  // watching them are read on the main thread as well.
+  if (!install_change_watcher && base::ThreadPoolInstance::Get()) {
+    prefetcher =
+        base::MakeRefCounted<LogEntryPrefetcher>(&reader, kPrefetchCapacity);
+  }
+}
+
+Multiplexer::LogSource::~LogSource() {
+  StopPrefetch();
+}
+
+MaybeLogEntry Multiplexer::LogSource::ReadNextEntry() {
+  if (prefetcher)
+    return prefetcher->GetNextEntry();
+  return reader.GetNextEntry();
+}
+
+void Multiplexer::LogSource::StopPrefetch() {
+  if (prefetcher)
+    prefetcher->Stop();
+}
 
 Multiplexer::Multiplexer() = default;
 
+Multiplexer::~Multiplexer() = default;
+
 void Multiplexer::AddSource(base::FilePath log_file,
                             std::unique_ptr<LogParser> parser,
                             bool install_change_watcher) {
-  auto source = std::make_unique<LogSource>(
-      std::move(log_file), std::move(parser), install_change_watcher);
+  auto source =
+      std::make_unique<LogSource>(std::move(log_file), std::move(parser),
+                                  install_change_watcher, sources_.size());
   source->reader.AddObserver(this);
   sources_.emplace_back(std::move(source));
+  forward_heap_valid_ = false;
 }
 
 void Multiplexer::OnFileChanged(LogLineReader* reader) {
+  // New entries may be available.
+  forward_heap_valid_ = false;
+
   for (auto&& source : sources_) {
     if (source->reader.file_path() != reader->file_path())
       continue;
 
+    source->StopPrefetch();
+
     // Invalidate caches, since the backed buffer may be invalid.
     if (source->cache_next_backward.has_value()) {
       CHECK(!source->cache_next_forward.has_value());
@@ -51,7 +93,17 @@ void Multiplexer::OnFileChanged(LogLineReader* reader) {
     obs.OnLogFileChanged();
 }
 
-MaybeLogEntry Multiplexer::Forward() {
+// static
+bool Multiplexer::ComesAfter(const LogSource* a, const LogSource* b) {
+  const base::Time a_time = a->cache_next_forward->time();
+  const base::Time b_time = b->cache_next_forward->time();
+  if (a_time != b_time)
+    return a_time > b_time;
+  return a->index > b->index;
+}
+
+void Multiplexer::RebuildForwardHeap() {
+  forward_heap_.clear();
   for (auto&& source : sources_) {
     if (source->cache_next_backward.has_value()) {
       CHECK(!source->cache_next_forward.has_value());
@@ -60,7 +112,7 @@ MaybeLogEntry Multiplexer::Forward() {
     }
 
     if (!source->cache_next_forward.has_value()) {
-      MaybeLogEntry entry = source->reader.GetNextEntry();
+      MaybeLogEntry entry = source->ReadNextEntry();
       if (!entry.has_value()) {
         // No more entry from this source.
         continue;
@@ -68,32 +120,47 @@ MaybeLogEntry Multiplexer::Forward() {
       // Reading an entry succeeds. Use this.
       source->cache_next_forward.emplace(std::move(*entry));
     }
-  }
 
-  Multiplexer::LogSource* next_source = nullptr;
-  for (auto&& source : sources_) {
-    if (!source->cache_next_forward.has_value()) {
-      // This source doesn't have a next entry.
-      continue;
-    }
-
-    if (next_source == nullptr || next_source->cache_next_forward->time() >
-                                      source->cache_next_forward->time()) {
-      next_source = source.get();
-    }
+    forward_heap_.push_back(source.get());
   }
+  std::make_heap(forward_heap_.begin(), forward_heap_.end(), &ComesAfter);
+  forward_heap_valid_ = true;
+}
 
-  if (next_source == nullptr) {
+MaybeLogEntry Multiplexer::Forward() {
+  // Sources reaching the end are dropped from the heap. Retries them, since
+  // the files may have been appended.
+  if (!forward_heap_valid_ || forward_heap_.empty())
+    RebuildForwardHeap();
+
+  if (forward_heap_.empty()) {
     return base::nullopt;
   }
 
+  std::pop_heap(forward_heap_.begin(), forward_heap_.end(), &ComesAfter);
+  LogSource* next_source = forward_heap_.back();
+  forward_heap_.pop_back();
+
   MaybeLogEntry entry = std::move(next_source->cache_next_forward);
   next_source->cache_next_forward.reset();
+
+  // Puts the source back to the heap with its next entry.
+  MaybeLogEntry next_entry = next_source->ReadNextEntry();
+  if (next_entry.has_value()) {
+    next_source->cache_next_forward.emplace(std::move(*next_entry));
+    forward_heap_.push_back(next_source);
+    std::push_heap(forward_heap_.begin(), forward_heap_.end(), &ComesAfter);
+  }
+
   return entry;
 }
 
 MaybeLogEntry Multiplexer::Backward() {
+  forward_heap_valid_ = false;
+
   for (auto&& source : sources_) {
+    source->StopPrefetch();
+
     if (source->cache_next_forward.has_value()) {
       CHECK(!source->cache_next_backward.has_value());
       source->cache_next_forward.reset();
@@ -142,7 +209,9 @@ void Multiplexer::RemoveObserver(Observer* obs) {
 }
 
 void Multiplexer::SetLinesFromLast(uint32_t pos) {
+  forward_heap_valid_ = false;
   for (auto& source : sources_) {
+    source->StopPrefetch();
     source->cache_next_backward.reset();
     source->cache_next_forward.reset();
     source->reader.SetPositionLast();
@@ -155,4 +224,14 @@ void Multiplexer::SetLinesFromLast(uint32_t pos) {
   }
 }
 
+void Multiplexer::SetPositionAt(base::Time time) {
+  forward_heap_valid_ = false;
+  for (auto& source : sources_) {
+    source->StopPrefetch();
+    source->cache_next_backward.reset();
+    source->cache_next_forward.reset();
+    source->reader.SetPositionAt(time);
+  }
+}
+
 }  // namespace croslog
@@ -10,16 +10,23 @@
 #include <vector>
 
 #include "base/files/file_path.h"
+#include "base/memory/scoped_refptr.h"
 #include "base/observer_list.h"
 #include "base/observer_list_types.h"
+#include "base/time/time.h"
 
 #include "croslog/log_entry.h"
+#include "croslog/log_entry_prefetcher.h"
 #include "croslog/log_entry_reader.h"
 #include "croslog/log_parser.h"
 
 namespace croslog {
 
 // Read logs from multiple files with merging the lines.
+// - Reading forward is a k-way merge with a min-heap of the next entries of the
+//   sources.
+// - Sources which don't watch file changes are read and parsed ahead on worker
+//   threads, if the thread pool is available.
 class Multiplexer : public LogLineReader::Observer {
  public:
   class Observer : public base::CheckedObserver {
@@ -31,6 +38,8 @@ class Multiplexer : public LogLineReader::Observer {
   Multiplexer(const Multiplexer&) = delete;
   Multiplexer& operator=(const Multiplexer&) = delete;
 
+  ~Multiplexer() override;
+
   // Add a source log file to read.
   void AddSource(base::FilePath log_file,
                  std::unique_ptr<LogParser> parser,
@@ -45,6 +54,9 @@ class Multiplexer : public LogLineReader::Observer {
 
   // Set the position to read next.
   void SetLinesFromLast(uint32_t pos);
+  // Set the position to read next before the first entries at or after |time|
+  // in all the sources. Some older entries may be read before them.
+  void SetPositionAt(base::Time time);
 
   // Add a observer to retrieve file change events.
   void AddObserver(Observer* obs);
@@ -55,16 +67,37 @@ class Multiplexer : public LogLineReader::Observer {
   struct LogSource {
     LogSource(base::FilePath log_file,
               std::unique_ptr<LogParser> parser_in,
-              bool install_change_watcher);
+              bool install_change_watcher,
+              size_t index_in);
+    ~LogSource();
+
+    // Reads the next entry, through the prefetcher if any.
+    MaybeLogEntry ReadNextEntry();
+    // Stops prefetching, so that |reader| can be accessed directly.
+    void StopPrefetch();
 
+    // Index in |sources_|, to break ties between entries of the same time.
+    const size_t index;
     LogEntryReader reader;
+    scoped_refptr<LogEntryPrefetcher> prefetcher;
     MaybeLogEntry cache_next_forward;
     MaybeLogEntry cache_next_backward;
   };
 
   void OnFileChanged(LogLineReader* reader) override;
 
+  // Comparator for the min-heap: |a| comes after |b| if its next entry is
+  // newer, or has the same time and |a| was added later.
+  static bool ComesAfter(const LogSource* a, const LogSource* b);
+
+  // Fills |cache_next_forward| of all the sources and builds the heap.
+  void RebuildForwardHeap();
+
   std::vector<std::unique_ptr<LogSource>> sources_;
+  // Min-heap of the sources which have |cache_next_forward|, ordered by the
+  // time of it. Valid only when |forward_heap_valid_| is true.
+  std::vector<LogSource*> forward_heap_;
+  bool forward_heap_valid_ = false;
   base::ObserverList<Observer> observers_;
 };
 
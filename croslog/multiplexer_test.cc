@@ -5,6 +5,7 @@
 #include "croslog/multiplexer.h"
 
 #include <base/files/file_path.h>
+#include <base/task/thread_pool/thread_pool_instance.h>
 #include <gtest/gtest.h>
 
 #include "croslog/log_parser_syslog.h"
@@ -152,4 +153,91 @@ TEST_F(MultiplexerTest, InterleaveForwardAndBackward2) {
   }
 }
 
+// Runs with the thread pool, so that the sources are read ahead on workers.
+class MultiplexerPrefetchTest : public ::testing::Test {
+ public:
+  MultiplexerPrefetchTest() = default;
+  MultiplexerPrefetchTest(const MultiplexerPrefetchTest&) = delete;
+  MultiplexerPrefetchTest& operator=(const MultiplexerPrefetchTest&) = delete;
+
+  void SetUp() override {
+    base::ThreadPoolInstance::CreateAndStartWithDefaultParams(
+        "MultiplexerPrefetchTest");
+  }
+
+  void TearDown() override {
+    base::ThreadPoolInstance::Get()->Shutdown();
+    base::ThreadPoolInstance::Get()->JoinForTesting();
+    base::ThreadPoolInstance::Set(nullptr);
+  }
+};
+
+TEST_F(MultiplexerPrefetchTest, ForwardMergesInOrder) {
+  Multiplexer multiplexer;
+  multiplexer.AddSource(base::FilePath("./testdata/TEST_SEQUENTIAL_LOG3"),
+                        std::make_unique<LogParserSyslog>(), false);
+  multiplexer.AddSource(base::FilePath("./testdata/TEST_SEQUENTIAL_LOG1"),
+                        std::make_unique<LogParserSyslog>(), false);
+  multiplexer.AddSource(base::FilePath("./testdata/TEST_SEQUENTIAL_LOG2"),
+                        std::make_unique<LogParserSyslog>(), false);
+
+  const char* kExpectedMessages[] = {
+      "This is log line 1-1.", "This is log line 1-2.",
+      "This is log line 2-1.", "This is log line 2-2.",
+      "This is log line 3-1.", "This is log line 3-2."};
+  for (const char* expected_message : kExpectedMessages) {
+    MaybeLogEntry e = multiplexer.Forward();
+    ASSERT_TRUE(e.has_value());
+    EXPECT_EQ(expected_message, e->message());
+  }
+  EXPECT_FALSE(multiplexer.Forward().has_value());
+}
+
+TEST_F(MultiplexerPrefetchTest, InterleaveForwardAndBackward) {
+  Multiplexer multiplexer;
+  multiplexer.AddSource(base::FilePath("./testdata/TEST_NORMAL_LOG1"),
+                        std::make_unique<LogParserSyslog>(), false);
+  multiplexer.AddSource(base::FilePath("./testdata/TEST_NORMAL_LOG2"),
+                        std::make_unique<LogParserSyslog>(), false);
+
+  {
+    MaybeLogEntry e = multiplexer.Forward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5963, e->pid());
+  }
+
+  {
+    MaybeLogEntry e = multiplexer.Forward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5964, e->pid());
+  }
+
+  // The entries read ahead are given back to the readers.
+  {
+    MaybeLogEntry e = multiplexer.Backward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5964, e->pid());
+  }
+
+  {
+    MaybeLogEntry e = multiplexer.Forward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5964, e->pid());
+  }
+
+  {
+    MaybeLogEntry e = multiplexer.Forward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5965, e->pid());
+  }
+
+  {
+    MaybeLogEntry e = multiplexer.Forward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5966, e->pid());
+  }
+
+  EXPECT_FALSE(multiplexer.Forward().has_value());
+}
+
 }  // namespace croslog
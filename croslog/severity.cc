@@ -20,7 +20,7 @@ bool StartsWithCaseInsensitive(const base::StringPiece& s,
 }
 }  // anonymous namespace
 
-Severity SeverityFromString(const std::string& severity_str) {
+Severity SeverityFromString(base::StringPiece severity_str) {
   if (severity_str == "0" ||
       base::CompareCaseInsensitiveASCII(severity_str, "emerg") == 0) {
     return Severity::EMERGE;
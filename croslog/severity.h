@@ -7,6 +7,8 @@
 
 #include <string>
 
+#include "base/strings/string_piece.h"
+
 namespace croslog {
 
 enum class Severity {
@@ -21,7 +23,7 @@ enum class Severity {
   DEBUG
 };
 
-Severity SeverityFromString(const std::string& str);
+Severity SeverityFromString(base::StringPiece str);
 
 }  // namespace croslog
 
@@ -4,6 +4,7 @@
 
 #include "croslog/viewer_plaintext.h"
 
+#include <algorithm>
 #include <memory>
 #include <unistd.h>
 #include <utility>
@@ -98,6 +99,13 @@ bool ViewerPlaintext::Run() {
     multiplexer_.SetLinesFromLast(config_.lines);
   } else if (config_.follow) {
     multiplexer_.SetLinesFromLast(10);
+  } else {
+    // Skips the entries filtered out by time, using the index of the files.
+    base::Time start_time = config_.since;
+    if (config_cursor_mode_ != CursorMode::UNSPECIFIED)
+      start_time = std::max(start_time, config_cursor_time_);
+    if (!start_time.is_null())
+      multiplexer_.SetPositionAt(start_time);
   }
 
   ReadRemainingLogs();
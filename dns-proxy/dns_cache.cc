@@ -0,0 +1,258 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "dns-proxy/dns_cache.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include <base/check.h>
+#include <base/memory/ref_counted.h>
+#include <base/optional.h>
+#include <base/sys_byteorder.h>
+#include <chromeos/patchpanel/dns/dns_protocol.h>
+#include <chromeos/patchpanel/dns/dns_query.h>
+#include <chromeos/patchpanel/dns/dns_response.h>
+#include <chromeos/patchpanel/dns/io_buffer.h>
+
+namespace dns_proxy {
+namespace {
+// Upper bounds of the time a response is cached, regardless of its TTL.
+constexpr base::TimeDelta kMaxPositiveTtl = base::Hours(1);
+constexpr base::TimeDelta kMaxNegativeTtl = base::Minutes(5);
+// CD flag of the header of a query.
+constexpr uint16_t kFlagCD = 0x10;
+// DO flag of the TTL field of an OPT record.
+constexpr uint32_t kEdnsFlagDO = 0x8000;
+
+base::Optional<patchpanel::DnsQuery> ParseQuery(const char* msg, size_t len) {
+  if (len == 0)
+    return base::nullopt;
+
+  scoped_refptr<patchpanel::IOBufferWithSize> buf =
+      base::MakeRefCounted<patchpanel::IOBufferWithSize>(len);
+  memcpy(buf->data(), msg, len);
+  patchpanel::DnsQuery query(buf);
+  if (!query.Parse(len))
+    return base::nullopt;
+
+  return query;
+}
+
+// Options of a query which change its response, besides its question.
+struct QueryOptions {
+  // Whether the query has an OPT record (EDNS).
+  bool edns = false;
+  // DO (DNSSEC OK) flag of the OPT record, RFC 3225.
+  bool dnssec_ok = false;
+  // CD (Checking Disabled) flag of the header, RFC 4035.
+  bool checking_disabled = false;
+  // Largest UDP response accepted by the client, RFC 6891 section 6.2.5.
+  size_t max_udp_size = patchpanel::dns_protocol::kMaxUDPSize;
+};
+
+// Parses the options of |query|, which holds a parsed query of length |len|.
+base::Optional<QueryOptions> ParseQueryOptions(
+    const patchpanel::DnsQuery& query, size_t len) {
+  const char* data = query.io_buffer()->data();
+  patchpanel::dns_protocol::Header header;
+  memcpy(&header, data, sizeof(header));
+
+  QueryOptions options;
+  options.checking_disabled = base::NetToHost16(header.flags) & kFlagCD;
+  const unsigned record_count = base::NetToHost16(header.ancount) +
+                                base::NetToHost16(header.nscount) +
+                                base::NetToHost16(header.arcount);
+  patchpanel::DnsRecordParser parser(data, len,
+                                     sizeof(header) + query.question_size());
+  for (unsigned i = 0; i < record_count; i++) {
+    patchpanel::DnsResourceRecord record;
+    if (!parser.ReadRecord(&record))
+      return base::nullopt;
+    // The class and TTL fields of the OPT pseudo-record hold the UDP payload
+    // size and the EDNS flags.
+    if (record.type != patchpanel::dns_protocol::kTypeOPT)
+      continue;
+    options.edns = true;
+    options.dnssec_ok = record.ttl & kEdnsFlagDO;
+    options.max_udp_size =
+        std::max<size_t>(record.klass, patchpanel::dns_protocol::kMaxUDPSize);
+  }
+  return options;
+}
+
+// Returns the cache key of |query|: its question followed by the options which
+// change its response.
+std::string MakeKey(const patchpanel::DnsQuery& query,
+                    const QueryOptions& options) {
+  std::string key(query.question());
+  key.push_back(static_cast<char>(options.edns | options.dnssec_ok << 1 |
+                                  options.checking_disabled << 2));
+  return key;
+}
+
+// Truncates the wire-format response |msg| to its header and question
+// section of size |question_size|, and sets its TC flag so that the client
+// retries over TCP (RFC 2181 section 9).
+void Truncate(std::string* msg, size_t question_size) {
+  patchpanel::dns_protocol::Header header;
+  DCHECK_GE(msg->size(), sizeof(header) + question_size);
+  memcpy(&header, msg->data(), sizeof(header));
+  header.flags |= base::HostToNet16(patchpanel::dns_protocol::kFlagTC);
+  header.ancount = 0;
+  header.nscount = 0;
+  header.arcount = 0;
+  msg->resize(sizeof(header) + question_size);
+  memcpy(&(*msg)[0], &header, sizeof(header));
+}
+
+// Writes the ID |id| to the header of the wire-format message |msg|.
+void SetId(std::string* msg, uint16_t id) {
+  DCHECK_GE(msg->size(), sizeof(patchpanel::dns_protocol::Header));
+  const uint16_t net_id = base::HostToNet16(id);
+  memcpy(&(*msg)[offsetof(patchpanel::dns_protocol::Header, id)], &net_id,
+         sizeof(net_id));
+}
+
+}  // namespace
+
+DnsCache::DnsCache(size_t max_entries, const base::TickClock* clock)
+    : cache_(max_entries), clock_(clock) {}
+
+DnsCache::~DnsCache() = default;
+
+void DnsCache::Put(const char* query,
+                   size_t query_len,
+                   const unsigned char* msg,
+                   size_t len) {
+  base::Optional<patchpanel::DnsQuery> dns_query = ParseQuery(query, query_len);
+  if (!dns_query.has_value() || len < sizeof(patchpanel::dns_protocol::Header))
+    return;
+  base::Optional<QueryOptions> options =
+      ParseQueryOptions(*dns_query, query_len);
+  if (!options.has_value())
+    return;
+
+  Entry entry;
+  entry.response.assign(reinterpret_cast<const char*>(msg), len);
+  // Only match the question as the ID is rewritten when looking up the
+  // response.
+  SetId(&entry.response, dns_query->id());
+
+  patchpanel::DnsResponse response(len);
+  memcpy(response.io_buffer()->data(), entry.response.data(), len);
+  if (!response.InitParse(len, *dns_query))
+    return;
+  if (response.flags() & patchpanel::dns_protocol::kFlagTC)
+    return;
+
+  const uint8_t rcode = response.rcode();
+  if (rcode != patchpanel::dns_protocol::kRcodeNOERROR &&
+      rcode != patchpanel::dns_protocol::kRcodeNXDOMAIN) {
+    return;
+  }
+  // A NOERROR response without answers means that the name exists but has no
+  // record of the queried type (NODATA).
+  entry.negative = rcode == patchpanel::dns_protocol::kRcodeNXDOMAIN ||
+                   response.answer_count() == 0;
+
+  const unsigned answer_end = response.answer_count();
+  const unsigned authority_end = answer_end + response.authority_count();
+  const unsigned record_end =
+      authority_end + response.additional_answer_count();
+  uint32_t ttl = std::numeric_limits<uint32_t>::max();
+  bool has_soa = false;
+  patchpanel::DnsRecordParser parser = response.Parser();
+  for (unsigned i = 0; i < record_end; i++) {
+    patchpanel::DnsResourceRecord record;
+    if (!parser.ReadRecord(&record))
+      return;
+    // The TTL field of the OPT pseudo-record holds EDNS flags instead.
+    if (record.type == patchpanel::dns_protocol::kTypeOPT)
+      continue;
+
+    // A record ends with its TTL, RDLENGTH and RDATA.
+    const size_t ttl_offset = parser.GetOffset() - record.rdata.size() -
+                              sizeof(uint16_t) - sizeof(uint32_t);
+    entry.ttls.emplace_back(ttl_offset, record.ttl);
+    ttl = std::min(ttl, record.ttl);
+
+    // RFC 2308 section 5: the TTL of a negative answer is the minimum of the
+    // TTL of the SOA record and its MINIMUM field, which ends its RDATA.
+    if (entry.negative && i >= answer_end && i < authority_end &&
+        record.type == patchpanel::dns_protocol::kTypeSOA) {
+      uint32_t minimum;
+      if (record.rdata.size() < sizeof(minimum))
+        return;
+      memcpy(&minimum,
+             record.rdata.data() + record.rdata.size() - sizeof(minimum),
+             sizeof(minimum));
+      ttl = std::min(ttl, base::NetToHost32(minimum));
+      has_soa = true;
+    }
+  }
+  // Negative answers without SOA record must not be cached.
+  if (entry.negative && !has_soa)
+    return;
+  if (ttl == 0)
+    return;
+
+  entry.created = clock_->NowTicks();
+  entry.expiry =
+      entry.created + std::min(base::Seconds(ttl), entry.negative
+                                                       ? kMaxNegativeTtl
+                                                       : kMaxPositiveTtl);
+  cache_.Put(MakeKey(*dns_query, *options), std::move(entry));
+}
+
+bool DnsCache::Get(const char* query,
+                   size_t query_len,
+                   bool udp,
+                   std::string* response,
+                   bool* negative) {
+  DCHECK(response);
+  base::Optional<patchpanel::DnsQuery> dns_query = ParseQuery(query, query_len);
+  if (!dns_query.has_value())
+    return false;
+  base::Optional<QueryOptions> options =
+      ParseQueryOptions(*dns_query, query_len);
+  if (!options.has_value())
+    return false;
+
+  auto it = cache_.Get(MakeKey(*dns_query, *options));
+  if (it == cache_.end())
+    return false;
+
+  const base::TimeTicks now = clock_->NowTicks();
+  const Entry& entry = it->second;
+  if (now >= entry.expiry) {
+    cache_.Erase(it);
+    return false;
+  }
+
+  *response = entry.response;
+  SetId(response, dns_query->id());
+  const int64_t elapsed = (now - entry.created).InSeconds();
+  for (const auto& [offset, ttl] : entry.ttls) {
+    const uint32_t remaining =
+        ttl > elapsed ? ttl - static_cast<uint32_t>(elapsed) : 0;
+    const uint32_t net_ttl = base::HostToNet32(remaining);
+    memcpy(&(*response)[offset], &net_ttl, sizeof(net_ttl));
+  }
+  if (udp && response->size() > options->max_udp_size)
+    Truncate(response, dns_query->question_size());
+  if (negative)
+    *negative = entry.negative;
+  return true;
+}
+
+void DnsCache::Clear() {
+  cache_.Clear();
+}
+
+}  // namespace dns_proxy
@@ -0,0 +1,91 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DNS_PROXY_DNS_CACHE_H_
+#define DNS_PROXY_DNS_CACHE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/containers/lru_cache.h>
+#include <base/time/default_tick_clock.h>
+#include <base/time/tick_clock.h>
+#include <base/time/time.h>
+
+namespace dns_proxy {
+
+// Maximum number of responses cached by a DnsCache by default.
+constexpr size_t kDefaultMaxCacheEntries = 256;
+
+// DnsCache caches wire-format DNS responses for the duration of their TTL, so
+// that repeated queries can be answered without going to the name servers.
+//
+// Responses are keyed on the question of the query, that is the QNAME, QTYPE
+// and QCLASS, and on the EDNS options which change the response: the presence
+// of an OPT record, its DO flag and the CD flag of the header. The QNAME is
+// matched case-sensitively so that a cached response always echoes the
+// question of the query as it was sent.
+//
+// Successful responses are cached for the lowest TTL of their records (positive
+// caching). Responses for names or records which do not exist are cached for
+// the negative caching TTL taken from the SOA record of the authority section,
+// as described in RFC 2308 (negative caching). Other responses, including
+// server failures and truncated responses, are not cached.
+class DnsCache {
+ public:
+  explicit DnsCache(
+      size_t max_entries = kDefaultMaxCacheEntries,
+      const base::TickClock* clock = base::DefaultTickClock::GetInstance());
+  DnsCache(const DnsCache&) = delete;
+  DnsCache& operator=(const DnsCache&) = delete;
+  ~DnsCache();
+
+  // Caches the wire-format response |msg| of length |len| to the wire-format
+  // query |query| of length |query_len| if it is cacheable. The least recently
+  // used response is evicted when the cache is full.
+  void Put(const char* query,
+           size_t query_len,
+           const unsigned char* msg,
+           size_t len);
+
+  // Looks up the response to the wire-format query |query| of length
+  // |query_len|. Returns true and stores the response in |response| if it is
+  // cached and has not expired. The ID of |response| is rewritten to the ID of
+  // |query| and the TTLs of its records are decremented by the time elapsed
+  // since it was cached. If |udp| is true and the response is larger than the
+  // UDP payload size of the query, it is truncated to its question with the
+  // TC flag set. If |negative| is not null, it is set to true if the response
+  // is a negative answer.
+  bool Get(const char* query,
+           size_t query_len,
+           bool udp,
+           std::string* response,
+           bool* negative = nullptr);
+
+  // Drops all the cached responses, for instance when the name servers change.
+  void Clear();
+
+  size_t size() const { return cache_.size(); }
+
+ private:
+  struct Entry {
+    std::string response;
+    // Offsets of the TTL fields of the records of |response| with their value
+    // when |response| was received.
+    std::vector<std::pair<size_t, uint32_t>> ttls;
+    bool negative = false;
+    base::TimeTicks created;
+    base::TimeTicks expiry;
+  };
+
+  base::HashingLRUCache<std::string, Entry> cache_;
+  const base::TickClock* clock_;
+};
+
+}  // namespace dns_proxy
+
+#endif  // DNS_PROXY_DNS_CACHE_H_
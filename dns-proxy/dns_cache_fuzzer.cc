@@ -0,0 +1,52 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <limits>
+#include <string>
+
+#include <base/at_exit.h>
+#include <base/logging.h>
+#include <base/test/simple_test_tick_clock.h>
+#include <fuzzer/FuzzedDataProvider.h>
+
+#include "dns-proxy/dns_cache.h"
+
+namespace dns_proxy {
+namespace {
+
+class Environment {
+ public:
+  Environment() {
+    logging::SetMinLogLevel(logging::LOGGING_FATAL);  // <- DISABLE LOGGING.
+  }
+  base::AtExitManager at_exit;
+};
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static Environment env;
+
+  FuzzedDataProvider provider(data, size);
+  base::SimpleTestTickClock clock;
+  DnsCache cache(kDefaultMaxCacheEntries, &clock);
+
+  while (provider.remaining_bytes() > 0) {
+    const std::string query = provider.ConsumeRandomLengthString(
+        std::numeric_limits<uint16_t>::max());
+    const std::string msg = provider.ConsumeRandomLengthString(
+        std::numeric_limits<uint16_t>::max());
+    cache.Put(query.data(), query.size(),
+              reinterpret_cast<const unsigned char*>(msg.data()), msg.size());
+
+    clock.Advance(base::Seconds(provider.ConsumeIntegral<uint8_t>()));
+    std::string response;
+    bool negative;
+    cache.Get(query.data(), query.size(), provider.ConsumeBool(), &response,
+              &negative);
+  }
+
+  return 0;
+}
+
+}  // namespace
+}  // namespace dns_proxy
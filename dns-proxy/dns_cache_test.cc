@@ -0,0 +1,317 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "dns-proxy/dns_cache.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <base/big_endian.h>
+#include <base/memory/ref_counted.h>
+#include <base/optional.h>
+#include <base/test/simple_test_tick_clock.h>
+#include <base/time/time.h>
+#include <chromeos/patchpanel/dns/dns_protocol.h>
+#include <chromeos/patchpanel/dns/dns_query.h>
+#include <chromeos/patchpanel/dns/dns_response.h>
+#include <chromeos/patchpanel/dns/io_buffer.h>
+#include <gtest/gtest.h>
+
+namespace dns_proxy {
+namespace {
+
+constexpr uint16_t kQueryId = 0x4a47;
+
+// Returns a wire-format query for the A records of |name|, with ID |id|.
+std::string MakeQuery(const std::string& name, uint16_t id = kQueryId) {
+  std::string query(sizeof(patchpanel::dns_protocol::Header), '\0');
+  base::BigEndianWriter writer(&query[0], query.size());
+  writer.WriteU16(id);
+  writer.WriteU16(patchpanel::dns_protocol::kFlagRD);
+  writer.WriteU16(1 /* qdcount */);
+
+  size_t start = 0;
+  while (start < name.size()) {
+    size_t end = name.find('.', start);
+    if (end == std::string::npos)
+      end = name.size();
+    query.push_back(static_cast<char>(end - start));
+    query.append(name, start, end - start);
+    start = end + 1;
+  }
+  query.append("\x00\x00\x01\x00\x01", 5);  // Root, QTYPE A and QCLASS IN.
+  return query;
+}
+
+// Adds an OPT record with the UDP payload size |udp_size| and the DO flag
+// |dnssec_ok| to the wire-format query |query|.
+void AddOpt(std::string* query, uint16_t udp_size, bool dnssec_ok) {
+  std::string opt(11, '\0');
+  base::BigEndianWriter writer(&opt[0], opt.size());
+  writer.Skip(1);  // Root name.
+  writer.WriteU16(patchpanel::dns_protocol::kTypeOPT);
+  writer.WriteU16(udp_size);
+  writer.WriteU32(dnssec_ok ? 0x8000 : 0);
+  query->append(opt);
+  base::WriteBigEndian<uint16_t>(
+      &(*query)[offsetof(patchpanel::dns_protocol::Header, arcount)], 1);
+}
+
+patchpanel::DnsResourceRecord MakeRecord(const std::string& name,
+                                         uint16_t type,
+                                         uint32_t ttl,
+                                         const std::string& rdata) {
+  patchpanel::DnsResourceRecord record;
+  record.name = name;
+  record.type = type;
+  record.klass = patchpanel::dns_protocol::kClassIN;
+  record.ttl = ttl;
+  record.SetOwnedRdata(rdata);
+  return record;
+}
+
+patchpanel::DnsResourceRecord MakeA(const std::string& name, uint32_t ttl) {
+  return MakeRecord(name, patchpanel::dns_protocol::kTypeA, ttl,
+                    std::string("\x08\x08\x08\x08", 4));
+}
+
+// Returns an SOA record with the negative caching TTL |minimum|.
+patchpanel::DnsResourceRecord MakeSoa(const std::string& name,
+                                      uint32_t ttl,
+                                      uint32_t minimum) {
+  // Root MNAME and RNAME, then SERIAL, REFRESH, RETRY, EXPIRE and MINIMUM.
+  std::string rdata(2 + 5 * sizeof(uint32_t), '\0');
+  base::WriteBigEndian(&rdata[rdata.size() - sizeof(minimum)], minimum);
+  return MakeRecord(name, patchpanel::dns_protocol::kTypeSOA, ttl, rdata);
+}
+
+// Returns a wire-format response to |query|.
+std::string MakeResponse(
+    const std::string& query,
+    const std::vector<patchpanel::DnsResourceRecord>& answers,
+    const std::vector<patchpanel::DnsResourceRecord>& authority_records = {},
+    uint8_t rcode = patchpanel::dns_protocol::kRcodeNOERROR) {
+  scoped_refptr<patchpanel::IOBufferWithSize> buf =
+      base::MakeRefCounted<patchpanel::IOBufferWithSize>(query.size());
+  memcpy(buf->data(), query.data(), query.size());
+  base::Optional<patchpanel::DnsQuery> dns_query = patchpanel::DnsQuery(buf);
+  EXPECT_TRUE(dns_query->Parse(query.size()));
+
+  patchpanel::DnsResponse response(
+      dns_query->id(), false /* is_authoritative */, answers, authority_records,
+      {} /* additional_records */, dns_query, rcode);
+  return std::string(response.io_buffer()->data(), response.io_buffer_size());
+}
+
+// Returns the ID of the wire-format response |response| and the TTLs of its
+// records.
+uint16_t ParseResponse(const std::string& response,
+                       std::vector<uint32_t>* ttls) {
+  patchpanel::DnsResponse parsed(response.size());
+  memcpy(parsed.io_buffer()->data(), response.data(), response.size());
+  EXPECT_TRUE(parsed.InitParseWithoutQuery(response.size()));
+  const unsigned count = parsed.answer_count() + parsed.authority_count() +
+                         parsed.additional_answer_count();
+  patchpanel::DnsRecordParser parser = parsed.Parser();
+  for (unsigned i = 0; i < count; i++) {
+    patchpanel::DnsResourceRecord record;
+    EXPECT_TRUE(parser.ReadRecord(&record));
+    ttls->push_back(record.ttl);
+  }
+  return parsed.id().value();
+}
+
+class DnsCacheTest : public testing::Test {
+ protected:
+  DnsCacheTest() : cache_(2 /* max_entries */, &clock_) {
+    clock_.Advance(base::Seconds(1));
+  }
+
+  void Put(const std::string& query, const std::string& response) {
+    cache_.Put(query.data(), query.size(),
+               reinterpret_cast<const unsigned char*>(response.data()),
+               response.size());
+  }
+
+  bool Get(const std::string& query,
+           std::string* response,
+           bool* negative = nullptr,
+           bool udp = true) {
+    return cache_.Get(query.data(), query.size(), udp, response, negative);
+  }
+
+  base::SimpleTestTickClock clock_;
+  DnsCache cache_;
+};
+
+TEST_F(DnsCacheTest, PositiveAnswer) {
+  const std::string query = MakeQuery("google.com");
+  std::string response;
+  EXPECT_FALSE(Get(query, &response));
+
+  Put(query, MakeResponse(query, {MakeA("google.com", 300),
+                                  MakeA("google.com", 60)}));
+  EXPECT_EQ(cache_.size(), 1u);
+
+  // The ID of the response is the one of the query, and its TTLs are
+  // decremented.
+  clock_.Advance(base::Seconds(10));
+  bool negative = true;
+  ASSERT_TRUE(Get(MakeQuery("google.com", 0x1234), &response, &negative));
+  EXPECT_FALSE(negative);
+  std::vector<uint32_t> ttls;
+  EXPECT_EQ(ParseResponse(response, &ttls), 0x1234);
+  EXPECT_EQ(ttls, std::vector<uint32_t>({290, 50}));
+
+  // The response expires with its lowest TTL.
+  clock_.Advance(base::Seconds(49));
+  EXPECT_TRUE(Get(query, &response));
+  clock_.Advance(base::Seconds(1));
+  EXPECT_FALSE(Get(query, &response));
+  EXPECT_EQ(cache_.size(), 0u);
+}
+
+TEST_F(DnsCacheTest, NegativeAnswer) {
+  const std::string nxdomain_query = MakeQuery("nx.google.com");
+  Put(nxdomain_query,
+      MakeResponse(nxdomain_query, {}, {MakeSoa("google.com", 600, 30)},
+                   patchpanel::dns_protocol::kRcodeNXDOMAIN));
+  const std::string nodata_query = MakeQuery("google.com");
+  Put(nodata_query,
+      MakeResponse(nodata_query, {}, {MakeSoa("google.com", 20, 60)}));
+  EXPECT_EQ(cache_.size(), 2u);
+
+  // The negative TTL is the lowest of the SOA TTL and its MINIMUM field.
+  std::string response;
+  bool negative = false;
+  clock_.Advance(base::Seconds(19));
+  ASSERT_TRUE(Get(nxdomain_query, &response, &negative));
+  EXPECT_TRUE(negative);
+  negative = false;
+  ASSERT_TRUE(Get(nodata_query, &response, &negative));
+  EXPECT_TRUE(negative);
+
+  clock_.Advance(base::Seconds(1));
+  EXPECT_TRUE(Get(nxdomain_query, &response));
+  EXPECT_FALSE(Get(nodata_query, &response));
+  clock_.Advance(base::Seconds(10));
+  EXPECT_FALSE(Get(nxdomain_query, &response));
+}
+
+TEST_F(DnsCacheTest, MaxTtl) {
+  const std::string query = MakeQuery("google.com");
+  Put(query, MakeResponse(query, {MakeA("google.com", 86400)}));
+  std::string response;
+  clock_.Advance(base::Hours(1) - base::Seconds(1));
+  EXPECT_TRUE(Get(query, &response));
+  clock_.Advance(base::Seconds(1));
+  EXPECT_FALSE(Get(query, &response));
+}
+
+TEST_F(DnsCacheTest, UncacheableResponses) {
+  const std::string query = MakeQuery("google.com");
+
+  // Failures, responses to other questions and truncated responses.
+  Put(query, MakeResponse(query, {}, {MakeSoa("google.com", 600, 30)},
+                          patchpanel::dns_protocol::kRcodeSERVFAIL));
+  const std::string other_query = MakeQuery("www.google.com");
+  Put(query, MakeResponse(other_query, {MakeA("www.google.com", 60)}));
+  std::string truncated = MakeResponse(query, {MakeA("google.com", 60)});
+  truncated[2] |= patchpanel::dns_protocol::kFlagTC >> 8;
+  Put(query, truncated);
+
+  // Negative answers without SOA record, and records which must not be cached.
+  Put(query, MakeResponse(query, {}, {},
+                          patchpanel::dns_protocol::kRcodeNXDOMAIN));
+  Put(query, MakeResponse(query, {MakeA("google.com", 0)}));
+
+  // Malformed responses and queries.
+  const std::string response = MakeResponse(query, {MakeA("google.com", 60)});
+  Put(query, response.substr(0, response.size() - 1));
+  Put(query, "");
+  Put("", response);
+  Put(response, response);
+
+  EXPECT_EQ(cache_.size(), 0u);
+}
+
+TEST_F(DnsCacheTest, QueryOptions) {
+  const std::string query = MakeQuery("google.com");
+  std::string edns_query = query;
+  AddOpt(&edns_query, 1232, false /* dnssec_ok */);
+  std::string dnssec_query = query;
+  AddOpt(&dnssec_query, 1232, true /* dnssec_ok */);
+  std::string cd_query = query;
+  cd_query[3] |= 0x10;
+
+  // Responses to queries with other EDNS options or CD flag are not used.
+  Put(query, MakeResponse(query, {MakeA("google.com", 60)}));
+  std::string response;
+  EXPECT_TRUE(Get(query, &response));
+  EXPECT_FALSE(Get(edns_query, &response));
+  EXPECT_FALSE(Get(dnssec_query, &response));
+  EXPECT_FALSE(Get(cd_query, &response));
+
+  Put(dnssec_query, MakeResponse(dnssec_query, {MakeA("google.com", 60)}));
+  EXPECT_EQ(cache_.size(), 2u);
+  EXPECT_TRUE(Get(dnssec_query, &response));
+  EXPECT_FALSE(Get(edns_query, &response));
+}
+
+TEST_F(DnsCacheTest, TruncateUdpResponse) {
+  std::vector<patchpanel::DnsResourceRecord> answers(
+      40, MakeA("google.com", 60));
+  const std::string query = MakeQuery("google.com");
+  const std::string full_response = MakeResponse(query, answers);
+  ASSERT_GT(full_response.size(), 512u);
+  Put(query, full_response);
+
+  // Over TCP, the whole response is sent.
+  std::string response;
+  ASSERT_TRUE(Get(query, &response, nullptr, false /* udp */));
+  EXPECT_EQ(response, full_response);
+
+  // Over UDP, the response is truncated to its question.
+  ASSERT_TRUE(Get(query, &response));
+  EXPECT_EQ(response.size(), query.size());
+  EXPECT_TRUE(response[2] & (patchpanel::dns_protocol::kFlagTC >> 8));
+  std::vector<uint32_t> ttls;
+  EXPECT_EQ(ParseResponse(response, &ttls), kQueryId);
+  EXPECT_TRUE(ttls.empty());
+
+  // Unless the client accepts larger UDP responses with EDNS.
+  std::string edns_query = query;
+  AddOpt(&edns_query, 4096, false /* dnssec_ok */);
+  Put(edns_query, MakeResponse(edns_query, answers));
+  ASSERT_TRUE(Get(edns_query, &response));
+  EXPECT_FALSE(response[2] & (patchpanel::dns_protocol::kFlagTC >> 8));
+  EXPECT_EQ(response.size(), full_response.size());
+}
+
+TEST_F(DnsCacheTest, Eviction) {
+  const std::string query1 = MakeQuery("a.com");
+  const std::string query2 = MakeQuery("b.com");
+  const std::string query3 = MakeQuery("c.com");
+  Put(query1, MakeResponse(query1, {MakeA("a.com", 60)}));
+  Put(query2, MakeResponse(query2, {MakeA("b.com", 60)}));
+
+  // Looking up |query1| makes |query2| the least recently used response.
+  std::string response;
+  EXPECT_TRUE(Get(query1, &response));
+  Put(query3, MakeResponse(query3, {MakeA("c.com", 60)}));
+  EXPECT_EQ(cache_.size(), 2u);
+  EXPECT_TRUE(Get(query1, &response));
+  EXPECT_FALSE(Get(query2, &response));
+  EXPECT_TRUE(Get(query3, &response));
+
+  cache_.Clear();
+  EXPECT_EQ(cache_.size(), 0u);
+  EXPECT_FALSE(Get(query1, &response));
+}
+
+}  // namespace
+}  // namespace dns_proxy
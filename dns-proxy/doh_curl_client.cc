@@ -7,6 +7,7 @@
 #include <utility>
 
 #include <base/bind.h>
+#include <base/callback_helpers.h>
 #include <base/containers/contains.h>
 #include <base/logging.h>
 #include <base/strings/string_util.h>
@@ -20,6 +21,11 @@ constexpr char kLinuxUserAgent[] =
 constexpr std::array<const char*, 2> kDoHHeaderList{
     {"Accept: application/dns-message",
      "Content-Type: application/dns-message"}};
+// Wire-format query for the NS records of the root zone, sent to open the
+// connections to the DoH providers. The ID is 0 as recommended by RFC 8484.
+constexpr char kPrewarmQuery[] = {
+    '\x00', '\x00', '\x01', '\x00', '\x00', '\x01', '\x00', '\x00', '\x00',
+    '\x00', '\x00', '\x00', '\x00', '\x00', '\x02', '\x00', '\x01'};
 }  // namespace
 
 DoHCurlClient::CurlResult::CurlResult(CURLcode curl_code,
@@ -61,11 +67,15 @@ void DoHCurlClient::State::SetResponse(char* msg, size_t len) {
 DoHCurlClient::DoHCurlClient(base::TimeDelta timeout,
                              int max_concurrent_queries)
     : timeout_seconds_(timeout.InSeconds()),
+      http_version_(CURL_HTTP_VERSION_2TLS),
       max_concurrent_queries_(max_concurrent_queries) {
   // Initialize CURL.
   curl_global_init(CURL_GLOBAL_DEFAULT);
   curlm_ = curl_multi_init();
 
+  // Multiplex the queries to a DoH provider on a single HTTP/2 connection.
+  curl_multi_setopt(curlm_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
   // Set socket callback to `SocketCallback(...)`. This function will be called
   // whenever a CURL socket state is changed. DoHCurlClient class |this| will
   // passed as a parameter of the callback.
@@ -164,26 +174,38 @@ void DoHCurlClient::AddWriteWatcher(curl_socket_t socket_fd) {
   if (!base::Contains(write_watchers_, socket_fd)) {
     write_watchers_.emplace(
         socket_fd,
-        base::FileDescriptorWatcher::WatchReadable(
+        base::FileDescriptorWatcher::WatchWritable(
             socket_fd,
             base::BindRepeating(&DoHCurlClient::OnFileCanWriteWithoutBlocking,
                                 weak_factory_.GetWeakPtr(), socket_fd)));
   }
 }
 
-void DoHCurlClient::RemoveWatcher(curl_socket_t socket_fd) {
+void DoHCurlClient::RemoveReadWatcher(curl_socket_t socket_fd) {
   read_watchers_.erase(socket_fd);
+}
+
+void DoHCurlClient::RemoveWriteWatcher(curl_socket_t socket_fd) {
   write_watchers_.erase(socket_fd);
 }
 
+void DoHCurlClient::RemoveWatcher(curl_socket_t socket_fd) {
+  RemoveReadWatcher(socket_fd);
+  RemoveWriteWatcher(socket_fd);
+}
+
 int DoHCurlClient::SocketCallback(
     CURL* easy, curl_socket_t socket_fd, int what, void* userp, void* socketp) {
   DoHCurlClient* client = static_cast<DoHCurlClient*>(userp);
+  // |what| is the complete set of events to wait for. Idle connections kept
+  // open between queries only wait for reads.
   switch (what) {
     case CURL_POLL_IN:
       client->AddReadWatcher(socket_fd);
+      client->RemoveWriteWatcher(socket_fd);
       return 0;
     case CURL_POLL_OUT:
+      client->RemoveReadWatcher(socket_fd);
       client->AddWriteWatcher(socket_fd);
       return 0;
     case CURL_POLL_INOUT:
@@ -244,12 +266,54 @@ size_t DoHCurlClient::HeaderCallback(char* data,
 
 void DoHCurlClient::SetNameServers(
     const std::vector<std::string>& name_servers) {
-  name_servers_ = base::JoinString(name_servers, ",");
+  const std::string joined_name_servers = base::JoinString(name_servers, ",");
+  if (joined_name_servers == name_servers_)
+    return;
+
+  name_servers_ = joined_name_servers;
+  // The providers are resolved through the name servers, so the connections
+  // are warmed up again once the name servers are known or change.
+  if (!doh_providers_.empty())
+    Prewarm();
 }
 
 void DoHCurlClient::SetDoHProviders(
     const std::vector<std::string>& doh_providers) {
+  if (doh_providers == doh_providers_)
+    return;
+
   doh_providers_ = doh_providers;
+  Prewarm();
+}
+
+void DoHCurlClient::SetHttpVersionForTest(long http_version) {
+  http_version_ = http_version;
+}
+
+void DoHCurlClient::Prewarm() {
+  if (name_servers_.empty())
+    return;
+
+  // Each provider is queried as a separate request so that the connection to a
+  // provider is not closed when another one replies first.
+  int num_concurrent_queries = 0;
+  for (const auto& doh_provider : doh_providers_) {
+    if (num_concurrent_queries >= max_concurrent_queries_)
+      break;
+    num_concurrent_queries++;
+
+    std::unique_ptr<State> state =
+        InitCurl(doh_provider, kPrewarmQuery, sizeof(kPrewarmQuery),
+                 base::DoNothing(), nullptr /* ctx */);
+    if (!state)
+      continue;
+
+    State* state_ptr = state.get();
+    states_.emplace(state_ptr->curl, std::move(state));
+    requests_.emplace(next_request_id_, std::set<State*>({state_ptr}));
+    next_request_id_++;
+    curl_multi_add_handle(curlm_, state_ptr->curl);
+  }
 }
 
 void DoHCurlClient::CancelRequest(const std::set<State*>& states) {
@@ -308,6 +372,11 @@ std::unique_ptr<DoHCurlClient::State> DoHCurlClient::InitCurl(
   // Set the user agent for the query.
   curl_easy_setopt(curl, CURLOPT_USERAGENT, kLinuxUserAgent);
 
+  // Use HTTP/2, and wait for a connection being opened to the provider to be
+  // multiplexed instead of opening another one.
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, http_version_);
+  curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+
   // Ignore signals SIGPIPE to be sent when the other end of CURL socket is
   // closed.
   curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 0);
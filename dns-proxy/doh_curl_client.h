@@ -70,6 +70,11 @@ class DoHCurlClientInterface {
 // response done through CURL. Given multiple DoH servers, DoHCurlClient will
 // query each servers concurrently. It will return only the first successful
 // response OR the last failing response.
+//
+// Queries are sent over HTTP/2 and multiplexed on a single persistent
+// connection per DoH server, which is kept open by CURL between queries.
+// The connections are opened as soon as the DoH servers are set, so that the
+// first queries do not wait for the TLS handshakes.
 class DoHCurlClient : public DoHCurlClientInterface {
  public:
   DoHCurlClient(base::TimeDelta timeout, int max_concurrent_queries);
@@ -90,9 +95,15 @@ class DoHCurlClient : public DoHCurlClientInterface {
                void* ctx) override;
 
   // Set standard DNS and DoH servers for running `Resolve(...)`.
+  // Connections to the DoH servers are opened when the name servers or the
+  // DoH servers change.
   void SetNameServers(const std::vector<std::string>& name_servers) override;
   void SetDoHProviders(const std::vector<std::string>& doh_providers) override;
 
+  // Sets the HTTP version used for the queries to a CURL_HTTP_VERSION value,
+  // for instance to query a local cleartext HTTP/2 server.
+  void SetHttpVersionForTest(long http_version);
+
   // Returns a weak pointer to ensure that callbacks don't run after this class
   // is destroyed.
   base::WeakPtr<DoHCurlClient> GetWeakPtr() {
@@ -185,6 +196,10 @@ class DoHCurlClient : public DoHCurlClientInterface {
                                size_t nitems,
                                void* userp);
 
+  // Opens the connections to the DoH servers queried by `Resolve(...)` by
+  // querying them for the name servers of the root zone.
+  void Prewarm();
+
   // Callback informed when a query timed out.
   void TimeoutCallback();
 
@@ -205,6 +220,8 @@ class DoHCurlClient : public DoHCurlClientInterface {
   // When an action is observed, `CheckMultiInfo()` will be called.
   void AddReadWatcher(curl_socket_t socket_fd);
   void AddWriteWatcher(curl_socket_t socket_fd);
+  void RemoveReadWatcher(curl_socket_t socket_fd);
+  void RemoveWriteWatcher(curl_socket_t socket_fd);
   void RemoveWatcher(curl_socket_t socket_fd);
 
   // Callback called whenever an event is ready to be handled by CURL on
@@ -228,6 +245,9 @@ class DoHCurlClient : public DoHCurlClientInterface {
   // Timeout for a CURL query in seconds.
   int64_t timeout_seconds_;
 
+  // HTTP version of the queries.
+  long http_version_;
+
   // Watchers for available event to be handled by CURL.
   std::map<curl_socket_t,
            std::unique_ptr<base::FileDescriptorWatcher::Controller>>
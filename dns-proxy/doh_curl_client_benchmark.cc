@@ -0,0 +1,412 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures the latency of DoHCurlClient queries to a local DoH server when
+// queries are sent one at a time or in bursts, like the ones sent when a page
+// is loaded. The server speaks cleartext HTTP/2, so the TLS handshakes of
+// actual DoH providers are not measured, but the "connections" counter reports
+// how many connections were needed to send the queries.
+// Usage: doh_curl_client_benchmark [benchmark flags]
+
+#include <arpa/inet.h>
+#include <curl/curl.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <nghttp2/nghttp2.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <base/at_exit.h>
+#include <base/bind.h>
+#include <base/check.h>
+#include <base/check_op.h>
+#include <base/files/file_descriptor_watcher_posix.h>
+#include <base/files/scoped_file.h>
+#include <base/logging.h>
+#include <base/run_loop.h>
+#include <base/task/single_thread_task_executor.h>
+#include <base/time/time.h>
+#include <benchmark/benchmark.h>
+
+#include "dns-proxy/doh_curl_client.h"
+
+namespace dns_proxy {
+
+namespace {
+
+constexpr size_t kDnsHeaderSize = 12;
+constexpr uint32_t kMaxConcurrentStreams = 100;
+constexpr base::TimeDelta kTimeout = base::Seconds(5);
+// Wire-format query for the A records of "example.com".
+constexpr char kQuery[] = {
+    '\x12', '\x34', '\x01', '\x00', '\x00', '\x01', '\x00', '\x00',
+    '\x00', '\x00', '\x00', '\x00', '\x07', 'e',    'x',    'a',
+    'm',    'p',    'l',    'e',    '\x03', 'c',    'o',    'm',
+    '\x00', '\x00', '\x01', '\x00', '\x01'};
+
+// Local cleartext HTTP/2 DoH server answering every query with an A record.
+// The server runs on its own thread so that it does not compete with
+// DoHCurlClient for the message loop of the benchmark.
+class LocalDoHServer {
+ public:
+  LocalDoHServer() = default;
+  LocalDoHServer(const LocalDoHServer&) = delete;
+  LocalDoHServer& operator=(const LocalDoHServer&) = delete;
+  ~LocalDoHServer() {
+    // Closing the write end of the pipe wakes the server thread up.
+    stop_write_.reset();
+    if (thread_.joinable())
+      thread_.join();
+  }
+
+  // Listens on an ephemeral port of the loopback interface.
+  bool Start() {
+    listen_fd_.reset(
+        socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    if (!listen_fd_.is_valid())
+      return false;
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(listen_fd_.get(), reinterpret_cast<struct sockaddr*>(&addr),
+             sizeof(addr)) != 0 ||
+        listen(listen_fd_.get(), SOMAXCONN) != 0 ||
+        getsockname(listen_fd_.get(), reinterpret_cast<struct sockaddr*>(&addr),
+                    &len) != 0) {
+      return false;
+    }
+    port_ = ntohs(addr.sin_port);
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+      return false;
+    stop_read_.reset(fds[0]);
+    stop_write_.reset(fds[1]);
+    thread_ = std::thread(&LocalDoHServer::Run, this);
+    return true;
+  }
+
+  std::string url() const {
+    return "http://127.0.0.1:" + std::to_string(port_) + "/dns-query";
+  }
+
+  // Number of connections accepted so far.
+  int connections() const { return connections_; }
+
+ private:
+  struct Stream {
+    std::string query;
+    std::string response;
+    size_t sent = 0;
+  };
+
+  struct Connection {
+    ~Connection() { nghttp2_session_del(session); }
+
+    base::ScopedFD fd;
+    nghttp2_session* session = nullptr;
+    std::map<int32_t, Stream> streams;
+  };
+
+  // Returns the response to the wire-format query |query|.
+  static std::string MakeResponse(const std::string& query) {
+    if (query.size() < kDnsHeaderSize)
+      return query;
+    std::string response = query;
+    response[2] |= 0x80;  // QR
+    response[3] |= 0x80;  // RA
+    response[7] = 1;      // ANCOUNT
+    // Name pointing to the question, A, IN, TTL 60 and 127.0.0.1.
+    static constexpr char kAnswer[] = {'\xc0', '\x0c', '\x00', '\x01',
+                                       '\x00', '\x01', '\x00', '\x00',
+                                       '\x00', '\x3c', '\x00', '\x04',
+                                       '\x7f', '\x00', '\x00', '\x01'};
+    response.append(kAnswer, sizeof(kAnswer));
+    return response;
+  }
+
+  static ssize_t Send(nghttp2_session* session,
+                      const uint8_t* data,
+                      size_t length,
+                      int flags,
+                      void* user_data) {
+    Connection* conn = static_cast<Connection*>(user_data);
+    ssize_t n = send(conn->fd.get(), data, length, MSG_NOSIGNAL);
+    if (n < 0) {
+      return errno == EAGAIN ? NGHTTP2_ERR_WOULDBLOCK
+                             : NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
+    return n;
+  }
+
+  static int OnBeginHeaders(nghttp2_session* session,
+                            const nghttp2_frame* frame,
+                            void* user_data) {
+    Connection* conn = static_cast<Connection*>(user_data);
+    if (frame->hd.type == NGHTTP2_HEADERS &&
+        frame->headers.cat == NGHTTP2_HCAT_REQUEST) {
+      conn->streams[frame->hd.stream_id];
+    }
+    return 0;
+  }
+
+  static int OnDataChunk(nghttp2_session* session,
+                         uint8_t flags,
+                         int32_t stream_id,
+                         const uint8_t* data,
+                         size_t len,
+                         void* user_data) {
+    Connection* conn = static_cast<Connection*>(user_data);
+    auto it = conn->streams.find(stream_id);
+    if (it != conn->streams.end())
+      it->second.query.append(reinterpret_cast<const char*>(data), len);
+    return 0;
+  }
+
+  static ssize_t ReadResponse(nghttp2_session* session,
+                              int32_t stream_id,
+                              uint8_t* buf,
+                              size_t length,
+                              uint32_t* data_flags,
+                              nghttp2_data_source* source,
+                              void* user_data) {
+    Stream* stream = static_cast<Stream*>(source->ptr);
+    const size_t n =
+        std::min(length, stream->response.size() - stream->sent);
+    memcpy(buf, stream->response.data() + stream->sent, n);
+    stream->sent += n;
+    if (stream->sent == stream->response.size())
+      *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+    return n;
+  }
+
+  static int OnFrameRecv(nghttp2_session* session,
+                         const nghttp2_frame* frame,
+                         void* user_data) {
+    Connection* conn = static_cast<Connection*>(user_data);
+    if ((frame->hd.type != NGHTTP2_HEADERS &&
+         frame->hd.type != NGHTTP2_DATA) ||
+        !(frame->hd.flags & NGHTTP2_FLAG_END_STREAM)) {
+      return 0;
+    }
+    auto it = conn->streams.find(frame->hd.stream_id);
+    if (it == conn->streams.end())
+      return 0;
+
+    Stream* stream = &it->second;
+    stream->response = MakeResponse(stream->query);
+    const std::string length = std::to_string(stream->response.size());
+    auto header = [](const char* name, const char* value) {
+      return nghttp2_nv{
+          reinterpret_cast<uint8_t*>(const_cast<char*>(name)),
+          reinterpret_cast<uint8_t*>(const_cast<char*>(value)), strlen(name),
+          strlen(value), NGHTTP2_NV_FLAG_NONE};
+    };
+    const nghttp2_nv headers[] = {
+        header(":status", "200"),
+        header("content-type", "application/dns-message"),
+        header("content-length", length.c_str()),
+    };
+    nghttp2_data_provider provider;
+    provider.source.ptr = stream;
+    provider.read_callback = &LocalDoHServer::ReadResponse;
+    return nghttp2_submit_response(session, frame->hd.stream_id, headers,
+                                   std::size(headers), &provider);
+  }
+
+  static int OnStreamClose(nghttp2_session* session,
+                           int32_t stream_id,
+                           uint32_t error_code,
+                           void* user_data) {
+    static_cast<Connection*>(user_data)->streams.erase(stream_id);
+    return 0;
+  }
+
+  void Accept() {
+    while (true) {
+      base::ScopedFD fd(accept4(listen_fd_.get(), nullptr, nullptr,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC));
+      if (!fd.is_valid())
+        return;
+      const int on = 1;
+      setsockopt(fd.get(), IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+      auto conn = std::make_unique<Connection>();
+      conn->fd = std::move(fd);
+      nghttp2_session_callbacks* callbacks;
+      nghttp2_session_callbacks_new(&callbacks);
+      nghttp2_session_callbacks_set_send_callback(callbacks,
+                                                  &LocalDoHServer::Send);
+      nghttp2_session_callbacks_set_on_begin_headers_callback(
+          callbacks, &LocalDoHServer::OnBeginHeaders);
+      nghttp2_session_callbacks_set_on_data_chunk_recv_callback(
+          callbacks, &LocalDoHServer::OnDataChunk);
+      nghttp2_session_callbacks_set_on_frame_recv_callback(
+          callbacks, &LocalDoHServer::OnFrameRecv);
+      nghttp2_session_callbacks_set_on_stream_close_callback(
+          callbacks, &LocalDoHServer::OnStreamClose);
+      nghttp2_session_server_new(&conn->session, callbacks, conn.get());
+      nghttp2_session_callbacks_del(callbacks);
+
+      const nghttp2_settings_entry settings[] = {
+          {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, kMaxConcurrentStreams}};
+      nghttp2_submit_settings(conn->session, NGHTTP2_FLAG_NONE, settings,
+                              std::size(settings));
+      nghttp2_session_send(conn->session);
+      connections_++;
+      connections_list_.push_back(std::move(conn));
+    }
+  }
+
+  // Returns false if the connection |conn| is to be closed.
+  static bool Process(Connection* conn, bool readable) {
+    if (readable) {
+      uint8_t buf[16384];
+      ssize_t n;
+      while ((n = recv(conn->fd.get(), buf, sizeof(buf), 0)) > 0) {
+        if (nghttp2_session_mem_recv(conn->session, buf, n) < 0)
+          return false;
+      }
+      if (n == 0 || errno != EAGAIN)
+        return false;
+    }
+    if (nghttp2_session_send(conn->session) != 0)
+      return false;
+    return nghttp2_session_want_read(conn->session) ||
+           nghttp2_session_want_write(conn->session);
+  }
+
+  void Run() {
+    while (true) {
+      std::vector<struct pollfd> fds = {{stop_read_.get(), POLLIN, 0},
+                                        {listen_fd_.get(), POLLIN, 0}};
+      for (const auto& conn : connections_list_) {
+        short events = POLLIN;
+        if (nghttp2_session_want_write(conn->session))
+          events |= POLLOUT;
+        fds.push_back({conn->fd.get(), events, 0});
+      }
+      if (poll(fds.data(), fds.size(), -1) < 0)
+        continue;
+      if (fds[0].revents)
+        return;
+      if (fds[1].revents & POLLIN)
+        Accept();
+
+      for (size_t i = 2; i < fds.size(); i++) {
+        Connection* conn = connections_list_[i - 2].get();
+        if (fds[i].revents &&
+            !Process(conn, fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+          conn->fd.reset();
+      }
+      connections_list_.erase(
+          std::remove_if(connections_list_.begin(), connections_list_.end(),
+                         [](const std::unique_ptr<Connection>& conn) {
+                           return !conn->fd.is_valid();
+                         }),
+          connections_list_.end());
+    }
+  }
+
+  base::ScopedFD listen_fd_;
+  base::ScopedFD stop_read_;
+  base::ScopedFD stop_write_;
+  uint16_t port_ = 0;
+  std::atomic<int> connections_{0};
+  // Accessed on |thread_| only.
+  std::vector<std::unique_ptr<Connection>> connections_list_;
+  std::thread thread_;
+};
+
+// Records the latency of a query started at |*ctx| and stops |run_loop| when
+// |*pending| queries are done.
+void OnResolved(std::vector<base::TimeDelta>* latencies,
+                int* pending,
+                base::RunLoop* run_loop,
+                void* ctx,
+                const DoHCurlClientInterface::CurlResult& res,
+                unsigned char* msg,
+                size_t len) {
+  CHECK_EQ(res.curl_code, CURLE_OK);
+  CHECK_EQ(res.http_code, kHTTPOk);
+  latencies->push_back(base::TimeTicks::Now() -
+                       *static_cast<base::TimeTicks*>(ctx));
+  if (--*pending == 0)
+    run_loop->Quit();
+}
+
+// Sends |count| queries at once with |client| and waits for their responses.
+void ResolveAll(DoHCurlClient* client,
+                int count,
+                std::vector<base::TimeDelta>* latencies) {
+  base::RunLoop run_loop;
+  int pending = count;
+  std::vector<base::TimeTicks> starts(count);
+  for (int i = 0; i < count; i++) {
+    starts[i] = base::TimeTicks::Now();
+    CHECK(client->Resolve(kQuery, sizeof(kQuery),
+                          base::BindRepeating(&OnResolved, latencies,
+                                              &pending, &run_loop),
+                          &starts[i]));
+  }
+  run_loop.Run();
+}
+
+// Arguments: the number of queries sent at once.
+void BM_Resolve(benchmark::State& state) {
+  LocalDoHServer server;
+  CHECK(server.Start());
+  DoHCurlClient client(kTimeout, 1 /* max_concurrent_queries */);
+  client.SetHttpVersionForTest(CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+  client.SetNameServers({"127.0.0.1"});
+  client.SetDoHProviders({server.url()});
+
+  // Waits for the connection opened when setting the DoH providers.
+  std::vector<base::TimeDelta> latencies;
+  ResolveAll(&client, 1, &latencies);
+  latencies.clear();
+
+  const int count = state.range(0);
+  for (auto _ : state)
+    ResolveAll(&client, count, &latencies);
+
+  std::sort(latencies.begin(), latencies.end());
+  state.counters["p50_us"] =
+      latencies[latencies.size() / 2].InMicrosecondsF();
+  state.counters["p99_us"] =
+      latencies[latencies.size() * 99 / 100].InMicrosecondsF();
+  state.counters["connections"] = server.connections();
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_Resolve)->ArgName("queries")->Arg(1)->Arg(8)->Arg(64);
+
+}  // namespace
+
+}  // namespace dns_proxy
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit;
+  logging::SetMinLogLevel(logging::LOGGING_WARNING);
+  base::SingleThreadTaskExecutor task_executor(base::MessagePumpType::IO);
+  base::FileDescriptorWatcher watcher(task_executor.task_runner());
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
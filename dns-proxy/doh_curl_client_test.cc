@@ -0,0 +1,261 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "dns-proxy/doh_curl_client.h"
+
+#include <arpa/inet.h>
+#include <curl/curl.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/files/file_descriptor_watcher_posix.h>
+#include <base/files/scoped_file.h>
+#include <base/run_loop.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_split.h>
+#include <base/strings/string_util.h>
+#include <base/strings/stringprintf.h>
+#include <base/test/mock_callback.h>
+#include <base/test/task_environment.h>
+#include <base/time/time.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using testing::ElementsAre;
+using testing::Field;
+using testing::InvokeWithoutArgs;
+using testing::IsEmpty;
+using testing::NotNull;
+
+namespace dns_proxy {
+namespace {
+constexpr base::TimeDelta kTimeout = base::Seconds(3);
+constexpr int kMaxConcurrentQueries = 3;
+// Wire-format query for the NS records of the root zone, sent by
+// DoHCurlClient to open the connections to the DoH providers.
+constexpr char kPrewarmQuery[] = {
+    '\x00', '\x00', '\x01', '\x00', '\x00', '\x01', '\x00', '\x00', '\x00',
+    '\x00', '\x00', '\x00', '\x00', '\x00', '\x02', '\x00', '\x01'};
+// Wire-format query for the A records of "example.com".
+constexpr char kQuery[] = {
+    '\x12', '\x34', '\x01', '\x00', '\x00', '\x01', '\x00', '\x00',
+    '\x00', '\x00', '\x00', '\x00', '\x07', 'e',    'x',    'a',
+    'm',    'p',    'l',    'e',    '\x03', 'c',    'o',    'm',
+    '\x00', '\x00', '\x01', '\x00', '\x01'};
+
+// Local cleartext HTTP/1.1 DoH server recording the queries it receives and
+// answering each of them with the query itself. The server runs on the message
+// loop of the test, like DoHCurlClient.
+class FakeDoHServer {
+ public:
+  // |on_query| is run whenever a query is received.
+  explicit FakeDoHServer(base::RepeatingClosure on_query)
+      : on_query_(std::move(on_query)) {}
+  FakeDoHServer(const FakeDoHServer&) = delete;
+  FakeDoHServer& operator=(const FakeDoHServer&) = delete;
+
+  // Listens on an ephemeral port of the loopback interface.
+  bool Start() {
+    listen_fd_.reset(
+        socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    if (!listen_fd_.is_valid())
+      return false;
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(listen_fd_.get(), reinterpret_cast<struct sockaddr*>(&addr),
+             sizeof(addr)) != 0 ||
+        listen(listen_fd_.get(), SOMAXCONN) != 0 ||
+        getsockname(listen_fd_.get(), reinterpret_cast<struct sockaddr*>(&addr),
+                    &len) != 0) {
+      return false;
+    }
+    port_ = ntohs(addr.sin_port);
+    listen_watcher_ = base::FileDescriptorWatcher::WatchReadable(
+        listen_fd_.get(),
+        base::BindRepeating(&FakeDoHServer::Accept, base::Unretained(this)));
+    return true;
+  }
+
+  std::string url() const {
+    return "http://127.0.0.1:" + std::to_string(port_) + "/dns-query";
+  }
+
+  // Queries received so far.
+  const std::vector<std::string>& queries() const { return queries_; }
+
+ private:
+  struct Connection {
+    base::ScopedFD fd;
+    std::string data;
+    std::unique_ptr<base::FileDescriptorWatcher::Controller> watcher;
+  };
+
+  void Accept() {
+    base::ScopedFD fd(accept4(listen_fd_.get(), nullptr, nullptr,
+                              SOCK_NONBLOCK | SOCK_CLOEXEC));
+    if (!fd.is_valid())
+      return;
+    const int conn_fd = fd.get();
+    auto conn = std::make_unique<Connection>();
+    conn->fd = std::move(fd);
+    conn->watcher = base::FileDescriptorWatcher::WatchReadable(
+        conn_fd, base::BindRepeating(&FakeDoHServer::Read,
+                                     base::Unretained(this), conn_fd));
+    connections_.emplace(conn_fd, std::move(conn));
+  }
+
+  void Read(int conn_fd) {
+    Connection* conn = connections_[conn_fd].get();
+    char buf[4096];
+    ssize_t n = recv(conn_fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      if (n == 0 || errno != EAGAIN)
+        connections_.erase(conn_fd);
+      return;
+    }
+    conn->data.append(buf, n);
+    Answer(conn);
+  }
+
+  // Answers the complete requests received on |conn|.
+  void Answer(Connection* conn) {
+    while (true) {
+      const size_t headers_end = conn->data.find("\r\n\r\n");
+      if (headers_end == std::string::npos)
+        return;
+      size_t length = 0;
+      for (const auto& line : base::SplitStringPiece(
+               base::StringPiece(conn->data).substr(0, headers_end), "\r\n",
+               base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY)) {
+        constexpr base::StringPiece kContentLength = "content-length:";
+        if (base::StartsWith(line, kContentLength,
+                             base::CompareCase::INSENSITIVE_ASCII)) {
+          base::StringToSizeT(
+              base::TrimWhitespaceASCII(line.substr(kContentLength.size()),
+                                        base::TRIM_ALL),
+              &length);
+        }
+      }
+      const size_t body_start = headers_end + 4;
+      if (conn->data.size() < body_start + length)
+        return;
+
+      const std::string query = conn->data.substr(body_start, length);
+      conn->data.erase(0, body_start + length);
+      const std::string response =
+          base::StringPrintf(
+              "HTTP/1.1 200 OK\r\n"
+              "Content-Type: application/dns-message\r\n"
+              "Content-Length: %zu\r\n\r\n",
+              query.size()) +
+          query;
+      send(conn->fd.get(), response.data(), response.size(), MSG_NOSIGNAL);
+      queries_.push_back(query);
+      on_query_.Run();
+    }
+  }
+
+  base::RepeatingClosure on_query_;
+  base::ScopedFD listen_fd_;
+  std::unique_ptr<base::FileDescriptorWatcher::Controller> listen_watcher_;
+  uint16_t port_ = 0;
+  std::map<int, std::unique_ptr<Connection>> connections_;
+  std::vector<std::string> queries_;
+};
+
+class DoHCurlClientTest : public testing::Test {
+ protected:
+  DoHCurlClientTest()
+      : server_a_(base::BindRepeating(&DoHCurlClientTest::OnQuery,
+                                      base::Unretained(this))),
+        server_b_(base::BindRepeating(&DoHCurlClientTest::OnQuery,
+                                      base::Unretained(this))),
+        client_(kTimeout, kMaxConcurrentQueries) {}
+
+  void SetUp() override {
+    ASSERT_TRUE(server_a_.Start());
+    ASSERT_TRUE(server_b_.Start());
+    client_.SetHttpVersionForTest(CURL_HTTP_VERSION_1_1);
+  }
+
+  // Runs the message loop until the servers received |count| queries in total.
+  void WaitForQueries(size_t count) {
+    while (server_a_.queries().size() + server_b_.queries().size() < count) {
+      base::RunLoop run_loop;
+      quit_closure_ = run_loop.QuitClosure();
+      run_loop.Run();
+    }
+    quit_closure_.Reset();
+  }
+
+  void OnQuery() {
+    if (quit_closure_)
+      std::move(quit_closure_).Run();
+  }
+
+  base::test::TaskEnvironment task_environment_{
+      base::test::TaskEnvironment::MainThreadType::IO};
+  base::OnceClosure quit_closure_;
+  FakeDoHServer server_a_;
+  FakeDoHServer server_b_;
+  DoHCurlClient client_;
+};
+
+TEST_F(DoHCurlClientTest, PrewarmOnNameServersChange) {
+  const std::string prewarm_query(kPrewarmQuery, sizeof(kPrewarmQuery));
+
+  // The providers cannot be reached until the name servers are known.
+  client_.SetDoHProviders({server_a_.url(), server_b_.url()});
+  base::RunLoop().RunUntilIdle();
+  EXPECT_THAT(server_a_.queries(), IsEmpty());
+  EXPECT_THAT(server_b_.queries(), IsEmpty());
+
+  client_.SetNameServers({"8.8.8.8"});
+  WaitForQueries(2);
+  EXPECT_THAT(server_a_.queries(), ElementsAre(prewarm_query));
+  EXPECT_THAT(server_b_.queries(), ElementsAre(prewarm_query));
+
+  // Setting the same name servers again does not prewarm the connections.
+  client_.SetNameServers({"8.8.8.8"});
+  client_.SetNameServers({"8.8.8.8", "8.8.4.4"});
+  WaitForQueries(4);
+  base::RunLoop().RunUntilIdle();
+  EXPECT_THAT(server_a_.queries(), ElementsAre(prewarm_query, prewarm_query));
+  EXPECT_THAT(server_b_.queries(), ElementsAre(prewarm_query, prewarm_query));
+}
+
+TEST_F(DoHCurlClientTest, PrewarmResultIgnored) {
+  client_.SetDoHProviders({server_a_.url()});
+  client_.SetNameServers({"8.8.8.8"});
+  WaitForQueries(1);
+
+  // Only the answer to the query resolved afterwards runs a callback.
+  testing::StrictMock<
+      base::MockCallback<DoHCurlClientInterface::QueryCallback>>
+      callback;
+  int ctx;
+  base::RunLoop run_loop;
+  EXPECT_CALL(callback,
+              Run(&ctx, Field(&DoHCurlClientInterface::CurlResult::http_code,
+                              kHTTPOk),
+                  NotNull(), sizeof(kQuery)))
+      .WillOnce(InvokeWithoutArgs(&run_loop, &base::RunLoop::Quit));
+  ASSERT_TRUE(client_.Resolve(kQuery, sizeof(kQuery), callback.Get(), &ctx));
+  run_loop.Run();
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(server_a_.queries().size(), 2u);
+}
+
+}  // namespace
+}  // namespace dns_proxy
@@ -29,6 +29,8 @@ constexpr char kQueryResultsTemplate[] = "Network.DnsProxy.$1Query.Results";
 constexpr char kQueryErrorsTemplate[] = "Network.DnsProxy.$1Query.Errors";
 constexpr char kHttpErrors[] = "Network.DnsProxy.DnsOverHttpsQuery.HttpErrors";
 
+constexpr char kCacheResults[] = "Network.DnsProxy.Cache.Results";
+
 constexpr char kQueryDurationTemplate[] = "Network.DnsProxy.Query.$1$2Duration";
 constexpr char kQueryDurationResolveTemplate[] =
     "Network.DnsProxy.$1Query.$2ResolveDuration";
@@ -184,6 +186,10 @@ void Metrics::RecordQueryResolveDuration(QueryType type,
                      kQueryDurationMillisecondsBuckets);
 }
 
+void Metrics::RecordCacheResult(Metrics::CacheResult result) {
+  metrics_.SendEnumToUMA(kCacheResults, result);
+}
+
 Metrics::QueryTimer::~QueryTimer() {
   Stop();
   Record(metrics_);
@@ -221,6 +227,10 @@ void Metrics::QueryTimer::StopResolve(bool success) {
   r.elapsed = d - r.elapsed;
 }
 
+void Metrics::QueryTimer::SetCacheHit() {
+  cache_hit_ = true;
+}
+
 void Metrics::QueryTimer::StartReply() {
   elapsed_reply_.first = true;
   timer_.GetElapsedTime(&elapsed_reply_.second);
@@ -253,7 +263,8 @@ void Metrics::QueryTimer::Record(Metrics* metrics) {
   if (!elapsed_recv_.first)
     return;
 
-  bool overall = false;
+  // A query answered from the cache succeeds without being resolved.
+  bool overall = cache_hit_;
   for (const auto& r : elapsed_resolve_) {
     overall |= r.success;
     metrics->RecordQueryResolveDuration(r.type, r.elapsed.InMilliseconds(),
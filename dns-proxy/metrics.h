@@ -131,6 +131,16 @@ class Metrics {
     kMaxValue = kOtherServerError,
   };
 
+  // These values are persisted to logs. Entries should not be renumbered and
+  // numeric values should never be reused.
+  enum class CacheResult {
+    kMiss = 0,
+    kHit = 1,
+    kNegativeHit = 2,
+
+    kMaxValue = kNegativeHit,
+  };
+
   // Helper class for measuring time elapsed during different stages of the
   // name resolution process. Accumulates stage timings for later use so that
   // logging metrics do not impact the time spans with i/o overhead.
@@ -151,6 +161,9 @@ class Metrics {
     void StartResolve(bool is_doh = false);
     void StopResolve(bool success);
 
+    // Marks the query as answered from the cache, without resolving it.
+    void SetCacheHit();
+
     // Measure time elapsed sending the reply to the client.
     void StartReply();
     void StopReply(bool success);
@@ -170,6 +183,7 @@ class Metrics {
     void Stop();
 
     Metrics* metrics_{nullptr};
+    bool cache_hit_{false};
     chromeos_metrics::Timer timer_;
     std::pair<bool, base::TimeDelta> elapsed_recv_;
     std::vector<resolv_t_> elapsed_resolve_;
@@ -190,6 +204,7 @@ class Metrics {
   void RecordQueryResolveDuration(QueryType type,
                                   int64_t ms,
                                   bool success = true);
+  void RecordCacheResult(CacheResult result);
 
  private:
   MetricsLibrary metrics_;
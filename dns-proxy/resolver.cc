@@ -128,16 +128,19 @@ Resolver::Resolver(base::TimeDelta timeout,
       ares_client_(
           new AresClient(timeout, max_num_retries, max_concurrent_queries)),
       curl_client_(new DoHCurlClient(timeout, max_concurrent_queries)),
-      metrics_(new Metrics) {}
+      metrics_(new Metrics),
+      cache_(new DnsCache) {}
 
 Resolver::Resolver(std::unique_ptr<AresClient> ares_client,
                    std::unique_ptr<DoHCurlClientInterface> curl_client,
-                   std::unique_ptr<Metrics> metrics)
+                   std::unique_ptr<Metrics> metrics,
+                   std::unique_ptr<DnsCache> cache)
     : always_on_doh_(false),
       doh_enabled_(false),
       ares_client_(std::move(ares_client)),
       curl_client_(std::move(curl_client)),
-      metrics_(std::move(metrics)) {}
+      metrics_(std::move(metrics)),
+      cache_(std::move(cache)) {}
 
 bool Resolver::ListenTCP(struct sockaddr* addr) {
   auto tcp_src = std::make_unique<patchpanel::Socket>(
@@ -216,6 +219,8 @@ void Resolver::HandleAresResult(void* ctx,
     LOG(ERROR) << "Failed to do ares lookup: " << ares_strerror(status);
     return;
   }
+  if (cache_)
+    cache_->Put(sock_fd->msg, sock_fd->len, msg, len);
   ReplyDNS(sock_fd.get(), msg, len);
 }
 
@@ -246,6 +251,8 @@ void Resolver::HandleCurlResult(void* ctx,
 
   switch (res.http_code) {
     case kHTTPOk: {
+      if (cache_)
+        cache_->Put(sock_fd->msg, sock_fd->len, msg, len);
       ReplyDNS(sock_fd, msg, len);
       delete sock_fd;
       return;
@@ -323,13 +330,40 @@ void Resolver::ReplyDNS(SocketFd* sock_fd, unsigned char* msg, size_t len) {
   }
 }
 
+bool Resolver::ReplyFromCache(SocketFd* sock_fd) {
+  if (!cache_)
+    return false;
+
+  std::string response;
+  bool negative;
+  if (!cache_->Get(sock_fd->msg, sock_fd->len, sock_fd->type == SOCK_DGRAM,
+                   &response, &negative)) {
+    if (metrics_)
+      metrics_->RecordCacheResult(Metrics::CacheResult::kMiss);
+    return false;
+  }
+  if (metrics_)
+    metrics_->RecordCacheResult(negative ? Metrics::CacheResult::kNegativeHit
+                                         : Metrics::CacheResult::kHit);
+  sock_fd->timer.SetCacheHit();
+  ReplyDNS(sock_fd, reinterpret_cast<unsigned char*>(&response[0]),
+           response.size());
+  return true;
+}
+
 void Resolver::SetNameServers(const std::vector<std::string>& name_servers) {
+  if (cache_ && name_servers != name_servers_)
+    cache_->Clear();
+  name_servers_ = name_servers;
   ares_client_->SetNameServers(name_servers);
   curl_client_->SetNameServers(name_servers);
 }
 
 void Resolver::SetDoHProviders(const std::vector<std::string>& doh_providers,
                                bool always_on_doh) {
+  if (cache_ && doh_providers != doh_providers_)
+    cache_->Clear();
+  doh_providers_ = doh_providers;
   always_on_doh_ = always_on_doh;
   doh_enabled_ = !doh_providers.empty();
   curl_client_->SetDoHProviders(doh_providers);
@@ -387,6 +421,10 @@ void Resolver::OnDNSQuery(int fd, int type) {
     sock_fd->len -= 2;
   }
 
+  if (ReplyFromCache(sock_fd)) {
+    delete sock_fd;
+    return;
+  }
   Resolve(sock_fd);
 }
 
@@ -17,6 +17,7 @@
 #include <chromeos/patchpanel/socket.h>
 
 #include "dns-proxy/ares_client.h"
+#include "dns-proxy/dns_cache.h"
 #include "dns-proxy/doh_curl_client.h"
 #include "dns-proxy/metrics.h"
 
@@ -42,6 +43,9 @@ constexpr int kDefaultMaxConcurrentQueries = 3;
 // are final. In the case of latter, if DNS over HTTP fails, it will fall back
 // to standard plain-text DNS.
 //
+// Successful and negative responses are cached for their TTL, and repeated
+// queries are answered from the cache without going to the name servers.
+//
 // Resolver listens on UDP and TCP port 53.
 class Resolver {
  public:
@@ -87,7 +91,8 @@ class Resolver {
   // Provided for testing only.
   Resolver(std::unique_ptr<AresClient> ares_client,
            std::unique_ptr<DoHCurlClientInterface> curl_client,
-           std::unique_ptr<Metrics> metrics = nullptr);
+           std::unique_ptr<Metrics> metrics = nullptr,
+           std::unique_ptr<DnsCache> cache = nullptr);
   virtual ~Resolver() = default;
 
   // Listen on an incoming DNS query on address |addr| for UDP and TCP.
@@ -156,6 +161,10 @@ class Resolver {
   // Send back data taken from CURL or Ares to the client.
   void ReplyDNS(SocketFd* sock_fd, unsigned char* msg, size_t len);
 
+  // Reply to the query of |sock_fd| from the cache if its response is cached.
+  // Returns false if the query needs to be resolved.
+  bool ReplyFromCache(SocketFd* sock_fd);
+
   // Disallow DoH fallback to standard plain-text DNS.
   bool always_on_doh_;
 
@@ -187,6 +196,13 @@ class Resolver {
 
   std::unique_ptr<Metrics> metrics_;
 
+  // Responses to previous queries, dropped when the servers change.
+  std::unique_ptr<DnsCache> cache_;
+  // Current name servers and DoH providers, to only drop the cached responses
+  // when they change.
+  std::vector<std::string> name_servers_;
+  std::vector<std::string> doh_providers_;
+
   base::WeakPtrFactory<Resolver> weak_factory_{this};
 };
 }  // namespace dns_proxy
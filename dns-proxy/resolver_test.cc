@@ -4,6 +4,7 @@
 
 #include "dns-proxy/resolver.h"
 
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -13,6 +14,7 @@
 #include <gtest/gtest.h>
 
 #include "dns-proxy/ares_client.h"
+#include "dns-proxy/dns_cache.h"
 #include "dns-proxy/doh_curl_client.h"
 
 using testing::_;
@@ -88,6 +90,44 @@ TEST_F(ResolverTest, SetNameServers) {
   resolver_->SetDoHProviders(kTestDoHProviders);
 }
 
+TEST_F(ResolverTest, ClearCacheOnServerChange) {
+  const char kDnsQuery[] = {'J',    'G',    '\x01', ' ',    '\x00', '\x01',
+                            '\x00', '\x00', '\x00', '\x00', '\x00', '\x00',
+                            '\x06', 'g',    'o',    'o',    'g',    'l',
+                            'e',    '\x03', 'c',    'o',    'm',    '\x00',
+                            '\x00', '\x01', '\x00', '\x01'};
+  // One A record for google.com with a TTL of 60 seconds.
+  const unsigned char kDnsResponse[] = {
+      'J',  'G',  0x81, 0x80, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00,
+      0x00, 0x06, 'g',  'o',  'o',  'g',  'l',  'e',  0x03, 'c',  'o',
+      'm',  0x00, 0x00, 0x01, 0x00, 0x01, 0xc0, 0x0c, 0x00, 0x01, 0x00,
+      0x01, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x04, 0x08, 0x08, 0x08, 0x08};
+  auto cache = std::make_unique<DnsCache>();
+  DnsCache* cache_ptr = cache.get();
+  resolver_ = std::make_unique<Resolver>(
+      std::make_unique<MockAresClient>(), std::make_unique<MockDoHCurlClient>(),
+      nullptr /* metrics */, std::move(cache));
+  resolver_->SetNameServers(kTestNameServers);
+  resolver_->SetDoHProviders(kTestDoHProviders);
+  cache_ptr->Put(kDnsQuery, sizeof(kDnsQuery), kDnsResponse,
+                 sizeof(kDnsResponse));
+  ASSERT_EQ(cache_ptr->size(), 1u);
+
+  // The DoH configuration is updated with the same servers.
+  resolver_->SetNameServers(kTestNameServers);
+  resolver_->SetDoHProviders(kTestDoHProviders);
+  EXPECT_EQ(cache_ptr->size(), 1u);
+
+  resolver_->SetDoHProviders({});
+  EXPECT_EQ(cache_ptr->size(), 0u);
+
+  cache_ptr->Put(kDnsQuery, sizeof(kDnsQuery), kDnsResponse,
+                 sizeof(kDnsResponse));
+  ASSERT_EQ(cache_ptr->size(), 1u);
+  resolver_->SetNameServers({"1.1.1.1"});
+  EXPECT_EQ(cache_ptr->size(), 0u);
+}
+
 TEST_F(ResolverTest, Resolve_DNSDoHServers) {
   EXPECT_CALL(*ares_client_, Resolve(_, _, _, _)).Times(0);
   EXPECT_CALL(*curl_client_, Resolve(_, _, _, _)).WillOnce(Return(true));
@@ -245,6 +245,16 @@ int chromeos_verity(verity::DmBhtInterface* bht,
       return -1;
     }
 
+    // Blocks of a page are hashed several at once.
+    if (blocksize == PAGE_SIZE) {
+      ret = bht->StoreBlocks(cur_block, count / blocksize, io_buffer.get());
+      if (ret) {
+        LOG(ERROR) << "dm_bht_store_blocks returned error: " << ret;
+        return ret;
+      }
+      cur_block += count / blocksize;
+      continue;
+    }
     for (i = 0; i < (count / blocksize); i++) {
       ret = bht->StoreBlock(cur_block, io_buffer.get() + (i * blocksize));
       if (ret) {
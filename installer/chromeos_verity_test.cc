@@ -71,4 +71,30 @@ TEST_F(ChromeOSVerityTest, VerityMultiplePageTest) {
                                /*enforce_rootfs_verification=*/false));
 }
 
+TEST_F(ChromeOSVerityTest, VerityPageBlocksTest) {
+  base::FilePath device = scoped_temp_dir_.GetPath().Append("device");
+
+  // Create device bits, read in 1 MiB buffers of 256 blocks.
+  constexpr int kBlockSize = PAGE_SIZE;
+  constexpr int kNumBlocks = 1000;
+  std::vector<char> buf(kBlockSize * kNumBlocks);
+
+  EXPECT_CALL(mock_bht_, Sectors()).WillOnce(Return(1));
+  EXPECT_CALL(mock_bht_, StoreBlock(_, _)).Times(0);
+  EXPECT_CALL(mock_bht_, StoreBlocks(0, 256, _)).Times(1);
+  EXPECT_CALL(mock_bht_, StoreBlocks(256, 256, _)).Times(1);
+  EXPECT_CALL(mock_bht_, StoreBlocks(512, 256, _)).Times(1);
+  EXPECT_CALL(mock_bht_, StoreBlocks(768, 232, _)).Times(1);
+
+  brillo::WriteToFile(device, buf.data(), buf.size());
+  EXPECT_EQ(0, chromeos_verity(&mock_bht_,
+                               /*alg=*/"",
+                               /*device=*/device.value(),
+                               /*blocksize=*/kBlockSize,
+                               /*fs_blocks=*/kNumBlocks,
+                               /*salt=*/"",
+                               /*expected=*/"",
+                               /*enforce_rootfs_verification=*/false));
+}
+
 }  // namespace verity
@@ -5,6 +5,7 @@
 #include "metrics/metrics_library.h"
 
 #include <base/check.h>
+#include <base/check_op.h>
 #include <base/files/file_enumerator.h>
 #include <base/files/file_util.h>
 #include <base/files/scoped_file.h>
@@ -13,6 +14,7 @@
 #include <base/strings/string_util.h>
 #include <base/strings/stringprintf.h>
 #include <brillo/files/safe_fd.h>
+#include <brillo/userdb_utils.h>
 #include <errno.h>
 #include <session_manager/dbus-proxies.h>
 #include <sys/file.h>
@@ -20,10 +22,12 @@
 
 #include <cstdio>
 #include <cstring>
+#include <utility>
 #include <vector>
 
 #include "metrics/serialization/metric_sample.h"
 #include "metrics/serialization/serialization_utils.h"
+#include "metrics/shared_histograms.h"
 
 #include "policy/device_policy.h"
 
@@ -39,6 +43,17 @@ const char kConsentFile[] = "/home/chronos/Consent To Send Stats";
 const char kDaemonStoreConsentDir[] = "/run/daemon-store/uma-consent";
 const char kDaemonStoreConsentFile[] = "consent-enabled";
 const char kUsePerUserConsentFile[] = "/run/metrics/use-per-user-consent";
+#if USE_METRICS_UPLOADER
+// Without Chrome, uma-events is only read by metrics_daemon, which also reads
+// the more compact binary format.
+constexpr metrics::SerializationUtils::SampleFormat kSampleFormat =
+    metrics::SerializationUtils::SampleFormat::kBinary;
+#else
+constexpr metrics::SerializationUtils::SampleFormat kSampleFormat =
+    metrics::SerializationUtils::SampleFormat::kText;
+#endif
+// How often to look for the shared histograms when they are not available.
+constexpr base::TimeDelta kSharedHistogramsOpenInterval = base::Minutes(1);
 const char kCrosEventHistogramName[] = "Platform.CrOSEvent";
 const int kCrosEventHistogramMax = 100;
 
@@ -102,12 +117,15 @@ time_t MetricsLibrary::cached_enabled_time_ = 0;
 bool MetricsLibrary::cached_enabled_ = false;
 
 MetricsLibrary::MetricsLibrary()
-    : uma_events_file_(base::FilePath(kUMAEventsPath)),
-      consent_file_(base::FilePath(kConsentFile)),
+    : consent_file_(base::FilePath(kConsentFile)),
       daemon_store_dir_(kDaemonStoreConsentDir),
-      per_user_consent_file_(kUsePerUserConsentFile) {}
+      per_user_consent_file_(kUsePerUserConsentFile),
+      shared_histograms_file_(metrics::kSharedHistogramsPath),
+      uma_events_file_(base::FilePath(kUMAEventsPath)) {}
 
-MetricsLibrary::~MetricsLibrary() {}
+MetricsLibrary::~MetricsLibrary() {
+  Flush();
+}
 
 bool MetricsLibrary::IsGuestMode() {
   // Shortcut check whether there is any logged-in user.
@@ -300,7 +318,27 @@ void MetricsLibrary::Init() {
 }
 
 void MetricsLibrary::SetOutputFile(const std::string& output_file) {
-  uma_events_file_ = base::FilePath(output_file);
+  // The buffered samples were meant for the previous file.
+  std::string batch;
+  base::FilePath previous_file;
+  {
+    base::AutoLock lock(batch_lock_);
+    batch.swap(batch_);
+    batch_samples_ = 0;
+    previous_file = uma_events_file_;
+    uma_events_file_ = base::FilePath(output_file);
+  }
+  if (!batch.empty()) {
+    metrics::SerializationUtils::WriteSerializedMetricsToFile(
+        batch, previous_file.value());
+  }
+  base::AutoLock lock(shared_histograms_lock_);
+  use_shared_histograms_ = false;
+}
+
+base::FilePath MetricsLibrary::GetOutputFile() {
+  base::AutoLock lock(batch_lock_);
+  return uma_events_file_;
 }
 
 bool MetricsLibrary::Replay(const std::string& input_file) {
@@ -311,15 +349,106 @@ bool MetricsLibrary::Replay(const std::string& input_file) {
     return false;
   }
   return metrics::SerializationUtils::WriteMetricsToFile(
-      samples, uma_events_file_.value());
+      samples, GetOutputFile().value(), kSampleFormat);
+}
+
+void MetricsLibrary::EnableBatching(size_t max_samples,
+                                    base::TimeDelta max_delay) {
+  DCHECK_GT(max_samples, 0u);
+  base::AutoLock lock(batch_lock_);
+  batching_ = true;
+  batch_max_samples_ = max_samples;
+  batch_max_delay_ = max_delay;
+}
+
+bool MetricsLibrary::Flush() {
+  std::string batch;
+  base::FilePath events_file;
+  {
+    base::AutoLock lock(batch_lock_);
+    batch.swap(batch_);
+    batch_samples_ = 0;
+    events_file = uma_events_file_;
+  }
+  if (batch.empty())
+    return true;
+  return metrics::SerializationUtils::WriteSerializedMetricsToFile(
+      batch, events_file.value());
+}
+
+metrics::SharedHistograms* MetricsLibrary::GetSharedHistograms() {
+  base::AutoLock lock(shared_histograms_lock_);
+  if (!use_shared_histograms_)
+    return nullptr;
+  if (!shared_histograms_) {
+    const base::TimeTicks now = clock_->NowTicks();
+    if (now < next_shared_histograms_open_)
+      return nullptr;
+    // The table is only trusted if it is owned by metrics_daemon.
+    if (!shared_histograms_owner_.has_value()) {
+      uid_t uid;
+      gid_t gid;
+      if (!brillo::userdb::GetUserInfo(metrics::kSharedHistogramsUser, &uid,
+                                       &gid)) {
+        use_shared_histograms_ = false;
+        return nullptr;
+      }
+      shared_histograms_owner_ = std::make_pair(uid, gid);
+    }
+    shared_histograms_ = metrics::SharedHistograms::Open(
+        shared_histograms_file_, shared_histograms_owner_->first,
+        shared_histograms_owner_->second);
+    if (!shared_histograms_)
+      next_shared_histograms_open_ = now + kSharedHistogramsOpenInterval;
+  }
+  return shared_histograms_.get();
+}
+
+bool MetricsLibrary::SendSample(const metrics::MetricSample& sample) {
+  if (!sample.IsValid())
+    return false;
+  // Repeated histogram samples are aggregated in shared memory when the
+  // uploader of metrics_daemon collects them.
+  metrics::SharedHistograms* shared_histograms = GetSharedHistograms();
+  if (shared_histograms && shared_histograms->Add(sample))
+    return true;
+
+  // Serialize outside of the lock so that concurrent senders only contend on
+  // appending to the batch.
+  std::string output;
+  if (!metrics::SerializationUtils::AppendSampleToBuffer(sample, &output,
+                                                         kSampleFormat)) {
+    return false;
+  }
+
+  base::FilePath events_file;
+  {
+    base::AutoLock lock(batch_lock_);
+    events_file = uma_events_file_;
+    if (batching_) {
+      const base::TimeTicks now = clock_->NowTicks();
+      if (batch_.empty())
+        batch_start_ = now;
+      batch_.append(output);
+      if (++batch_samples_ < batch_max_samples_ &&
+          now - batch_start_ < batch_max_delay_) {
+        return true;
+      }
+      // Write the full batch without holding the lock, so that other senders
+      // can start the next one meanwhile.
+      output = std::move(batch_);
+      batch_.clear();
+      batch_samples_ = 0;
+    }
+  }
+  return metrics::SerializationUtils::WriteSerializedMetricsToFile(
+      output, events_file.value());
 }
 
 bool MetricsLibrary::SendToUMA(
     const std::string& name, int sample, int min, int max, int nbuckets) {
-  return metrics::SerializationUtils::WriteMetricsToFile(
-      {metrics::MetricSample::HistogramSample(name, sample, min, max,
-                                              nbuckets)},
-      uma_events_file_.value());
+  return SendSample(
+      metrics::MetricSample::HistogramSample(name, sample, min, max, nbuckets));
 }
 
 #if USE_METRICS_UPLOADER
@@ -329,10 +458,8 @@ bool MetricsLibrary::SendRepeatedToUMA(const std::string& name,
                                        int max,
                                        int nbuckets,
                                        int num_samples) {
-  return metrics::SerializationUtils::WriteMetricsToFile(
-      {metrics::MetricSample::HistogramSample(name, sample, min, max, nbuckets,
-                                              num_samples)},
-      uma_events_file_.value());
+  return SendSample(metrics::MetricSample::HistogramSample(
+      name, sample, min, max, nbuckets, num_samples));
 }
 #endif
 
@@ -343,33 +470,25 @@ void MetricsLibrary::SetConsentFileForTest(const base::FilePath& consent_file) {
 bool MetricsLibrary::SendEnumToUMA(const std::string& name,
                                    int sample,
                                    int max) {
-  return metrics::SerializationUtils::WriteMetricsToFile(
-      {metrics::MetricSample::LinearHistogramSample(name, sample, max)},
-      uma_events_file_.value());
+  return SendSample(
+      metrics::MetricSample::LinearHistogramSample(name, sample, max));
 }
 
 bool MetricsLibrary::SendBoolToUMA(const std::string& name, bool sample) {
-  return metrics::SerializationUtils::WriteMetricsToFile(
-      {metrics::MetricSample::LinearHistogramSample(name, sample ? 1 : 0, 2)},
-      uma_events_file_.value());
+  return SendSample(
+      metrics::MetricSample::LinearHistogramSample(name, sample ? 1 : 0, 2));
 }
 
 bool MetricsLibrary::SendSparseToUMA(const std::string& name, int sample) {
-  return metrics::SerializationUtils::WriteMetricsToFile(
-      {metrics::MetricSample::SparseHistogramSample(name, sample)},
-      uma_events_file_.value());
+  return SendSample(metrics::MetricSample::SparseHistogramSample(name, sample));
 }
 
 bool MetricsLibrary::SendUserActionToUMA(const std::string& action) {
-  return metrics::SerializationUtils::WriteMetricsToFile(
-      {metrics::MetricSample::UserActionSample(action)},
-      uma_events_file_.value());
+  return SendSample(metrics::MetricSample::UserActionSample(action));
 }
 
 bool MetricsLibrary::SendCrashToUMA(const char* crash_kind) {
-  return metrics::SerializationUtils::WriteMetricsToFile(
-      {metrics::MetricSample::CrashSample(crash_kind)},
-      uma_events_file_.value());
+  return SendSample(metrics::MetricSample::CrashSample(crash_kind));
 }
 
 void MetricsLibrary::SetPolicyProvider(policy::PolicyProvider* provider) {
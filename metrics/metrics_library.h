@@ -9,15 +9,25 @@
 #include <unistd.h>
 #include <memory>
 #include <string>
+#include <utility>
 
 #include <base/compiler_specific.h>
 #include <base/files/file_path.h>
 #include <base/macros.h>
+#include <base/synchronization/lock.h>
+#include <base/time/default_tick_clock.h>
+#include <base/time/tick_clock.h>
+#include <base/time/time.h>
 #include <gtest/gtest_prod.h>  // for FRIEND_TEST
 
 #include "policy/libpolicy.h"
 #include "third_party/abseil-cpp/absl/types/optional.h"
 
+namespace metrics {
+class MetricSample;
+class SharedHistograms;
+}  // namespace metrics
+
 class MetricsLibraryInterface {
  public:
   virtual void Init() = 0;  // TODO(chromium:940343): Remove this function.
@@ -62,6 +72,11 @@ class MetricsLibraryInterface {
 // Library used to send metrics to Chrome/UMA.
 class MetricsLibrary : public MetricsLibraryInterface {
  public:
+  // Default thresholds at which the samples buffered by EnableBatching() are
+  // written out.
+  static constexpr size_t kDefaultBatchMaxSamples = 100;
+  static constexpr base::TimeDelta kDefaultBatchMaxDelay = base::Seconds(10);
+
   MetricsLibrary();
   MetricsLibrary(const MetricsLibrary&) = delete;
   MetricsLibrary& operator=(const MetricsLibrary&) = delete;
@@ -102,12 +117,33 @@ class MetricsLibrary : public MetricsLibraryInterface {
   // fully available (e.g. when /var is not mounted). Note that the contents of
   // custom output files will not be sent to the server automatically, but need
   // to be imported via Replay() to get picked up by the reporting pipeline.
+  // Samples are then never counted in the shared histograms of metrics_daemon.
   void SetOutputFile(const std::string& output_file) override;
 
   // Replays metrics from the given file as if the events contained in |file|
   // where being generated via the SendXYZ functions.
   bool Replay(const std::string& input_file);
 
+  // By default, each sample sent by the SendXYZ functions is appended to the
+  // events file right away, which opens and locks the file once per sample.
+  // Once batching is enabled, samples are buffered in memory instead and
+  // appended in a single locked write when |max_samples| samples are buffered,
+  // when a sample is sent |max_delay| or more after the oldest buffered one,
+  // on Flush() and when the library is destroyed. Note that |max_delay| is
+  // only checked when a sample is sent: callers which may stop sending samples
+  // for a while should call Flush() themselves.
+  //
+  // Batching delays the delivery of samples to Chrome, and the buffered
+  // samples are lost if the process crashes, so it is meant for processes
+  // which send many samples. The SendXYZ functions and Flush() can be called
+  // from several threads concurrently.
+  void EnableBatching(size_t max_samples = kDefaultBatchMaxSamples,
+                      base::TimeDelta max_delay = kDefaultBatchMaxDelay);
+
+  // Writes the samples buffered since the last write to the events file.
+  // Returns true on success or if no sample was buffered.
+  bool Flush();
+
   // Sends histogram data to Chrome for transport to UMA and returns
   // true on success. This method results in the equivalent of an
   // asynchronous non-blocking RPC to UMA_HISTOGRAM_CUSTOM_COUNTS
@@ -227,6 +263,17 @@ class MetricsLibrary : public MetricsLibraryInterface {
     per_user_consent_file_ = per_user_consent_file;
   }
 
+  void SetClockForTest(const base::TickClock* clock) { clock_ = clock; }
+
+  // Counts the histogram samples in the shared histograms of |file|, which
+  // must be owned by the caller.
+  void SetSharedHistogramsFileForTest(const base::FilePath& file) {
+    base::AutoLock lock(shared_histograms_lock_);
+    shared_histograms_file_ = file;
+    shared_histograms_owner_ = std::make_pair(geteuid(), getegid());
+    use_shared_histograms_ = true;
+  }
+
  private:
   friend class CMetricsLibraryTest;
   friend class MetricsLibraryTest;
@@ -246,18 +293,56 @@ class MetricsLibrary : public MetricsLibraryInterface {
   // multiple users are signed in simultaneously.
   absl::optional<bool> ArePerUserMetricsEnabled();
 
+  // Counts |sample| in the shared histograms if it can, or else appends it to
+  // the events file, or buffers it if batching is enabled.
+  bool SendSample(const metrics::MetricSample& sample);
+
+  // Returns the events file that the samples are appended to.
+  base::FilePath GetOutputFile();
+
+  // Returns the shared histograms, or null if metrics_daemon has not created
+  // them, in which case they are looked for again at most once per minute.
+  metrics::SharedHistograms* GetSharedHistograms();
+
   // Time at which we last checked if metrics were enabled.
   static time_t cached_enabled_time_;
 
   // Cached state of whether or not metrics were enabled.
   static bool cached_enabled_;
 
-  base::FilePath uma_events_file_;
   base::FilePath consent_file_;
   base::FilePath daemon_store_dir_;
   base::FilePath per_user_consent_file_;
 
   std::unique_ptr<policy::PolicyProvider> policy_provider_;
+
+  const base::TickClock* clock_ = base::DefaultTickClock::GetInstance();
+
+  base::Lock shared_histograms_lock_;
+  base::FilePath shared_histograms_file_ GUARDED_BY(shared_histograms_lock_);
+  bool use_shared_histograms_ GUARDED_BY(shared_histograms_lock_) = true;
+  // User and group which must own the shared histograms, looked up on first
+  // use.
+  absl::optional<std::pair<uid_t, gid_t>> shared_histograms_owner_
+      GUARDED_BY(shared_histograms_lock_);
+  // Once set, |shared_histograms_| is kept until destruction, so that it can
+  // be used without holding the lock.
+  std::unique_ptr<metrics::SharedHistograms> shared_histograms_
+      GUARDED_BY(shared_histograms_lock_);
+  base::TimeTicks next_shared_histograms_open_
+      GUARDED_BY(shared_histograms_lock_);
+
+  base::Lock batch_lock_;
+  // Read by senders on any thread while SetOutputFile() may change it.
+  base::FilePath uma_events_file_ GUARDED_BY(batch_lock_);
+  bool batching_ GUARDED_BY(batch_lock_) = false;
+  size_t batch_max_samples_ GUARDED_BY(batch_lock_) = 0;
+  base::TimeDelta batch_max_delay_ GUARDED_BY(batch_lock_);
+  // Serialized samples waiting to be written, and when the first of them was
+  // sent.
+  std::string batch_ GUARDED_BY(batch_lock_);
+  size_t batch_samples_ GUARDED_BY(batch_lock_) = 0;
+  base::TimeTicks batch_start_ GUARDED_BY(batch_lock_);
 };
 
 #endif  // METRICS_METRICS_LIBRARY_H_
@@ -0,0 +1,79 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures the number of samples per second that concurrent writers can send
+// with MetricsLibrary, appending each sample to the events file as it is sent
+// or in batches. The events file is created in a temporary directory.
+// Usage: metrics_library_benchmark [benchmark flags]
+
+#include <thread>
+#include <vector>
+
+#include <base/at_exit.h>
+#include <base/check.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <benchmark/benchmark.h>
+
+#include "metrics/metrics_library.h"
+
+namespace {
+
+// Samples sent by each writer per benchmark iteration.
+constexpr int kSamplesPerWriter = 1000;
+
+// Arguments: the number of writer threads, and the number of samples written
+// at once, where 1 disables batching.
+void BM_SendToUMA(benchmark::State& state) {
+  base::ScopedTempDir temp_dir;
+  CHECK(temp_dir.CreateUniqueTempDir());
+  const base::FilePath events_file = temp_dir.GetPath().Append("uma-events");
+
+  MetricsLibrary lib;
+  lib.SetOutputFile(events_file.value());
+  if (state.range(1) > 1)
+    lib.EnableBatching(state.range(1));
+
+  for (auto _ : state) {
+    std::vector<std::thread> writers;
+    for (int i = 0; i < state.range(0); i++) {
+      writers.emplace_back([&lib] {
+        for (int j = 0; j < kSamplesPerWriter; j++)
+          lib.SendToUMA("Benchmark.Histogram", j % 100, 1, 100, 50);
+      });
+    }
+    for (auto& writer : writers)
+      writer.join();
+    CHECK(lib.Flush());
+
+    // Keep the events file from growing across iterations, as metrics_daemon
+    // would.
+    state.PauseTiming();
+    CHECK(base::WriteFile(events_file, ""));
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0) *
+                          kSamplesPerWriter);
+}
+BENCHMARK(BM_SendToUMA)
+    ->ArgNames({"writers", "batch"})
+    ->Args({1, 1})
+    ->Args({1, MetricsLibrary::kDefaultBatchMaxSamples})
+    ->Args({4, 1})
+    ->Args({4, MetricsLibrary::kDefaultBatchMaxSamples})
+    ->Args({16, 1})
+    ->Args({16, MetricsLibrary::kDefaultBatchMaxSamples})
+    ->UseRealTime();
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit;
+  logging::SetMinLogLevel(logging::LOGGING_WARNING);
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -5,10 +5,16 @@
 #include <unistd.h>
 
 #include <cstring>
+#include <memory>
+#include <string>
 #include <utility>
+#include <vector>
 
+#include <base/bind.h>
 #include <base/files/file_util.h>
 #include <base/files/scoped_temp_dir.h>
+#include <base/test/simple_test_tick_clock.h>
+#include <base/time/time.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <policy/libpolicy.h>
@@ -17,6 +23,9 @@
 #include "metrics/c_metrics_library.h"
 #include "metrics/metrics_library.h"
 #include "metrics/metrics_library_mock.h"
+#include "metrics/serialization/metric_sample.h"
+#include "metrics/serialization/serialization_utils.h"
+#include "metrics/shared_histograms.h"
 
 using base::FilePath;
 using ::testing::_;
@@ -78,6 +87,16 @@ class MetricsLibraryTest : public testing::Test {
     lib_.cached_enabled_time_ = 0;
   }
 
+  // Returns the number of samples written to the events file since the last
+  // call, and empties the file.
+  size_t ReadSamples() {
+    std::vector<metrics::MetricSample> samples;
+    EXPECT_TRUE(metrics::SerializationUtils::ReadAndTruncateMetricsFromFile(
+        kTestUMAEventsFile.value(), &samples,
+        metrics::SerializationUtils::kSampleBatchMaxLength));
+    return samples.size();
+  }
+
   void SetPerUserConsent(bool value) {
     if (value) {
       EXPECT_EQ(1, WriteFile(test_dir_.Append("hash/consent-enabled"), "1", 1));
@@ -324,6 +343,100 @@ TEST_F(MetricsLibraryTest, AreMetricsEnabledCaching) {
   VerifyEnabledCacheEviction(true);
 }
 
+TEST_F(MetricsLibraryTest, SendWithoutBatching) {
+  EXPECT_TRUE(lib_.SendToUMA("Test.Histogram", 5, 1, 100, 50));
+  EXPECT_TRUE(lib_.SendSparseToUMA("Test.Sparse", 5));
+  EXPECT_EQ(ReadSamples(), 2u);
+  EXPECT_TRUE(lib_.Flush());
+  EXPECT_EQ(ReadSamples(), 0u);
+}
+
+TEST_F(MetricsLibraryTest, BatchingWritesFullBatches) {
+  lib_.EnableBatching(3 /* max_samples */, base::Hours(1));
+  EXPECT_TRUE(lib_.SendToUMA("Test.Histogram", 5, 1, 100, 50));
+  EXPECT_TRUE(lib_.SendEnumToUMA("Test.Enum", 1, 3));
+  EXPECT_EQ(ReadSamples(), 0u);
+  EXPECT_TRUE(lib_.SendBoolToUMA("Test.Bool", true));
+  EXPECT_EQ(ReadSamples(), 3u);
+
+  // Invalid samples are rejected without spoiling the batch.
+  EXPECT_TRUE(lib_.SendUserActionToUMA("Test.Action"));
+  EXPECT_FALSE(lib_.SendSparseToUMA("no space", 10));
+  EXPECT_TRUE(lib_.SendCrashToUMA("kernel"));
+  EXPECT_EQ(ReadSamples(), 0u);
+  EXPECT_TRUE(lib_.Flush());
+  EXPECT_EQ(ReadSamples(), 2u);
+}
+
+TEST_F(MetricsLibraryTest, BatchingWritesOldBatches) {
+  base::SimpleTestTickClock clock;
+  lib_.SetClockForTest(&clock);
+  lib_.EnableBatching(100 /* max_samples */, base::Seconds(10));
+  EXPECT_TRUE(lib_.SendSparseToUMA("Test.Sparse", 1));
+  clock.Advance(base::Seconds(9));
+  EXPECT_TRUE(lib_.SendSparseToUMA("Test.Sparse", 2));
+  EXPECT_EQ(ReadSamples(), 0u);
+  clock.Advance(base::Seconds(1));
+  EXPECT_TRUE(lib_.SendSparseToUMA("Test.Sparse", 3));
+  EXPECT_EQ(ReadSamples(), 3u);
+
+  // The delay starts over with the next batch.
+  clock.Advance(base::Seconds(9));
+  EXPECT_TRUE(lib_.SendSparseToUMA("Test.Sparse", 4));
+  EXPECT_EQ(ReadSamples(), 0u);
+}
+
+TEST_F(MetricsLibraryTest, BatchingFlushesOnDestructionAndNewFile) {
+  const FilePath other_file = test_dir_.Append("other-uma-events");
+  {
+    MetricsLibrary lib;
+    lib.SetOutputFile(kTestUMAEventsFile.value());
+    lib.EnableBatching();
+    EXPECT_TRUE(lib.SendSparseToUMA("Test.Sparse", 1));
+    lib.SetOutputFile(other_file.value());
+    EXPECT_EQ(ReadSamples(), 1u);
+    EXPECT_TRUE(lib.SendSparseToUMA("Test.Sparse", 2));
+    EXPECT_TRUE(lib.SendSparseToUMA("Test.Sparse", 3));
+  }
+  std::vector<metrics::MetricSample> samples;
+  EXPECT_TRUE(metrics::SerializationUtils::ReadAndTruncateMetricsFromFile(
+      other_file.value(), &samples,
+      metrics::SerializationUtils::kSampleBatchMaxLength));
+  EXPECT_EQ(samples.size(), 2u);
+}
+
+TEST_F(MetricsLibraryTest, SharedHistograms) {
+  const FilePath shared_file = test_dir_.Append("shared-histograms");
+  lib_.SetSharedHistogramsFileForTest(shared_file);
+  std::unique_ptr<metrics::SharedHistograms> shared_histograms =
+      metrics::SharedHistograms::Create(shared_file, 16);
+  ASSERT_TRUE(shared_histograms);
+
+  // Histogram samples are counted in the shared histograms, other samples are
+  // written to the events file.
+  EXPECT_TRUE(lib_.SendSparseToUMA("Test.Sparse", 5));
+  EXPECT_TRUE(lib_.SendSparseToUMA("Test.Sparse", 5));
+  EXPECT_TRUE(lib_.SendEnumToUMA("Test.Enum", 1, 3));
+  EXPECT_TRUE(lib_.SendCrashToUMA("kernel"));
+  EXPECT_FALSE(lib_.SendSparseToUMA("no space", 10));
+  EXPECT_EQ(ReadSamples(), 1u);
+
+  std::vector<std::pair<std::string, int>> counts;
+  shared_histograms->Snapshot(base::BindRepeating(
+      [](std::vector<std::pair<std::string, int>>* counts,
+         const metrics::MetricSample& sample,
+         int count) { counts->emplace_back(sample.name(), count); },
+      &counts));
+  EXPECT_THAT(counts, ::testing::UnorderedElementsAre(
+                          std::pair<std::string, int>("Test.Sparse", 2),
+                          std::pair<std::string, int>("Test.Enum", 1)));
+
+  // Samples sent to another file are never counted.
+  lib_.SetOutputFile(kTestUMAEventsFile.value());
+  EXPECT_TRUE(lib_.SendSparseToUMA("Test.Sparse", 5));
+  EXPECT_EQ(ReadSamples(), 1u);
+}
+
 class CMetricsLibraryTest : public testing::Test {
  protected:
   void SetUp() override {
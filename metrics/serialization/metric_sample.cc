@@ -4,6 +4,7 @@
 
 #include "metrics/serialization/metric_sample.h"
 
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -16,6 +17,53 @@
 #include <base/check_op.h>
 
 namespace metrics {
+namespace {
+
+// Appends |value| to |output| as a base 128 varint, least significant group
+// first.
+void AppendVarint(uint32_t value, std::string* output) {
+  while (value >= 0x80) {
+    output->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  output->push_back(static_cast<char>(value));
+}
+
+// Appends the signed |value| with zigzag encoding, so that small negative
+// values stay short.
+void AppendSignedVarint(int value, std::string* output) {
+  const uint32_t bits = static_cast<uint32_t>(value);
+  AppendVarint((bits << 1) ^ (value < 0 ? 0xffffffffu : 0u), output);
+}
+
+// Reads a varint from |serialized| at |*pos| and advances |*pos| past it.
+// Returns false if the varint is truncated or does not fit in 32 bits.
+bool ReadVarint(const std::string& serialized, size_t* pos, uint32_t* value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (*pos >= serialized.size())
+      return false;
+    const uint8_t byte = serialized[(*pos)++];
+    result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      if (result > std::numeric_limits<uint32_t>::max())
+        return false;
+      *value = static_cast<uint32_t>(result);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ReadSignedVarint(const std::string& serialized, size_t* pos, int* value) {
+  uint32_t bits;
+  if (!ReadVarint(serialized, pos, &bits))
+    return false;
+  *value = static_cast<int>((bits >> 1) ^ (~(bits & 1) + 1));
+  return true;
+}
+
+}  // namespace
 
 MetricSample::MetricSample(MetricSample::SampleType sample_type,
                            const std::string& metric_name,
@@ -88,6 +136,91 @@ std::string MetricSample::ToString() const {
   return std::string();
 }
 
+std::string MetricSample::ToBinary() const {
+  std::string output(1, kBinaryFormatVersion);
+  AppendVarint(type_, &output);
+  AppendVarint(name_.size(), &output);
+  output.append(name_);
+  switch (type_) {
+    case CRASH:
+    case USER_ACTION:
+      break;
+    case SPARSE_HISTOGRAM:
+      AppendSignedVarint(sample_, &output);
+      break;
+    case LINEAR_HISTOGRAM:
+      AppendSignedVarint(sample_, &output);
+      AppendSignedVarint(max_, &output);
+      break;
+    case HISTOGRAM:
+      AppendSignedVarint(sample_, &output);
+      AppendSignedVarint(min_, &output);
+      AppendSignedVarint(max_, &output);
+      AppendSignedVarint(bucket_count_, &output);
+      AppendSignedVarint(num_samples_, &output);
+      break;
+    default:
+      NOTREACHED() << "Invalid sample type" << type_;
+      return std::string();
+  }
+  return output;
+}
+
+// static
+MetricSample MetricSample::ParseBinary(const std::string& serialized) {
+  if (serialized.empty() || serialized[0] != kBinaryFormatVersion)
+    return MetricSample();
+
+  size_t pos = 1;
+  uint32_t type, name_length;
+  if (!ReadVarint(serialized, &pos, &type) ||
+      !ReadVarint(serialized, &pos, &name_length) ||
+      name_length > serialized.size() - pos) {
+    return MetricSample();
+  }
+  const std::string name = serialized.substr(pos, name_length);
+  pos += name_length;
+
+  // Ignore samples with trailing data, which are likely corrupted.
+  int sample, min, max, bucket_count, num_samples;
+  switch (type) {
+    case CRASH:
+      if (pos != serialized.size())
+        return MetricSample();
+      return CrashSample(name);
+    case USER_ACTION:
+      if (pos != serialized.size())
+        return MetricSample();
+      return UserActionSample(name);
+    case SPARSE_HISTOGRAM:
+      if (!ReadSignedVarint(serialized, &pos, &sample) ||
+          pos != serialized.size()) {
+        return MetricSample();
+      }
+      return SparseHistogramSample(name, sample);
+    case LINEAR_HISTOGRAM:
+      if (!ReadSignedVarint(serialized, &pos, &sample) ||
+          !ReadSignedVarint(serialized, &pos, &max) ||
+          pos != serialized.size()) {
+        return MetricSample();
+      }
+      return LinearHistogramSample(name, sample, max);
+    case HISTOGRAM:
+      if (!ReadSignedVarint(serialized, &pos, &sample) ||
+          !ReadSignedVarint(serialized, &pos, &min) ||
+          !ReadSignedVarint(serialized, &pos, &max) ||
+          !ReadSignedVarint(serialized, &pos, &bucket_count) ||
+          !ReadSignedVarint(serialized, &pos, &num_samples) ||
+          pos != serialized.size()) {
+        return MetricSample();
+      }
+      return HistogramSample(name, sample, min, max, bucket_count,
+                             num_samples);
+    default:
+      return MetricSample();
+  }
+}
+
 int MetricSample::sample() const {
   CHECK_NE(type_, USER_ACTION);
   CHECK_NE(type_, CRASH);
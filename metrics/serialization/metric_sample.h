@@ -17,7 +17,14 @@ namespace metrics {
 // It is meant to be a simple container with serialization functions.
 class MetricSample {
  public:
-  // Types of metric sample used.
+  // Version of the binary serialization format written by ToBinary(). Binary
+  // messages start with their version, which is always below 0x20 so that
+  // they cannot be mistaken for text messages.
+  static constexpr char kBinaryFormatVersion = 1;
+
+  // Types of metric sample used. These values are written by ToBinary():
+  // entries should not be renumbered and numeric values should never be
+  // reused.
   enum SampleType {
     INVALID,
     CRASH,
@@ -67,6 +74,19 @@ class MetricSample {
   // linearhistogram: linearhistogram\0|name_| |sample_| |max_|\0
   std::string ToString() const;
 
+  // Returns a serialized version of the sample in the compact binary format,
+  // which is only read by metrics_daemon and not by Chrome.
+  //
+  // The serialized message is the format version followed by varints: the
+  // type, the length of |name_|, |name_| itself, then the values of the type
+  // in the order of the text format, zigzag-encoded. Histograms always carry
+  // |num_samples_|.
+  std::string ToBinary() const;
+
+  // Deserializes a sample serialized by ToBinary(). Returns an invalid sample
+  // if |serialized| is malformed or of an unknown version.
+  static MetricSample ParseBinary(const std::string& serialized);
+
   // Builds a crash sample.
   static MetricSample CrashSample(const std::string& crash_name);
 
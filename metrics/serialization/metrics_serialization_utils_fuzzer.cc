@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <string>
 #include <vector>
 
 #include <base/check.h>
@@ -33,5 +34,16 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
   metrics::SerializationUtils::ReadAndTruncateMetricsFromFile(
       metrics_file.value(), &samples, kSampleBatchMaxLengthForFuzzing);
 
+  // Also parse the input as a single message, in the text or binary format
+  // depending on its first byte. Valid samples must survive a round trip
+  // through the binary format, which unlike the text format can represent any
+  // of them.
+  const metrics::MetricSample sample = metrics::SerializationUtils::ParseSample(
+      std::string(reinterpret_cast<const char*>(data), size));
+  if (sample.IsValid()) {
+    CHECK(sample.IsEqual(
+        metrics::MetricSample::ParseBinary(sample.ToBinary())));
+  }
+
   return 0;
 }
@@ -11,6 +11,7 @@
 #include <utility>
 #include <vector>
 
+#include "base/bind.h"
 #include "base/files/file_path.h"
 #include "base/files/file_util.h"
 #include "base/files/scoped_file.h"
@@ -20,6 +21,7 @@
 #include "metrics/serialization/metric_sample.h"
 
 #include <base/check.h>
+#include <base/check_op.h>
 
 #define READ_WRITE_ALL_FILE_FLAGS \
   (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)
@@ -31,22 +33,24 @@ namespace {
 // when the file has been partially uploaded.
 constexpr char kMagicString[] = {'S', 'K', 'I', 'P'};
 
+// Size of the buffer messages are read through. It must hold at least one
+// message of kMessageMaxLength.
+constexpr size_t kReadBufferSize = 32 * 1024;
+static_assert(kReadBufferSize >= SerializationUtils::kMessageMaxLength,
+              "The read buffer must hold the longest message");
+
 // Leaves a marker at the beginning of the metrics file, to indicate that the
-// first part of the file has been processed.  The marker starts with a 4-byte
-// magic number ("SKIP") followed by the offset to the remaining samples.
-// Returns true on success, false on errors.
+// part of the file before |offset| has been processed.  The marker starts with
+// a 4-byte magic number ("SKIP") followed by the offset to the remaining
+// samples.  Returns true on success, false on errors.
 //
 // Since the file could also start with a regular message, whose 4-byte header
 // indicates its size, the magic number must be an invalid size i.e. greater
 // than kMessageMaxLength when read as an uint32_t in any byte order.
-bool RemovePreviousSamples(int fd) {
-  off_t offset = lseek(fd, 0, SEEK_CUR);
+bool RemovePreviousSamples(int fd, off_t offset) {
   char marker[sizeof(kMagicString) + sizeof(off_t)];
 
-  if (offset == static_cast<off_t>(-1)) {
-    PLOG(ERROR) << "cannot find offset in metrics log";
-    return false;
-  } else if (offset < sizeof(marker)) {
+  if (offset < sizeof(marker)) {
     LOG(ERROR) << "metrics log offset is too small: " << offset;
     return false;
   }
@@ -70,9 +74,9 @@ bool RemovePreviousSamples(int fd) {
   return true;
 }
 
-// Seeks to the first valid sample in an incompletely-uploaded metrics log, as
-// needed.
-void SeekToSamples(int fd) {
+// Returns the offset of the first valid sample in an incompletely-uploaded
+// metrics log, or 0.
+off_t FindSamples(int fd) {
   char marker[sizeof(kMagicString) + sizeof(off_t)];
   off_t offset;
 
@@ -81,32 +85,94 @@ void SeekToSamples(int fd) {
   // Also, we don't need to worry about errors, as we'll hit them again shortly.
   if (pread(fd, &marker, sizeof(marker), 0) != sizeof(marker) ||
       memcmp(marker, kMagicString, sizeof(kMagicString)) != 0)
-    return;
+    return 0;
 
   memcpy(&offset, marker + sizeof(kMagicString), sizeof(off_t));
-  if (lseek(fd, offset, SEEK_SET) < 0) {
-    // This isn't really recoverable, but the earlier pread() did not change
-    // the offset, and an error will be generated when reading the first sample.
-    PLOG(WARNING) << "could not seek to samples at offset " << offset;
+  if (offset < 0) {
+    // This isn't really recoverable, but an error will be generated when
+    // reading the first sample.
+    LOG(WARNING) << "invalid offset to samples " << offset;
   }
+  return offset;
 }
 
-// Reads the next message from |file_descriptor| into |message|.
-//
-// |message| will be set to the empty string if no message could be read (EOF)
-// or the message was badly constructed.
-//
-// Returns false if no message can be read from this file anymore (EOF or
-// unrecoverable error).
-bool ReadMessage(int fd, std::string* message_out, size_t* bytes_used_out) {
+// Reads the messages of a metrics log through a fixed-size buffer, so that
+// most messages are read without a system call and memory use does not depend
+// on the size of the log.
+class MessageReader {
+ public:
+  MessageReader(int fd, off_t offset)
+      : fd_(fd), offset_(offset), buffer_(kReadBufferSize) {}
+  MessageReader(const MessageReader&) = delete;
+  MessageReader& operator=(const MessageReader&) = delete;
+
+  // Offset in the file of the next message.
+  off_t offset() const { return offset_; }
+
+  // Reads the next message into |message_out|.
+  //
+  // |message_out| will be set to the empty string if the message was badly
+  // constructed.
+  //
+  // Returns false if no message can be read from this file anymore (EOF or
+  // unrecoverable error).
+  bool ReadMessage(std::string* message_out, size_t* bytes_used_out);
+
+ private:
+  // Reads from the file until at least |size| bytes are buffered, or the end
+  // of the file is reached. Returns the number of buffered bytes, or -1 on
+  // errors.
+  ssize_t Fill(size_t size);
+
+  // Drops |size| bytes, which may not all be buffered.
+  void Skip(size_t size);
+
+  const int fd_;
+  // Offset in the file of buffer_[begin_].
+  off_t offset_;
+  std::vector<char> buffer_;
+  size_t begin_ = 0;
+  size_t end_ = 0;
+};
+
+ssize_t MessageReader::Fill(size_t size) {
+  DCHECK_LE(size, buffer_.size());
+  if (end_ - begin_ >= size)
+    return end_ - begin_;
+
+  memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+  end_ -= begin_;
+  begin_ = 0;
+  while (end_ < size) {
+    // pread() leaves the file offset alone, as the buffer runs ahead of it.
+    ssize_t result = HANDLE_EINTR(pread(fd_, buffer_.data() + end_,
+                                        buffer_.size() - end_, offset_ + end_));
+    if (result < 0)
+      return -1;
+    if (result == 0)
+      break;
+    end_ += result;
+  }
+  return end_;
+}
+
+void MessageReader::Skip(size_t size) {
+  if (size < end_ - begin_) {
+    begin_ += size;
+  } else {
+    begin_ = end_ = 0;
+  }
+  offset_ += size;
+}
+
+bool MessageReader::ReadMessage(std::string* message_out,
+                                size_t* bytes_used_out) {
   CHECK(message_out);
 
-  int result;
+  ssize_t result;
   uint32_t message_size;
   const size_t message_hdr_size = sizeof(message_size);
-  // The file containing the metrics does not leave the device, so the writer
-  // and the reader always have the same endianness.
-  result = HANDLE_EINTR(read(fd, &message_size, sizeof(message_size)));
+  result = Fill(message_hdr_size);
   if (result < 0) {
     PLOG(ERROR) << "failed to read message header";
     return false;
@@ -120,16 +186,15 @@ bool ReadMessage(int fd, std::string* message_out, size_t* bytes_used_out) {
                << sizeof(message_size);
     return false;
   }
+  // The file containing the metrics does not leave the device, so the writer
+  // and the reader always have the same endianness.
+  memcpy(&message_size, buffer_.data() + begin_, message_hdr_size);
 
   // kMessageMaxLength applies to the entire message: the 4-byte
   // length field and the content.
   if (message_size > SerializationUtils::kMessageMaxLength) {
     LOG(ERROR) << "message too long, length = " << message_size;
-    if (HANDLE_EINTR(lseek(fd, message_size - message_hdr_size, SEEK_CUR)) ==
-        -1) {
-      PLOG(ERROR) << "error while skipping message. Aborting.";
-      return false;
-    }
+    Skip(message_size);
     // Badly formatted message was skipped. Treat the badly formatted sample as
     // an empty sample.
     message_out->clear();
@@ -141,14 +206,16 @@ bool ReadMessage(int fd, std::string* message_out, size_t* bytes_used_out) {
     return false;
   }
 
-  message_size -= message_hdr_size;  // The message size includes itself.
-  char buffer[SerializationUtils::kMessageMaxLength];
-  if (!base::ReadFromFD(fd, buffer, message_size)) {
+  result = Fill(message_size);
+  if (result < message_size) {
     LOG(ERROR) << "failed to read message body";
     return false;
   }
-  *message_out = std::string(buffer, message_size);
-  *bytes_used_out = message_size + message_hdr_size;
+  // The message size includes itself.
+  message_out->assign(buffer_.data() + begin_ + message_hdr_size,
+                      message_size - message_hdr_size);
+  Skip(message_size);
+  *bytes_used_out = message_size;
   return true;
 }
 
@@ -158,6 +225,9 @@ MetricSample SerializationUtils::ParseSample(const std::string& sample) {
   if (sample.empty())
     return MetricSample();
 
+  if (sample[0] == MetricSample::kBinaryFormatVersion)
+    return MetricSample::ParseBinary(sample);
+
   // Can't split at \0 anymore, so replace null chars with \n.
   std::string sample_copy = sample;
   std::replace(sample_copy.begin(), sample_copy.end(), '\0', '\n');
@@ -193,6 +263,20 @@ bool SerializationUtils::ReadAndTruncateMetricsFromFile(
     const std::string& filename,
     std::vector<MetricSample>* metrics,
     size_t sample_batch_max_length) {
+  return ReadAndTruncateMetricsFromFile(
+      filename,
+      base::BindRepeating(
+          [](std::vector<MetricSample>* metrics, const MetricSample& sample) {
+            metrics->push_back(sample);
+          },
+          metrics),
+      sample_batch_max_length);
+}
+
+bool SerializationUtils::ReadAndTruncateMetricsFromFile(
+    const std::string& filename,
+    const SampleCallback& callback,
+    size_t sample_batch_max_length) {
   struct stat stat_buf = {};
   int result;
   off_t total_length = 0;
@@ -224,7 +308,7 @@ bool SerializationUtils::ReadAndTruncateMetricsFromFile(
   // left by an earlier partial read if the file was too large.  Normally there
   // are none, but following long stretches of time without connectivity, there
   // could be a large number.  (They are optimized away by fallocate().)
-  SeekToSamples(fd.get());
+  MessageReader reader(fd.get(), FindSamples(fd.get()));
 
   // Try to process all messages in the log, but stop when
   // kMaxMetricsBytesCount has been exceeded.  If all messages are read and
@@ -237,18 +321,18 @@ bool SerializationUtils::ReadAndTruncateMetricsFromFile(
     std::string message;
     size_t bytes_used = 0;
 
-    if (!ReadMessage(fd.get(), &message, &bytes_used))
+    if (!reader.ReadMessage(&message, &bytes_used))
       break;
 
     MetricSample sample = ParseSample(message);
     if (sample.IsValid())
-      metrics->push_back(std::move(sample));
+      callback.Run(sample);
 
     total_length += bytes_used;
     if (total_length > sample_batch_max_length) {
       // Set up the file to continue processing.  Avoid final truncation,
       // unless there were errors.
-      skip_truncation = RemovePreviousSamples(fd.get());
+      skip_truncation = RemovePreviousSamples(fd.get(), reader.offset());
       break;
     }
   }
@@ -267,22 +351,37 @@ bool SerializationUtils::ReadAndTruncateMetricsFromFile(
 }
 
 bool SerializationUtils::WriteMetricsToFile(
-    const std::vector<MetricSample>& samples, const std::string& filename) {
+    const std::vector<MetricSample>& samples,
+    const std::string& filename,
+    SampleFormat format) {
   std::string output;
   for (const auto& sample : samples) {
-    if (!sample.IsValid()) {
-      return false;
-    }
-    std::string msg = sample.ToString();
-    int32_t size = msg.length() + sizeof(int32_t);
-    if (size > kMessageMaxLength) {
-      LOG(ERROR) << "cannot write message: too long, length = " << size;
+    if (!AppendSampleToBuffer(sample, &output, format))
       return false;
-    }
-    output.append(reinterpret_cast<char*>(&size), sizeof(size));
-    output.append(msg);
   }
+  return WriteSerializedMetricsToFile(output, filename);
+}
+
+bool SerializationUtils::AppendSampleToBuffer(const MetricSample& sample,
+                                              std::string* output,
+                                              SampleFormat format) {
+  if (!sample.IsValid())
+    return false;
+
+  std::string msg = format == SampleFormat::kBinary ? sample.ToBinary()
+                                                    : sample.ToString();
+  int32_t size = msg.length() + sizeof(int32_t);
+  if (size > kMessageMaxLength) {
+    LOG(ERROR) << "cannot write message: too long, length = " << size;
+    return false;
+  }
+  output->append(reinterpret_cast<char*>(&size), sizeof(size));
+  output->append(msg);
+  return true;
+}
 
+bool SerializationUtils::WriteSerializedMetricsToFile(
+    const std::string& output, const std::string& filename) {
   base::ScopedFD file_descriptor(open(filename.c_str(),
                                       O_WRONLY | O_APPEND | O_CREAT,
                                       READ_WRITE_ALL_FILE_FLAGS));
@@ -8,6 +8,8 @@
 #include <string>
 #include <vector>
 
+#include <base/callback.h>
+
 namespace metrics {
 
 class MetricSample;
@@ -16,9 +18,21 @@ class MetricSample;
 // ChromeOS.
 namespace SerializationUtils {
 
-// Deserializes a sample passed as a string and return a sample.
-// The return value will either be a std::unique_ptr to a Metric sample (if the
-// deserialization was successful) or a NULL std::unique_ptr.
+// Formats of the serialized messages. A file may hold messages in both
+// formats.
+enum class SampleFormat {
+  // NUL-separated text, see MetricSample::ToString(). This is the only format
+  // Chrome reads.
+  kText,
+  // Compact binary records, see MetricSample::ToBinary().
+  kBinary,
+};
+
+// Called with each sample read by ReadAndTruncateMetricsFromFile().
+using SampleCallback = base::RepeatingCallback<void(const MetricSample&)>;
+
+// Deserializes a sample in either format passed as a string and returns it.
+// The returned sample is invalid if the deserialization failed.
 MetricSample ParseSample(const std::string& sample);
 
 // Reads samples from a file, and modifies the file to reflect the samples
@@ -31,18 +45,39 @@ bool ReadAndTruncateMetricsFromFile(const std::string& filename,
                                     std::vector<MetricSample>* metrics,
                                     size_t sample_batch_max_length);
 
+// Same as above, but streams the file through a fixed-size buffer and runs
+// |callback| with each valid sample as it is parsed instead of collecting the
+// samples, so that memory use does not depend on the size of the file. The
+// file is locked while |callback| runs, so it should return quickly.
+bool ReadAndTruncateMetricsFromFile(const std::string& filename,
+                                    const SampleCallback& callback,
+                                    size_t sample_batch_max_length);
+
 // Serializes a vector of samples and writes them to filename.
 // The format for each sample is:
 //  message_size, serialized_message
 // where
 //  * message_size is the total length of the message (message_size +
 //    serialized_message) on 4 bytes
-//  * serialized_message is the serialized version of sample (using ToString)
+//  * serialized_message is the serialized version of sample (using ToString,
+//    or ToBinary for SampleFormat::kBinary)
 //
 //  NB: the file will never leave the device so message_size will be written
 //  with the architecture's endianness.
 bool WriteMetricsToFile(const std::vector<MetricSample>& samples,
-                        const std::string& filename);
+                        const std::string& filename,
+                        SampleFormat format = SampleFormat::kText);
+
+// Serializes |sample| as described above and appends it to |output|. Returns
+// false and leaves |output| unchanged if the sample is invalid or too long.
+bool AppendSampleToBuffer(const MetricSample& sample,
+                          std::string* output,
+                          SampleFormat format = SampleFormat::kText);
+
+// Appends |output|, a sequence of samples serialized by AppendSampleToBuffer(),
+// to filename in a single write, taking the file lock once.
+bool WriteSerializedMetricsToFile(const std::string& output,
+                                  const std::string& filename);
 
 // Maximum length of a serialized message.
 static const size_t kMessageMaxLength = 1024;
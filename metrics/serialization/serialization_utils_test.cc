@@ -8,6 +8,7 @@
 
 #include "metrics/serialization/serialization_utils.h"
 
+#include <base/bind.h>
 #include <base/check.h>
 #include <base/files/file_util.h>
 #include <base/files/scoped_temp_dir.h>
@@ -40,6 +41,11 @@ class SerializationUtilsTest : public testing::Test {
     ASSERT_EQ('\0', serialized[serialized.length() - 1]);
     MetricSample deserialized = SerializationUtils::ParseSample(serialized);
     EXPECT_TRUE(sample.IsEqual(deserialized));
+
+    std::string binary(sample.ToBinary());
+    EXPECT_LT(binary.length(), serialized.length());
+    MetricSample binary_deserialized = SerializationUtils::ParseSample(binary);
+    EXPECT_TRUE(sample.IsEqual(binary_deserialized));
   }
 
   std::string filename_;
@@ -72,6 +78,42 @@ TEST_F(SerializationUtilsTest, UserActionSerializeTest) {
   TestSerialization(MetricSample::UserActionSample("myaction"));
 }
 
+TEST_F(SerializationUtilsTest, BinaryNegativeValuesTest) {
+  TestSerialization(MetricSample::SparseHistogramSample("mysparse", -1));
+  TestSerialization(
+      MetricSample::HistogramSample("myhist", -100000, -200000, 10, 5));
+}
+
+TEST_F(SerializationUtilsTest, BadBinaryInputIsCaughtTest) {
+  const std::string binary =
+      MetricSample::HistogramSample("myhist", 3, 1, 10, 5).ToBinary();
+  ASSERT_TRUE(SerializationUtils::ParseSample(binary).IsValid());
+
+  // Truncated and extended messages.
+  for (size_t length = 1; length < binary.length(); length++) {
+    EXPECT_FALSE(
+        SerializationUtils::ParseSample(binary.substr(0, length)).IsValid());
+  }
+  EXPECT_FALSE(SerializationUtils::ParseSample(binary + '\0').IsValid());
+
+  // Unknown version and type.
+  std::string bad_version = binary;
+  bad_version[0] = MetricSample::kBinaryFormatVersion + 1;
+  EXPECT_FALSE(SerializationUtils::ParseSample(bad_version).IsValid());
+  std::string bad_type = binary;
+  bad_type[1] = 0x7f;
+  EXPECT_FALSE(SerializationUtils::ParseSample(bad_type).IsValid());
+
+  // A name length past the end of the message, and a varint which does not
+  // fit in 32 bits.
+  EXPECT_FALSE(
+      SerializationUtils::ParseSample(std::string("\x01\x01\x7f" "abc", 6))
+          .IsValid());
+  EXPECT_FALSE(SerializationUtils::ParseSample(
+                   std::string("\x01\x04\x01" "a\xff\xff\xff\xff\x7f", 9))
+                   .IsValid());
+}
+
 TEST_F(SerializationUtilsTest, IllegalNameAreFilteredTest) {
   EXPECT_FALSE(SerializationUtils::WriteMetricsToFile(
       {MetricSample::SparseHistogramSample("no space", 10),
@@ -212,6 +254,54 @@ TEST_F(SerializationUtilsTest, WriteReadTest) {
   ASSERT_EQ(0, size);
 }
 
+TEST_F(SerializationUtilsTest, MixedFormatsWriteReadTest) {
+  const MetricSample text_sample =
+      MetricSample::LinearHistogramSample("linear", 1, 10);
+  const MetricSample binary_sample =
+      MetricSample::HistogramSample("myrepeatedhist", 3, 1, 10, 5, 10);
+  ASSERT_TRUE(SerializationUtils::WriteMetricsToFile({text_sample}, filename_));
+  ASSERT_TRUE(SerializationUtils::WriteMetricsToFile(
+      {binary_sample, binary_sample}, filename_,
+      SerializationUtils::SampleFormat::kBinary));
+  ASSERT_TRUE(SerializationUtils::WriteMetricsToFile({text_sample}, filename_));
+
+  std::vector<MetricSample> samples;
+  EXPECT_TRUE(SerializationUtils::ReadAndTruncateMetricsFromFile(
+      filename_, &samples, SerializationUtils::kSampleBatchMaxLength));
+  ASSERT_EQ(4U, samples.size());
+  EXPECT_TRUE(text_sample.IsEqual(samples[0]));
+  EXPECT_TRUE(binary_sample.IsEqual(samples[1]));
+  EXPECT_TRUE(binary_sample.IsEqual(samples[2]));
+  EXPECT_TRUE(text_sample.IsEqual(samples[3]));
+}
+
+// Reads more samples than the read buffer holds through the callback.
+TEST_F(SerializationUtilsTest, StreamingReadTest) {
+  const MetricSample hist =
+      MetricSample::HistogramSample("Boring.Histogram", 3, 1, 10, 5);
+  const int sample_count = 10000;
+  ASSERT_TRUE(SerializationUtils::WriteMetricsToFile(
+      std::vector<MetricSample>(sample_count, hist), filename_,
+      SerializationUtils::SampleFormat::kBinary));
+
+  int count = 0;
+  EXPECT_TRUE(SerializationUtils::ReadAndTruncateMetricsFromFile(
+      filename_,
+      base::BindRepeating(
+          [](const MetricSample* expected, int* count,
+             const MetricSample& sample) {
+            EXPECT_TRUE(expected->IsEqual(sample));
+            ++*count;
+          },
+          &hist, &count),
+      SerializationUtils::kSampleBatchMaxLength));
+  EXPECT_EQ(count, sample_count);
+
+  int64_t size = 0;
+  ASSERT_TRUE(base::GetFileSize(filepath_, &size));
+  EXPECT_EQ(0, size);
+}
+
 // Test of batched upload.  Creates a metrics log with enough samples to
 // trigger two uploads.
 TEST_F(SerializationUtilsTest, BatchedUploadTest) {
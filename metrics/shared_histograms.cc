@@ -0,0 +1,391 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "metrics/shared_histograms.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <string>
+
+#include <base/check.h>
+#include <base/check_op.h>
+#include <base/files/scoped_file.h>
+#include <base/hash/hash.h>
+#include <base/logging.h>
+#include <base/metrics/bucket_ranges.h>
+#include <base/metrics/histogram.h>
+#include <base/posix/eintr_wrapper.h>
+
+#include "metrics/serialization/metric_sample.h"
+
+namespace metrics {
+namespace {
+
+// "MSH2", which also identifies the version of the layout below.
+constexpr uint32_t kMagic = 0x3248534d;
+
+// Mode of the table: only metrics_daemon and the processes in its group may
+// map it.
+constexpr mode_t kTableMode = 0660;
+
+// States of a slot or bucket. A slot or bucket is claimed by a writer while it
+// fills in its key, and is ready once its key can be read.
+constexpr uint32_t kFree = 0;
+constexpr uint32_t kClaimed = 1;
+constexpr uint32_t kReady = 2;
+
+constexpr int kMaxBuckets = SharedHistograms::kMaxBucketCount;
+
+// Maximum number of slots looked at to find the slot of a histogram, starting
+// from the one its hash maps to.
+constexpr size_t kMaxProbes = 32;
+
+// Number of times a claimed slot or bucket is polled for its key before
+// moving on, in case its writer died while filling it in.
+constexpr int kMaxClaimedPolls = 1000;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "Shared counters must be lock-free to work across processes");
+
+// Claims |state| if it is free, running |fill| to fill in the key it guards
+// before making it ready. Returns the state then, waiting for a while for
+// other writers which claimed it.
+template <typename Fill>
+uint32_t ClaimOrWait(std::atomic<uint32_t>* state, Fill fill) {
+  uint32_t current = state->load(std::memory_order_acquire);
+  if (current == kFree && state->compare_exchange_strong(
+                              current, kClaimed, std::memory_order_acquire)) {
+    fill();
+    state->store(kReady, std::memory_order_release);
+    return kReady;
+  }
+  for (int i = 0; current == kClaimed && i < kMaxClaimedPolls; i++) {
+    sched_yield();
+    current = state->load(std::memory_order_acquire);
+  }
+  return current;
+}
+
+}  // namespace
+
+struct SharedHistograms::Header {
+  // Written last by Create(), so that a table with a valid magic number is
+  // fully initialized.
+  std::atomic<uint32_t> magic;
+  uint32_t slot_size;
+  uint32_t slot_count;
+  uint32_t reserved;
+};
+
+struct SharedHistograms::Bucket {
+  std::atomic<uint32_t> state;
+  // The sample counted by the bucket, which is only written when it is
+  // claimed.
+  int32_t value;
+  std::atomic<uint32_t> count;
+};
+
+// The fields of a sample which make the key of the slot of its histogram.
+struct SharedHistograms::Key {
+  uint32_t hash;
+  int32_t type;
+  int32_t min;
+  int32_t max;
+  int32_t bucket_count;
+};
+
+struct SharedHistograms::Slot {
+  std::atomic<uint32_t> state;
+  // The key of the histogram, which is only written when it is claimed.
+  Key key;
+  char name[kMaxNameLength + 1];
+  // Regular and linear histograms have their |bucket_count| first buckets
+  // ready as soon as the slot is, holding the lower bound of each bucket in
+  // increasing order. Sparse histograms claim a bucket per distinct sample.
+  Bucket buckets[kMaxBucketCount];
+};
+
+// static
+std::unique_ptr<SharedHistograms> SharedHistograms::Create(
+    const base::FilePath& path, size_t histogram_count) {
+  CHECK_GT(histogram_count, 0u);
+  base::ScopedFD fd(HANDLE_EINTR(
+      open(path.value().c_str(), O_RDWR | O_CLOEXEC | O_NOFOLLOW)));
+  if (fd.is_valid()) {
+    std::unique_ptr<SharedHistograms> table =
+        Map(fd.get(), geteuid(), getegid());
+    if (table && table->histogram_count_ == histogram_count)
+      return table;
+  }
+
+  // Build the new table aside and move it in place once it is initialized, so
+  // that Open() never maps a partial table. Processes which mapped a previous
+  // table keep using it until they reopen the file.
+  const base::FilePath new_path = path.AddExtension("new");
+  unlink(new_path.value().c_str());
+  fd.reset(HANDLE_EINTR(
+      open(new_path.value().c_str(),
+           O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, kTableMode)));
+  if (!fd.is_valid()) {
+    PLOG(ERROR) << new_path.value() << ": cannot create";
+    return nullptr;
+  }
+  // The processes of the group of the caller must be able to write the
+  // counters, whatever the umask.
+  const size_t size = sizeof(Header) + histogram_count * sizeof(Slot);
+  if (fchmod(fd.get(), kTableMode) < 0 || ftruncate(fd.get(), size) < 0) {
+    PLOG(ERROR) << new_path.value() << ": cannot initialize";
+    unlink(new_path.value().c_str());
+    return nullptr;
+  }
+  void* memory =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+  if (memory == MAP_FAILED) {
+    PLOG(ERROR) << new_path.value() << ": cannot map";
+    unlink(new_path.value().c_str());
+    return nullptr;
+  }
+  Header* header = static_cast<Header*>(memory);
+  header->slot_size = sizeof(Slot);
+  header->slot_count = histogram_count;
+  header->magic.store(kMagic, std::memory_order_release);
+  if (rename(new_path.value().c_str(), path.value().c_str()) < 0) {
+    PLOG(ERROR) << path.value() << ": cannot replace";
+    munmap(memory, size);
+    unlink(new_path.value().c_str());
+    return nullptr;
+  }
+  return std::unique_ptr<SharedHistograms>(
+      new SharedHistograms(memory, size, histogram_count));
+}
+
+// static
+std::unique_ptr<SharedHistograms> SharedHistograms::Open(
+    const base::FilePath& path, uid_t uid, gid_t gid) {
+  base::ScopedFD fd(HANDLE_EINTR(
+      open(path.value().c_str(), O_RDWR | O_CLOEXEC | O_NOFOLLOW)));
+  if (!fd.is_valid())
+    return nullptr;
+  return Map(fd.get(), uid, gid);
+}
+
+// static
+std::unique_ptr<SharedHistograms> SharedHistograms::Map(int fd,
+                                                        uid_t uid,
+                                                        gid_t gid) {
+  // Anyone able to write the table can also make it shorter than its mapping,
+  // which would crash the processes using it with SIGBUS: only trust a table
+  // that only metrics_daemon and its group can write.
+  struct stat stat_buf;
+  if (fstat(fd, &stat_buf) < 0 || !S_ISREG(stat_buf.st_mode) ||
+      stat_buf.st_uid != uid || stat_buf.st_gid != gid ||
+      (stat_buf.st_mode & 07777) != kTableMode || stat_buf.st_nlink != 1 ||
+      stat_buf.st_size < static_cast<off_t>(sizeof(Header))) {
+    LOG(WARNING) << "unexpected shared histograms file";
+    return nullptr;
+  }
+  const size_t size = stat_buf.st_size;
+  void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (memory == MAP_FAILED) {
+    PLOG(ERROR) << "cannot map shared histograms";
+    return nullptr;
+  }
+  // The table may have been written by another version of libmetrics: check
+  // that it has the size of its slots. The header is read once, as it could
+  // change under us.
+  const Header* header = static_cast<const Header*>(memory);
+  const uint32_t magic = header->magic.load(std::memory_order_acquire);
+  const size_t slot_size = header->slot_size;
+  const size_t slot_count = header->slot_count;
+  if (magic != kMagic || slot_size != sizeof(Slot) || slot_count == 0 ||
+      size != sizeof(Header) + slot_count * sizeof(Slot)) {
+    LOG(WARNING) << "invalid shared histograms";
+    munmap(memory, size);
+    return nullptr;
+  }
+  return std::unique_ptr<SharedHistograms>(
+      new SharedHistograms(memory, size, slot_count));
+}
+
+SharedHistograms::SharedHistograms(void* memory,
+                                   size_t size,
+                                   size_t histogram_count)
+    : memory_(memory), size_(size), histogram_count_(histogram_count) {}
+
+SharedHistograms::~SharedHistograms() {
+  munmap(memory_, size_);
+}
+
+SharedHistograms::Header* SharedHistograms::header() const {
+  return static_cast<Header*>(memory_);
+}
+
+SharedHistograms::Slot* SharedHistograms::slots() const {
+  return reinterpret_cast<Slot*>(header() + 1);
+}
+
+SharedHistograms::Slot* SharedHistograms::FindSlot(const Key& key,
+                                                   const std::string& name) {
+  Slot* table = slots();
+  for (size_t probe = 0; probe < std::min(kMaxProbes, histogram_count_);
+       probe++) {
+    Slot& slot = table[(key.hash + probe) % histogram_count_];
+    const uint32_t state = ClaimOrWait(&slot.state, [&]() {
+      slot.key = key;
+      memset(slot.name, 0, sizeof(slot.name));
+      memcpy(slot.name, name.data(), name.size());
+      // The buckets of regular and linear histograms are known in advance.
+      if (key.type == MetricSample::HISTOGRAM) {
+        base::BucketRanges ranges(key.bucket_count + 1);
+        base::Histogram::InitializeBucketRanges(key.min, key.max, &ranges);
+        for (int32_t i = 0; i < key.bucket_count; i++) {
+          slot.buckets[i].value = ranges.range(i);
+          slot.buckets[i].state.store(kReady, std::memory_order_relaxed);
+        }
+      } else if (key.type == MetricSample::LINEAR_HISTOGRAM) {
+        for (int32_t i = 0; i <= key.max; i++) {
+          slot.buckets[i].value = i;
+          slot.buckets[i].state.store(kReady, std::memory_order_relaxed);
+        }
+      }
+    });
+    if (state != kReady || slot.key.hash != key.hash ||
+        slot.key.type != key.type || slot.key.min != key.min ||
+        slot.key.max != key.max || slot.key.bucket_count != key.bucket_count ||
+        strncmp(slot.name, name.c_str(), sizeof(slot.name)) != 0) {
+      continue;
+    }
+    return &slot;
+  }
+  return nullptr;
+}
+
+bool SharedHistograms::Add(const MetricSample& sample) {
+  Key key = {};
+  key.type = sample.type();
+  uint32_t count = 1;
+  switch (sample.type()) {
+    case MetricSample::HISTOGRAM:
+      // Only count histograms whose buckets are not adjusted by the uploader.
+      if (sample.num_samples() <= 0 || sample.min() < 1 ||
+          sample.max() >= std::numeric_limits<int32_t>::max() - 1 ||
+          sample.min() >= sample.max() || sample.bucket_count() < 3 ||
+          sample.bucket_count() > kMaxBuckets ||
+          sample.bucket_count() >
+              static_cast<int64_t>(sample.max()) - sample.min() + 2) {
+        return false;
+      }
+      key.min = sample.min();
+      key.max = sample.max();
+      key.bucket_count = sample.bucket_count();
+      count = sample.num_samples();
+      break;
+    case MetricSample::LINEAR_HISTOGRAM:
+      // The uploader counts them in buckets 0 to max.
+      if (sample.max() < 2 || sample.max() >= kMaxBuckets)
+        return false;
+      key.max = sample.max();
+      break;
+    case MetricSample::SPARSE_HISTOGRAM:
+      break;
+    default:
+      // Crashes and user actions are not aggregated by the uploader.
+      return false;
+  }
+  const std::string& name = sample.name();
+  if (name.size() > kMaxNameLength)
+    return false;
+  // Hash the name with the other fields of the key, so that histograms of the
+  // same name with other parameters get another slot.
+  std::string hashed(name);
+  hashed.append(reinterpret_cast<const char*>(&key), sizeof(key));
+  key.hash = base::PersistentHash(hashed);
+
+  Slot* slot = FindSlot(key, name);
+  if (!slot)
+    return false;
+
+  const int32_t value = sample.sample();
+  Bucket* bucket = nullptr;
+  switch (key.type) {
+    case MetricSample::HISTOGRAM: {
+      // The bucket with the largest lower bound not above the sample.
+      Bucket* end = slot->buckets + key.bucket_count;
+      bucket = std::upper_bound(slot->buckets, end, value,
+                                [](int32_t value, const Bucket& bucket) {
+                                  return value < bucket.value;
+                                });
+      if (bucket != slot->buckets)
+        bucket--;
+      break;
+    }
+    case MetricSample::LINEAR_HISTOGRAM:
+      bucket = &slot->buckets[std::clamp(value, 0, key.max)];
+      break;
+    case MetricSample::SPARSE_HISTOGRAM: {
+      const uint32_t start = base::PersistentHash(&value, sizeof(value));
+      for (size_t probe = 0; probe < kMaxBucketCount && !bucket; probe++) {
+        Bucket& candidate = slot->buckets[(start + probe) % kMaxBucketCount];
+        const uint32_t state = ClaimOrWait(
+            &candidate.state, [&]() { candidate.value = value; });
+        if (state == kReady && candidate.value == value)
+          bucket = &candidate;
+      }
+      if (!bucket)
+        return false;
+      break;
+    }
+  }
+  bucket->count.fetch_add(count, std::memory_order_relaxed);
+  return true;
+}
+
+// static
+MetricSample SharedHistograms::SlotSample(const Slot& slot, int32_t value) {
+  const std::string name(slot.name, strnlen(slot.name, sizeof(slot.name)));
+  switch (slot.key.type) {
+    case MetricSample::HISTOGRAM:
+      return MetricSample::HistogramSample(name, value, slot.key.min,
+                                           slot.key.max, slot.key.bucket_count);
+    case MetricSample::LINEAR_HISTOGRAM:
+      return MetricSample::LinearHistogramSample(name, value, slot.key.max);
+    case MetricSample::SPARSE_HISTOGRAM:
+      return MetricSample::SparseHistogramSample(name, value);
+    default:
+      return MetricSample();
+  }
+}
+
+void SharedHistograms::Snapshot(const SnapshotCallback& callback) {
+  Slot* table = slots();
+  for (size_t i = 0; i < histogram_count_; i++) {
+    Slot& slot = table[i];
+    if (slot.state.load(std::memory_order_acquire) != kReady)
+      continue;
+    for (Bucket& bucket : slot.buckets) {
+      if (bucket.state.load(std::memory_order_acquire) != kReady)
+        continue;
+      const uint32_t count =
+          bucket.count.exchange(0, std::memory_order_relaxed);
+      if (count == 0)
+        continue;
+
+      const MetricSample sample = SlotSample(slot, bucket.value);
+      if (!sample.IsValid())
+        continue;
+      callback.Run(sample, std::min<uint32_t>(
+                               count, std::numeric_limits<int>::max()));
+    }
+  }
+}
+
+}  // namespace metrics
@@ -0,0 +1,119 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef METRICS_SHARED_HISTOGRAMS_H_
+#define METRICS_SHARED_HISTOGRAMS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+
+#include <base/callback.h>
+#include <base/files/file_path.h>
+
+namespace metrics {
+
+class MetricSample;
+
+// Location of the table shared by libmetrics and metrics_daemon. /run is a
+// tmpfs, so the counts do not outlive the boot.
+constexpr char kSharedHistogramsPath[] = "/run/metrics/shared-histograms";
+// User running metrics_daemon, which owns the table with its group.
+constexpr char kSharedHistogramsUser[] = "metrics";
+
+// SharedHistograms is a table of histograms in a file mapped in shared
+// memory. It lets the processes using libmetrics count repeated histogram
+// samples with an atomic increment, instead of appending each of them to the
+// uma-events file, and the uploader of metrics_daemon collect the counts.
+//
+// The table holds a slot per histogram, keyed on its type, name and
+// parameters, with a counter per bucket of the histogram. The samples of
+// regular and linear histograms are counted in the bucket the uploader would
+// put them in, so that a histogram never takes more than its bucket count of
+// counters. Sparse histograms get a counter per distinct sample instead, up
+// to kMaxBucketCount. Slots and counters are allocated the first time a
+// sample is added to them, and stay allocated until the table is removed at
+// reboot. Add() fails for samples which cannot be counted, such as crashes,
+// user actions and histograms with too many buckets, and when the table or
+// the slot of the histogram is full, in which case the sample should be
+// written to uma-events instead.
+//
+// The table is only readable and writable by its owner and group, which are
+// the user and group of metrics_daemon, and is only mapped if it is still
+// owned by them. All operations are lock-free, and may be used concurrently
+// by any number of threads and processes.
+class SharedHistograms {
+ public:
+  // Called by Snapshot() with each sample and its count.
+  using SnapshotCallback =
+      base::RepeatingCallback<void(const MetricSample& sample, int count)>;
+
+  // Longest histogram name which can be counted.
+  static constexpr size_t kMaxNameLength = 127;
+  // Largest number of buckets of a histogram which can be counted.
+  static constexpr size_t kMaxBucketCount = 128;
+  // Default number of histograms of a table.
+  static constexpr size_t kDefaultHistogramCount = 256;
+
+  // Creates the table in |path| with room for |histogram_count| histograms,
+  // owned by the user and group of the caller. A valid table already there is
+  // reused, so that its counts survive a restart of the caller. Returns null
+  // on errors.
+  static std::unique_ptr<SharedHistograms> Create(
+      const base::FilePath& path,
+      size_t histogram_count = kDefaultHistogramCount);
+
+  // Maps the table created in |path| by Create(), which must be owned by user
+  // |uid| and group |gid|. Returns null if there is no valid table in |path|.
+  static std::unique_ptr<SharedHistograms> Open(const base::FilePath& path,
+                                                uid_t uid,
+                                                gid_t gid);
+
+  SharedHistograms(const SharedHistograms&) = delete;
+  SharedHistograms& operator=(const SharedHistograms&) = delete;
+  ~SharedHistograms();
+
+  // Counts |sample|, which must be valid. Histogram samples carrying several
+  // samples are counted as many times. Returns false if the sample cannot be
+  // counted.
+  bool Add(const MetricSample& sample);
+
+  // Runs |callback| with each sample counted since the previous snapshot and
+  // the number of times it was counted, and resets the counts. The samples of
+  // regular histograms are reported as the lower bound of their bucket.
+  void Snapshot(const SnapshotCallback& callback);
+
+ private:
+  struct Header;
+  struct Bucket;
+  struct Slot;
+  struct Key;
+
+  // Maps the table of the open file |fd| if it is valid and owned by user
+  // |uid| and group |gid|.
+  static std::unique_ptr<SharedHistograms> Map(int fd, uid_t uid, gid_t gid);
+
+  // Returns the sample of |value| counted in |slot|, which may be invalid.
+  static MetricSample SlotSample(const Slot& slot, int32_t value);
+
+  SharedHistograms(void* memory, size_t size, size_t histogram_count);
+
+  Header* header() const;
+  Slot* slots() const;
+
+  // Returns the slot of the histogram |key| named |name|, allocating it if
+  // needed, or null if the table is full.
+  Slot* FindSlot(const Key& key, const std::string& name);
+
+  void* const memory_;
+  const size_t size_;
+  const size_t histogram_count_;
+};
+
+}  // namespace metrics
+
+#endif  // METRICS_SHARED_HISTOGRAMS_H_
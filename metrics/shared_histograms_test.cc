@@ -0,0 +1,285 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "metrics/shared_histograms.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <gtest/gtest.h>
+
+#include "metrics/serialization/metric_sample.h"
+
+namespace metrics {
+namespace {
+
+struct Count {
+  std::string sample;
+  int count;
+};
+
+class SharedHistogramsTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    path_ = temp_dir_.GetPath().Append("shared-histograms");
+  }
+
+  // Opens the table of |path_|, which is owned by the test.
+  std::unique_ptr<SharedHistograms> Open() {
+    return SharedHistograms::Open(path_, geteuid(), getegid());
+  }
+
+  // Returns the samples counted by |table| since the previous snapshot, in
+  // the order of the table.
+  static std::vector<Count> Snapshot(SharedHistograms* table) {
+    std::vector<Count> counts;
+    table->Snapshot(base::BindRepeating(
+        [](std::vector<Count>* counts, const MetricSample& sample, int count) {
+          counts->push_back({sample.ToString(), count});
+        },
+        &counts));
+    return counts;
+  }
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath path_;
+};
+
+TEST_F(SharedHistogramsTest, AddAndSnapshot) {
+  std::unique_ptr<SharedHistograms> table = SharedHistograms::Create(path_);
+  ASSERT_TRUE(table);
+  const MetricSample histogram =
+      MetricSample::HistogramSample("Test.Histogram", 5, 1, 100, 50);
+  const MetricSample linear =
+      MetricSample::LinearHistogramSample("Test.Enum", 2, 10);
+  const MetricSample sparse = MetricSample::SparseHistogramSample("Test", 7);
+  // Repeated histogram samples are counted as many times.
+  EXPECT_TRUE(table->Add(histogram));
+  EXPECT_TRUE(table->Add(
+      MetricSample::HistogramSample("Test.Histogram", 5, 1, 100, 50, 3)));
+  EXPECT_TRUE(table->Add(linear));
+  EXPECT_TRUE(table->Add(sparse));
+  // Samples differing in any of their fields are counted apart.
+  EXPECT_TRUE(
+      table->Add(MetricSample::LinearHistogramSample("Test.Enum", 2, 11)));
+  EXPECT_TRUE(table->Add(MetricSample::SparseHistogramSample("Test", 8)));
+
+  std::map<std::string, int> counts;
+  for (const Count& count : Snapshot(table.get()))
+    counts[count.sample] += count.count;
+  EXPECT_EQ(counts.size(), 5u);
+  EXPECT_EQ(counts[histogram.ToString()], 4);
+  EXPECT_EQ(counts[linear.ToString()], 1);
+  EXPECT_EQ(counts[sparse.ToString()], 1);
+
+  // The counts are reset by the snapshot.
+  EXPECT_TRUE(Snapshot(table.get()).empty());
+  EXPECT_TRUE(table->Add(sparse));
+  const std::vector<Count> next_counts = Snapshot(table.get());
+  ASSERT_EQ(next_counts.size(), 1u);
+  EXPECT_EQ(next_counts[0].sample, sparse.ToString());
+  EXPECT_EQ(next_counts[0].count, 1);
+}
+
+TEST_F(SharedHistogramsTest, UncountableSamples) {
+  std::unique_ptr<SharedHistograms> table = SharedHistograms::Create(path_);
+  ASSERT_TRUE(table);
+  EXPECT_FALSE(table->Add(MetricSample::CrashSample("kernel")));
+  EXPECT_FALSE(table->Add(MetricSample::UserActionSample("Test.Action")));
+  EXPECT_FALSE(table->Add(
+      MetricSample::HistogramSample("Test.Histogram", 5, 1, 100, 50, 0)));
+  EXPECT_FALSE(table->Add(MetricSample::SparseHistogramSample(
+      std::string(SharedHistograms::kMaxNameLength + 1, 'a'), 1)));
+  EXPECT_TRUE(table->Add(MetricSample::SparseHistogramSample(
+      std::string(SharedHistograms::kMaxNameLength, 'a'), 1)));
+  // Histograms with too many buckets, or whose buckets would be adjusted by
+  // the uploader.
+  EXPECT_FALSE(table->Add(
+      MetricSample::HistogramSample("Test.Histogram", 5, 1, 10000, 200)));
+  EXPECT_FALSE(table->Add(
+      MetricSample::HistogramSample("Test.Histogram", 5, 0, 100, 50)));
+  EXPECT_FALSE(table->Add(
+      MetricSample::HistogramSample("Test.Histogram", 5, 1, 10, 50)));
+  EXPECT_FALSE(
+      table->Add(MetricSample::LinearHistogramSample("Test.Enum", 1, 200)));
+  EXPECT_EQ(Snapshot(table.get()).size(), 1u);
+}
+
+TEST_F(SharedHistogramsTest, HistogramBuckets) {
+  std::unique_ptr<SharedHistograms> table = SharedHistograms::Create(path_);
+  ASSERT_TRUE(table);
+  // Samples of regular histograms are counted in their bucket, and linear
+  // histograms count the samples above their maximum as the maximum.
+  for (int i = 0; i <= 10000; i++) {
+    EXPECT_TRUE(table->Add(
+        MetricSample::HistogramSample("Test.Histogram", i, 1, 10000, 50)));
+  }
+  EXPECT_TRUE(table->Add(MetricSample::LinearHistogramSample("Test.Enum", 10,
+                                                             10)));
+  EXPECT_TRUE(table->Add(MetricSample::LinearHistogramSample("Test.Enum", 12,
+                                                             10)));
+  EXPECT_TRUE(table->Add(MetricSample::LinearHistogramSample("Test.Enum", -1,
+                                                             10)));
+
+  std::map<std::string, int> counts;
+  int histogram_buckets = 0;
+  int histogram_count = 0;
+  for (const Count& count : Snapshot(table.get())) {
+    if (count.sample.find("Test.Histogram") != std::string::npos) {
+      histogram_buckets++;
+      histogram_count += count.count;
+    } else {
+      counts[count.sample] += count.count;
+    }
+  }
+  EXPECT_EQ(histogram_buckets, 50);
+  EXPECT_EQ(histogram_count, 10001);
+  EXPECT_EQ(counts.size(), 2u);
+  EXPECT_EQ(
+      counts[MetricSample::LinearHistogramSample("Test.Enum", 10, 10)
+                 .ToString()],
+      2);
+  EXPECT_EQ(
+      counts[MetricSample::LinearHistogramSample("Test.Enum", 0, 10)
+                 .ToString()],
+      1);
+}
+
+TEST_F(SharedHistogramsTest, TableFull) {
+  std::unique_ptr<SharedHistograms> table =
+      SharedHistograms::Create(path_, 4 /* histogram_count */);
+  ASSERT_TRUE(table);
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(table->Add(
+        MetricSample::SparseHistogramSample("Test" + std::to_string(i), 1)));
+  }
+  EXPECT_FALSE(table->Add(MetricSample::SparseHistogramSample("Test4", 1)));
+  // Slots stay allocated after a snapshot.
+  EXPECT_EQ(Snapshot(table.get()).size(), 4u);
+  EXPECT_FALSE(table->Add(MetricSample::SparseHistogramSample("Test4", 1)));
+  EXPECT_TRUE(table->Add(MetricSample::SparseHistogramSample("Test0", 2)));
+}
+
+TEST_F(SharedHistogramsTest, HistogramFull) {
+  std::unique_ptr<SharedHistograms> table = SharedHistograms::Create(path_);
+  ASSERT_TRUE(table);
+  const int max_bucket_count = SharedHistograms::kMaxBucketCount;
+  for (int i = 0; i < max_bucket_count; i++)
+    EXPECT_TRUE(table->Add(MetricSample::SparseHistogramSample("Test", i)));
+  // A sparse histogram with too many samples does not take the room of the
+  // other histograms.
+  EXPECT_FALSE(table->Add(
+      MetricSample::SparseHistogramSample("Test", max_bucket_count)));
+  EXPECT_TRUE(table->Add(MetricSample::SparseHistogramSample("Other", 1)));
+  EXPECT_TRUE(table->Add(MetricSample::SparseHistogramSample("Test", 0)));
+}
+
+TEST_F(SharedHistogramsTest, Open) {
+  EXPECT_FALSE(Open());
+  ASSERT_TRUE(base::WriteFile(path_, "not a table"));
+  ASSERT_EQ(chmod(path_.value().c_str(), 0660), 0);
+  EXPECT_FALSE(Open());
+
+  std::unique_ptr<SharedHistograms> table = SharedHistograms::Create(path_);
+  ASSERT_TRUE(table);
+  std::unique_ptr<SharedHistograms> writer = Open();
+  ASSERT_TRUE(writer);
+  EXPECT_TRUE(writer->Add(MetricSample::SparseHistogramSample("Test", 1)));
+  EXPECT_TRUE(writer->Add(MetricSample::SparseHistogramSample("Test", 1)));
+  std::vector<Count> counts = Snapshot(table.get());
+  ASSERT_EQ(counts.size(), 1u);
+  EXPECT_EQ(counts[0].count, 2);
+}
+
+TEST_F(SharedHistogramsTest, OpenChecksFile) {
+  ASSERT_TRUE(SharedHistograms::Create(path_));
+  struct stat stat_buf;
+  ASSERT_EQ(stat(path_.value().c_str(), &stat_buf), 0);
+  EXPECT_EQ(stat_buf.st_mode & 07777, 0660u);
+  EXPECT_TRUE(Open());
+
+  // Tables owned by someone else.
+  EXPECT_FALSE(SharedHistograms::Open(path_, geteuid() + 1, getegid()));
+  EXPECT_FALSE(SharedHistograms::Open(path_, geteuid(), getegid() + 1));
+
+  // Tables which anyone could write.
+  ASSERT_EQ(chmod(path_.value().c_str(), 0666), 0);
+  EXPECT_FALSE(Open());
+  ASSERT_EQ(chmod(path_.value().c_str(), 0660), 0);
+  EXPECT_TRUE(Open());
+
+  // Tables shorter or longer than their slots.
+  const int64_t size = stat_buf.st_size;
+  ASSERT_EQ(truncate(path_.value().c_str(), size - 1), 0);
+  EXPECT_FALSE(Open());
+  ASSERT_EQ(truncate(path_.value().c_str(), size + 1), 0);
+  EXPECT_FALSE(Open());
+
+  // Tables with other links.
+  ASSERT_EQ(truncate(path_.value().c_str(), size), 0);
+  EXPECT_TRUE(Open());
+  ASSERT_EQ(link(path_.value().c_str(),
+                 path_.AddExtension("link").value().c_str()),
+            0);
+  EXPECT_FALSE(Open());
+}
+
+TEST_F(SharedHistogramsTest, CreateReusesTable) {
+  const MetricSample sample = MetricSample::SparseHistogramSample("Test", 1);
+  std::unique_ptr<SharedHistograms> table =
+      SharedHistograms::Create(path_, 16 /* histogram_count */);
+  ASSERT_TRUE(table);
+  EXPECT_TRUE(table->Add(sample));
+  table.reset();
+
+  // The counts survive a restart of the uploader.
+  table = SharedHistograms::Create(path_, 16 /* histogram_count */);
+  ASSERT_TRUE(table);
+  EXPECT_EQ(Snapshot(table.get()).size(), 1u);
+
+  // Tables of another size are replaced.
+  EXPECT_TRUE(table->Add(sample));
+  table = SharedHistograms::Create(path_, 32 /* histogram_count */);
+  ASSERT_TRUE(table);
+  EXPECT_TRUE(Snapshot(table.get()).empty());
+  EXPECT_FALSE(base::PathExists(path_.AddExtension("new")));
+}
+
+TEST_F(SharedHistogramsTest, ConcurrentAdds) {
+  constexpr int kThreads = 4;
+  constexpr int kSamples = 1000;
+  std::unique_ptr<SharedHistograms> table = SharedHistograms::Create(path_);
+  ASSERT_TRUE(table);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([this]() {
+      std::unique_ptr<SharedHistograms> writer = Open();
+      ASSERT_TRUE(writer);
+      for (int j = 0; j < kSamples; j++) {
+        EXPECT_TRUE(
+            writer->Add(MetricSample::SparseHistogramSample("Test", j % 4)));
+      }
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+
+  std::vector<Count> counts = Snapshot(table.get());
+  ASSERT_EQ(counts.size(), 4u);
+  for (const Count& count : counts)
+    EXPECT_EQ(count.count, kThreads * kSamples / 4);
+}
+
+}  // namespace
+}  // namespace metrics
@@ -9,6 +9,7 @@
 #include <vector>
 
 #include <base/bind.h>
+#include <base/callback_helpers.h>
 #include <base/check.h>
 #include <base/hash/sha1.h>
 #include <base/logging.h>
@@ -51,6 +52,11 @@ void UploadService::Init(const base::TimeDelta& upload_interval,
   skip_upload_ = !uploads_enabled;
 
   if (!testing_) {
+    shared_histograms_ = metrics::SharedHistograms::Create(
+        base::FilePath(metrics::kSharedHistogramsPath));
+    LOG_IF(WARNING, !shared_histograms_)
+        << "Histogram samples will only be read from " << metrics_file_;
+
     base::ThreadTaskRunnerHandle::Get()->PostDelayedTask(
         FROM_HERE,
         base::BindOnce(&UploadService::UploadEventCallback,
@@ -91,6 +97,9 @@ void UploadService::UploadEvent() {
       if (ReadMetrics())
         break;
     }
+    // Likewise, reset the counts of the shared histograms.
+    if (shared_histograms_)
+      shared_histograms_->Snapshot(base::DoNothing());
     return;
   }
 
@@ -164,20 +173,26 @@ bool UploadService::ReadMetrics() {
   CHECK(!staged_log_)
       << "cannot read metrics until the old logs have been discarded";
 
-  std::vector<metrics::MetricSample> samples;
+  // Add the samples as they are parsed rather than collecting them first, as
+  // uma-events may hold many samples after a long time without connectivity.
+  size_t sample_count = 0;
   bool result = metrics::SerializationUtils::ReadAndTruncateMetricsFromFile(
-      metrics_file_, &samples,
+      metrics_file_,
+      base::BindRepeating(
+          [](UploadService* service, size_t* sample_count,
+             const metrics::MetricSample& sample) {
+            service->AddSample(sample);
+            ++*sample_count;
+          },
+          base::Unretained(this), &sample_count),
       metrics::SerializationUtils::kSampleBatchMaxLength);
 
-  for (const auto& sample : samples) {
-    AddSample(sample);
-  }
-  DLOG(INFO) << samples.size() << " samples found in uma-events";
+  DLOG(INFO) << sample_count << " samples found in uma-events";
 
   return result;
 }
 
-void UploadService::AddSample(const metrics::MetricSample& sample) {
+void UploadService::AddSample(const metrics::MetricSample& sample, int count) {
   base::HistogramBase* counter;
   switch (sample.type()) {
     case metrics::MetricSample::CRASH:
@@ -188,20 +203,20 @@ void UploadService::AddSample(const metrics::MetricSample& sample) {
           sample.name(), sample.min(), sample.max(), sample.bucket_count(),
           base::Histogram::kUmaTargetedHistogramFlag);
       CHECK(counter) << "FactoryGet failed for " << sample.name();
-      counter->AddCount(sample.sample(), sample.num_samples());
+      counter->AddCount(sample.sample(), sample.num_samples() * count);
       break;
     case metrics::MetricSample::SPARSE_HISTOGRAM:
       counter = base::SparseHistogram::FactoryGet(
           sample.name(), base::HistogramBase::kUmaTargetedHistogramFlag);
       CHECK(counter) << "FactoryGet failed for " << sample.name();
-      counter->Add(sample.sample());
+      counter->AddCount(sample.sample(), count);
       break;
     case metrics::MetricSample::LINEAR_HISTOGRAM:
       counter = base::LinearHistogram::FactoryGet(
           sample.name(), 1, sample.max(), sample.max() + 1,
           base::Histogram::kUmaTargetedHistogramFlag);
       CHECK(counter) << "FactoryGet failed for " << sample.name();
-      counter->Add(sample.sample());
+      counter->AddCount(sample.sample(), count);
       break;
     case metrics::MetricSample::USER_ACTION:
       GetOrCreateCurrentLog()->RecordUserAction(sample.name());
@@ -224,6 +239,11 @@ void UploadService::AddCrash(const std::string& crash_name) {
 }
 
 void UploadService::GatherHistograms() {
+  if (shared_histograms_) {
+    shared_histograms_->Snapshot(base::BindRepeating(
+        &UploadService::AddSample, base::Unretained(this)));
+  }
+
   auto histograms = base::StatisticsRecorder::GetHistograms();
 
   histogram_snapshot_manager_.PrepareDeltas(
@@ -13,6 +13,7 @@
 #include "base/metrics/histogram_snapshot_manager.h"
 
 #include "metrics/metrics_library.h"
+#include "metrics/shared_histograms.h"
 #include "metrics/uploader/metrics_log.h"
 #include "metrics/uploader/sender.h"
 #include "metrics/uploader/system_profile_cache.h"
@@ -91,6 +92,7 @@ class UploadService : public base::HistogramFlattener {
   FRIEND_TEST(UploadServiceTest, LogKernelCrash);
   FRIEND_TEST(UploadServiceTest, LogUncleanShutdown);
   FRIEND_TEST(UploadServiceTest, LogUserCrash);
+  FRIEND_TEST(UploadServiceTest, SharedHistogramsAreGathered);
   FRIEND_TEST(UploadServiceTest, UnknownCrashIgnored);
   FRIEND_TEST(UploadServiceTest, ValuesInConfigFileAreSent);
 
@@ -111,14 +113,15 @@ class UploadService : public base::HistogramFlattener {
   // Returns false if more metrics are remaining in the file.
   bool ReadMetrics();
 
-  // Adds a generic sample to the current log.
-  void AddSample(const metrics::MetricSample& sample);
+  // Adds a generic sample to the current log. Histogram samples are added
+  // |count| times.
+  void AddSample(const metrics::MetricSample& sample, int count = 1);
 
   // Adds a crash to the current log.
   void AddCrash(const std::string& crash_name);
 
-  // Aggregates all histogram available in memory and store them in the current
-  // log.
+  // Aggregates all histogram available in memory, including the samples
+  // counted in the shared histograms, and store them in the current log.
   void GatherHistograms();
 
   // Callback for HistogramSnapshotManager to store the histograms.
@@ -141,6 +144,9 @@ class UploadService : public base::HistogramFlattener {
   std::unique_ptr<MetricsLog> staged_log_;
 
   std::string metrics_file_;
+  // Histogram samples counted by the processes using libmetrics, instead of
+  // being written to |metrics_file_|.
+  std::unique_ptr<metrics::SharedHistograms> shared_histograms_;
   bool skip_upload_;
 
   bool testing_;
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <memory>
+#include <utility>
 
 #include <gtest/gtest.h>
 
@@ -13,6 +14,7 @@
 #include "base/test/scoped_chromeos_version_info.h"
 #include "metrics/metrics_library_mock.h"
 #include "metrics/serialization/metric_sample.h"
+#include "metrics/shared_histograms.h"
 #include "metrics/uploader/metrics_log.h"
 #include "metrics/uploader/mock/mock_system_profile_setter.h"
 #include "metrics/uploader/mock/sender_mock.h"
@@ -175,6 +177,31 @@ TEST_F(UploadServiceTest, LogContainsAggregatedValues) {
   EXPECT_EQ(1, proto->histogram_event().size());
 }
 
+TEST_F(UploadServiceTest, SharedHistogramsAreGathered) {
+  std::unique_ptr<metrics::SharedHistograms> shared_histograms =
+      metrics::SharedHistograms::Create(
+          dir_.GetPath().Append("shared-histograms"), 16);
+  ASSERT_TRUE(shared_histograms);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(shared_histograms->Add(
+        metrics::MetricSample::SparseHistogramSample("sparse", 7)));
+  }
+  EXPECT_TRUE(shared_histograms->Add(
+      metrics::MetricSample::LinearHistogramSample("enum", 2, 10)));
+  upload_service_.shared_histograms_ = std::move(shared_histograms);
+
+  upload_service_.GatherHistograms();
+  metrics::ChromeUserMetricsExtension* proto =
+      upload_service_.current_log_->uma_proto();
+  ASSERT_EQ(2, proto->histogram_event().size());
+  int64_t total = 0;
+  for (const auto& histogram : proto->histogram_event()) {
+    for (const auto& bucket : histogram.bucket())
+      total += bucket.count();
+  }
+  EXPECT_EQ(4, total);
+}
+
 TEST_F(UploadServiceTest, ExtractChannelFromString) {
   EXPECT_EQ(SystemProfileCache::ProtoChannelFromString("developer-build"),
             metrics::SystemProfileProto::CHANNEL_UNKNOWN);
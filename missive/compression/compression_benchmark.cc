@@ -0,0 +1,193 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Compares snappy against zstd with a trained dictionary on a corpus of small
+// records, reporting bytes stored per record (rounded up to the storage frame)
+// and CPU time per record. The dictionary is trained on records generated
+// apart from the measured ones, so that the ratio is not inflated by records
+// the dictionary has seen.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/at_exit.h>
+#include <base/bind.h>
+#include <base/check.h>
+#include <base/no_destructor.h>
+#include <base/rand_util.h>
+#include <base/strings/strcat.h>
+#include <base/strings/string_number_conversions.h>
+#include <benchmark/benchmark.h>
+#include <zdict.h>
+
+#include "missive/compression/compression_dictionaries.h"
+#include "missive/compression/compression_module.h"
+#include "missive/compression/decompression.h"
+#include "missive/compression/scoped_compression_feature.h"
+#include "missive/proto/record.pb.h"
+#include "missive/proto/record_constants.pb.h"
+#include "third_party/abseil-cpp/absl/types/optional.h"
+
+namespace reporting {
+namespace {
+
+// Records the dictionary is trained on, and records measured, which follow
+// them.
+constexpr size_t kTrainingSize = 4096;
+constexpr size_t kCorpusSize = 4096;
+constexpr size_t kDictionaryCapacity = 16 * 1024;
+constexpr uint32_t kDictionaryId = 1;
+
+// Records are stored in StorageQueue files padded to this size.
+constexpr size_t kFrameSize = 16;
+
+// Generates a serialized WrappedRecord of the size typical for events.
+std::string MakeSerializedRecord(size_t index) {
+  static const char* const kEventTypes[] = {"LOGIN", "LOGOUT", "LOCK",
+                                            "UNLOCK", "APP_INSTALL"};
+  WrappedRecord wrapped_record;
+  Record* const record = wrapped_record.mutable_record();
+  record->set_destination(UPLOAD_EVENTS);
+  record->set_dm_token("DM TOKEN");
+  record->set_timestamp_us(1600000000000000 + index * 1000);
+  record->set_data(base::StrCat(
+      {"{\"event_type\":\"", kEventTypes[base::RandInt(0, 4)],
+       "\",\"user_id\":", base::NumberToString(base::RandInt(0, 100)),
+       ",\"session\":", base::NumberToString(index), "}"}));
+  wrapped_record.mutable_record_digest()->assign(32, 'D');
+  wrapped_record.mutable_last_record_digest()->assign(32, 'L');
+  std::string serialized;
+  CHECK(wrapped_record.SerializeToString(&serialized));
+  return serialized;
+}
+
+// Returns the measured records.
+const std::vector<std::string>& Corpus() {
+  static const base::NoDestructor<std::vector<std::string>> corpus([] {
+    std::vector<std::string> corpus;
+    for (size_t i = kTrainingSize; i < kTrainingSize + kCorpusSize; ++i) {
+      corpus.emplace_back(MakeSerializedRecord(i));
+    }
+    return corpus;
+  }());
+  return *corpus;
+}
+
+// Returns dictionaries with one dictionary for UPLOAD_EVENTS, trained on
+// records that are not in Corpus().
+scoped_refptr<CompressionDictionaries> TrainDictionaries() {
+  std::string samples;
+  std::vector<size_t> sample_sizes;
+  for (size_t i = 0; i < kTrainingSize; ++i) {
+    const std::string record = MakeSerializedRecord(i);
+    samples.append(record);
+    sample_sizes.push_back(record.size());
+  }
+  std::string dictionary(kDictionaryCapacity, '\0');
+  const size_t dictionary_size = ZDICT_trainFromBuffer(
+      dictionary.data(), dictionary.size(), samples.data(),
+      sample_sizes.data(), sample_sizes.size());
+  CHECK(!ZDICT_isError(dictionary_size))
+      << ZDICT_getErrorName(dictionary_size);
+  dictionary.resize(dictionary_size);
+  auto dictionaries = CompressionDictionaries::Create();
+  CHECK(dictionaries->Add(UPLOAD_EVENTS, kDictionaryId, dictionary));
+  return dictionaries;
+}
+
+// Returns |size| as stored in StorageQueue files.
+size_t FrameRoundedSize(size_t size) {
+  return (size + kFrameSize - 1) / kFrameSize * kFrameSize;
+}
+
+// Compresses the records of Corpus() with |compression_module| while |state|
+// runs, and reports the bytes stored per record.
+void CompressCorpus(benchmark::State& state,
+                    scoped_refptr<CompressionModule> compression_module) {
+  test::ScopedCompressionFeature compression_feature(/*enable=*/true);
+  const auto& corpus = Corpus();
+  size_t index = 0;
+  uint64_t total_records = 0;
+  uint64_t total_bytes = 0;
+  for (auto _ : state) {
+    compression_module->CompressRecord(
+        corpus[index], UPLOAD_EVENTS,
+        base::BindOnce(
+            [](uint64_t* total_bytes, std::string record,
+               absl::optional<CompressionInformation> compression_information) {
+              // Compression information is stored with the record.
+              *total_bytes += FrameRoundedSize(
+                  record.size() + (compression_information.has_value()
+                                       ? compression_information->ByteSizeLong()
+                                       : 0));
+            },
+            &total_bytes));
+    ++total_records;
+    index = (index + 1) % corpus.size();
+  }
+  state.SetItemsProcessed(total_records);
+  state.counters["bytes_per_record"] =
+      static_cast<double>(total_bytes) / total_records;
+}
+
+void BM_CompressRecordSnappy(benchmark::State& state) {
+  CompressCorpus(state, CompressionModule::Create(
+                            /*compression_threshold=*/0,
+                            CompressionInformation::COMPRESSION_SNAPPY));
+}
+BENCHMARK(BM_CompressRecordSnappy);
+
+void BM_CompressRecordZstdDictionary(benchmark::State& state) {
+  CompressCorpus(state, CompressionModule::Create(
+                            /*compression_threshold=*/0,
+                            CompressionInformation::COMPRESSION_SNAPPY,
+                            TrainDictionaries()));
+}
+BENCHMARK(BM_CompressRecordZstdDictionary);
+
+void BM_DecompressRecordZstdDictionary(benchmark::State& state) {
+  test::ScopedCompressionFeature compression_feature(/*enable=*/true);
+  const auto dictionaries = TrainDictionaries();
+  const auto compression_module = CompressionModule::Create(
+      /*compression_threshold=*/0, CompressionInformation::COMPRESSION_SNAPPY,
+      dictionaries);
+  std::vector<std::pair<std::string, CompressionInformation>> compressed;
+  for (const auto& record : Corpus()) {
+    compression_module->CompressRecord(
+        record, UPLOAD_EVENTS,
+        base::BindOnce(
+            [](std::vector<std::pair<std::string, CompressionInformation>>*
+                   compressed,
+               std::string record,
+               absl::optional<CompressionInformation> compression_information) {
+              compressed->emplace_back(std::move(record),
+                                       compression_information.value());
+            },
+            &compressed));
+  }
+
+  size_t index = 0;
+  uint64_t total_records = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Decompression::DecompressRecord(
+        compressed[index].first, compressed[index].second, dictionaries));
+    ++total_records;
+    index = (index + 1) % compressed.size();
+  }
+  state.SetItemsProcessed(total_records);
+}
+BENCHMARK(BM_DecompressRecordZstdDictionary);
+
+}  // namespace
+}  // namespace reporting
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit;
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,141 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "missive/compression/compression_dictionaries.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/files/file_enumerator.h>
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/memory/ref_counted.h>
+#include <base/strings/strcat.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_piece.h>
+#include <base/strings/string_split.h>
+#include <zstd.h>
+
+#include "missive/proto/record_constants.pb.h"
+
+namespace reporting {
+
+const char kCompressionDictionariesDirectory[] =
+    "/usr/share/missive/compression_dictionaries";
+
+namespace {
+
+// Extension of the dictionary files.
+constexpr char kDictionaryExtension[] = ".zdict";
+
+// Dictionaries are digested once, so a high compression level is affordable.
+constexpr int kDictionaryCompressionLevel = 9;
+
+// Largest dictionary file accepted.
+constexpr int64_t kMaxDictionarySize = 1024 * 1024;  // 1 MiB
+
+}  // namespace
+
+CompressionDictionaries::Dictionary::Dictionary(uint32_t id,
+                                                base::StringPiece content,
+                                                int compression_level)
+    : id_(id),
+      cdict_(ZSTD_createCDict(content.data(), content.size(),
+                              compression_level)),
+      ddict_(ZSTD_createDDict(content.data(), content.size())) {}
+
+CompressionDictionaries::Dictionary::~Dictionary() {
+  ZSTD_freeCDict(cdict_);
+  ZSTD_freeDDict(ddict_);
+}
+
+// static
+scoped_refptr<CompressionDictionaries> CompressionDictionaries::Create() {
+  return base::WrapRefCounted(new CompressionDictionaries());
+}
+
+// static
+scoped_refptr<CompressionDictionaries> CompressionDictionaries::Load(
+    const base::FilePath& directory) {
+  auto dictionaries = Create();
+  base::FileEnumerator dir_enum(directory, /*recursive=*/false,
+                                base::FileEnumerator::FILES,
+                                base::StrCat({"*", kDictionaryExtension}));
+  for (base::FilePath full_name = dir_enum.Next(); !full_name.empty();
+       full_name = dir_enum.Next()) {
+    // <DESTINATION>.<id>.zdict
+    const std::vector<std::string> parts = base::SplitString(
+        full_name.BaseName().RemoveFinalExtension().MaybeAsASCII(), ".",
+        base::TRIM_WHITESPACE, base::SPLIT_WANT_ALL);
+    Destination destination;
+    uint32_t id;
+    if (parts.size() != 2 || !Destination_Parse(parts[0], &destination) ||
+        !base::StringToUint(parts[1], &id)) {
+      LOG(WARNING) << "Unexpected dictionary file name "
+                   << full_name.MaybeAsASCII();
+      continue;
+    }
+    if (dir_enum.GetInfo().GetSize() > kMaxDictionarySize) {
+      LOG(WARNING) << "Dictionary too large " << full_name.MaybeAsASCII();
+      continue;
+    }
+    std::string content;
+    if (!base::ReadFileToString(full_name, &content)) {
+      LOG(WARNING) << "Cannot read dictionary " << full_name.MaybeAsASCII();
+      continue;
+    }
+    if (!dictionaries->Add(destination, id, content)) {
+      LOG(WARNING) << "Dictionary rejected " << full_name.MaybeAsASCII();
+    }
+  }
+  return dictionaries;
+}
+
+bool CompressionDictionaries::Add(Destination destination,
+                                  uint32_t id,
+                                  base::StringPiece content) {
+  if (dictionaries_.contains(id)) {
+    return false;
+  }
+  auto dictionary =
+      std::make_unique<Dictionary>(id, content, kDictionaryCompressionLevel);
+  if (!dictionary->is_valid()) {
+    return false;
+  }
+  const Dictionary* const added =
+      dictionaries_.emplace(id, std::move(dictionary)).first->second.get();
+  auto it = latest_for_destination_.find(destination);
+  if (it == latest_for_destination_.end()) {
+    latest_for_destination_.emplace(destination, added);
+  } else if (it->second->id() < id) {
+    it->second = added;
+  }
+  return true;
+}
+
+const CompressionDictionaries::Dictionary*
+CompressionDictionaries::GetForDestination(Destination destination) const {
+  const auto it = latest_for_destination_.find(destination);
+  if (it == latest_for_destination_.end()) {
+    return nullptr;
+  }
+  return it->second;
+}
+
+const CompressionDictionaries::Dictionary* CompressionDictionaries::GetById(
+    uint32_t id) const {
+  const auto it = dictionaries_.find(id);
+  if (it == dictionaries_.end()) {
+    return nullptr;
+  }
+  return it->second.get();
+}
+
+CompressionDictionaries::CompressionDictionaries() = default;
+CompressionDictionaries::~CompressionDictionaries() = default;
+
+}  // namespace reporting
@@ -0,0 +1,101 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MISSIVE_COMPRESSION_COMPRESSION_DICTIONARIES_H_
+#define MISSIVE_COMPRESSION_COMPRESSION_DICTIONARIES_H_
+
+#include <cstdint>
+#include <memory>
+
+#include <base/containers/flat_map.h>
+#include <base/files/file_path.h>
+#include <base/memory/ref_counted.h>
+#include <base/strings/string_piece.h>
+#include <zstd.h>
+
+#include "missive/proto/record_constants.pb.h"
+
+namespace reporting {
+
+// Directory the trained dictionaries are installed to.
+extern const char kCompressionDictionariesDirectory[];
+
+// Set of trained zstd dictionaries, one or more per destination. Every
+// dictionary has a versioned id, which is recorded in the DictionaryFrameHeader
+// of each compressed record, so that a record can be decompressed after the
+// dictionary for its destination has been retrained.
+// Dictionaries are added right after creation; once the object is handed over
+// to CompressionModule, it is immutable and can be used on any thread.
+class CompressionDictionaries
+    : public base::RefCountedThreadSafe<CompressionDictionaries> {
+ public:
+  // Single dictionary, digested for both compression and decompression.
+  class Dictionary {
+   public:
+    Dictionary(uint32_t id, base::StringPiece content, int compression_level);
+    Dictionary(const Dictionary& other) = delete;
+    Dictionary& operator=(const Dictionary& other) = delete;
+    ~Dictionary();
+
+    // Returns true if the content was accepted by zstd.
+    bool is_valid() const { return cdict_ != nullptr && ddict_ != nullptr; }
+
+    uint32_t id() const { return id_; }
+    const ZSTD_CDict* cdict() const { return cdict_; }
+    const ZSTD_DDict* ddict() const { return ddict_; }
+
+   private:
+    const uint32_t id_;
+    ZSTD_CDict* const cdict_;
+    ZSTD_DDict* const ddict_;
+  };
+
+  // Not copyable or movable
+  CompressionDictionaries(const CompressionDictionaries& other) = delete;
+  CompressionDictionaries& operator=(const CompressionDictionaries& other) =
+      delete;
+
+  // Factory method creates empty |CompressionDictionaries| object.
+  static scoped_refptr<CompressionDictionaries> Create();
+
+  // Factory method creates |CompressionDictionaries| object and loads all
+  // dictionaries from |directory|. Dictionary files are named
+  // <DESTINATION>.<id>.zdict, e.g. "UPLOAD_EVENTS.3.zdict"; files that do not
+  // follow the pattern or cannot be loaded are skipped.
+  static scoped_refptr<CompressionDictionaries> Load(
+      const base::FilePath& directory);
+
+  // Adds dictionary |content| with versioned |id| for |destination|. The
+  // dictionary with the highest id is used for compressing records for the
+  // destination; all dictionaries are kept for decompression. Returns false
+  // if |id| is already used or the content is rejected.
+  bool Add(Destination destination, uint32_t id, base::StringPiece content);
+
+  // Returns dictionary for compressing records for |destination|, or nullptr
+  // if there is none.
+  const Dictionary* GetForDestination(Destination destination) const;
+
+  // Returns dictionary with the versioned |id|, or nullptr if there is none.
+  const Dictionary* GetById(uint32_t id) const;
+
+ protected:
+  // Constructor can only be called by factory methods.
+  CompressionDictionaries();
+
+  // Refcounted object must have destructor declared protected or private.
+  virtual ~CompressionDictionaries();
+
+ private:
+  friend base::RefCountedThreadSafe<CompressionDictionaries>;
+
+  // All dictionaries by id.
+  base::flat_map<uint32_t, std::unique_ptr<Dictionary>> dictionaries_;
+
+  // Latest dictionary for each destination (owned by |dictionaries_|).
+  base::flat_map<Destination, const Dictionary*> latest_for_destination_;
+};
+
+}  // namespace reporting
+
+#endif  // MISSIVE_COMPRESSION_COMPRESSION_DICTIONARIES_H_
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 #include "missive/compression/compression_module.h"
 
+#include <memory>
 #include <string>
 #include <utility>
 
@@ -14,8 +15,12 @@
 #include <base/strings/string_piece.h>
 #include <base/task/thread_pool.h>
 #include <snappy.h>
+#include <zstd.h>
 
+#include "missive/compression/compression_dictionaries.h"
+#include "missive/compression/dictionary_frame.h"
 #include "missive/proto/record.pb.h"
+#include "missive/proto/record_constants.pb.h"
 #include "missive/resources/resource_interface.h"
 #include "third_party/abseil-cpp/absl/types/optional.h"
 
@@ -37,10 +42,27 @@ scoped_refptr<CompressionModule> CompressionModule::Create(
       new CompressionModule(compression_threshold, compression_type));
 }
 
+// static
+scoped_refptr<CompressionModule> CompressionModule::Create(
+    uint64_t compression_threshold,
+    CompressionInformation::CompressionAlgorithm compression_type,
+    scoped_refptr<CompressionDictionaries> dictionaries) {
+  return base::WrapRefCounted(new CompressionModule(
+      compression_threshold, compression_type, std::move(dictionaries)));
+}
+
 void CompressionModule::CompressRecord(
     std::string record,
     base::OnceCallback<void(std::string,
                             absl::optional<CompressionInformation>)> cb) const {
+  CompressRecord(std::move(record), UNDEFINED_DESTINATION, std::move(cb));
+}
+
+void CompressionModule::CompressRecord(
+    std::string record,
+    Destination destination,
+    base::OnceCallback<void(std::string,
+                            absl::optional<CompressionInformation>)> cb) const {
   if (!is_enabled()) {
     // Compression disabled, don't compress and don't return compression
     // information.
@@ -59,17 +81,17 @@ void CompressionModule::CompressRecord(
       break;
     }
     case CompressionInformation::COMPRESSION_SNAPPY: {
-      if (record.length() < compression_threshold_) {
-        // Record size is smaller than threshold, don't compress.
-        CompressionInformation compression_information;
-        compression_information.set_compression_algorithm(
-            CompressionInformation::COMPRESSION_NONE);
-        std::move(cb).Run(std::move(record),
-                          std::move(compression_information));
+      const CompressionDictionaries::Dictionary* const dictionary =
+          dictionaries_ ? dictionaries_->GetForDestination(destination)
+                        : nullptr;
+      if (dictionary == nullptr) {
+        // No dictionary trained for the destination, use snappy.
+        CompressRecordAboveThreshold(std::move(record), std::move(cb));
         return;
       }
-      // Before doing compression, we must make sure there is enough memory - we
-      // are going to temporarily double the record.
+      // Trained dictionary pays off even for small records, so threshold is
+      // not applied. Before doing compression, we must make sure there is
+      // enough memory - we are going to temporarily double the record.
       ScopedReservation scoped_reservation(record.size(), GetMemoryResource());
       if (!scoped_reservation.reserved()) {
         CompressionInformation compression_information;
@@ -80,12 +102,39 @@ void CompressionModule::CompressRecord(
         return;
       }
       // Perform compression.
-      CompressionModule::CompressRecordSnappy(std::move(record), std::move(cb));
+      CompressRecordZstdDictionary(std::move(record), *dictionary,
+                                   std::move(cb));
       break;
     }
   }
 }
 
+void CompressionModule::CompressRecordAboveThreshold(
+    std::string record,
+    base::OnceCallback<void(std::string,
+                            absl::optional<CompressionInformation>)> cb) const {
+  if (record.length() < compression_threshold_) {
+    // Record size is smaller than threshold, don't compress.
+    CompressionInformation compression_information;
+    compression_information.set_compression_algorithm(
+        CompressionInformation::COMPRESSION_NONE);
+    std::move(cb).Run(std::move(record), std::move(compression_information));
+    return;
+  }
+  // Before doing compression, we must make sure there is enough memory - we
+  // are going to temporarily double the record.
+  ScopedReservation scoped_reservation(record.size(), GetMemoryResource());
+  if (!scoped_reservation.reserved()) {
+    CompressionInformation compression_information;
+    compression_information.set_compression_algorithm(
+        CompressionInformation::COMPRESSION_NONE);
+    std::move(cb).Run(std::move(record), std::move(compression_information));
+    return;
+  }
+  // Perform compression.
+  CompressionModule::CompressRecordSnappy(std::move(record), std::move(cb));
+}
+
 // static
 bool CompressionModule::is_enabled() {
   return base::FeatureList::IsEnabled(kCompressReportingPipeline);
@@ -93,9 +142,11 @@ bool CompressionModule::is_enabled() {
 
 CompressionModule::CompressionModule(
     uint64_t compression_threshold,
-    CompressionInformation::CompressionAlgorithm compression_type)
+    CompressionInformation::CompressionAlgorithm compression_type,
+    scoped_refptr<CompressionDictionaries> dictionaries)
     : compression_type_(compression_type),
-      compression_threshold_(compression_threshold) {}
+      compression_threshold_(compression_threshold),
+      dictionaries_(std::move(dictionaries)) {}
 CompressionModule::~CompressionModule() = default;
 
 void CompressionModule::CompressRecordSnappy(
@@ -112,4 +163,50 @@ void CompressionModule::CompressRecordSnappy(
       CompressionInformation::COMPRESSION_SNAPPY);
   std::move(cb).Run(output, compression_information);
 }
+
+void CompressionModule::CompressRecordZstdDictionary(
+    std::string record,
+    const CompressionDictionaries::Dictionary& dictionary,
+    base::OnceCallback<void(std::string,
+                            absl::optional<CompressionInformation>)> cb) const {
+  std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> cctx(ZSTD_createCCtx(),
+                                                            &ZSTD_freeCCtx);
+  std::string output = EncodeDictionaryFrameHeader(
+      {DictionaryFrameHeader::Algorithm::kZstd, dictionary.id()});
+  output.resize(kDictionaryFrameHeaderSize +
+                ZSTD_compressBound(record.size()));
+  size_t result = 0;
+  bool success =
+      cctx && !ZSTD_isError(ZSTD_CCtx_refCDict(cctx.get(), dictionary.cdict()));
+  if (success) {
+    // Dictionary id is recorded in the frame header, do not repeat it in the
+    // zstd frame.
+    success = !ZSTD_isError(
+        ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_dictIDFlag, 0));
+  }
+  if (success) {
+    result = ZSTD_compress2(
+        cctx.get(), output.data() + kDictionaryFrameHeaderSize,
+        output.size() - kDictionaryFrameHeaderSize, record.data(),
+        record.size());
+    success = !ZSTD_isError(result) &&
+              kDictionaryFrameHeaderSize + result < record.size();
+  }
+  if (!success) {
+    // Failed to compress or compression is useless, return the record as is.
+    CompressionInformation compression_information;
+    compression_information.set_compression_algorithm(
+        CompressionInformation::COMPRESSION_NONE);
+    std::move(cb).Run(std::move(record), std::move(compression_information));
+    return;
+  }
+  output.resize(kDictionaryFrameHeaderSize + result);
+
+  // Return compressed string. The synced CompressionAlgorithm has no value for
+  // dictionary compression, the frame header identifies it instead.
+  CompressionInformation compression_information;
+  compression_information.set_compression_algorithm(
+      CompressionInformation::COMPRESSION_NONE);
+  std::move(cb).Run(std::move(output), std::move(compression_information));
+}
 }  // namespace reporting
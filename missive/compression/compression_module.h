@@ -8,7 +8,9 @@
 #include <base/memory/ref_counted.h>
 #include <base/strings/string_piece.h>
 
+#include "missive/compression/compression_dictionaries.h"
 #include "missive/proto/record.pb.h"
+#include "missive/proto/record_constants.pb.h"
 #include "third_party/abseil-cpp/absl/types/optional.h"
 
 #ifndef MISSIVE_COMPRESSION_COMPRESSION_MODULE_H_
@@ -31,6 +33,14 @@ class CompressionModule : public base::RefCountedThreadSafe<CompressionModule> {
       uint64_t compression_threshold_,
       CompressionInformation::CompressionAlgorithm compression_type_);
 
+  // Factory method creates |CompressionModule| object with trained
+  // |dictionaries_|. With COMPRESSION_SNAPPY, records headed to a destination
+  // that has a dictionary are compressed with it instead, see below.
+  static scoped_refptr<CompressionModule> Create(
+      uint64_t compression_threshold_,
+      CompressionInformation::CompressionAlgorithm compression_type_,
+      scoped_refptr<CompressionDictionaries> dictionaries_);
+
   // CompressRecord will attempt to compress the provided |record| and respond
   // with the callback. On success the returned std::string sink will
   // contain a compressed WrappedRecord string. The sink string then can be
@@ -42,6 +52,20 @@ class CompressionModule : public base::RefCountedThreadSafe<CompressionModule> {
       base::OnceCallback<
           void(std::string, absl::optional<CompressionInformation>)> cb) const;
 
+  // Same as above, for a record headed to |destination|. If the module has a
+  // dictionary for the destination, the record is compressed with zstd and
+  // that dictionary regardless of its size, and returned behind a
+  // DictionaryFrameHeader with COMPRESSION_NONE, since the synced
+  // CompressionAlgorithm has no value for it. Such records can only be read
+  // back by Decompression with the same dictionaries, so dictionaries must not
+  // be given to modules whose records are uploaded before the server reads the
+  // header.
+  void CompressRecord(
+      std::string record,
+      Destination destination,
+      base::OnceCallback<
+          void(std::string, absl::optional<CompressionInformation>)> cb) const;
+
   // Returns 'true' if |kCompressReportingPipeline| feature is enabled.
   static bool is_enabled();
 
@@ -52,7 +76,8 @@ class CompressionModule : public base::RefCountedThreadSafe<CompressionModule> {
   // Constructor can only be called by |Create| factory method.
   CompressionModule(
       uint64_t compression_threshold_,
-      CompressionInformation::CompressionAlgorithm compression_type_);
+      CompressionInformation::CompressionAlgorithm compression_type_,
+      scoped_refptr<CompressionDictionaries> dictionaries_ = nullptr);
 
   // Refcounted object must have destructor declared protected or private.
   virtual ~CompressionModule();
@@ -66,9 +91,25 @@ class CompressionModule : public base::RefCountedThreadSafe<CompressionModule> {
       base::OnceCallback<
           void(std::string, absl::optional<CompressionInformation>)> cb) const;
 
+  // Compresses a record using snappy, if it is not below the threshold
+  void CompressRecordAboveThreshold(
+      std::string record,
+      base::OnceCallback<
+          void(std::string, absl::optional<CompressionInformation>)> cb) const;
+
+  // Compresses a record using zstd with the trained |dictionary|
+  void CompressRecordZstdDictionary(
+      std::string record,
+      const CompressionDictionaries::Dictionary& dictionary,
+      base::OnceCallback<
+          void(std::string, absl::optional<CompressionInformation>)> cb) const;
+
   // Minimum compression threshold (in bytes) for when a record will be
   // compressed
   const uint64_t compression_threshold_;
+
+  // Trained dictionaries (used only with COMPRESSION_SNAPPY, may be null).
+  const scoped_refptr<CompressionDictionaries> dictionaries_;
 };
 
 }  // namespace reporting
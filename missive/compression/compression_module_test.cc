@@ -4,6 +4,7 @@
 
 #include "missive/compression/compression_module.h"
 
+#include <cstring>
 #include <initializer_list>
 #include <memory>
 #include <string>
@@ -17,6 +18,8 @@
 #include <base/rand_util.h>
 #include <base/strings/strcat.h>
 #include <base/feature_list.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
 #include <base/synchronization/waitable_event.h>
 #include <base/task/thread_pool.h>
 #include <base/test/task_environment.h>
@@ -25,8 +28,12 @@
 #include <gtest/gtest.h>
 #include <snappy.h>
 
+#include "missive/compression/compression_dictionaries.h"
+#include "missive/compression/decompression.h"
+#include "missive/compression/dictionary_frame.h"
 #include "missive/compression/scoped_compression_feature.h"
 #include "missive/proto/record.pb.h"
+#include "missive/proto/record_constants.pb.h"
 #include "missive/util/test_support_callbacks.h"
 
 using ::testing::Eq;
@@ -37,6 +44,15 @@ namespace {
 
 constexpr char kTestString[] = "AAAAA11111";
 
+// Small record, typical for events, and raw-content dictionary resembling it.
+constexpr char kTestEventString[] =
+    "{\"event_type\":\"LOGIN\",\"user\":\"affiliated\",\"result\":\"OK\"}";
+constexpr char kTestDictionaryContent[] =
+    "{\"event_type\":\"LOGOUT\",\"user\":\"affiliated\",\"result\":\"OK\"}"
+    "{\"event_type\":\"LOGIN\",\"user\":\"unaffiliated\",\"result\":"
+    "\"FAILURE\"}";
+constexpr uint32_t kTestDictionaryId = 7;
+
 class CompressionModuleTest : public ::testing::Test {
  protected:
   CompressionModuleTest() = default;
@@ -47,6 +63,24 @@ class CompressionModuleTest : public ::testing::Test {
     return output;
   }
 
+  // Compresses |record| for |destination| with a module that has
+  // |dictionaries|, and returns the result.
+  std::tuple<std::string, absl::optional<CompressionInformation>>
+  CompressWithDictionaries(
+      base::StringPiece record,
+      Destination destination,
+      scoped_refptr<CompressionDictionaries> dictionaries) {
+    scoped_refptr<CompressionModule> test_compression_module =
+        CompressionModule::Create(512,
+                                  CompressionInformation::COMPRESSION_SNAPPY,
+                                  std::move(dictionaries));
+    test::TestMultiEvent<std::string, absl::optional<CompressionInformation>>
+        compressed_record_event;
+    test_compression_module->CompressRecord(std::string(record), destination,
+                                            compressed_record_event.cb());
+    return compressed_record_event.result();
+  }
+
   scoped_refptr<CompressionModule> compression_module_;
   base::test::TaskEnvironment task_environment_{};
 };
@@ -177,5 +211,181 @@ TEST_F(CompressionModuleTest, CompressRecordCompressionNone) {
               Eq(CompressionInformation::COMPRESSION_NONE));
 }
 
+TEST_F(CompressionModuleTest, CompressRecordZstdDictionary) {
+  test::ScopedCompressionFeature compression_feature{/*enable=*/true};
+  auto dictionaries = CompressionDictionaries::Create();
+  ASSERT_TRUE(dictionaries->Add(UPLOAD_EVENTS, kTestDictionaryId,
+                                kTestDictionaryContent));
+
+  const auto [compressed_string, compression_info] =
+      CompressWithDictionaries(kTestEventString, UPLOAD_EVENTS, dictionaries);
+
+  // Expect that record is compressed in spite of being below threshold, and
+  // that the frame header refers to the dictionary.
+  EXPECT_LT(compressed_string.size(), strlen(kTestEventString));
+  DictionaryFrameHeader header;
+  base::StringPiece payload;
+  ASSERT_TRUE(DecodeDictionaryFrame(compressed_string, &header, &payload));
+  EXPECT_THAT(header.algorithm, Eq(DictionaryFrameHeader::Algorithm::kZstd));
+  EXPECT_THAT(header.dictionary_id, Eq(kTestDictionaryId));
+
+  // The synced CompressionAlgorithm has no value for the header.
+  ASSERT_TRUE(compression_info.has_value());
+  EXPECT_THAT(compression_info.value().compression_algorithm(),
+              Eq(CompressionInformation::COMPRESSION_NONE));
+
+  // Expect that the record is restored with the dictionary only.
+  EXPECT_THAT(Decompression::DecompressRecord(
+                  compressed_string, compression_info.value(), dictionaries),
+              StrEq(kTestEventString));
+  EXPECT_THAT(Decompression::DecompressRecord(compressed_string,
+                                              compression_info.value()),
+              StrEq(""));
+}
+
+TEST_F(CompressionModuleTest, CompressRecordZstdDictionaryMissing) {
+  test::ScopedCompressionFeature compression_feature{/*enable=*/true};
+  auto dictionaries = CompressionDictionaries::Create();
+  ASSERT_TRUE(dictionaries->Add(UPLOAD_EVENTS, kTestDictionaryId,
+                                kTestDictionaryContent));
+
+  // Compress string for a destination that has no dictionary
+  const auto [compressed_string, compression_info] = CompressWithDictionaries(
+      kTestEventString, HEARTBEAT_EVENTS, dictionaries);
+
+  // Expect that record is not compressed, since it is below threshold.
+  EXPECT_THAT(compressed_string, StrEq(kTestEventString));
+  ASSERT_TRUE(compression_info.has_value());
+  EXPECT_THAT(compression_info.value().compression_algorithm(),
+              Eq(CompressionInformation::COMPRESSION_NONE));
+  EXPECT_THAT(Decompression::DecompressRecord(
+                  compressed_string, compression_info.value(), dictionaries),
+              StrEq(kTestEventString));
+}
+
+TEST_F(CompressionModuleTest, DecompressRecordAfterRetraining) {
+  test::ScopedCompressionFeature compression_feature{/*enable=*/true};
+  auto old_dictionaries = CompressionDictionaries::Create();
+  ASSERT_TRUE(old_dictionaries->Add(UPLOAD_EVENTS, kTestDictionaryId,
+                                    kTestDictionaryContent));
+  const auto [compressed_string, compression_info] = CompressWithDictionaries(
+      kTestEventString, UPLOAD_EVENTS, old_dictionaries);
+  ASSERT_TRUE(compression_info.has_value());
+
+  // The retrained dictionary is used for new records, and the old one still
+  // restores the records compressed with it.
+  auto dictionaries = CompressionDictionaries::Create();
+  ASSERT_TRUE(dictionaries->Add(UPLOAD_EVENTS, kTestDictionaryId,
+                                kTestDictionaryContent));
+  ASSERT_TRUE(dictionaries->Add(UPLOAD_EVENTS, kTestDictionaryId + 1,
+                                base::StrCat({kTestDictionaryContent,
+                                              kTestEventString})));
+  const auto [new_compressed_string, new_compression_info] =
+      CompressWithDictionaries(kTestEventString, UPLOAD_EVENTS, dictionaries);
+  DictionaryFrameHeader header;
+  base::StringPiece payload;
+  ASSERT_TRUE(DecodeDictionaryFrame(new_compressed_string, &header, &payload));
+  EXPECT_THAT(header.dictionary_id, Eq(kTestDictionaryId + 1));
+
+  EXPECT_THAT(Decompression::DecompressRecord(
+                  compressed_string, compression_info.value(), dictionaries),
+              StrEq(kTestEventString));
+  ASSERT_TRUE(new_compression_info.has_value());
+  EXPECT_THAT(
+      Decompression::DecompressRecord(
+          new_compressed_string, new_compression_info.value(), dictionaries),
+      StrEq(kTestEventString));
+}
+
+TEST_F(CompressionModuleTest, DecompressRecordCorruptDictionaryFrame) {
+  test::ScopedCompressionFeature compression_feature{/*enable=*/true};
+  auto dictionaries = CompressionDictionaries::Create();
+  ASSERT_TRUE(dictionaries->Add(UPLOAD_EVENTS, kTestDictionaryId,
+                                kTestDictionaryContent));
+  const auto [compressed_string, compression_info] =
+      CompressWithDictionaries(kTestEventString, UPLOAD_EVENTS, dictionaries);
+  ASSERT_TRUE(compression_info.has_value());
+
+  // Truncated header or payload.
+  for (size_t size : {size_t{4}, kDictionaryFrameHeaderSize,
+                      compressed_string.size() - 1}) {
+    EXPECT_THAT(
+        Decompression::DecompressRecord(compressed_string.substr(0, size),
+                                        compression_info.value(), dictionaries),
+        StrEq(""))
+        << "size=" << size;
+  }
+  // Unknown version, algorithm or dictionary.
+  for (size_t offset : {4, 5, 6}) {
+    std::string corrupt = compressed_string;
+    corrupt[offset] = static_cast<char>(corrupt[offset] + 1);
+    EXPECT_THAT(Decompression::DecompressRecord(
+                    corrupt, compression_info.value(), dictionaries),
+                StrEq(""))
+        << "offset=" << offset;
+  }
+}
+
+TEST_F(CompressionModuleTest, SerializedRecordIsNotDictionaryFrame) {
+  // Uncompressed records are told apart from the frames by their first byte.
+  WrappedRecord wrapped_record;
+  wrapped_record.mutable_record()->set_destination(UPLOAD_EVENTS);
+  wrapped_record.mutable_record()->set_data(kTestEventString);
+  std::string serialized;
+  ASSERT_TRUE(wrapped_record.SerializeToString(&serialized));
+  EXPECT_FALSE(IsDictionaryFrame(serialized));
+
+  CompressionInformation compression_information;
+  compression_information.set_compression_algorithm(
+      CompressionInformation::COMPRESSION_NONE);
+  EXPECT_THAT(Decompression::DecompressRecord(
+                  serialized, compression_information,
+                  CompressionDictionaries::Create()),
+              StrEq(serialized));
+}
+
+TEST_F(CompressionModuleTest, CompressionDictionariesLatestWins) {
+  auto dictionaries = CompressionDictionaries::Create();
+  ASSERT_TRUE(dictionaries->Add(UPLOAD_EVENTS, kTestDictionaryId + 1,
+                                kTestDictionaryContent));
+  ASSERT_TRUE(dictionaries->Add(UPLOAD_EVENTS, kTestDictionaryId,
+                                kTestDictionaryContent));
+  // Ids cannot be reused.
+  EXPECT_FALSE(dictionaries->Add(HEARTBEAT_EVENTS, kTestDictionaryId,
+                                 kTestDictionaryContent));
+
+  ASSERT_THAT(dictionaries->GetForDestination(UPLOAD_EVENTS),
+              ::testing::NotNull());
+  EXPECT_THAT(dictionaries->GetForDestination(UPLOAD_EVENTS)->id(),
+              Eq(kTestDictionaryId + 1));
+  EXPECT_THAT(dictionaries->GetForDestination(HEARTBEAT_EVENTS),
+              ::testing::IsNull());
+  EXPECT_THAT(dictionaries->GetById(kTestDictionaryId), ::testing::NotNull());
+}
+
+TEST_F(CompressionModuleTest, CompressionDictionariesLoad) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  for (const char* name :
+       {"UPLOAD_EVENTS.3.zdict", "UPLOAD_EVENTS.5.zdict",
+        "HEARTBEAT_EVENTS.x.zdict", "NO_SUCH_DESTINATION.4.zdict",
+        "HEARTBEAT_EVENTS.6.dict"}) {
+    const int size = strlen(kTestDictionaryContent);
+    ASSERT_EQ(size, base::WriteFile(temp_dir.GetPath().Append(name),
+                                    kTestDictionaryContent, size));
+  }
+
+  auto dictionaries = CompressionDictionaries::Load(temp_dir.GetPath());
+  ASSERT_THAT(dictionaries->GetForDestination(UPLOAD_EVENTS),
+              ::testing::NotNull());
+  EXPECT_THAT(dictionaries->GetForDestination(UPLOAD_EVENTS)->id(), Eq(5u));
+  EXPECT_THAT(dictionaries->GetById(3), ::testing::NotNull());
+  // Files with a bad name or extension are skipped.
+  EXPECT_THAT(dictionaries->GetForDestination(HEARTBEAT_EVENTS),
+              ::testing::IsNull());
+  EXPECT_THAT(dictionaries->GetById(4), ::testing::IsNull());
+  EXPECT_THAT(dictionaries->GetById(6), ::testing::IsNull());
+}
+
 }  // namespace
 }  // namespace reporting
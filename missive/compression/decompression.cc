@@ -3,17 +3,22 @@
 // found in the LICENSE file.
 #include "missive/compression/decompression.h"
 
+#include <memory>
 #include <string>
 #include <utility>
 
 #include <base/bind.h>
 #include <base/callback.h>
 #include <base/feature_list.h>
+#include <base/logging.h>
 #include <base/memory/ref_counted.h>
 #include <base/strings/string_piece.h>
 #include <base/task/thread_pool.h>
 #include <snappy.h>
+#include <zstd.h>
 
+#include "missive/compression/compression_dictionaries.h"
+#include "missive/compression/dictionary_frame.h"
 #include "missive/proto/record.pb.h"
 #include "third_party/abseil-cpp/absl/types/optional.h"
 
@@ -21,12 +26,63 @@ namespace reporting {
 
 namespace {
 
+// Largest record accepted from a zstd frame header.
+constexpr unsigned long long kMaxDecompressedSize =  // NOLINT(runtime/int)
+    64 * 1024 * 1024;  // 64 MiB
+
 std::string DecompressRecordSnappy(std::string record) {
   // Compression is enabled and crosses the threshold,
   std::string output;
   snappy::Uncompress(record.data(), record.size(), &output);
   return output;
 }
+
+std::string DecompressRecordZstdDictionary(
+    base::StringPiece record,
+    const CompressionDictionaries::Dictionary& dictionary) {
+  const unsigned long long content_size =  // NOLINT(runtime/int)
+      ZSTD_getFrameContentSize(record.data(), record.size());
+  if (content_size == ZSTD_CONTENTSIZE_ERROR ||
+      content_size == ZSTD_CONTENTSIZE_UNKNOWN ||
+      content_size > kMaxDecompressedSize) {
+    LOG(ERROR) << "Invalid zstd frame, content size=" << content_size;
+    return std::string();
+  }
+  std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> dctx(ZSTD_createDCtx(),
+                                                            &ZSTD_freeDCtx);
+  if (!dctx) {
+    LOG(ERROR) << "Failed to allocate zstd context";
+    return std::string();
+  }
+  std::string output(content_size, '\0');
+  const size_t result =
+      ZSTD_decompress_usingDDict(dctx.get(), output.data(), output.size(),
+                                 record.data(), record.size(),
+                                 dictionary.ddict());
+  if (ZSTD_isError(result) || result != content_size) {
+    LOG(ERROR) << "Failed to decompress record, dictionary id="
+               << dictionary.id();
+    return std::string();
+  }
+  return output;
+}
+
+std::string DecompressDictionaryFrame(
+    std::string record, scoped_refptr<CompressionDictionaries> dictionaries) {
+  DictionaryFrameHeader header;
+  base::StringPiece payload;
+  if (!DecodeDictionaryFrame(record, &header, &payload)) {
+    LOG(ERROR) << "Unsupported dictionary frame header";
+    return std::string();
+  }
+  const CompressionDictionaries::Dictionary* const dictionary =
+      dictionaries ? dictionaries->GetById(header.dictionary_id) : nullptr;
+  if (dictionary == nullptr) {
+    LOG(ERROR) << "Unknown dictionary id=" << header.dictionary_id;
+    return std::string();
+  }
+  return DecompressRecordZstdDictionary(payload, *dictionary);
+}
 }  // namespace
 
 // static
@@ -36,9 +92,23 @@ scoped_refptr<Decompression> Decompression::Create() {
 
 std::string Decompression::DecompressRecord(
     std::string record, CompressionInformation compression_information) {
+  return DecompressRecord(std::move(record), std::move(compression_information),
+                          /*dictionaries=*/nullptr);
+}
+
+std::string Decompression::DecompressRecord(
+    std::string record,
+    CompressionInformation compression_information,
+    scoped_refptr<CompressionDictionaries> dictionaries) {
   // Decompress
   switch (compression_information.compression_algorithm()) {
     case CompressionInformation::COMPRESSION_NONE: {
+      // Records compressed with a dictionary carry their own header, which no
+      // serialized record starts with.
+      if (IsDictionaryFrame(record)) {
+        return DecompressDictionaryFrame(std::move(record),
+                                         std::move(dictionaries));
+      }
       // Don't decompress, simply return serialized record
       return record;
     }
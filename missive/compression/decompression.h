@@ -7,6 +7,7 @@
 #include <base/memory/ref_counted.h>
 #include <base/strings/string_piece.h>
 
+#include "missive/compression/compression_dictionaries.h"
 #include "missive/proto/record.pb.h"
 #include "third_party/abseil-cpp/absl/types/optional.h"
 
@@ -34,6 +35,14 @@ class Decompression : public base::RefCountedThreadSafe<Decompression> {
   static std::string DecompressRecord(
       std::string record, CompressionInformation compression_information);
 
+  // Same as above, with trained |dictionaries| that records behind a
+  // DictionaryFrameHeader are looked up in by dictionary id. If the dictionary
+  // is not found or the record is corrupt, returns empty string.
+  static std::string DecompressRecord(
+      std::string record,
+      CompressionInformation compression_information,
+      scoped_refptr<CompressionDictionaries> dictionaries);
+
  protected:
   // Constructor can only be called by |Create| factory method.
   Decompression();
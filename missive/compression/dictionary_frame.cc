@@ -0,0 +1,66 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "missive/compression/dictionary_frame.h"
+
+#include <cstdint>
+#include <string>
+
+#include <base/strings/string_piece.h>
+
+namespace reporting {
+
+namespace {
+
+constexpr char kMagic[] = {'\0', 'M', 'Z', 'D'};
+constexpr size_t kVersionOffset = sizeof(kMagic);
+constexpr size_t kAlgorithmOffset = kVersionOffset + 1;
+constexpr size_t kDictionaryIdOffset = kAlgorithmOffset + 1;
+static_assert(kDictionaryIdOffset + sizeof(uint32_t) ==
+                  kDictionaryFrameHeaderSize,
+              "Header size does not match its fields");
+
+}  // namespace
+
+std::string EncodeDictionaryFrameHeader(const DictionaryFrameHeader& header) {
+  std::string encoded(kMagic, sizeof(kMagic));
+  encoded.push_back(static_cast<char>(kDictionaryFrameVersion));
+  encoded.push_back(static_cast<char>(header.algorithm));
+  for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+    encoded.push_back(static_cast<char>(header.dictionary_id >> (i * 8)));
+  }
+  return encoded;
+}
+
+bool IsDictionaryFrame(base::StringPiece frame) {
+  return frame.size() >= sizeof(kMagic) &&
+         frame.substr(0, sizeof(kMagic)) ==
+             base::StringPiece(kMagic, sizeof(kMagic));
+}
+
+bool DecodeDictionaryFrame(base::StringPiece frame,
+                           DictionaryFrameHeader* header,
+                           base::StringPiece* payload) {
+  if (!IsDictionaryFrame(frame) || frame.size() < kDictionaryFrameHeaderSize ||
+      static_cast<uint8_t>(frame[kVersionOffset]) != kDictionaryFrameVersion) {
+    return false;
+  }
+  const auto algorithm = static_cast<DictionaryFrameHeader::Algorithm>(
+      static_cast<uint8_t>(frame[kAlgorithmOffset]));
+  if (algorithm != DictionaryFrameHeader::Algorithm::kZstd) {
+    return false;
+  }
+  header->algorithm = algorithm;
+  header->dictionary_id = 0;
+  for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+    header->dictionary_id |=
+        static_cast<uint32_t>(
+            static_cast<uint8_t>(frame[kDictionaryIdOffset + i]))
+        << (i * 8);
+  }
+  *payload = frame.substr(kDictionaryFrameHeaderSize);
+  return true;
+}
+
+}  // namespace reporting
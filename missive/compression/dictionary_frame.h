@@ -0,0 +1,59 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MISSIVE_COMPRESSION_DICTIONARY_FRAME_H_
+#define MISSIVE_COMPRESSION_DICTIONARY_FRAME_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <base/strings/string_piece.h>
+
+namespace reporting {
+
+// Header of the records compressed with a trained dictionary. The format is
+// owned by missive: CompressionInformation comes from the synced record.proto
+// and has no room for the algorithm or the dictionary id, so the header is
+// carried in front of the compressed payload instead:
+//
+//   0  "\0MZD"   Magic. No serialized WrappedRecord starts with a zero byte,
+//                since protobuf field number 0 is invalid.
+//   4  version   Version of the header, kDictionaryFrameVersion.
+//   5  algorithm DictionaryFrameHeader::Algorithm.
+//   6  id        Versioned dictionary id, 32-bit little-endian.
+//  10  payload   Compressed record.
+struct DictionaryFrameHeader {
+  enum class Algorithm : uint8_t {
+    // zstd frame without dictionary id, which the header already carries.
+    kZstd = 1,
+  };
+
+  Algorithm algorithm;
+  uint32_t dictionary_id;
+};
+
+// Current version of the header.
+constexpr uint8_t kDictionaryFrameVersion = 1;
+
+// Size of the header in front of the compressed payload.
+constexpr size_t kDictionaryFrameHeaderSize = 10;
+
+// Returns the serialized |header|, to be followed by the compressed payload.
+std::string EncodeDictionaryFrameHeader(const DictionaryFrameHeader& header);
+
+// Returns true if |frame| starts with the magic of the header, whether or not
+// the rest of the header can be decoded.
+bool IsDictionaryFrame(base::StringPiece frame);
+
+// Decodes the header of |frame| into |header| and the compressed payload that
+// follows it into |payload|. Returns false if |frame| is not a dictionary
+// frame, or has an unknown version or algorithm.
+bool DecodeDictionaryFrame(base::StringPiece frame,
+                           DictionaryFrameHeader* header,
+                           base::StringPiece* payload);
+
+}  // namespace reporting
+
+#endif  // MISSIVE_COMPRESSION_DICTIONARY_FRAME_H_
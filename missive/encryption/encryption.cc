@@ -107,10 +107,12 @@ void Encryptor::Handle::ProduceEncryptedRecord(
   std::move(cb).Run(encrypted_record);
 }
 
+// Every record retrieves the key on this sequence, so it must not be starved by
+// best effort tasks while records are encrypted in parallel.
 Encryptor::Encryptor()
     : asymmetric_key_sequenced_task_runner_(
           base::ThreadPool::CreateSequencedTaskRunner(
-              {base::TaskPriority::BEST_EFFORT, base::MayBlock()})) {
+              {base::TaskPriority::USER_VISIBLE, base::MayBlock()})) {
   DETACH_FROM_SEQUENCE(asymmetric_key_sequence_checker_);
 }
 
@@ -48,6 +48,18 @@ class StorageOptions {
     max_total_memory_size_ = max_total_memory_size;
     return *this;
   }
+  StorageOptions& set_max_write_batch_size(size_t max_write_batch_size) {
+    max_write_batch_size_ = max_write_batch_size;
+    return *this;
+  }
+  StorageOptions& set_write_batch_window(base::TimeDelta write_batch_window) {
+    write_batch_window_ = write_batch_window;
+    return *this;
+  }
+  StorageOptions& set_memory_mapped_read(bool memory_mapped_read) {
+    memory_mapped_read_ = memory_mapped_read;
+    return *this;
+  }
   const base::FilePath& directory() const { return directory_; }
   base::StringPiece signature_verification_public_key() const {
     return signature_verification_public_key_;
@@ -55,6 +67,9 @@ class StorageOptions {
   size_t max_record_size() const { return max_record_size_; }
   uint64_t max_total_files_size() const { return max_total_files_size_; }
   uint64_t max_total_memory_size() const { return max_total_memory_size_; }
+  size_t max_write_batch_size() const { return max_write_batch_size_; }
+  base::TimeDelta write_batch_window() const { return write_batch_window_; }
+  bool memory_mapped_read() const { return memory_mapped_read_; }
 
  private:
   // Subdirectory of the location assigned for this Storage.
@@ -72,6 +87,19 @@ class StorageOptions {
 
   // Maximum memory usage (reading buffers).
   uint64_t max_total_memory_size_ = 4 * 1024LL * 1024LL;  // 4 MiB
+
+  // Maximum number of records written as one group commit: appended to the
+  // data file as a single contiguous block, with metadata persisted once per
+  // batch. 1 (default) disables batching.
+  size_t max_write_batch_size_ = 1;
+
+  // Time the first record of a group commit waits for more records to join
+  // the batch before it is written. Only used when batching is enabled.
+  base::TimeDelta write_batch_window_ = base::Milliseconds(5);
+
+  // When set, uploads read sealed data files through a read-only memory
+  // mapping instead of a per-file read buffer.
+  bool memory_mapped_read_ = false;
 };
 
 // Single queue options class allowing to set parameters individually, e.g.:
@@ -115,6 +143,15 @@ class QueueOptions {
     return storage_options_.max_total_memory_size();
   }
   uint64_t max_single_file_size() const { return max_single_file_size_; }
+  size_t max_write_batch_size() const {
+    return storage_options_.max_write_batch_size();
+  }
+  base::TimeDelta write_batch_window() const {
+    return storage_options_.write_batch_window();
+  }
+  bool memory_mapped_read() const {
+    return storage_options_.memory_mapped_read();
+  }
   base::TimeDelta upload_period() const { return upload_period_; }
   base::TimeDelta upload_retry_delay() const { return upload_retry_delay_; }
 
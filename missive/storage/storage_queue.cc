@@ -4,6 +4,8 @@
 
 #include "missive/storage/storage_queue.h"
 
+#include <sys/mman.h>
+
 #include <algorithm>
 #include <cstring>
 #include <iterator>
@@ -23,6 +25,7 @@
 #include <base/files/file_enumerator.h>
 #include <base/files/file_path.h>
 #include <base/files/file_util.h>
+#include <base/files/memory_mapped_file.h>
 #include <base/hash/hash.h>
 #include <base/logging.h>
 #include <base/memory/ptr_util.h>
@@ -35,6 +38,7 @@
 #include <base/strings/string_split.h>
 #include <base/strings/string_util.h>
 #include <base/task/post_task.h>
+#include <base/task/task_traits.h>
 #include <base/task/thread_pool.h>
 #include <base/task_runner.h>
 #include <crypto/random.h>
@@ -44,6 +48,7 @@
 #include "missive/compression/compression_module.h"
 #include "missive/encryption/encryption_module_interface.h"
 #include "missive/proto/record.pb.h"
+#include "missive/proto/record_constants.pb.h"
 #include "missive/resources/resource_interface.h"
 #include "missive/storage/storage_configuration.h"
 #include "missive/storage/storage_uploader_interface.h"
@@ -61,6 +66,14 @@ namespace {
 // Metadata file name prefix.
 constexpr char METADATA_NAME[] = "META";
 
+// Traits of the write pipeline stage that serializes, compresses and encrypts
+// records. Records go through the stage in parallel on the thread pool and
+// are put back in sequencing id order by |write_contexts_queue_| before being
+// written. BEST_EFFORT would cap the stage at a couple of worker threads
+// regardless of the number of cores.
+constexpr base::TaskTraits kWritePipelineTraits = {
+    base::TaskPriority::USER_VISIBLE};
+
 // The size in bytes that all files and records are rounded to (for privacy:
 // make it harder to differ between kinds of records).
 constexpr size_t FRAME_SIZE = 16u;
@@ -556,27 +569,105 @@ Status StorageQueue::WriteHeaderAndBlock(
   return Status::StatusOK();
 }
 
-Status StorageQueue::WriteMetadata(base::StringPiece current_record_digest) {
+Status StorageQueue::WriteHeadersAndBlocks(
+    const std::vector<base::StringPiece>& blocks,
+    base::StringPiece last_record_digest,
+    scoped_refptr<StorageQueue::SingleFile> file) {
+  DCHECK_CALLED_ON_VALID_SEQUENCE(storage_queue_sequence_checker_);
+  DCHECK(!blocks.empty());
+
+  // Test only: Simulate failure if requested
+  if (test_injected_failures_.count(
+          test::StorageQueueOperationKind::kWriteBlock) > 0) {
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      const int64_t sequencing_id = next_sequencing_id_ + i;
+      if (test_injected_failures_[test::StorageQueueOperationKind::kWriteBlock]
+              .count(sequencing_id)) {
+        return Status(error::INTERNAL,
+                      base::StrCat({"Simulated failure, seq=",
+                                    base::NumberToString(sequencing_id)}));
+      }
+    }
+  }
+
+  // Compose headers, data and padding of all records into one contiguous
+  // buffer, so that the batch is appended to the file at once.
+  size_t total_size = 0;
+  for (const auto& data : blocks) {
+    total_size += RoundUpToFrameSize(sizeof(RecordHeader) + data.size());
+  }
+  ScopedReservation scoped_reservation(total_size, GetMemoryResource());
+  if (!scoped_reservation.reserved()) {
+    return Status(error::RESOURCE_EXHAUSTED,
+                  "Not enough memory for the write batch buffer");
+  }
+  std::string buffer;
+  buffer.reserve(total_size);
+  for (const auto& data : blocks) {
+    RecordHeader header;
+    header.record_sequencing_id = next_sequencing_id_++;
+    header.record_hash = base::PersistentHash(data.data(), data.size());
+    header.record_size = data.size();
+    buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer.append(data.data(), data.size());
+    // Pad to the whole frame, if necessary.
+    const size_t pad_size =
+        RoundUpToFrameSize(sizeof(header) + data.size()) -
+        (sizeof(header) + data.size());
+    if (pad_size > 0) {
+      // Fill in with random bytes.
+      char junk_bytes[FRAME_SIZE];
+      crypto::RandBytes(junk_bytes, pad_size);
+      buffer.append(&junk_bytes[0], pad_size);
+    }
+  }
+  DCHECK_EQ(buffer.size(), total_size);
+  // Store last record digest.
+  last_record_digest_.emplace(last_record_digest);
+  // Write to the last file.
+  auto open_status = file->Open(/*read_only=*/false);
+  if (!open_status.ok()) {
+    return Status(error::ALREADY_EXISTS,
+                  base::StrCat({"Cannot open file=", file->name(),
+                                " status=", open_status.ToString()}));
+  }
+  if (!GetDiskResource()->Reserve(total_size)) {
+    return Status(
+        error::RESOURCE_EXHAUSTED,
+        base::StrCat({"Not enough disk space available to write into file=",
+                      file->name()}));
+  }
+  auto write_status = file->Append(buffer);
+  if (!write_status.ok()) {
+    return Status(error::RESOURCE_EXHAUSTED,
+                  base::StrCat({"Cannot write file=", file->name(),
+                                " status=", write_status.status().ToString()}));
+  }
+  return Status::StatusOK();
+}
+
+Status StorageQueue::WriteMetadata(base::StringPiece current_record_digest,
+                                   int64_t sequencing_id) {
   DCHECK_CALLED_ON_VALID_SEQUENCE(storage_queue_sequence_checker_);
 
   // Test only: Simulate failure if requested
   if (test_injected_failures_.count(
           test::StorageQueueOperationKind::kWriteMetadata) > 0 &&
       test_injected_failures_[test::StorageQueueOperationKind::kWriteMetadata]
-          .count(next_sequencing_id_)) {
+          .count(sequencing_id)) {
     return Status(error::INTERNAL,
                   base::StrCat({"Simulated failure, seq=",
-                                base::NumberToString(next_sequencing_id_)}));
+                                base::NumberToString(sequencing_id)}));
   }
 
   // Synchronously write the metafile.
   ASSIGN_OR_RETURN(
       scoped_refptr<SingleFile> meta_file,
-      SingleFile::Create(
-          options_.directory()
-              .Append(METADATA_NAME)
-              .AddExtensionASCII(base::NumberToString(next_sequencing_id_)),
-          /*size=*/0));
+      SingleFile::Create(options_.directory()
+                             .Append(METADATA_NAME)
+                             .AddExtensionASCII(
+                                 base::NumberToString(sequencing_id)),
+                         /*size=*/0));
   RETURN_IF_ERROR(meta_file->Open(/*read_only=*/false));
   // Account for the metadata file size.
   if (!GetDiskResource()->Reserve(sizeof(generation_id_) +
@@ -618,7 +709,7 @@ Status StorageQueue::WriteMetadata(base::StringPiece current_record_digest) {
   base::ThreadPool::PostTask(
       FROM_HERE, {base::TaskPriority::BEST_EFFORT, base::MayBlock()},
       base::BindOnce(&StorageQueue::DeleteOutdatedMetadata, this,
-                     next_sequencing_id_));
+                     sequencing_id));
   return Status::StatusOK();
 }
 
@@ -1098,7 +1189,11 @@ class StorageQueue::ReadContext : public TaskRunnerContext<Status> {
     }
 
     // Read from the current file at the current offset.
-    RETURN_IF_ERROR(current_file_->second->Open(/*read_only=*/true));
+    if (storage_queue_->options_.memory_mapped_read()) {
+      RETURN_IF_ERROR(current_file_->second->Map());
+    } else {
+      RETURN_IF_ERROR(current_file_->second->Open(/*read_only=*/true));
+    }
     const size_t max_buffer_size =
         RoundUpToFrameSize(storage_queue_->options_.max_record_size()) +
         RoundUpToFrameSize(sizeof(RecordHeader));
@@ -1285,9 +1380,9 @@ class StorageQueue::WriteContext : public TaskRunnerContext<Status> {
     // filled in, schedule respective |Write| to happen now.
     if (!storage_queue_->write_contexts_queue_.empty() &&
         !storage_queue_->write_contexts_queue_.front()->buffer_.empty()) {
-      storage_queue_->write_contexts_queue_.front()->Schedule(
-          &WriteContext::ResumeWriteRecord,
-          base::Unretained(storage_queue_->write_contexts_queue_.front()));
+      storage_queue_->sequenced_task_runner_->PostTask(
+          FROM_HERE, base::BindOnce(&WriteContext::ResumeFrontWriteContext,
+                                    storage_queue_));
     }
 
     // If uploads are not immediate, we are done.
@@ -1347,9 +1442,10 @@ class StorageQueue::WriteContext : public TaskRunnerContext<Status> {
     in_contexts_queue_ = storage_queue_->write_contexts_queue_.insert(
         storage_queue_->write_contexts_queue_.end(), this);
 
-    // Serialize and compress wrapped record on a thread pool.
+    // Serialize, compress and encrypt wrapped record on a thread pool,
+    // in parallel with other records.
     base::ThreadPool::PostTask(
-        FROM_HERE, {base::TaskPriority::BEST_EFFORT},
+        FROM_HERE, kWritePipelineTraits,
         base::BindOnce(&WriteContext::ProcessWrappedRecord,
                        base::Unretained(this), std::move(wrapped_record)));
   }
@@ -1371,15 +1467,18 @@ class StorageQueue::WriteContext : public TaskRunnerContext<Status> {
                Status(error::DATA_LOSS, "Cannot serialize record"));
       return;
     }
+    // Destination selects the compression dictionary, if any.
+    const Destination destination = wrapped_record.record().destination();
     // Release wrapped record memory, so scoped reservation may act.
     wrapped_record.Clear();
-    CompressWrappedRecord(std::move(buffer));
+    CompressWrappedRecord(std::move(buffer), destination);
   }
 
-  void CompressWrappedRecord(std::string serialized_record) {
+  void CompressWrappedRecord(std::string serialized_record,
+                             Destination destination) {
     // Compress the string.
     storage_queue_->compression_module_->CompressRecord(
-        std::move(serialized_record),
+        std::move(serialized_record), destination,
         base::BindOnce(&WriteContext::OnCompressedRecordReady,
                        base::Unretained(this)));
   }
@@ -1436,6 +1535,21 @@ class StorageQueue::WriteContext : public TaskRunnerContext<Status> {
              std::move(buffer));
   }
 
+  // Resumes the context at the front of the queue, if its buffer is filled in.
+  // Every context of a committed batch schedules this, and by the time it runs
+  // the context that was at the front may have been committed in a batch as
+  // well, so the front is looked up again.
+  static void ResumeFrontWriteContext(
+      scoped_refptr<StorageQueue> storage_queue) {
+    DCHECK_CALLED_ON_VALID_SEQUENCE(
+        storage_queue->storage_queue_sequence_checker_);
+    if (storage_queue->write_contexts_queue_.empty() ||
+        storage_queue->write_contexts_queue_.front()->buffer_.empty()) {
+      return;
+    }
+    storage_queue->write_contexts_queue_.front()->ResumeWriteRecord();
+  }
+
   void WriteRecord(std::string buffer) {
     DCHECK_CALLED_ON_VALID_SEQUENCE(write_sequence_checker_);
     buffer_.swap(buffer);
@@ -1446,6 +1560,13 @@ class StorageQueue::WriteContext : public TaskRunnerContext<Status> {
   void ResumeWriteRecord() {
     DCHECK_CALLED_ON_VALID_SEQUENCE(write_sequence_checker_);
 
+    // With group commit, records are written in batches by the context
+    // at the head of the queue.
+    if (storage_queue_->options_.max_write_batch_size() > 1) {
+      JoinBatch();
+      return;
+    }
+
     // If we are not at the head of the queue, delay write and expect to be
     // reactivated later.
     DCHECK(in_contexts_queue_ != storage_queue_->write_contexts_queue_.end());
@@ -1467,7 +1588,8 @@ class StorageQueue::WriteContext : public TaskRunnerContext<Status> {
     scoped_refptr<SingleFile> last_file = assign_result.ValueOrDie();
 
     // Writing metadata ahead of the data write.
-    Status write_result = storage_queue_->WriteMetadata(current_record_digest_);
+    Status write_result = storage_queue_->WriteMetadata(
+        current_record_digest_, storage_queue_->next_sequencing_id_);
     if (!write_result.ok()) {
       Response(write_result);
       return;
@@ -1485,6 +1607,122 @@ class StorageQueue::WriteContext : public TaskRunnerContext<Status> {
     Response(Status::StatusOK());
   }
 
+  // Returns the number of contexts at the head of the queue that have their
+  // buffers filled in (no more than |limit|).
+  size_t CountReadyContexts(size_t limit) const {
+    size_t count = 0;
+    for (const WriteContext* context : storage_queue_->write_contexts_queue_) {
+      if (count >= limit || context->buffer_.empty()) {
+        break;
+      }
+      ++count;
+    }
+    return count;
+  }
+
+  void JoinBatch() {
+    DCHECK_CALLED_ON_VALID_SEQUENCE(write_sequence_checker_);
+    DCHECK(in_contexts_queue_ != storage_queue_->write_contexts_queue_.end());
+    auto& batch_timer = storage_queue_->write_batch_timer_;
+    const size_t max_write_batch_size =
+        storage_queue_->options_.max_write_batch_size();
+
+    // If the batch at the head of the queue is full, commit it right away
+    // without waiting for the window to expire, whichever of its contexts
+    // got ready last. Note that this context may be part of the batch, and be
+    // deleted by the time CommitBatch returns.
+    if (CountReadyContexts(max_write_batch_size) >= max_write_batch_size) {
+      batch_timer.Stop();
+      storage_queue_->write_contexts_queue_.front()->CommitBatch();
+      return;
+    }
+
+    // Otherwise the context at the head of the queue collects the batch.
+    // Unless already collecting, give other writes a chance to join it.
+    if (storage_queue_->write_contexts_queue_.front() != this ||
+        batch_timer.IsRunning()) {
+      return;
+    }
+    batch_timer.Start(FROM_HERE, storage_queue_->options_.write_batch_window(),
+                      base::BindOnce(&WriteContext::CommitBatch,
+                                     base::Unretained(this)));
+  }
+
+  void CommitBatch() {
+    DCHECK_CALLED_ON_VALID_SEQUENCE(write_sequence_checker_);
+    DCHECK_EQ(storage_queue_->write_contexts_queue_.front(), this);
+
+    // Remove contexts with filled in buffers from the head of the queue.
+    std::vector<WriteContext*> batch;
+    while (!storage_queue_->write_contexts_queue_.empty() &&
+           batch.size() < storage_queue_->options_.max_write_batch_size() &&
+           !storage_queue_->write_contexts_queue_.front()->buffer_.empty()) {
+      WriteContext* const context =
+          storage_queue_->write_contexts_queue_.front();
+      storage_queue_->write_contexts_queue_.pop_front();
+      context->in_contexts_queue_ = storage_queue_->write_contexts_queue_.end();
+      batch.push_back(context);
+    }
+    DCHECK(!batch.empty());
+    DCHECK_EQ(batch.front(), this);
+
+    // Split the batch into segments that fit into the same file, and write
+    // each segment with one metadata update and one append.
+    std::vector<Status> results(batch.size());
+    size_t begin = 0;
+    while (begin < batch.size()) {
+      StatusOr<scoped_refptr<SingleFile>> assign_result =
+          storage_queue_->AssignLastFile(batch[begin]->buffer_.size());
+      if (!assign_result.ok()) {
+        results[begin] = assign_result.status();
+        ++begin;
+        continue;
+      }
+      scoped_refptr<SingleFile> last_file = assign_result.ValueOrDie();
+
+      // Extend the segment while the records fit into |last_file|.
+      std::vector<base::StringPiece> blocks{batch[begin]->buffer_};
+      uint64_t file_size =
+          last_file->size() +
+          RoundUpToFrameSize(sizeof(RecordHeader) + blocks.back().size());
+      size_t end = begin + 1;
+      for (; end < batch.size(); ++end) {
+        const size_t size = batch[end]->buffer_.size();
+        if (size > storage_queue_->options_.max_record_size() ||
+            file_size + size + sizeof(RecordHeader) + FRAME_SIZE >
+                storage_queue_->options_.max_single_file_size()) {
+          break;
+        }
+        blocks.emplace_back(batch[end]->buffer_);
+        file_size += RoundUpToFrameSize(sizeof(RecordHeader) + size);
+      }
+
+      // Writing metadata of the last record in segment ahead of the data
+      // write.
+      const base::StringPiece last_record_digest =
+          batch[end - 1]->current_record_digest_;
+      Status write_result = storage_queue_->WriteMetadata(
+          last_record_digest,
+          storage_queue_->next_sequencing_id_ + blocks.size() - 1);
+      if (write_result.ok()) {
+        // Write headers and blocks. Store last_record_digest with the queue,
+        // advance next_sequencing_id_
+        write_result = storage_queue_->WriteHeadersAndBlocks(
+            blocks, last_record_digest, std::move(last_file));
+      }
+      for (size_t i = begin; i < end; ++i) {
+        results[i] = write_result;
+      }
+      begin = end;
+    }
+
+    // Respond to the rest of the batch, and then to ourselves.
+    for (size_t i = 1; i < batch.size(); ++i) {
+      batch[i]->Response(results[i]);
+    }
+    Response(results[0]);
+  }
+
   scoped_refptr<StorageQueue> storage_queue_;
 
   Record record_;
@@ -1728,6 +1966,7 @@ Status StorageQueue::SingleFile::Open(bool read_only) {
 }
 
 void StorageQueue::SingleFile::Close() {
+  mapped_file_.reset();
   if (!handle_) {
     // TODO(b/157943192): Restart auto-closing timer.
     return;
@@ -1747,8 +1986,54 @@ void StorageQueue::SingleFile::DeleteWarnIfFailed() {
   DeleteFileWarnIfFailed(filename_);
 }
 
+Status StorageQueue::SingleFile::Map() {
+  if (mapped_file_) {
+    return Status::StatusOK();
+  }
+  if (size_ == 0) {
+    // Nothing to map, reading will report end of file.
+    return Open(/*read_only=*/true);
+  }
+  if (handle_) {
+    // Switching from buffered reading; the file must be sealed by now.
+    if (!is_readonly()) {
+      return Status(
+          error::INTERNAL,
+          base::StrCat({"Attempt to map writeable File ", name()}));
+    }
+    Close();
+  }
+  auto mapped_file = std::make_unique<base::MemoryMappedFile>();
+  if (!mapped_file->Initialize(filename_)) {
+    return Status(error::DATA_LOSS,
+                  base::StrCat({"Cannot map file=", name()}));
+  }
+  // Records are uploaded in order; let the kernel read ahead and drop pages
+  // that have already been consumed.
+  if (madvise(const_cast<uint8_t*>(mapped_file->data()),
+              mapped_file->length(), MADV_SEQUENTIAL) != 0) {
+    PLOG(WARNING) << "madvise failed for file=" << name();
+  }
+  mapped_file_ = std::move(mapped_file);
+  return Status::StatusOK();
+}
+
 StatusOr<base::StringPiece> StorageQueue::SingleFile::Read(
     uint32_t pos, uint32_t size, size_t max_buffer_size, bool expect_readonly) {
+  if (mapped_file_) {
+    DCHECK(expect_readonly);
+    if (size > max_buffer_size) {
+      return Status(error::RESOURCE_EXHAUSTED, "Too much data to read");
+    }
+    const size_t length = std::min<uint64_t>(size_, mapped_file_->length());
+    if (pos >= length) {
+      return Status(error::OUT_OF_RANGE, "End of file");
+    }
+    // Return reference to the mapped data, no more than |size|.
+    return base::StringPiece(
+        reinterpret_cast<const char*>(mapped_file_->data()) + pos,
+        std::min<size_t>(size, length - pos));
+  }
   if (!handle_) {
     return Status(error::UNAVAILABLE, base::StrCat({"File not open ", name()}));
   }
@@ -9,6 +9,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <base/callback.h>
 #include <base/containers/flat_map.h>
@@ -16,6 +17,7 @@
 #include <base/files/file.h>
 #include <base/files/file_enumerator.h>
 #include <base/files/file_path.h>
+#include <base/files/memory_mapped_file.h>
 #include <base/memory/ref_counted.h>
 #include <base/memory/ref_counted_delete_on_sequence.h>
 #include <base/memory/scoped_refptr.h>
@@ -80,6 +82,10 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
   // large, it is closed and new file is created.
   // Helper methods: AssignLastFile, WriteHeaderAndBlock, OpenNewWriteableFile,
   // WriteMetadata, DeleteOutdatedMetadata.
+  // If options allow group commit (max_write_batch_size > 1), the record
+  // waits up to write_batch_window for other concurrent Writes, and all of
+  // them are appended as one contiguous block, with metadata written once per
+  // batch. Helper methods: WriteHeadersAndBlocks.
   void Write(Record record, base::OnceCallback<void(Status)> completion_cb);
 
   // Confirms acceptance of the records up to |sequencing_id| (inclusively).
@@ -150,7 +156,13 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
         const base::FilePath& filename, int64_t size);
 
     Status Open(bool read_only);  // No-op if already opened.
-    void Close();                 // No-op if not opened.
+    void Close();                 // No-op if not opened or mapped.
+
+    // Maps the whole file into memory for reading; the file must be sealed
+    // (not appended anymore). No-op if already mapped. Once mapped, |Read|
+    // returns references into the mapping rather than into the read buffer,
+    // and multiple readers can share the file regardless of positions.
+    Status Map();
 
     void DeleteWarnIfFailed();
 
@@ -163,6 +175,8 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
     // |expect_readonly| must match to is_readonly() (when set to false,
     // the file is expected to be writeable; this only happens when scanning
     // files restarting the queue).
+    // For a mapped file the data is referenced in the mapping and stays valid
+    // until the file is closed; |max_buffer_size| is only used as a limit.
     StatusOr<base::StringPiece> Read(uint32_t pos,
                                      uint32_t size,
                                      size_t max_buffer_size,
@@ -172,6 +186,7 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
     StatusOr<uint32_t> Append(base::StringPiece data);
 
     bool is_opened() const { return handle_.get() != nullptr; }
+    bool is_mapped() const { return mapped_file_.get() != nullptr; }
     bool is_readonly() const {
       DCHECK(is_opened());
       return is_readonly_.value();
@@ -197,6 +212,9 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
 
     std::unique_ptr<base::File> handle_;  // Set only when opened/created.
 
+    // Read-only mapping of the sealed file. Set only when mapped.
+    std::unique_ptr<base::MemoryMappedFile> mapped_file_;
+
     // When reading the file, this is the buffer and data positions.
     // If the data is read sequentially, buffered portions are reused
     // improving performance. When the sequential order is broken (e.g.
@@ -260,13 +278,15 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
   StatusOr<scoped_refptr<SingleFile>> OpenNewWriteableFile();
 
   // Helper method for Write(): stores a file with metadata to match the
-  // incoming new record. Synchronously composes metadata to record, then
+  // incoming new record with |sequencing_id| (for a batch - the last record
+  // in it). Synchronously composes metadata to record, then
   // asynchronously writes it into a file with next sequencing id and then
   // notifies the Write operation that it can now complete. After that it
   // asynchronously deletes all other files with lower sequencing id
   // (multiple Writes can see the same files and attempt to delete them, and
   // that is not an error).
-  Status WriteMetadata(base::StringPiece current_record_digest);
+  Status WriteMetadata(base::StringPiece current_record_digest,
+                       int64_t sequencing_id);
 
   // Helper method for RestoreMetadata(): loads and verifies metadata file
   // contents. If accepted, adds the file to the set.
@@ -295,6 +315,14 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
                              base::StringPiece current_record_digest,
                              scoped_refptr<SingleFile> file);
 
+  // Helper method for batched Write(): composes headers for all |blocks|,
+  // assigning them consecutive sequencing ids, and appends headers, data and
+  // padding to the file with a single write. Stores |last_record_digest| in
+  // the queue, advances next sequencing id past the batch.
+  Status WriteHeadersAndBlocks(const std::vector<base::StringPiece>& blocks,
+                               base::StringPiece last_record_digest,
+                               scoped_refptr<SingleFile> file);
+
   // Helper method for Upload: if the last file is not empty (has at least one
   // record), close it and create the new one, so that its records are also
   // included in the reading.
@@ -347,6 +375,10 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
   // whether it is at the head, tail or middle.
   std::list<WriteContext*> write_contexts_queue_;
 
+  // Group commit timer (active only while the write context at the head of
+  // |write_contexts_queue_| collects a batch).
+  base::OneShotTimer write_batch_timer_;
+
   // Next sequencing id to store (not assigned yet).
   int64_t next_sequencing_id_ = 0;
 
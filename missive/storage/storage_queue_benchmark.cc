@@ -0,0 +1,192 @@
+// Copyright 2021 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures StorageQueue write throughput with real compression and encryption
+// depending on the number of thread pool workers (cores available to the
+// write pipeline).
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include <base/at_exit.h>
+#include <base/bind.h>
+#include <base/callback.h>
+#include <base/check.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/strings/strcat.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/synchronization/waitable_event.h>
+#include <base/task/thread_pool/thread_pool_instance.h>
+#include <base/time/time.h>
+#include <benchmark/benchmark.h>
+
+#include "missive/compression/compression_module.h"
+#include "missive/compression/scoped_compression_feature.h"
+#include "missive/encryption/encryption_module.h"
+#include "missive/encryption/primitives.h"
+#include "missive/encryption/scoped_encryption_feature.h"
+#include "missive/encryption/testing_primitives.h"
+#include "missive/proto/record.pb.h"
+#include "missive/storage/storage_configuration.h"
+#include "missive/storage/storage_queue.h"
+#include "missive/storage/storage_uploader_interface.h"
+#include "missive/util/status.h"
+#include "missive/util/statusor.h"
+
+namespace reporting {
+namespace {
+
+constexpr size_t kRecordsPerIteration = 256;
+constexpr size_t kRecordSize = 2 * 1024;
+constexpr size_t kCompressionThreshold = 512;
+
+// Waits for a number of callbacks on any threads.
+class CallbackWaiter {
+ public:
+  explicit CallbackWaiter(size_t count) : pending_(count) {}
+
+  void Signal(Status status) {
+    CHECK(status.ok()) << status;
+    if (pending_.fetch_sub(1) == 1) {
+      event_.Signal();
+    }
+  }
+
+  base::OnceCallback<void(Status)> cb() {
+    return base::BindOnce(&CallbackWaiter::Signal, base::Unretained(this));
+  }
+
+  void Wait() { event_.Wait(); }
+
+ private:
+  std::atomic<size_t> pending_;
+  base::WaitableEvent event_;
+};
+
+// Thread pool with the specified number of workers for the lifetime of the
+// benchmark.
+class ScopedThreadPool {
+ public:
+  explicit ScopedThreadPool(int num_workers) {
+    base::ThreadPoolInstance::Create("StorageQueueBenchmark");
+    base::ThreadPoolInstance::Get()->Start(
+        base::ThreadPoolInstance::InitParams(num_workers));
+  }
+
+  ~ScopedThreadPool() {
+    base::ThreadPoolInstance::Get()->Shutdown();
+    base::ThreadPoolInstance::Get()->JoinForTesting();
+    base::ThreadPoolInstance::Set(nullptr);
+  }
+};
+
+void NoUploader(UploaderInterface::UploadReason reason,
+                UploaderInterface::UploaderInterfaceResultCb start_uploader_cb) {
+  std::move(start_uploader_cb)
+      .Run(Status(error::UNAVAILABLE, "No uploads in benchmark"));
+}
+
+scoped_refptr<StorageQueue> CreateStorageQueue(const QueueOptions& options) {
+  auto encryption_module = EncryptionModule::Create();
+  uint8_t private_key[kKeySize];
+  uint8_t public_value[kKeySize];
+  test::GenerateEncryptionKeyPair(private_key, public_value);
+  CallbackWaiter key_waiter(1);
+  encryption_module->UpdateAsymmetricKey(
+      std::string(reinterpret_cast<const char*>(public_value), kKeySize),
+      /*new_public_key_id=*/1, key_waiter.cb());
+  key_waiter.Wait();
+
+  StatusOr<scoped_refptr<StorageQueue>> storage_queue_result;
+  base::WaitableEvent created;
+  StorageQueue::Create(
+      options, base::BindRepeating(&NoUploader), encryption_module,
+      CompressionModule::Create(kCompressionThreshold,
+                                CompressionInformation::COMPRESSION_SNAPPY),
+      base::BindOnce(
+          [](StatusOr<scoped_refptr<StorageQueue>>* result,
+             base::WaitableEvent* created,
+             StatusOr<scoped_refptr<StorageQueue>> storage_queue_result) {
+            *result = std::move(storage_queue_result);
+            created->Signal();
+          },
+          &storage_queue_result, &created));
+  created.Wait();
+  CHECK(storage_queue_result.ok()) << storage_queue_result.status();
+  return storage_queue_result.ValueOrDie();
+}
+
+Record MakeRecord(size_t index) {
+  // Repetitive payload, resembling serialized reporting protos.
+  std::string data;
+  while (data.size() < kRecordSize) {
+    base::StrAppend(&data, {"event_", base::NumberToString(index),
+                            ":metric=value;"});
+  }
+  Record record;
+  record.set_data(std::move(data));
+  record.set_destination(UPLOAD_EVENTS);
+  record.set_dm_token("DM TOKEN");
+  return record;
+}
+
+void BM_StorageQueueWrite(benchmark::State& state) {
+  ScopedThreadPool thread_pool(state.range(0));
+  test::ScopedEncryptionFeature encryption_feature(/*enable=*/true);
+  test::ScopedCompressionFeature compression_feature(/*enable=*/true);
+
+  base::ScopedTempDir location;
+  CHECK(location.CreateUniqueTempDir());
+  StorageOptions options;
+  options.set_directory(location.GetPath());
+  auto storage_queue = CreateStorageQueue(QueueOptions(options)
+                                              .set_subdirectory("D1")
+                                              .set_file_prefix("F0001")
+                                              .set_upload_period(
+                                                  base::TimeDelta::Max()));
+
+  int64_t total_records = 0;
+  for (auto _ : state) {
+    CallbackWaiter write_waiter(kRecordsPerIteration);
+    for (size_t i = 0; i < kRecordsPerIteration; ++i) {
+      storage_queue->Write(MakeRecord(i), write_waiter.cb());
+    }
+    write_waiter.Wait();
+    total_records += kRecordsPerIteration;
+
+    // Drop the records written, so that disk usage does not grow.
+    state.PauseTiming();
+    CallbackWaiter confirm_waiter(1);
+    storage_queue->Confirm(total_records - 1, /*force=*/false,
+                           confirm_waiter.cb());
+    confirm_waiter.Wait();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(total_records);
+  state.SetBytesProcessed(total_records * kRecordSize);
+
+  // StorageQueue is destructed on its sequence; release it before the thread
+  // pool shuts down.
+  storage_queue.reset();
+  base::ThreadPoolInstance::Get()->FlushForTesting();
+}
+BENCHMARK(BM_StorageQueueWrite)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8);
+
+}  // namespace
+}  // namespace reporting
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit;
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -125,11 +125,13 @@ class TestUploadClient : public UploaderInterface {
   Sequence test_upload_sequence_;
 };
 
-class StorageQueueStressTest : public ::testing::TestWithParam<size_t> {
+class StorageQueueStressTest
+    : public ::testing::TestWithParam<size_t /*max_write_batch_size*/> {
  public:
   void SetUp() override {
     ASSERT_TRUE(location_.CreateUniqueTempDir());
-    options_.set_directory(base::FilePath(location_.GetPath()));
+    options_.set_directory(base::FilePath(location_.GetPath()))
+        .set_max_write_batch_size(max_write_batch_size());
   }
 
   void TearDown() override {
@@ -207,6 +209,8 @@ class StorageQueueStressTest : public ::testing::TestWithParam<size_t> {
     storage_queue_->Write(std::move(record), std::move(cb));
   }
 
+  size_t max_write_batch_size() const { return GetParam(); }
+
   base::test::TaskEnvironment task_environment_{
       base::test::TaskEnvironment::TimeSource::MOCK_TIME};
 
@@ -268,10 +272,10 @@ TEST_P(StorageQueueStressTest,
   }
 }
 
-INSTANTIATE_TEST_SUITE_P(
-    VaryingFileSize,
-    StorageQueueStressTest,
-    testing::Values(1 * 1024LL, 2 * 1024LL, 3 * 1024LL, 4 * 1024LL));
+INSTANTIATE_TEST_SUITE_P(VaryingBatchSize,
+                         StorageQueueStressTest,
+                         testing::Values(1u /*no batching*/,
+                                         kTotalWritesPerStart / 4));
 
 }  // namespace
 }  // namespace reporting
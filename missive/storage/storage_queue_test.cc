@@ -7,6 +7,7 @@
 #include <atomic>
 #include <cstdint>
 #include <initializer_list>
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -43,6 +44,7 @@ using ::testing::_;
 using ::testing::Between;
 using ::testing::DoAll;
 using ::testing::Eq;
+using ::testing::Ge;
 using ::testing::Invoke;
 using ::testing::Return;
 using ::testing::Sequence;
@@ -86,12 +88,15 @@ void EnsureDeletingFiles(FileEnumeratorParams... file_enum_params) {
 
 class StorageQueueTest
     : public ::testing::TestWithParam<
-          testing::tuple<size_t /*file_size*/, std::string /*dm_token*/>> {
+          testing::tuple<size_t /*file_size*/,
+                         std::string /*dm_token*/,
+                         bool /*memory_mapped_read*/>> {
  protected:
   void SetUp() override {
     ASSERT_TRUE(location_.CreateUniqueTempDir());
     dm_token_ = testing::get<1>(GetParam());
-    options_.set_directory(base::FilePath(location_.GetPath()));
+    options_.set_directory(base::FilePath(location_.GetPath()))
+        .set_memory_mapped_read(testing::get<2>(GetParam()));
     // Disallow uploads unless other expectation is set (any later EXPECT_CALL
     // will take precedence over this one).
     EXPECT_CALL(set_mock_uploader_expectations_, Call(_))
@@ -605,15 +610,52 @@ class StorageQueueTest
             reason, std::move(start_uploader_cb), base::Unretained(this)));
   }
 
-  Status WriteString(base::StringPiece data) {
+  Record BuildRecord(base::StringPiece data) const {
     Record record;
     record.set_data(std::string(data));
     record.set_destination(UPLOAD_EVENTS);
     if (!dm_token_.empty()) {
       record.set_dm_token(dm_token_);
     }
+    return record;
+  }
+
+  Status WriteString(base::StringPiece data) {
+    return WriteRecord(BuildRecord(data));
+  }
 
-    return WriteRecord(std::move(record));
+  // Starts all the writes before waiting for any of them, so that they can
+  // be committed together when group commit is enabled. Returns the results
+  // in the order of |data|.
+  std::vector<Status> WriteStringsConcurrently(
+      std::initializer_list<base::StringPiece> data) {
+    EXPECT_TRUE(storage_queue_) << "StorageQueue not created yet";
+    std::vector<std::unique_ptr<test::TestEvent<Status>>> write_events;
+    for (const auto& item : data) {
+      write_events.push_back(std::make_unique<test::TestEvent<Status>>());
+      LOG(ERROR) << "Write data='" << item << "'";
+      storage_queue_->Write(BuildRecord(item), write_events.back()->cb());
+    }
+    std::vector<Status> write_results;
+    for (const auto& write_event : write_events) {
+      write_results.push_back(write_event->result());
+    }
+    return write_results;
+  }
+
+  // Returns the number of data files of the queue.
+  size_t CountDataFiles() const {
+    const QueueOptions& options = storage_queue_->options();
+    base::FileEnumerator dir_enum(options.directory(),
+                                  /*recursive=*/false,
+                                  base::FileEnumerator::FILES,
+                                  base::StrCat({options.file_prefix(), ".*"}));
+    size_t count = 0;
+    for (base::FilePath full_name = dir_enum.Next(); !full_name.empty();
+         full_name = dir_enum.Next()) {
+      ++count;
+    }
+    return count;
   }
 
   Status WriteRecord(const Record record) {
@@ -1767,6 +1809,104 @@ TEST_P(StorageQueueTest, WriteRecordWithWriteBlockFailures) {
   EXPECT_EQ(write_result.error_code(), error::INTERNAL);
 }
 
+TEST_P(StorageQueueTest, WriteBatchAcrossFilesAndFlush) {
+  options_.set_max_write_batch_size(kData.size() + kMoreData.size());
+  CreateTestStorageQueueOrDie(BuildStorageQueueOptionsOnlyManual());
+  for (const Status& write_result :
+       WriteStringsConcurrently({kData[0], kData[1], kData[2], kMoreData[0],
+                                 kMoreData[1], kMoreData[2]})) {
+    EXPECT_OK(write_result) << write_result;
+  }
+
+  // The batch is split into segments that fit into the same file.
+  switch (storage_queue_->options().max_single_file_size()) {
+    case 1:  // single record in file
+      EXPECT_THAT(CountDataFiles(), Eq(kData.size() + kMoreData.size()));
+      break;
+    case 256:  // no more than two records in file
+      EXPECT_THAT(CountDataFiles(), Ge((kData.size() + kMoreData.size()) / 2));
+      break;
+    default:  // unlimited file size
+      EXPECT_THAT(CountDataFiles(), Eq(1u));
+  }
+
+  // Set uploader expectations. Last record digests are verified across the
+  // segments.
+  test::TestCallbackAutoWaiter waiter;
+  EXPECT_CALL(set_mock_uploader_expectations_,
+              Call(Eq(UploaderInterface::UploadReason::MANUAL)))
+      .WillOnce(Invoke([&waiter, this](UploaderInterface::UploadReason reason) {
+        return TestUploader::SetUp(&waiter, this)
+            .Required(0, kData[0])
+            .Required(1, kData[1])
+            .Required(2, kData[2])
+            .Required(3, kMoreData[0])
+            .Required(4, kMoreData[1])
+            .Required(5, kMoreData[2])
+            .Complete();
+      }))
+      .RetiresOnSaturation();
+
+  // Flush manually.
+  storage_queue_->Flush();
+}
+
+TEST_P(StorageQueueTest, WriteBatchWithWriteMetadataFailures) {
+  options_.set_max_write_batch_size(kData.size());
+  // Make the batch fit into one file, so that metadata is written once, for
+  // the last record of the batch.
+  CreateTestStorageQueueOrDie(
+      BuildStorageQueueOptionsOnlyManual().set_max_single_file_size(
+          128 * 1024LL * 1024LL));
+  WriteStringOrDie(kMoreData[0]);
+
+  // The batch takes sequencing ids 1 to 3, and its metadata is written for 3.
+  InjectFailures(test::StorageQueueOperationKind::kWriteMetadata, {3});
+  for (const Status& write_result :
+       WriteStringsConcurrently({kData[0], kData[1], kData[2]})) {
+    EXPECT_FALSE(write_result.ok());
+    EXPECT_EQ(write_result.error_code(), error::INTERNAL);
+  }
+}
+
+TEST_P(StorageQueueTest, WriteBatchWithWriteBlockFailures) {
+  options_.set_max_write_batch_size(kData.size());
+  // Make the batch fit into one file, so that it is appended at once.
+  CreateTestStorageQueueOrDie(
+      BuildStorageQueueOptionsOnlyManual().set_max_single_file_size(
+          128 * 1024LL * 1024LL));
+  WriteStringOrDie(kMoreData[0]);
+
+  // The batch takes sequencing ids 1 to 3, failing in the middle fails all of
+  // its writes.
+  InjectFailures(test::StorageQueueOperationKind::kWriteBlock, {2});
+  for (const Status& write_result :
+       WriteStringsConcurrently({kData[0], kData[1], kData[2]})) {
+    EXPECT_FALSE(write_result.ok());
+    EXPECT_EQ(write_result.error_code(), error::INTERNAL);
+  }
+}
+
+TEST_P(StorageQueueTest, WriteFullBatchWithoutWaiting) {
+  // Make the window long enough to tell whether it expired.
+  const base::TimeDelta write_batch_window = base::Hours(1);
+  options_.set_max_write_batch_size(kData.size())
+      .set_write_batch_window(write_batch_window);
+  CreateTestStorageQueueOrDie(BuildStorageQueueOptionsOnlyManual());
+
+  // The batch is committed as soon as it is full.
+  const base::TimeTicks write_start = task_environment_.NowTicks();
+  for (const Status& write_result :
+       WriteStringsConcurrently({kData[0], kData[1], kData[2]})) {
+    EXPECT_OK(write_result) << write_result;
+  }
+  EXPECT_LT(task_environment_.NowTicks() - write_start, write_batch_window);
+
+  // A batch that is not full waits for the window to expire.
+  WriteStringOrDie(kMoreData[0]);
+  EXPECT_GE(task_environment_.NowTicks() - write_start, write_batch_window);
+}
+
 TEST_P(StorageQueueTest, WriteRecordWithInvalidFilePrefix) {
   QueueOptions options = BuildStorageQueueOptionsPeriodic();
   options.set_file_prefix(kInvalidFilePrefix);
@@ -1816,7 +1956,8 @@ INSTANTIATE_TEST_SUITE_P(
     testing::Combine(testing::Values(128 * 1024LL * 1024LL,
                                      256 /* two records in file */,
                                      1 /* single record in file */),
-                     testing::Values("DM TOKEN", "")));
+                     testing::Values("DM TOKEN", ""),
+                     testing::Bool()));
 
 }  // namespace
 }  // namespace reporting
@@ -20,6 +20,7 @@
 #include <utility>
 
 #include <base/bind.h>
+#include <base/check_op.h>
 #include <base/logging.h>
 #include <shill/net/rtnl_handler.h>
 
@@ -328,91 +329,106 @@ void BroadcastForwarder::RemoveGuest(const std::string& br_ifname) {
 }
 
 void BroadcastForwarder::OnFileCanReadWithoutBlocking(int fd) {
-  alignas(4) uint8_t buffer[kBufSize];
-  uint8_t* data = buffer + sizeof(struct iphdr) + sizeof(struct udphdr);
-
-  sockaddr_ll dst_addr;
-  struct iovec iov = {
-      .iov_base = buffer,
-      .iov_len = kBufSize,
-  };
-  msghdr hdr = {
-      .msg_name = &dst_addr,
-      .msg_namelen = sizeof(dst_addr),
-      .msg_iov = &iov,
-      .msg_iovlen = 1,
-      .msg_control = nullptr,
-      .msg_controllen = 0,
-      .msg_flags = 0,
-  };
+  // Drains up to kBatchSize packets per wakeup so that busy networks do not
+  // cost one wakeup and one raw socket per received packet.
+  alignas(4) uint8_t buffers[kBatchSize][kBufSize];
+  sockaddr_ll dst_addrs[kBatchSize];
+  struct iovec iovs[kBatchSize];
+  struct mmsghdr msgs[kBatchSize];
+  memset(msgs, 0, sizeof(msgs));
+  for (unsigned int i = 0; i < kBatchSize; i++) {
+    iovs[i].iov_base = buffers[i];
+    iovs[i].iov_len = kBufSize;
+    msgs[i].msg_hdr.msg_name = &dst_addrs[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(dst_addrs[i]);
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
 
-  ssize_t msg_len = ReceiveMessage(fd, &hdr);
-  if (msg_len < 0) {
+  int count = ReceiveMessages(fd, msgs, kBatchSize);
+  if (count < 0) {
     // Ignore ENETDOWN: this can happen if the interface is not yet configured.
-    if (errno != ENETDOWN) {
-      PLOG(WARNING) << "recvmsg() failed";
+    // Ignore EAGAIN: the packets were already read.
+    if (errno != ENETDOWN && errno != EAGAIN) {
+      PLOG(WARNING) << "recvmmsg() failed";
     }
     return;
   }
 
-  // These headers are taken directly from the buffer and is 4 bytes aligned.
-  struct iphdr* ip_hdr = (struct iphdr*)(buffer);
-  struct udphdr* udp_hdr = (struct udphdr*)(buffer + sizeof(struct iphdr));
-
-  // Check that the IP header and UDP header have been filled.
-  if (msg_len < sizeof(struct iphdr) + sizeof(struct udphdr))
-    return;
-
-  // Drop fragmented packets.
-  if ((ntohs(ip_hdr->frag_off) & (kIpFragOffsetMask | IP_MF)) != 0)
-    return;
-
-  // Store the length of the message data without its headers.
-  ssize_t len = ntohs(udp_hdr->len) - sizeof(struct udphdr);
+  // Packets received from the network to forward to guests, which point into
+  // |buffers|.
+  struct iovec ingress_pkts[kBatchSize];
+  unsigned int ingress_count = 0;
+  for (int i = 0; i < count; i++) {
+    uint8_t* buffer = buffers[i];
+    uint8_t* data = buffer + sizeof(struct iphdr) + sizeof(struct udphdr);
+    ssize_t msg_len = msgs[i].msg_len;
+
+    // These headers are taken directly from the buffer and is 4 bytes aligned.
+    struct iphdr* ip_hdr = (struct iphdr*)(buffer);
+    struct udphdr* udp_hdr = (struct udphdr*)(buffer + sizeof(struct iphdr));
+
+    // Check that the IP header and UDP header have been filled.
+    if (msg_len < sizeof(struct iphdr) + sizeof(struct udphdr))
+      continue;
 
-  // Validate message data length.
-  if ((len + sizeof(struct udphdr) + sizeof(struct iphdr) > msg_len) ||
-      (len < 0))
-    return;
+    // Drop fragmented packets.
+    if ((ntohs(ip_hdr->frag_off) & (kIpFragOffsetMask | IP_MF)) != 0)
+      continue;
 
-  struct sockaddr_in fromaddr = {0};
-  fromaddr.sin_family = AF_INET;
-  fromaddr.sin_port = udp_hdr->uh_sport;
-  fromaddr.sin_addr.s_addr = ip_hdr->saddr;
+    // Store the length of the message data without its headers.
+    ssize_t len = ntohs(udp_hdr->len) - sizeof(struct udphdr);
 
-  struct sockaddr_in dst = {0};
-  dst.sin_family = AF_INET;
-  dst.sin_port = udp_hdr->uh_dport;
-  dst.sin_addr.s_addr = ip_hdr->daddr;
+    // Validate message data length.
+    if ((len + sizeof(struct udphdr) + sizeof(struct iphdr) > msg_len) ||
+        (len < 0))
+      continue;
 
-  // Forward ingress traffic to guests.
-  if (fd == dev_socket_->fd.get()) {
-    // Prevent looped back broadcast packets to be forwarded.
-    if (fromaddr.sin_addr.s_addr == dev_socket_->addr)
-      return;
+    struct sockaddr_in fromaddr = {0};
+    fromaddr.sin_family = AF_INET;
+    fromaddr.sin_port = udp_hdr->uh_sport;
+    fromaddr.sin_addr.s_addr = ip_hdr->saddr;
+
+    // Forward ingress traffic to guests.
+    if (fd == dev_socket_->fd.get()) {
+      // Prevent looped back broadcast packets to be forwarded.
+      if (fromaddr.sin_addr.s_addr == dev_socket_->addr)
+        continue;
+
+      ingress_pkts[ingress_count].iov_base = buffer;
+      ingress_pkts[ingress_count].iov_len =
+          sizeof(struct iphdr) + sizeof(struct udphdr) + len;
+      ingress_count++;
+      continue;
+    }
 
-    SendToGuests(buffer, len, dst);
-    return;
-  }
+    struct sockaddr_in dst = {0};
+    dst.sin_family = AF_INET;
+    dst.sin_port = udp_hdr->uh_dport;
+    dst.sin_addr.s_addr = ip_hdr->daddr;
 
-  for (auto const& socket : br_sockets_) {
-    if (fd != socket.second->fd.get())
-      continue;
+    for (auto const& socket : br_sockets_) {
+      if (fd != socket.second->fd.get())
+        continue;
 
-    // Prevent looped back broadcast packets to be forwarded.
-    if (fromaddr.sin_addr.s_addr == socket.second->addr)
-      return;
+      // Prevent looped back broadcast packets to be forwarded.
+      if (fromaddr.sin_addr.s_addr == socket.second->addr)
+        break;
 
-    // We are spoofing packets source IP to be the actual sender source IP.
-    // Prevent looped back broadcast packets by not forwarding anything from
-    // outside the interface netmask.
-    if ((fromaddr.sin_addr.s_addr & socket.second->netmask) !=
-        (socket.second->addr & socket.second->netmask))
-      return;
+      // We are spoofing packets source IP to be the actual sender source IP.
+      // Prevent looped back broadcast packets by not forwarding anything from
+      // outside the interface netmask.
+      if ((fromaddr.sin_addr.s_addr & socket.second->netmask) !=
+          (socket.second->addr & socket.second->netmask))
+        break;
 
-    // Forward egress traffic from one guest to outside network.
-    SendToNetwork(ntohs(fromaddr.sin_port), data, len, dst);
+      // Forward egress traffic from one guest to outside network.
+      SendToNetwork(ntohs(fromaddr.sin_port), data, len, dst);
+    }
   }
+
+  if (ingress_count > 0)
+    SendToGuests(ingress_pkts, ingress_count);
 }
 
 bool BroadcastForwarder::SendToNetwork(uint16_t src_port,
@@ -442,76 +458,114 @@ bool BroadcastForwarder::SendToNetwork(uint16_t src_port,
   return true;
 }
 
-bool BroadcastForwarder::SendToGuests(const void* ip_pkt,
-                                      ssize_t len,
-                                      const struct sockaddr_in& dst) {
+bool BroadcastForwarder::SendToGuests(struct iovec* ip_pkts,
+                                      unsigned int count) {
+  DCHECK_LE(count, kBatchSize);
   bool success = true;
 
+  base::ScopedFD raw = CreateRawSocket();
+  if (!raw.is_valid())
+    return false;
+
+  // The IP packets received by the lan interface are only forwarded to guests,
+  // so they are modified in place and only their destination address changes.
+  struct sockaddr_in br_dsts[kBatchSize];
+  struct mmsghdr msgs[kBatchSize];
+  memset(br_dsts, 0, sizeof(br_dsts));
+  memset(msgs, 0, sizeof(msgs));
+  for (unsigned int i = 0; i < count; i++) {
+    // These headers are taken directly from the buffer and is 4 bytes aligned.
+    const struct iphdr* ip_hdr = (struct iphdr*)ip_pkts[i].iov_base;
+    const struct udphdr* udp_hdr =
+        (struct udphdr*)((uint8_t*)ip_pkts[i].iov_base + sizeof(struct iphdr));
+    br_dsts[i].sin_family = AF_INET;
+    br_dsts[i].sin_port = udp_hdr->uh_dport;
+    br_dsts[i].sin_addr.s_addr = ip_hdr->daddr;
+
+    msgs[i].msg_hdr.msg_name = &br_dsts[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(br_dsts[i]);
+    msgs[i].msg_hdr.msg_iov = &ip_pkts[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  for (auto const& socket : br_sockets_) {
+    for (unsigned int i = 0; i < count; i++) {
+      uint8_t* buffer = static_cast<uint8_t*>(ip_pkts[i].iov_base);
+      struct iphdr* ip_hdr = (struct iphdr*)buffer;
+      struct udphdr* udp_hdr = (struct udphdr*)(buffer + sizeof(struct iphdr));
+
+      // Set destination address.
+      if (br_dsts[i].sin_addr.s_addr != kBcastAddr) {
+        br_dsts[i].sin_addr.s_addr = socket.second->broadaddr;
+        ip_hdr->daddr = socket.second->broadaddr;
+      }
+      ip_hdr->check = 0;
+      ip_hdr->check = Ipv4Checksum(ip_hdr);
+      udp_hdr->check = 0;
+      udp_hdr->check = Udpv4Checksum(buffer, ip_pkts[i].iov_len);
+    }
+
+    if (!BindToDevice(raw.get(), socket.first))
+      continue;
+
+    // Use already created broadcast fd. sendmmsg() stops at the first packet
+    // which cannot be sent, which is skipped.
+    unsigned int sent = 0;
+    while (sent < count) {
+      int ret = SendMessages(raw.get(), &msgs[sent], count - sent);
+      if (ret < 0) {
+        PLOG(WARNING) << "sendmmsg failed";
+        success = false;
+        sent++;
+        continue;
+      }
+      sent += ret;
+    }
+  }
+  return success;
+}
+
+int BroadcastForwarder::ReceiveMessages(int fd,
+                                        struct mmsghdr* msgs,
+                                        unsigned int vlen) {
+  return recvmmsg(fd, msgs, vlen, MSG_DONTWAIT, nullptr);
+}
+
+base::ScopedFD BroadcastForwarder::CreateRawSocket() {
   base::ScopedFD raw(socket(AF_INET, SOCK_RAW | SOCK_CLOEXEC, IPPROTO_UDP));
   if (!raw.is_valid()) {
     PLOG(ERROR) << "socket() failed for raw socket";
-    return false;
+    return base::ScopedFD();
   }
 
   int on = 1;
   if (setsockopt(raw.get(), IPPROTO_IP, IP_HDRINCL, &on, sizeof(on)) < 0) {
     PLOG(ERROR) << "setsockopt(IP_HDRINCL) failed";
-    return false;
+    return base::ScopedFD();
   }
   if (setsockopt(raw.get(), SOL_SOCKET, SO_BROADCAST, &on, sizeof(on)) < 0) {
     PLOG(ERROR) << "setsockopt(SO_BROADCAST) failed";
-    return false;
+    return base::ScopedFD();
   }
+  return raw;
+}
 
-  // Copy IP packet received by the lan interface and only change its
-  // destination address.
-  alignas(4) uint8_t buffer[kBufSize];
-  memset(buffer, 0, kBufSize);
-  memcpy(buffer, reinterpret_cast<const uint8_t*>(ip_pkt),
-         sizeof(iphdr) + sizeof(udphdr) + len);
-
-  // These headers are taken directly from the buffer and is 4 bytes aligned.
-  struct iphdr* ip_hdr = (struct iphdr*)buffer;
-  struct udphdr* udp_hdr = (struct udphdr*)(buffer + sizeof(struct iphdr));
-
-  ip_hdr->check = 0;
-  udp_hdr->check = 0;
-
-  struct sockaddr_in br_dst = {0};
-  memcpy(&br_dst, &dst, sizeof(struct sockaddr_in));
-
-  for (auto const& socket : br_sockets_) {
-    // Set destination address.
-    if (br_dst.sin_addr.s_addr != kBcastAddr) {
-      br_dst.sin_addr.s_addr = socket.second->broadaddr;
-      ip_hdr->daddr = socket.second->broadaddr;
-      ip_hdr->check = Ipv4Checksum(ip_hdr);
-    }
-    udp_hdr->check =
-        Udpv4Checksum(buffer, sizeof(iphdr) + sizeof(udphdr) + len);
-
-    struct ifreq ifr;
-    memset(&ifr, 0, sizeof(ifr));
-    strncpy(ifr.ifr_name, socket.first.c_str(), IFNAMSIZ);
-    if (setsockopt(raw.get(), SOL_SOCKET, SO_BINDTODEVICE, &ifr, sizeof(ifr))) {
-      PLOG(ERROR) << "setsockopt(SOL_SOCKET) failed for broadcast forwarder on "
-                  << socket.first;
-      continue;
-    }
-
-    // Use already created broadcast fd.
-    if (SendTo(raw.get(), buffer,
-               sizeof(struct iphdr) + sizeof(struct udphdr) + len,
-               &br_dst) < 0) {
-      PLOG(WARNING) << "sendto failed";
-      success = false;
-    }
+bool BroadcastForwarder::BindToDevice(int fd, const std::string& ifname) {
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  strncpy(ifr.ifr_name, ifname.c_str(), IFNAMSIZ);
+  if (setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, &ifr, sizeof(ifr))) {
+    PLOG(ERROR) << "setsockopt(SOL_SOCKET) failed for broadcast forwarder on "
+                << ifname;
+    return false;
   }
-  return success;
+  return true;
 }
 
-ssize_t BroadcastForwarder::ReceiveMessage(int fd, struct msghdr* msg) {
-  return recvmsg(fd, msg, 0);
+int BroadcastForwarder::SendMessages(int fd,
+                                     struct mmsghdr* msgs,
+                                     unsigned int vlen) {
+  return sendmmsg(fd, msgs, vlen, 0);
 }
 
 ssize_t BroadcastForwarder::SendTo(int fd,
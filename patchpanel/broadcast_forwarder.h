@@ -30,6 +30,11 @@ constexpr uint32_t kBcastAddr = Ipv4Addr(255, 255, 255, 255);
 // netmask, are constant.
 class BroadcastForwarder {
  public:
+  // Maximum number of packets read at once from a socket. The packets received
+  // from the network are then forwarded to each guest with a single sendmmsg()
+  // call.
+  static constexpr unsigned int kBatchSize = 16;
+
   explicit BroadcastForwarder(const std::string& dev_ifname);
   BroadcastForwarder(const BroadcastForwarder&) = delete;
   BroadcastForwarder& operator=(const BroadcastForwarder&) = delete;
@@ -80,14 +85,28 @@ class BroadcastForwarder {
                      ssize_t len,
                      const struct sockaddr_in& dst);
 
-  // SendToGuests will forward the broadcast packet to all Chrome OS guests'
-  // (ARC++, Crostini, etc) internal fd.
-  bool SendToGuests(const void* ip_pkt,
-                    ssize_t len,
-                    const struct sockaddr_in& dst);
+  // SendToGuests will forward the |count| broadcast IP packets of |ip_pkts|
+  // to all Chrome OS guests' (ARC++, Crostini, etc) internal fd, with one
+  // sendmmsg() call per guest. The destination address and checksums of the
+  // packets are rewritten in place for each guest. |count| must not exceed
+  // kBatchSize.
+  bool SendToGuests(struct iovec* ip_pkts, unsigned int count);
+
+  // Creates the raw IPv4 socket used by SendToGuests() to send IP packets
+  // with their own headers, allowing override in tests.
+  virtual base::ScopedFD CreateRawSocket();
+
+  // Binds |fd| to the network interface |ifname| with SO_BINDTODEVICE,
+  // allowing override in tests.
+  virtual bool BindToDevice(int fd, const std::string& ifname);
+
+  // Wrapper around libc recvmmsg, allowing override in fuzzer tests. Receives
+  // up to |vlen| packets into |msgs| without blocking and returns their
+  // number, or -1 on failure.
+  virtual int ReceiveMessages(int fd, struct mmsghdr* msgs, unsigned int vlen);
 
-  // Wrapper around libc recvmsg, allowing override in fuzzer tests.
-  virtual ssize_t ReceiveMessage(int fd, struct msghdr* msg);
+  // Wrapper around libc sendmmsg, allowing override in fuzzer tests.
+  virtual int SendMessages(int fd, struct mmsghdr* msgs, unsigned int vlen);
 
   // Wrapper around libc sendto, allowing override in fuzzer tests.
   virtual ssize_t SendTo(int fd,
@@ -55,12 +55,20 @@ class TestBroadcastForwarder : public BroadcastForwarder {
     return socket;
   }
 
-  ssize_t ReceiveMessage(int fd, struct msghdr* msg) override {
-    ssize_t msg_len = std::min(payload.size(), msg->msg_iov->iov_len);
+  int ReceiveMessages(int fd,
+                      struct mmsghdr* msgs,
+                      unsigned int vlen) override {
+    struct msghdr* msg = &msgs[0].msg_hdr;
+    size_t msg_len = std::min(payload.size(), msg->msg_iov->iov_len);
     if (msg_len > 0) {
       memcpy(msg->msg_iov->iov_base, payload.data(), msg_len);
     }
-    return msg_len;
+    msgs[0].msg_len = msg_len;
+    return 1;
+  }
+
+  int SendMessages(int fd, struct mmsghdr* msgs, unsigned int vlen) override {
+    return vlen;
   }
 
   ssize_t SendTo(int fd,
@@ -0,0 +1,256 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "patchpanel/broadcast_forwarder.h"
+
+#include <errno.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/files/scoped_file.h>
+#include <gtest/gtest.h>
+
+#include "patchpanel/net_util.h"
+
+namespace patchpanel {
+namespace {
+
+constexpr uint32_t kLanBroadaddr = Ipv4Addr(192, 168, 1, 255);
+constexpr uint32_t kLanSrcAddr = Ipv4Addr(192, 168, 1, 10);
+constexpr uint32_t kArcBroadaddr = Ipv4Addr(100, 115, 92, 3);
+constexpr uint32_t kVmBroadaddr = Ipv4Addr(100, 115, 92, 27);
+constexpr uint16_t kPort = 9999;
+constexpr size_t kPayloadSize = 32;
+
+// An IPv4 UDP packet, with a payload filled with |id| to tell the packets
+// apart once sent.
+struct TestPacket {
+  alignas(4) uint8_t data[sizeof(struct iphdr) + sizeof(struct udphdr) +
+                          kPayloadSize];
+};
+
+TestPacket MakePacket(uint32_t daddr, uint8_t id) {
+  TestPacket packet;
+  memset(packet.data, id, sizeof(packet.data));
+  struct iphdr* ip_hdr = reinterpret_cast<struct iphdr*>(packet.data);
+  memset(ip_hdr, 0, sizeof(*ip_hdr));
+  ip_hdr->version = 4;
+  ip_hdr->ihl = sizeof(*ip_hdr) / 4;
+  ip_hdr->tot_len = htons(sizeof(packet.data));
+  ip_hdr->ttl = 64;
+  ip_hdr->protocol = IPPROTO_UDP;
+  ip_hdr->saddr = kLanSrcAddr;
+  ip_hdr->daddr = daddr;
+  ip_hdr->check = Ipv4Checksum(ip_hdr);
+  struct udphdr* udp_hdr =
+      reinterpret_cast<struct udphdr*>(packet.data + sizeof(*ip_hdr));
+  udp_hdr->uh_sport = htons(kPort);
+  udp_hdr->uh_dport = htons(kPort);
+  udp_hdr->uh_ulen = htons(sizeof(*udp_hdr) + kPayloadSize);
+  udp_hdr->uh_sum = 0;
+  udp_hdr->uh_sum = Udpv4Checksum(packet.data, sizeof(packet.data));
+  return packet;
+}
+
+// A packet passed to SendMessages() and reported as sent.
+struct SentPacket {
+  std::string ifname;
+  uint32_t dst_addr;
+  std::vector<uint8_t> data;
+};
+
+// Test class that records the packets sent to guests instead of sending them
+// on a raw socket, and that makes SendMessages() return the values of
+// |send_results| in order.
+class TestBroadcastForwarder : public BroadcastForwarder {
+ public:
+  explicit TestBroadcastForwarder(const std::string& dev_ifname)
+      : BroadcastForwarder(dev_ifname) {}
+  TestBroadcastForwarder(const TestBroadcastForwarder&) = delete;
+  TestBroadcastForwarder& operator=(const TestBroadcastForwarder&) = delete;
+  ~TestBroadcastForwarder() override = default;
+
+  using BroadcastForwarder::SendToGuests;
+
+  base::ScopedFD BindRaw(const std::string& ifname) override {
+    last_bound_ifname_ = ifname;
+    return base::ScopedFD(socket(AF_INET, SOCK_DGRAM, 0));
+  }
+
+  std::unique_ptr<Socket> CreateSocket(base::ScopedFD fd,
+                                       uint32_t addr,
+                                       uint32_t broadaddr,
+                                       uint32_t netmask) override {
+    auto socket = std::make_unique<Socket>();
+    socket->fd = std::move(fd);
+    socket->broadaddr = broadaddrs[last_bound_ifname_];
+    return socket;
+  }
+
+  base::ScopedFD CreateRawSocket() override {
+    return base::ScopedFD(socket(AF_INET, SOCK_DGRAM, 0));
+  }
+
+  bool BindToDevice(int fd, const std::string& ifname) override {
+    bound_ifname_ = ifname;
+    return true;
+  }
+
+  int SendMessages(int fd, struct mmsghdr* msgs, unsigned int vlen) override {
+    send_vlens.push_back(vlen);
+    int ret = vlen;
+    if (!send_results.empty()) {
+      ret = std::min(send_results.front(), static_cast<int>(vlen));
+      send_results.pop_front();
+    }
+    if (ret < 0) {
+      errno = EPERM;
+      return ret;
+    }
+    for (int i = 0; i < ret; i++) {
+      const struct msghdr& hdr = msgs[i].msg_hdr;
+      const auto* dst = static_cast<const struct sockaddr_in*>(hdr.msg_name);
+      const auto* data = static_cast<const uint8_t*>(hdr.msg_iov->iov_base);
+      sent.push_back(
+          {bound_ifname_, dst->sin_addr.s_addr,
+           std::vector<uint8_t>(data, data + hdr.msg_iov->iov_len)});
+    }
+    return ret;
+  }
+
+  std::map<std::string, uint32_t> broadaddrs;
+  std::deque<int> send_results;
+  std::vector<unsigned int> send_vlens;
+  std::vector<SentPacket> sent;
+
+ private:
+  std::string last_bound_ifname_;
+  std::string bound_ifname_;
+};
+
+// Checks that the IPv4 and UDP checksums of |packet| match its contents.
+void ExpectValidChecksums(std::vector<uint8_t> packet) {
+  struct iphdr* ip_hdr = reinterpret_cast<struct iphdr*>(packet.data());
+  struct udphdr* udp_hdr =
+      reinterpret_cast<struct udphdr*>(packet.data() + sizeof(*ip_hdr));
+  uint16_t ip_check = ip_hdr->check;
+  ip_hdr->check = 0;
+  EXPECT_EQ(ip_check, Ipv4Checksum(ip_hdr));
+  uint16_t udp_check = udp_hdr->uh_sum;
+  udp_hdr->uh_sum = 0;
+  EXPECT_EQ(udp_check, Udpv4Checksum(packet.data(), packet.size()));
+}
+
+uint32_t GetDaddr(const std::vector<uint8_t>& packet) {
+  return reinterpret_cast<const struct iphdr*>(packet.data())->daddr;
+}
+
+// Returns the id of a packet made by MakePacket().
+uint8_t GetId(const std::vector<uint8_t>& packet) {
+  return packet.back();
+}
+
+}  // namespace
+
+class BroadcastForwarderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    forwarder_.broadaddrs = {{"wlan0", kLanBroadaddr},
+                             {"arc_br0", kArcBroadaddr},
+                             {"vmtap0", kVmBroadaddr}};
+  }
+
+  TestBroadcastForwarder forwarder_{"wlan0"};
+};
+
+TEST_F(BroadcastForwarderTest, SendToGuestsRewritesChecksumsPerGuest) {
+  ASSERT_TRUE(forwarder_.AddGuest("arc_br0"));
+  ASSERT_TRUE(forwarder_.AddGuest("vmtap0"));
+
+  TestPacket packets[] = {MakePacket(kLanBroadaddr, 0),
+                          MakePacket(kBcastAddr, 1)};
+  struct iovec iovs[2];
+  for (int i = 0; i < 2; i++) {
+    iovs[i].iov_base = packets[i].data;
+    iovs[i].iov_len = sizeof(packets[i].data);
+  }
+  EXPECT_TRUE(forwarder_.SendToGuests(iovs, 2));
+
+  ASSERT_EQ(4, forwarder_.sent.size());
+  const std::map<std::string, uint32_t> guest_broadaddrs = {
+      {"arc_br0", kArcBroadaddr}, {"vmtap0", kVmBroadaddr}};
+  for (int i = 0; i < 4; i++) {
+    const SentPacket& packet = forwarder_.sent[i];
+    SCOPED_TRACE(packet.ifname);
+    EXPECT_EQ(i < 2 ? "arc_br0" : "vmtap0", packet.ifname);
+    EXPECT_EQ(i % 2, GetId(packet.data));
+    // The limited broadcast address is kept, and the directed broadcast
+    // address of the LAN is replaced by the one of the guest.
+    uint32_t daddr = i % 2 ? kBcastAddr : guest_broadaddrs.at(packet.ifname);
+    EXPECT_EQ(daddr, GetDaddr(packet.data));
+    EXPECT_EQ(daddr, packet.dst_addr);
+    ExpectValidChecksums(packet.data);
+  }
+}
+
+TEST_F(BroadcastForwarderTest, SendToGuestsSkipsFailedPacket) {
+  ASSERT_TRUE(forwarder_.AddGuest("arc_br0"));
+
+  TestPacket packets[] = {MakePacket(kLanBroadaddr, 0),
+                          MakePacket(kLanBroadaddr, 1),
+                          MakePacket(kLanBroadaddr, 2)};
+  struct iovec iovs[3];
+  for (int i = 0; i < 3; i++) {
+    iovs[i].iov_base = packets[i].data;
+    iovs[i].iov_len = sizeof(packets[i].data);
+  }
+  // sendmmsg() sends the first packet and stops at the second, which then
+  // fails on its own.
+  forwarder_.send_results = {1, -1};
+  EXPECT_FALSE(forwarder_.SendToGuests(iovs, 3));
+
+  EXPECT_EQ(std::vector<unsigned int>({3, 2, 1}), forwarder_.send_vlens);
+  ASSERT_EQ(2, forwarder_.sent.size());
+  EXPECT_EQ(0, GetId(forwarder_.sent[0].data));
+  EXPECT_EQ(2, GetId(forwarder_.sent[1].data));
+  for (const SentPacket& packet : forwarder_.sent)
+    ExpectValidChecksums(packet.data);
+}
+
+TEST_F(BroadcastForwarderTest, SendToGuestsContinuesAfterGuestFailure) {
+  ASSERT_TRUE(forwarder_.AddGuest("arc_br0"));
+  ASSERT_TRUE(forwarder_.AddGuest("vmtap0"));
+
+  TestPacket packets[] = {MakePacket(kLanBroadaddr, 0),
+                          MakePacket(kLanBroadaddr, 1)};
+  struct iovec iovs[2];
+  for (int i = 0; i < 2; i++) {
+    iovs[i].iov_base = packets[i].data;
+    iovs[i].iov_len = sizeof(packets[i].data);
+  }
+  // Both packets fail for the first guest, and are sent to the second one.
+  forwarder_.send_results = {-1, -1};
+  EXPECT_FALSE(forwarder_.SendToGuests(iovs, 2));
+
+  EXPECT_EQ(std::vector<unsigned int>({2, 1, 2}), forwarder_.send_vlens);
+  ASSERT_EQ(2, forwarder_.sent.size());
+  for (int i = 0; i < 2; i++) {
+    EXPECT_EQ("vmtap0", forwarder_.sent[i].ifname);
+    EXPECT_EQ(i, GetId(forwarder_.sent[i].data));
+    EXPECT_EQ(kVmBroadaddr, GetDaddr(forwarder_.sent[i].data));
+    ExpectValidChecksums(forwarder_.sent[i].data);
+  }
+}
+
+}  // namespace patchpanel
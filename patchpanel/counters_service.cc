@@ -4,6 +4,9 @@
 
 #include "patchpanel/counters_service.h"
 
+#include <string.h>
+#include <sys/socket.h>
+
 #include <set>
 #include <string>
 #include <utility>
@@ -13,8 +16,12 @@
 #include <base/logging.h>
 #include <base/strings/strcat.h>
 #include <base/strings/string_split.h>
+#include <base/strings/string_util.h>
+#include <base/time/default_tick_clock.h>
 #include <re2/re2.h>
 
+#include "patchpanel/iptables_entries.h"
+
 namespace patchpanel {
 
 namespace {
@@ -27,6 +34,10 @@ constexpr char kVpnChainTag[] = "vpn";
 constexpr char kRxTag[] = "rx_";
 constexpr char kTxTag[] = "tx_";
 
+// The traffic counters are polled by the UI. They are read again at most once
+// per this delay, and the cached values are returned in between.
+constexpr base::TimeDelta kCountersCacheTtl = base::Seconds(1);
+
 // The following regexs and code is written and tested for iptables v1.6.2.
 // Output code of iptables can be found at:
 //   https://git.netfilter.org/iptables/tree/iptables/iptables.c?h=v1.6.2
@@ -80,7 +91,6 @@ bool MatchCounterLine(const std::string& line,
 // the counter for that interface. Note that this function will not fully
 // validate if |output| is an output from iptables.
 bool ParseOutput(const std::string& output,
-                 const std::set<std::string>& devices,
                  const TrafficCounter::IpFamily ip_family,
                  std::map<CounterKey, Counter>* counters) {
   DCHECK(counters);
@@ -100,10 +110,6 @@ bool ParseOutput(const std::string& output,
     if (it == lines.cend())
       break;
 
-    // Skips this group if this ifname is not requested.
-    if (!devices.empty() && devices.find(ifname) == devices.end())
-      continue;
-
     // Skips the chain name line and the header line.
     if (lines.cend() - it <= 2) {
       LOG(ERROR) << "Invalid iptables output for " << direction << "_"
@@ -152,57 +158,146 @@ bool ParseOutput(const std::string& output,
   return true;
 }
 
+// Adds the counters of the accounting rules in |rules|, as read from the
+// kernel, into the corresponding counters in |counters|. This is the
+// counterpart of ParseOutput() without iptables.
+bool ParseRules(const std::vector<IptablesRule>& rules,
+                const TrafficCounter::IpFamily ip_family,
+                std::map<CounterKey, Counter>* counters) {
+  DCHECK(counters);
+  for (const auto& rule : rules) {
+    bool rx;
+    if (base::StartsWith(rule.chain, kRxTag, base::CompareCase::SENSITIVE)) {
+      rx = true;
+    } else if (base::StartsWith(rule.chain, kTxTag,
+                                base::CompareCase::SENSITIVE)) {
+      rx = false;
+    } else {
+      continue;
+    }
+
+    // Accounting rules either match one source mark or catch everything else.
+    TrafficSource source;
+    if (rule.match_count == 0) {
+      source = TrafficSource::UNKNOWN;
+    } else if (rule.match_count == 1 && rule.has_mark &&
+               rule.mask == kFwmarkAllSourcesMask.Value()) {
+      source = Fwmark{.fwmark = rule.mark}.Source();
+    } else {
+      LOG(ERROR) << "Unexpected accounting rule in " << rule.chain;
+      return false;
+    }
+
+    if (rule.packets == 0 && rule.bytes == 0)
+      continue;
+
+    CounterKey key = {};
+    key.ifname = rule.chain.substr(strlen(kRxTag));
+    key.source = TrafficSourceToProto(source);
+    key.ip_family = ip_family;
+    auto& counter = (*counters)[key];
+    if (rx) {
+      counter.rx_bytes += rule.bytes;
+      counter.rx_packets += rule.packets;
+    } else {
+      counter.tx_bytes += rule.bytes;
+      counter.tx_packets += rule.packets;
+    }
+  }
+  return true;
+}
+
 }  // namespace
 
-CountersService::CountersService(Datapath* datapath) : datapath_(datapath) {}
+CountersService::CountersService(Datapath* datapath)
+    : CountersService(datapath, base::DefaultTickClock::GetInstance()) {}
+
+CountersService::CountersService(Datapath* datapath,
+                                 const base::TickClock* clock)
+    : datapath_(datapath), clock_(clock) {}
 
 std::map<CounterKey, Counter> CountersService::GetCounters(
     const std::set<std::string>& devices) {
-  std::map<CounterKey, Counter> counters;
+  const base::TimeTicks now = clock_->NowTicks();
+  if (counters_time_.is_null() || now - counters_time_ >= kCountersCacheTtl) {
+    // Handles counters for IPv4 and IPv6 separately and returns failure if
+    // either of the procession fails, since counters for only IPv4 or IPv6 are
+    // biased.
+    std::map<CounterKey, Counter> counters;
+    if (!ReadCounters(IpFamily::IPv4, TrafficCounter::IPV4, &counters) ||
+        !ReadCounters(IpFamily::IPv6, TrafficCounter::IPV6, &counters)) {
+      return {};
+    }
+    counters_ = std::move(counters);
+    counters_time_ = now;
+  }
 
-  // Handles counters for IPv4 and IPv6 separately and returns failure if either
-  // of the procession fails, since counters for only IPv4 or IPv6 are biased.
-  std::string iptables_result =
-      datapath_->DumpIptables(IpFamily::IPv4, kMangleTable);
-  if (iptables_result.empty()) {
-    LOG(ERROR) << "Failed to query IPv4 counters";
-    return {};
+  if (devices.empty())
+    return counters_;
+
+  std::map<CounterKey, Counter> counters;
+  for (const auto& kv : counters_) {
+    if (devices.find(kv.first.ifname) != devices.end())
+      counters.insert(kv);
   }
-  if (!ParseOutput(iptables_result, devices, TrafficCounter::IPV4, &counters)) {
-    LOG(ERROR) << "Failed to parse IPv4 counters";
-    return {};
+  return counters;
+}
+
+bool CountersService::ReadCounters(IpFamily family,
+                                   TrafficCounter::IpFamily ip_family,
+                                   std::map<CounterKey, Counter>* counters) {
+  const std::string& family_name = TrafficCounter::IpFamily_Name(ip_family);
+
+  // Reads the rules from the kernel first, which does not need to run and
+  // parse the output of iptables. This is not possible if the rules are
+  // managed through nftables.
+  const std::string entries =
+      datapath_->DumpIptablesEntries(family, kMangleTable);
+  if (!entries.empty()) {
+    std::vector<IptablesRule> rules;
+    std::map<CounterKey, Counter> rule_counters;
+    if (ParseIptablesEntries(family == IpFamily::IPv4 ? AF_INET : AF_INET6,
+                             entries, &rules) &&
+        ParseRules(rules, ip_family, &rule_counters)) {
+      counters->insert(rule_counters.begin(), rule_counters.end());
+      return true;
+    }
+    LOG(WARNING) << "Failed to parse " << family_name
+                 << " counters from the kernel, querying iptables";
   }
 
-  std::string ip6tables_result =
-      datapath_->DumpIptables(IpFamily::IPv6, kMangleTable);
-  if (ip6tables_result.empty()) {
-    LOG(ERROR) << "Failed to query IPv6 counters";
-    return {};
+  const std::string iptables_result =
+      datapath_->DumpIptables(family, kMangleTable);
+  if (iptables_result.empty()) {
+    LOG(ERROR) << "Failed to query " << family_name << " counters";
+    return false;
   }
-  if (!ParseOutput(ip6tables_result, devices, TrafficCounter::IPV6,
-                   &counters)) {
-    LOG(ERROR) << "Failed to parse IPv6 counters";
-    return {};
+  if (!ParseOutput(iptables_result, ip_family, counters)) {
+    LOG(ERROR) << "Failed to parse " << family_name << " counters";
+    return false;
   }
-
-  return counters;
+  return true;
 }
 
 void CountersService::OnPhysicalDeviceAdded(const std::string& ifname) {
+  ScopedIptablesBatch iptables_batch(datapath_);
   SetupAccountingRules(ifname);
   SetupJumpRules("-A", ifname, ifname);
 }
 
 void CountersService::OnPhysicalDeviceRemoved(const std::string& ifname) {
+  ScopedIptablesBatch iptables_batch(datapath_);
   SetupJumpRules("-D", ifname, ifname);
 }
 
 void CountersService::OnVpnDeviceAdded(const std::string& ifname) {
+  ScopedIptablesBatch iptables_batch(datapath_);
   SetupAccountingRules(kVpnChainTag);
   SetupJumpRules("-A", ifname, kVpnChainTag);
 }
 
 void CountersService::OnVpnDeviceRemoved(const std::string& ifname) {
+  ScopedIptablesBatch iptables_batch(datapath_);
   SetupJumpRules("-D", ifname, kVpnChainTag);
 }
 
@@ -11,6 +11,8 @@
 #include <utility>
 #include <vector>
 
+#include <base/time/tick_clock.h>
+#include <base/time/time.h>
 #include <patchpanel/proto_bindings/patchpanel_service.pb.h>
 
 #include "patchpanel/datapath.h"
@@ -44,9 +46,12 @@ namespace patchpanel {
 // and removed dynamically based on shill physical Device and shill vpn Device
 // creation and removal events.
 //
-// Query: Two commands (iptables and ip6tables) will be executed in the mangle
-// table to get all the chains and rules. And then we perform a text parsing on
-// the output to get the counters.
+// Query: The rules of the mangle table are read from the kernel for both IPv4
+// and IPv6, without running iptables, and the counters are collected from the
+// accounting chains. If the rules cannot be read that way, two commands
+// (iptables and ip6tables) will be executed in the mangle table to get all the
+// chains and rules, and we perform a text parsing on the output to get the
+// counters. The counters are cached for a short time between queries.
 class CountersService {
  public:
   struct CounterKey {
@@ -65,6 +70,8 @@ class CountersService {
   };
 
   CountersService(Datapath* datapath);
+  // Provided for testing only.
+  CountersService(Datapath* datapath, const base::TickClock* clock);
   ~CountersService() = default;
 
   // Adds accounting rules and jump rules for a new physical device if this is
@@ -80,7 +87,7 @@ class CountersService {
   // |devices| is the set of interfaces for which counters should be returned,
   // any unknown interfaces will be ignored. If |devices| is empty, counters for
   // all known interfaces will be returned. An empty map will be returned on
-  // any failure.
+  // any failure. The counters can be up to one second old.
   std::map<CounterKey, Counter> GetCounters(
       const std::set<std::string>& devices);
 
@@ -97,8 +104,17 @@ class CountersService {
   void SetupJumpRules(const std::string& op,
                       const std::string& ifname,
                       const std::string& chain_tag);
+  // Reads the counters of |family| into |counters|, with |ip_family| as their
+  // key. Returns false on failure.
+  bool ReadCounters(IpFamily family,
+                    TrafficCounter::IpFamily ip_family,
+                    std::map<CounterKey, Counter>* counters);
 
   Datapath* datapath_;
+  const base::TickClock* clock_;
+  // The counters of all the interfaces at |counters_time_|.
+  std::map<CounterKey, Counter> counters_;
+  base::TimeTicks counters_time_;
 };
 
 TrafficCounter::Source TrafficSourceToProto(TrafficSource source);
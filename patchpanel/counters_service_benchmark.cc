@@ -0,0 +1,244 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures reading the traffic counters with CountersService, parsing the
+// rules of the mangle table read from the kernel with ParseIptablesEntries(),
+// or parsing the text output of iptables as when the rules cannot be read from
+// the kernel. The rules are generated for a number of interfaces as set up by
+// CountersService. Running iptables, which only the text path needs, is not
+// included.
+// Usage: counters_service_benchmark [benchmark flags]
+
+// The libc definitions must come first to prevent the uapi headers from
+// redefining them.
+#include <netinet/in.h>
+
+#include <linux/netfilter/x_tables.h>
+#include <linux/netfilter/xt_mark.h>
+#include <linux/netfilter_ipv4/ip_tables.h>
+#include <linux/netfilter_ipv6/ip6_tables.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+
+#include <base/at_exit.h>
+#include <base/logging.h>
+#include <base/strings/stringprintf.h>
+#include <base/time/tick_clock.h>
+#include <base/time/time.h>
+#include <benchmark/benchmark.h>
+
+#include "patchpanel/counters_service.h"
+#include "patchpanel/datapath.h"
+#include "patchpanel/routing_service.h"
+
+namespace patchpanel {
+
+namespace {
+
+// Packets and bytes counted by every accounting rule, so that none of them is
+// skipped for being zero.
+constexpr int kPackets = 1366;
+constexpr int kBytes = 244427;
+
+// Returns the name of the interface |index|.
+std::string Ifname(int index) {
+  return base::StringPrintf("eth%d", index);
+}
+
+// Returns an entry of the kernel ruleset with the target |target_name|,
+// optionally preceded by a mark match with |mark|/kFwmarkAllSourcesMask.
+// |Entry| is ipt_entry or ip6t_entry.
+template <typename Entry>
+std::string MakeEntry(const std::string& target_name,
+                      const std::string& target_data,
+                      uint32_t mark = 0,
+                      uint64_t packets = 0,
+                      uint64_t bytes = 0) {
+  std::string matches;
+  if (mark != 0) {
+    struct xt_entry_match match = {};
+    match.u.user.match_size =
+        XT_ALIGN(sizeof(match) + sizeof(struct xt_mark_mtinfo1));
+    strncpy(match.u.user.name, "mark", sizeof(match.u.user.name) - 1);
+    match.u.user.revision = 1;
+    struct xt_mark_mtinfo1 info = {};
+    info.mark = mark;
+    info.mask = kFwmarkAllSourcesMask.Value();
+    matches.append(reinterpret_cast<const char*>(&match), sizeof(match));
+    matches.append(reinterpret_cast<const char*>(&info), sizeof(info));
+    matches.resize(match.u.user.match_size);
+  }
+
+  struct xt_entry_target target = {};
+  target.u.user.target_size = XT_ALIGN(sizeof(target) + target_data.size());
+  strncpy(target.u.user.name, target_name.c_str(),
+          sizeof(target.u.user.name) - 1);
+
+  Entry entry = {};
+  entry.target_offset = sizeof(entry) + matches.size();
+  entry.next_offset = entry.target_offset + target.u.user.target_size;
+  entry.counters.pcnt = packets;
+  entry.counters.bcnt = bytes;
+
+  std::string result(reinterpret_cast<const char*>(&entry), sizeof(entry));
+  result += matches;
+  result.append(reinterpret_cast<const char*>(&target), sizeof(target));
+  result += target_data;
+  result.resize(entry.next_offset);
+  return result;
+}
+
+template <typename Entry>
+std::string MakeChainEntry(const std::string& name) {
+  std::string data = name;
+  data.resize(XT_FUNCTION_MAXNAMELEN);
+  return MakeEntry<Entry>(XT_ERROR_TARGET, data);
+}
+
+template <typename Entry>
+std::string MakeReturnEntry(uint32_t mark = 0,
+                            uint64_t packets = 0,
+                            uint64_t bytes = 0) {
+  const int verdict = XT_RETURN;
+  return MakeEntry<Entry>(
+      XT_STANDARD_TARGET,
+      std::string(reinterpret_cast<const char*>(&verdict), sizeof(verdict)),
+      mark, packets, bytes);
+}
+
+// Returns the mangle table with the accounting chains of |interfaces|
+// interfaces, as read by Datapath::DumpIptablesEntries().
+template <typename Entry>
+std::string MakeEntries(int interfaces) {
+  // The builtin chains come first, here with their policy only.
+  std::string entries = MakeReturnEntry<Entry>();
+  for (int i = 0; i < interfaces; i++) {
+    for (const char* tag : {"rx_", "tx_"}) {
+      entries += MakeChainEntry<Entry>(tag + Ifname(i));
+      for (TrafficSource source : kAllSources) {
+        entries += MakeReturnEntry<Entry>(Fwmark::FromSource(source).Value(),
+                                          kPackets, kBytes);
+      }
+      entries += MakeReturnEntry<Entry>(0, kPackets, kBytes);
+      // The implicit RETURN rule ending the chain.
+      entries += MakeReturnEntry<Entry>();
+    }
+  }
+  return entries + MakeChainEntry<Entry>(XT_ERROR_TARGET);
+}
+
+// Returns the output of "iptables -t mangle -L -x -v -n" for the same rules as
+// MakeEntries(), as read by Datapath::DumpIptables().
+std::string MakeIptablesOutput(IpFamily family, int interfaces) {
+  const char* any = family == IpFamily::IPv4 ? "0.0.0.0/0" : "::/0";
+  const char kHeader[] =
+      "    pkts      bytes target     prot opt in     out     source"
+      "               destination\n";
+  std::string output = base::StringPrintf(
+      "Chain PREROUTING (policy ACCEPT 0 packets, 0 bytes)\n%s\n", kHeader);
+  for (int i = 0; i < interfaces; i++) {
+    for (const char* tag : {"rx_", "tx_"}) {
+      output += base::StringPrintf("Chain %s%s (2 references)\n%s", tag,
+                                   Ifname(i).c_str(), kHeader);
+      for (TrafficSource source : kAllSources) {
+        output += base::StringPrintf(
+            "%8d %10d RETURN     all  --  *      *       %-20s %-20s "
+            "mark match 0x%x/0x%x\n",
+            kPackets, kBytes, any, any, Fwmark::FromSource(source).Value(),
+            kFwmarkAllSourcesMask.Value());
+      }
+      output += base::StringPrintf(
+          "%8d %10d            all  --  *      *       %-20s %-20s\n\n",
+          kPackets, kBytes, any, any);
+    }
+  }
+  return output;
+}
+
+// Returns the rules of the mangle table from the kernel, or from iptables if
+// |from_kernel| is false, as when the rules are managed through nftables.
+class FakeDatapath : public Datapath {
+ public:
+  FakeDatapath(bool from_kernel, int interfaces)
+      : Datapath(nullptr, nullptr, nullptr) {
+    if (from_kernel) {
+      entries_[IpFamily::IPv4] = MakeEntries<struct ipt_entry>(interfaces);
+      entries_[IpFamily::IPv6] = MakeEntries<struct ip6t_entry>(interfaces);
+    } else {
+      output_[IpFamily::IPv4] =
+          MakeIptablesOutput(IpFamily::IPv4, interfaces);
+      output_[IpFamily::IPv6] =
+          MakeIptablesOutput(IpFamily::IPv6, interfaces);
+    }
+  }
+  FakeDatapath(const FakeDatapath&) = delete;
+  FakeDatapath& operator=(const FakeDatapath&) = delete;
+
+  std::string DumpIptables(IpFamily family, const std::string& table) override {
+    return output_[family];
+  }
+
+  std::string DumpIptablesEntries(IpFamily family,
+                                  const std::string& table) override {
+    return entries_[family];
+  }
+
+ private:
+  std::map<IpFamily, std::string> entries_;
+  std::map<IpFamily, std::string> output_;
+};
+
+// Expires the cached counters of CountersService at every read.
+class ExpiringTickClock : public base::TickClock {
+ public:
+  base::TimeTicks NowTicks() const override {
+    now_ += base::Seconds(1);
+    return now_;
+  }
+
+ private:
+  mutable base::TimeTicks now_;
+};
+
+void BM_GetCounters(benchmark::State& state) {
+  const bool from_kernel = state.range(0);
+  const int interfaces = state.range(1);
+  FakeDatapath datapath(from_kernel, interfaces);
+  ExpiringTickClock clock;
+  CountersService counters_svc(&datapath, &clock);
+
+  // No counters are returned if the rules fail to parse.
+  if (counters_svc.GetCounters({}).empty()) {
+    state.SkipWithError("Failed to parse the counters");
+    return;
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(counters_svc.GetCounters({}));
+  }
+  state.SetItemsProcessed(state.iterations() * interfaces);
+}
+BENCHMARK(BM_GetCounters)
+    ->ArgNames({"kernel", "interfaces"})
+    ->Args({0, 1})
+    ->Args({1, 1})
+    ->Args({0, 4})
+    ->Args({1, 4})
+    ->Args({0, 16})
+    ->Args({1, 16});
+
+}  // namespace
+
+}  // namespace patchpanel
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit;
+  logging::SetMinLogLevel(logging::LOGGING_WARNING);
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
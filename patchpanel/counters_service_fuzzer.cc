@@ -34,6 +34,11 @@ class FakeDatapath : public Datapath {
     return data_;
   }
 
+  std::string DumpIptablesEntries(IpFamily family,
+                                  const std::string& table) override {
+    return data_;
+  }
+
  private:
   std::string data_;
 };
@@ -4,13 +4,22 @@
 
 #include "patchpanel/counters_service.h"
 
+// The libc definitions must come first to prevent the uapi headers from
+// redefining them.
 #include <net/if.h>
+#include <netinet/in.h>
+
+#include <linux/netfilter/x_tables.h>
+#include <linux/netfilter/xt_mark.h>
+#include <linux/netfilter_ipv4/ip_tables.h>
+#include <string.h>
 
 #include <memory>
 #include <string>
 #include <vector>
 
 #include <base/logging.h>
+#include <base/test/simple_test_tick_clock.h>
 #include <chromeos/dbus/service_constants.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -256,11 +265,69 @@ bool CompareCounters(std::map<CounterKey, Counter> expected,
   return success;
 }
 
+// Returns an IPv4 entry of the kernel ruleset with the target |target_name|,
+// optionally preceded by a mark match with |mark|/0x3f00.
+std::string MakeIptablesEntry(const std::string& target_name,
+                              const std::string& target_data,
+                              uint32_t mark = 0,
+                              uint64_t packets = 0,
+                              uint64_t bytes = 0) {
+  std::string matches;
+  if (mark != 0) {
+    struct xt_entry_match match = {};
+    match.u.user.match_size =
+        XT_ALIGN(sizeof(match) + sizeof(struct xt_mark_mtinfo1));
+    strcpy(match.u.user.name, "mark");  // NOLINT(runtime/printf)
+    match.u.user.revision = 1;
+    struct xt_mark_mtinfo1 info = {};
+    info.mark = mark;
+    info.mask = 0x3f00;
+    matches.append(reinterpret_cast<const char*>(&match), sizeof(match));
+    matches.append(reinterpret_cast<const char*>(&info), sizeof(info));
+    matches.resize(match.u.user.match_size);
+  }
+
+  struct xt_entry_target target = {};
+  target.u.user.target_size = XT_ALIGN(sizeof(target) + target_data.size());
+  strncpy(target.u.user.name, target_name.c_str(),
+          sizeof(target.u.user.name) - 1);
+
+  struct ipt_entry entry = {};
+  entry.target_offset = sizeof(entry) + matches.size();
+  entry.next_offset = entry.target_offset + target.u.user.target_size;
+  entry.counters.pcnt = packets;
+  entry.counters.bcnt = bytes;
+
+  std::string result(reinterpret_cast<const char*>(&entry), sizeof(entry));
+  result += matches;
+  result.append(reinterpret_cast<const char*>(&target), sizeof(target));
+  result += target_data;
+  result.resize(entry.next_offset);
+  return result;
+}
+
+std::string MakeChainEntry(const std::string& name) {
+  std::string data = name;
+  data.resize(XT_FUNCTION_MAXNAMELEN);
+  return MakeIptablesEntry(XT_ERROR_TARGET, data);
+}
+
+std::string MakeRuleEntry(uint32_t mark, uint64_t packets, uint64_t bytes) {
+  const int verdict = XT_RETURN;
+  return MakeIptablesEntry(
+      XT_STANDARD_TARGET,
+      std::string(reinterpret_cast<const char*>(&verdict), sizeof(verdict)),
+      mark, packets, bytes);
+}
+
 class CountersServiceTest : public testing::Test {
  protected:
   void SetUp() override {
+    // A null TimeTicks means that the counters were never read.
+    clock_.Advance(base::Seconds(1));
     datapath_ = std::make_unique<MockDatapath>();
-    counters_svc_ = std::make_unique<CountersService>(datapath_.get());
+    counters_svc_ =
+        std::make_unique<CountersService>(datapath_.get(), &clock_);
   }
 
   // Makes `iptables` and `ip6tables` returning |ipv4_output| and
@@ -277,12 +344,16 @@ class CountersServiceTest : public testing::Test {
     EXPECT_TRUE(CompareCounters(expected, actual));
   }
 
+  base::SimpleTestTickClock clock_;
   std::unique_ptr<MockDatapath> datapath_;
   std::unique_ptr<CountersService> counters_svc_;
 };
 
 TEST_F(CountersServiceTest, OnPhysicalDeviceAdded) {
   // The following commands are expected when eth0 comes up.
+  EXPECT_CALL(*datapath_, StartIptablesBatch());
+  EXPECT_CALL(*datapath_, CommitIptablesBatch())
+      .WillOnce(Return(IptablesBatchResult::kApplied));
   EXPECT_CALL(*datapath_,
               ModifyChain(IpFamily::Dual, "mangle", "-N", "rx_eth0", _))
       .WillOnce(Return(true));
@@ -627,6 +698,81 @@ Chain tx_eth0 (1 references)
   EXPECT_TRUE(CompareCounters(expected, actual));
 }
 
+TEST_F(CountersServiceTest, QueryTrafficCountersFromKernel) {
+  // The IPv4 rules are read from the kernel, and the IPv6 rules from
+  // ip6tables since they cannot be read from the kernel.
+  const std::string ipv4_entries =
+      MakeRuleEntry(0, 100, 10000) + MakeChainEntry("rx_eth0") +
+      MakeRuleEntry(0x100, 73, 11938) + MakeRuleEntry(0x200, 0, 0) +
+      MakeRuleEntry(0, 6, 345) + MakeRuleEntry(0, 0, 0) +
+      MakeChainEntry("tx_eth0") + MakeRuleEntry(0x100, 1366, 244427) +
+      MakeRuleEntry(0, 0, 0) + MakeChainEntry(XT_ERROR_TARGET);
+  const std::string ipv6_output = R"(
+Chain tx_wlan0 (1 references)
+    pkts      bytes target     prot opt in     out     source               destination
+     310    57004 RETURN     all      *      *       ::/0                 ::/0                 mark match 0x100/0x3f00
+       0        0            all      *      *       ::/0                 ::/0
+)";
+  EXPECT_CALL(*datapath_, DumpIptablesEntries(IpFamily::IPv4, "mangle"))
+      .WillOnce(Return(ipv4_entries));
+  EXPECT_CALL(*datapath_, DumpIptablesEntries(IpFamily::IPv6, "mangle"))
+      .WillOnce(Return(""));
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv4, _)).Times(0);
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv6, "mangle"))
+      .WillOnce(Return(ipv6_output));
+
+  auto actual = counters_svc_->GetCounters({});
+
+  std::map<CounterKey, Counter> expected{
+      {{"eth0", TrafficCounter::CHROME, TrafficCounter::IPV4},
+       {11938 /*rx_bytes*/, 73 /*rx_packets*/, 244427 /*tx_bytes*/,
+        1366 /*tx_packets*/}},
+      {{"eth0", TrafficCounter::UNKNOWN, TrafficCounter::IPV4},
+       {345 /*rx_bytes*/, 6 /*rx_packets*/, 0 /*tx_bytes*/,
+        0 /*tx_packets*/}},
+      {{"wlan0", TrafficCounter::CHROME, TrafficCounter::IPV6},
+       {0 /*rx_bytes*/, 0 /*rx_packets*/, 57004 /*tx_bytes*/,
+        310 /*tx_packets*/}},
+  };
+
+  EXPECT_TRUE(CompareCounters(expected, actual));
+}
+
+TEST_F(CountersServiceTest, QueryTrafficCountersWithBadKernelEntries) {
+  // Malformed rules read from the kernel are read again with iptables.
+  EXPECT_CALL(*datapath_, DumpIptablesEntries(_, "mangle"))
+      .WillRepeatedly(Return("garbage"));
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv4, "mangle"))
+      .WillOnce(Return(kIptablesOutput));
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv6, "mangle"))
+      .WillOnce(Return(kIp6tablesOutput));
+
+  EXPECT_THAT(counters_svc_->GetCounters({}), SizeIs(16));
+}
+
+TEST_F(CountersServiceTest, QueryTrafficCountersCached) {
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv4, "mangle"))
+      .WillOnce(Return(kIptablesOutput));
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv6, "mangle"))
+      .WillOnce(Return(kIp6tablesOutput));
+
+  const auto counters = counters_svc_->GetCounters({});
+  EXPECT_THAT(counters, SizeIs(16));
+
+  // The counters are not queried again within one second.
+  clock_.Advance(base::Milliseconds(500));
+  EXPECT_TRUE(CompareCounters(counters, counters_svc_->GetCounters({})));
+  EXPECT_THAT(counters_svc_->GetCounters({"wlan0"}), SizeIs(4));
+  testing::Mock::VerifyAndClearExpectations(datapath_.get());
+
+  clock_.Advance(base::Milliseconds(500));
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv4, "mangle"))
+      .WillOnce(Return(kIptablesOutput));
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv6, "mangle"))
+      .WillOnce(Return(kIp6tablesOutput));
+  EXPECT_TRUE(CompareCounters(counters, counters_svc_->GetCounters({})));
+}
+
 TEST_F(CountersServiceTest, QueryTrafficCountersWithEmptyIPv4Output) {
   TestBadIptablesOutput("", kIp6tablesOutput);
 }
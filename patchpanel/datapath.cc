@@ -28,6 +28,7 @@
 
 #include "patchpanel/adb_proxy.h"
 #include "patchpanel/arc_service.h"
+#include "patchpanel/iptables_entries.h"
 
 namespace patchpanel {
 
@@ -159,6 +160,10 @@ void Datapath::Start() {
                << " IPv6 functionality may be broken.";
   }
 
+  // Applies the initial ruleset with a few iptables-restore transactions
+  // instead of hundreds of iptables processes.
+  ScopedIptablesBatch iptables_batch(this);
+
   // Creates all "stateless" iptables chains used by patchpanel and set up
   // basic jump rules from the builtin chains. All chains that needs to carry
   // some state when patchpanel restarts (for instance: chains for
@@ -1113,6 +1118,7 @@ void Datapath::StartRoutingDevice(const std::string& ext_ifname,
                                   TrafficSource source,
                                   bool route_on_vpn,
                                   uint32_t peer_ipv4_addr) {
+  ScopedIptablesBatch iptables_batch(this);
   if (!ModifyJumpRule(IpFamily::Dual, "filter", "-A", "FORWARD", "ACCEPT",
                       "" /*iif*/, int_ifname)) {
     LOG(ERROR) << "Failed to enable IP forwarding from " << ext_ifname;
@@ -1125,9 +1131,13 @@ void Datapath::StartRoutingDevice(const std::string& ext_ifname,
 
   std::string subchain = "PREROUTING_" + int_ifname;
   // This can fail if patchpanel did not stopped correctly or failed to cleanup
-  // the chain when |int_ifname| was previously deleted.
-  if (!AddChain(IpFamily::Dual, "mangle", subchain))
+  // the chain when |int_ifname| was previously deleted. Commands expected to
+  // fail run outside of the iptables batch, so that the failure does not make
+  // the whole mangle transaction fall back to one command at a time.
+  if (!ModifyChain(IpFamily::Dual, "mangle", "-N", subchain,
+                   false /*log_failures*/)) {
     LOG(ERROR) << "Failed to create mangle chain " << subchain;
+  }
   // Make sure the chain is empty if patchpanel did not cleaned correctly that
   // chain before.
   if (!FlushChain(IpFamily::Dual, "mangle", subchain)) {
@@ -1199,6 +1209,13 @@ void Datapath::StartRoutingDevice(const std::string& ext_ifname,
     if (route_on_vpn && !ModifyFwmarkVpnJumpRule(subchain, "-A", {}, {}))
       LOG(ERROR) << "Failed to add jump rule to VPN chain for " << int_ifname;
   }
+
+  // Only reported here when not nested in another batch, as in
+  // StartVpnRouting().
+  if (iptables_batch.Commit() == IptablesBatchResult::kFailed) {
+    LOG(ERROR) << "Failed to apply some of the routing rules for "
+               << int_ifname;
+  }
 }
 
 void Datapath::StopRoutingDevice(const std::string& ext_ifname,
@@ -1206,6 +1223,7 @@ void Datapath::StopRoutingDevice(const std::string& ext_ifname,
                                  uint32_t int_ipv4_addr,
                                  TrafficSource source,
                                  bool route_on_vpn) {
+  ScopedIptablesBatch iptables_batch(this);
   ModifyJumpRule(IpFamily::Dual, "filter", "-D", "FORWARD", "ACCEPT",
                  "" /*iif*/, int_ifname);
   ModifyJumpRule(IpFamily::Dual, "filter", "-D", "FORWARD", "ACCEPT",
@@ -1409,10 +1427,14 @@ void Datapath::StartConnectionPinning(const std::string& ext_ifname) {
     return;
   }
 
+  ScopedIptablesBatch iptables_batch(this);
+
   std::string subchain = "POSTROUTING_" + ext_ifname;
   // This can fail if patchpanel did not stopped correctly or failed to cleanup
-  // the chain when |ext_ifname| was previously deleted.
-  if (!AddChain(IpFamily::Dual, "mangle", subchain)) {
+  // the chain when |ext_ifname| was previously deleted. As in
+  // StartRoutingDevice(), this runs outside of the iptables batch.
+  if (!ModifyChain(IpFamily::Dual, "mangle", "-N", subchain,
+                   false /*log_failures*/)) {
     LOG(ERROR) << "Failed to create mangle chain " << subchain;
   }
   // Make sure the chain is empty if patchpanel did not cleaned correctly that
@@ -1449,9 +1471,17 @@ void Datapath::StartConnectionPinning(const std::string& ext_ifname) {
                   "traffic received on "
                << ext_ifname;
   }
+
+  // Only reported here when not nested in another batch, as in
+  // StartVpnRouting().
+  if (iptables_batch.Commit() == IptablesBatchResult::kFailed) {
+    LOG(ERROR) << "Failed to apply some of the connection pinning rules for "
+               << ext_ifname;
+  }
 }
 
 void Datapath::StopConnectionPinning(const std::string& ext_ifname) {
+  ScopedIptablesBatch iptables_batch(this);
   std::string subchain = "POSTROUTING_" + ext_ifname;
   ModifyJumpRule(IpFamily::Dual, "mangle", "-D", "POSTROUTING", subchain,
                  "" /*iif*/, ext_ifname);
@@ -1473,6 +1503,8 @@ void Datapath::StartVpnRouting(const std::string& vpn_ifname) {
     return;
   }
 
+  ScopedIptablesBatch iptables_batch(this);
+
   Fwmark routing_mark = Fwmark::FromIfIndex(ifindex);
   LOG(INFO) << "Start VPN routing on " << vpn_ifname
             << " fwmark=" << routing_mark.ToString();
@@ -1517,9 +1549,17 @@ void Datapath::StartVpnRouting(const std::string& vpn_ifname) {
            "ACCEPT", "-w"})) {
     LOG(ERROR) << "Failed to set filter rule for accepting VPN marked traffic";
   }
+
+  // Also reports the failures of the rules of StartConnectionPinning() and
+  // StartRoutingDevice() above, whose batches are nested in this one.
+  if (iptables_batch.Commit() == IptablesBatchResult::kFailed) {
+    LOG(ERROR) << "Failed to apply some of the VPN routing rules for "
+               << vpn_ifname;
+  }
 }
 
 void Datapath::StopVpnRouting(const std::string& vpn_ifname) {
+  ScopedIptablesBatch iptables_batch(this);
   LOG(INFO) << "Stop VPN routing on " << vpn_ifname;
   if (!FlushChain(IpFamily::Dual, "filter", kVpnAcceptChain)) {
     LOG(ERROR) << "Could not flush " << kVpnAcceptChain;
@@ -1781,6 +1821,26 @@ bool Datapath::ModifyIptables(IpFamily family,
   return success;
 }
 
+void Datapath::StartIptablesBatch() {
+  process_runner_->StartIptablesBatch();
+}
+
+IptablesBatchResult Datapath::CommitIptablesBatch() {
+  return process_runner_->CommitIptablesBatch();
+}
+
+ScopedIptablesBatch::~ScopedIptablesBatch() {
+  if (!committed_ && Commit() == IptablesBatchResult::kFailed) {
+    LOG(ERROR) << "Failed to apply some of the batched iptables commands";
+  }
+}
+
+IptablesBatchResult ScopedIptablesBatch::Commit() {
+  DCHECK(!committed_);
+  committed_ = true;
+  return datapath_->CommitIptablesBatch();
+}
+
 std::string Datapath::DumpIptables(IpFamily family, const std::string& table) {
   std::string result;
   std::vector<std::string> argv = {"-L", "-x", "-v", "-n", "-w"};
@@ -1806,6 +1866,20 @@ std::string Datapath::DumpIptables(IpFamily family, const std::string& table) {
   return result;
 }
 
+std::string Datapath::DumpIptablesEntries(IpFamily family,
+                                          const std::string& table) {
+  switch (family) {
+    case IPv4:
+      return GetIptablesEntries(AF_INET, table);
+    case IPv6:
+      return GetIptablesEntries(AF_INET6, table);
+    default:
+      LOG(ERROR) << "Could not read iptables entries: incorrect IP family "
+                 << family;
+      return "";
+  }
+}
+
 bool Datapath::AddIPv4Route(uint32_t gateway_addr,
                             uint32_t addr,
                             uint32_t netmask) {
@@ -350,6 +350,16 @@ class Datapath {
   // Dumps the iptables chains rules for the table |table|. |family| must be
   // either IPv4 or IPv6.
   virtual std::string DumpIptables(IpFamily family, const std::string& table);
+  // Reads the rules of the table |table| with their counters directly from the
+  // kernel, without running iptables. |family| must be either IPv4 or IPv6.
+  // The result is parsed with ParseIptablesEntries(), and is empty on failure.
+  virtual std::string DumpIptablesEntries(IpFamily family,
+                                          const std::string& table);
+  // Defers the iptables commands modifying rules or chains until the matching
+  // CommitIptablesBatch() call, which applies them with one iptables-restore
+  // transaction per table. See MinijailedProcessRunner::StartIptablesBatch().
+  virtual void StartIptablesBatch();
+  virtual IptablesBatchResult CommitIptablesBatch();
 
   // Changes firewall rules based on |request|, allowing ingress traffic to a
   // port, forwarding ingress traffic to a port into ARC or Crostini, or
@@ -485,6 +495,31 @@ class Datapath {
   std::map<std::string, std::string> physical_dns_addresses_;
 };
 
+// Batches the iptables commands of |datapath| during its lifetime. The queued
+// commands return 0, so the result checks of the Datapath methods modifying
+// rules cannot fail inside a batch: the failures are reported by the Commit()
+// of the outermost batch, or logged on its destruction if Commit() was not
+// called.
+class ScopedIptablesBatch {
+ public:
+  explicit ScopedIptablesBatch(Datapath* datapath) : datapath_(datapath) {
+    datapath_->StartIptablesBatch();
+  }
+  ScopedIptablesBatch(const ScopedIptablesBatch&) = delete;
+  ScopedIptablesBatch& operator=(const ScopedIptablesBatch&) = delete;
+
+  ~ScopedIptablesBatch();
+
+  // Ends the batch. Returns kFailed if any of the queued commands failed, or
+  // kDeferred if the batch is nested: the commands are then applied and
+  // checked by the outermost batch.
+  IptablesBatchResult Commit();
+
+ private:
+  Datapath* datapath_;
+  bool committed_ = false;
+};
+
 }  // namespace patchpanel
 
 #endif  // PATCHPANEL_DATAPATH_H_
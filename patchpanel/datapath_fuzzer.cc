@@ -44,6 +44,12 @@ class FakeProcessRunner : public MinijailedProcessRunner {
               std::string* output) override {
     return 0;
   }
+
+  int RunSyncWithInput(const std::vector<std::string>& argv,
+                       const std::string& input,
+                       bool log_failures) override {
+    return 0;
+  }
 };
 
 // Always succeeds
@@ -9,6 +9,7 @@
 #include <net/if.h>
 #include <sys/ioctl.h>
 
+#include <map>
 #include <memory>
 #include <string>
 #include <utility>
@@ -487,6 +488,92 @@ TEST(DatapathTest, Start) {
   datapath.Start();
 }
 
+// Records the iptables and ip6tables commands run, either by the iptables
+// processes or by the iptables-restore processes.
+class RecordingProcessRunner : public MinijailedProcessRunner {
+ public:
+  // Commands per iptables binary and table, without the wait option which
+  // iptables-restore only takes on its command line.
+  using Commands =
+      std::map<std::pair<std::string, std::string>, std::vector<std::string>>;
+
+  explicit RecordingProcessRunner(bool restore_succeeds)
+      : restore_succeeds_(restore_succeeds) {}
+  ~RecordingProcessRunner() = default;
+
+  int Run(const std::vector<std::string>& argv, bool log_failures) override {
+    return 0;
+  }
+
+  int RunSync(const std::vector<std::string>& argv,
+              bool log_failures,
+              std::string* output) override {
+    processes_++;
+    std::vector<std::string> args;
+    for (size_t i = 3; i < argv.size(); i++) {
+      if (argv[i] != "-w")
+        args.push_back(argv[i]);
+    }
+    commands_[{argv[0], argv[2]}].push_back(base::JoinString(args, " "));
+    return 0;
+  }
+
+  int RunSyncWithInput(const std::vector<std::string>& argv,
+                       const std::string& input,
+                       bool log_failures) override {
+    processes_++;
+    restores_++;
+    if (!restore_succeeds_)
+      return 1;
+
+    const std::string path = argv[0] == "/sbin/iptables-restore"
+                                 ? "/sbin/iptables"
+                                 : "/sbin/ip6tables";
+    std::string table;
+    for (const auto& line :
+         base::SplitString(input, "\n", base::TRIM_WHITESPACE,
+                           base::SPLIT_WANT_NONEMPTY)) {
+      if (line[0] == '*') {
+        table = line.substr(1);
+      } else if (line != "COMMIT") {
+        commands_[{path, table}].push_back(line);
+      }
+    }
+    return 0;
+  }
+
+  const Commands& commands() const { return commands_; }
+  int processes() const { return processes_; }
+  int restores() const { return restores_; }
+
+ private:
+  const bool restore_succeeds_;
+  Commands commands_;
+  int processes_ = 0;
+  int restores_ = 0;
+};
+
+TEST(DatapathTest, StartIptablesBatch) {
+  // Applies the batches with iptables-restore.
+  auto restore_runner = new RecordingProcessRunner(true /*restore_succeeds*/);
+  Datapath restore_datapath(restore_runner, new MockFirewall(),
+                            new FakeSystem());
+  restore_datapath.Start();
+
+  // Falls back to running the batched commands one by one, as without
+  // batches.
+  auto iptables_runner = new RecordingProcessRunner(false /*restore_succeeds*/);
+  Datapath iptables_datapath(iptables_runner, new MockFirewall(),
+                             new FakeSystem());
+  iptables_datapath.Start();
+
+  // Both backends must result in the same rules in every table.
+  EXPECT_EQ(restore_runner->commands(), iptables_runner->commands());
+  EXPECT_LT(0, restore_runner->restores());
+  EXPECT_EQ(restore_runner->restores(), iptables_runner->restores());
+  EXPECT_LT(restore_runner->processes(), iptables_runner->processes());
+}
+
 TEST(DatapathTest, Stop) {
   auto runner = new MockProcessRunner();
   auto firewall = new MockFirewall();
@@ -0,0 +1,93 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "patchpanel/iptables_batch.h"
+
+#include <base/check.h>
+#include <base/containers/contains.h>
+
+namespace patchpanel {
+
+namespace {
+
+// Commands which only modify the ruleset.
+constexpr const char* kBatchableOps[] = {"-A", "-D", "-I", "-R",
+                                         "-N", "-X", "-F", "-P"};
+
+// The options to wait for the xtables lock, which iptables-restore only
+// accepts on its own command line.
+bool IsWaitOption(const std::string& arg) {
+  return arg == "-w" || arg == "--wait";
+}
+
+}  // namespace
+
+bool IptablesBatch::CanBatch(const std::vector<std::string>& argv) {
+  if (argv.empty() || !base::Contains(kBatchableOps, argv[0]))
+    return false;
+
+  // iptables-restore splits lines on whitespace and only understands double
+  // quoted arguments, without a way to escape special characters reliably.
+  for (const auto& arg : argv) {
+    if (arg.find_first_of("\"\\\n") != std::string::npos)
+      return false;
+  }
+  return true;
+}
+
+void IptablesBatch::Add(const std::string& table,
+                        const std::vector<std::string>& argv) {
+  DCHECK(CanBatch(argv));
+  for (auto& entry : tables_) {
+    if (entry.first == table) {
+      entry.second.push_back(argv);
+      return;
+    }
+  }
+  tables_.emplace_back(table, std::vector<std::vector<std::string>>{argv});
+}
+
+void IptablesBatch::Clear() {
+  tables_.clear();
+}
+
+std::vector<std::string> IptablesBatch::GetTables() const {
+  std::vector<std::string> tables;
+  for (const auto& entry : tables_)
+    tables.push_back(entry.first);
+  return tables;
+}
+
+std::vector<std::vector<std::string>> IptablesBatch::GetCommands(
+    const std::string& table) const {
+  for (const auto& entry : tables_) {
+    if (entry.first == table)
+      return entry.second;
+  }
+  return {};
+}
+
+std::string IptablesBatch::GetRestoreInput(const std::string& table) const {
+  std::string input = "*" + table + "\n";
+  for (const auto& argv : GetCommands(table)) {
+    bool first = true;
+    for (const auto& arg : argv) {
+      if (IsWaitOption(arg))
+        continue;
+      if (!first)
+        input += " ";
+      first = false;
+      if (arg.empty() || arg.find_first_of(" \t") != std::string::npos) {
+        input += "\"" + arg + "\"";
+      } else {
+        input += arg;
+      }
+    }
+    input += "\n";
+  }
+  input += "COMMIT\n";
+  return input;
+}
+
+}  // namespace patchpanel
@@ -0,0 +1,58 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef PATCHPANEL_IPTABLES_BATCH_H_
+#define PATCHPANEL_IPTABLES_BATCH_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace patchpanel {
+
+// Accumulates iptables commands for one IP family and converts them into the
+// input of iptables-restore --noflush, so that they can be applied with one
+// process and one atomic transaction per table instead of one iptables
+// process per command.
+class IptablesBatch {
+ public:
+  IptablesBatch() = default;
+  IptablesBatch(const IptablesBatch&) = delete;
+  IptablesBatch& operator=(const IptablesBatch&) = delete;
+
+  ~IptablesBatch() = default;
+
+  // Returns true if |argv| only modifies rules or chains and can be written as
+  // an iptables-restore line. Commands listing or checking rules need their
+  // result and cannot be batched.
+  static bool CanBatch(const std::vector<std::string>& argv);
+
+  // Queues the command |argv| for table |table|. CanBatch(|argv|) must be
+  // true.
+  void Add(const std::string& table, const std::vector<std::string>& argv);
+
+  bool empty() const { return tables_.empty(); }
+  void Clear();
+
+  // Returns the tables which have queued commands, in the order they were
+  // first used.
+  std::vector<std::string> GetTables() const;
+
+  // Returns the commands queued for |table| in the order they were added.
+  std::vector<std::vector<std::string>> GetCommands(
+      const std::string& table) const;
+
+  // Returns the iptables-restore input applying the commands queued for
+  // |table| in one transaction.
+  std::string GetRestoreInput(const std::string& table) const;
+
+ private:
+  // Commands per table, in first use order. There are only a few tables.
+  std::vector<std::pair<std::string, std::vector<std::vector<std::string>>>>
+      tables_;
+};
+
+}  // namespace patchpanel
+
+#endif  // PATCHPANEL_IPTABLES_BATCH_H_
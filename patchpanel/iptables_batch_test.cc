@@ -0,0 +1,85 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "patchpanel/iptables_batch.h"
+
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+namespace patchpanel {
+namespace {
+
+TEST(IptablesBatchTest, CanBatch) {
+  EXPECT_TRUE(IptablesBatch::CanBatch({"-A", "FORWARD", "-j", "ACCEPT", "-w"}));
+  EXPECT_TRUE(IptablesBatch::CanBatch({"-I", "OUTPUT", "-j", "ACCEPT"}));
+  EXPECT_TRUE(IptablesBatch::CanBatch({"-D", "OUTPUT", "-j", "ACCEPT"}));
+  EXPECT_TRUE(IptablesBatch::CanBatch({"-N", "chain", "-w"}));
+  EXPECT_TRUE(IptablesBatch::CanBatch({"-F", "chain", "-w"}));
+  EXPECT_TRUE(IptablesBatch::CanBatch({"-X", "chain", "-w"}));
+
+  EXPECT_FALSE(IptablesBatch::CanBatch({}));
+  EXPECT_FALSE(IptablesBatch::CanBatch({"-L", "chain", "-w"}));
+  EXPECT_FALSE(IptablesBatch::CanBatch({"-L", "-x", "-v", "-n", "-w"}));
+  EXPECT_FALSE(IptablesBatch::CanBatch({"-C", "OUTPUT", "-j", "ACCEPT"}));
+  EXPECT_FALSE(IptablesBatch::CanBatch({"-S", "OUTPUT"}));
+  EXPECT_FALSE(IptablesBatch::CanBatch(
+      {"-A", "OUTPUT", "-m", "comment", "--comment", "a\"b", "-j", "ACCEPT"}));
+  EXPECT_FALSE(IptablesBatch::CanBatch({"-A", "OUTPUT", "-i", "a\nb"}));
+}
+
+TEST(IptablesBatchTest, Empty) {
+  IptablesBatch batch;
+  EXPECT_TRUE(batch.empty());
+  EXPECT_THAT(batch.GetTables(), IsEmpty());
+  EXPECT_THAT(batch.GetCommands("filter"), IsEmpty());
+}
+
+TEST(IptablesBatchTest, GetTables) {
+  IptablesBatch batch;
+  batch.Add("mangle", {"-N", "chain", "-w"});
+  batch.Add("filter", {"-A", "FORWARD", "-j", "ACCEPT", "-w"});
+  batch.Add("mangle", {"-A", "OUTPUT", "-j", "chain", "-w"});
+
+  EXPECT_FALSE(batch.empty());
+  EXPECT_THAT(batch.GetTables(), ElementsAre("mangle", "filter"));
+  EXPECT_THAT(batch.GetCommands("mangle"),
+              ElementsAre(ElementsAre("-N", "chain", "-w"),
+                          ElementsAre("-A", "OUTPUT", "-j", "chain", "-w")));
+  EXPECT_THAT(batch.GetCommands("filter"),
+              ElementsAre(ElementsAre("-A", "FORWARD", "-j", "ACCEPT", "-w")));
+
+  batch.Clear();
+  EXPECT_TRUE(batch.empty());
+  EXPECT_THAT(batch.GetTables(), IsEmpty());
+}
+
+TEST(IptablesBatchTest, GetRestoreInput) {
+  IptablesBatch batch;
+  batch.Add("mangle", {"-N", "chain", "-w"});
+  batch.Add("nat", {"-A", "POSTROUTING", "-j", "MASQUERADE", "-w"});
+  batch.Add("mangle", {"-A", "chain", "-m", "mark", "!", "--mark",
+                       "0x0/0x00003f00", "-j", "RETURN", "--wait"});
+  batch.Add("mangle", {"-A", "chain", "-m", "comment", "--comment",
+                       "two words", "-j", "ACCEPT"});
+
+  EXPECT_EQ(batch.GetRestoreInput("mangle"),
+            "*mangle\n"
+            "-N chain\n"
+            "-A chain -m mark ! --mark 0x0/0x00003f00 -j RETURN\n"
+            "-A chain -m comment --comment \"two words\" -j ACCEPT\n"
+            "COMMIT\n");
+  EXPECT_EQ(batch.GetRestoreInput("nat"),
+            "*nat\n"
+            "-A POSTROUTING -j MASQUERADE\n"
+            "COMMIT\n");
+}
+
+}  // namespace
+}  // namespace patchpanel
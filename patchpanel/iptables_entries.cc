@@ -0,0 +1,215 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "patchpanel/iptables_entries.h"
+
+// The libc definitions must come first to prevent the uapi headers from
+// redefining them.
+#include <netinet/in.h>
+
+#include <errno.h>
+#include <linux/netfilter/x_tables.h>
+#include <linux/netfilter/xt_mark.h>
+#include <linux/netfilter_ipv4/ip_tables.h>
+#include <linux/netfilter_ipv6/ip6_tables.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <utility>
+
+#include <base/check.h>
+#include <base/files/scoped_file.h>
+#include <base/logging.h>
+
+namespace patchpanel {
+
+namespace {
+
+constexpr char kMarkMatch[] = "mark";
+// The ruleset can change between reading its size and reading its entries.
+constexpr int kGetEntriesAttempts = 3;
+
+// Returns the name of an extension, which is not NUL-terminated if it has the
+// maximum length.
+template <size_t N>
+std::string GetExtensionName(const char (&name)[N]) {
+  return std::string(name, strnlen(name, N));
+}
+
+// Parses the matches of a rule, which are |size| bytes at |data|. The
+// structures are copied out of |data| since it may not be aligned.
+bool ParseMatches(const char* data, size_t size, IptablesRule* rule) {
+  size_t offset = 0;
+  while (offset < size) {
+    struct xt_entry_match match;
+    if (size - offset < sizeof(match))
+      return false;
+    memcpy(&match, data + offset, sizeof(match));
+    const size_t match_size = match.u.user.match_size;
+    if (match_size < sizeof(match) || match_size > size - offset)
+      return false;
+
+    rule->match_count++;
+    struct xt_mark_mtinfo1 mark_info;
+    if (GetExtensionName(match.u.user.name) == kMarkMatch &&
+        match.u.user.revision == 1 &&
+        match_size - sizeof(match) >= sizeof(mark_info)) {
+      memcpy(&mark_info, data + offset + sizeof(match), sizeof(mark_info));
+      if (!mark_info.invert) {
+        rule->has_mark = true;
+        rule->mark = mark_info.mark;
+        rule->mask = mark_info.mask;
+      }
+    }
+    offset += match_size;
+  }
+  return true;
+}
+
+// |Entry| is ipt_entry or ip6t_entry, which only differ by their IP header
+// criteria.
+template <typename Entry>
+bool ParseEntries(const std::string& entries,
+                  std::vector<IptablesRule>* rules) {
+  const char* data = entries.data();
+  const size_t size = entries.size();
+
+  // The builtin chains come first. Each user-defined chain then starts with an
+  // ERROR entry named after the chain and ends with a RETURN rule, and the
+  // table ends with an ERROR entry named "ERROR".
+  bool in_chain = false;
+  bool ended = false;
+  std::string chain;
+  size_t chain_start = rules->size();
+  size_t offset = 0;
+  while (offset < size && !ended) {
+    Entry entry;
+    if (size - offset < sizeof(entry))
+      return false;
+    memcpy(&entry, data + offset, sizeof(entry));
+    const size_t entry_size = entry.next_offset;
+    const size_t target_offset = entry.target_offset;
+    if (target_offset < sizeof(entry) || target_offset > entry_size ||
+        entry_size > size - offset) {
+      return false;
+    }
+
+    struct xt_entry_target target;
+    if (entry_size - target_offset < sizeof(target))
+      return false;
+    memcpy(&target, data + offset + target_offset, sizeof(target));
+    const size_t target_size = target.u.user.target_size;
+    if (target_size < sizeof(target) ||
+        target_size > entry_size - target_offset) {
+      return false;
+    }
+
+    if (GetExtensionName(target.u.user.name) == XT_ERROR_TARGET) {
+      if (in_chain) {
+        // Drops the RETURN rule ending the previous chain.
+        if (rules->size() == chain_start)
+          return false;
+        rules->pop_back();
+      }
+      const char* name = data + offset + target_offset + sizeof(target);
+      chain = std::string(name, strnlen(name, target_size - sizeof(target)));
+      ended = chain == XT_ERROR_TARGET;
+      in_chain = !ended;
+      chain_start = rules->size();
+    } else if (in_chain) {
+      IptablesRule rule;
+      rule.chain = chain;
+      rule.packets = entry.counters.pcnt;
+      rule.bytes = entry.counters.bcnt;
+      if (!ParseMatches(data + offset + sizeof(entry),
+                        target_offset - sizeof(entry), &rule)) {
+        return false;
+      }
+      rules->push_back(std::move(rule));
+    }
+    offset += entry_size;
+  }
+  return ended;
+}
+
+// |GetInfo| and |GetEntries| are the getsockopt() structures of ip_tables or
+// ip6_tables, which are read with options |info_opt| and |entries_opt| at
+// |level|.
+template <typename GetInfo, typename GetEntries>
+std::string ReadEntries(int domain,
+                        int level,
+                        int info_opt,
+                        int entries_opt,
+                        const std::string& table) {
+  GetInfo info = {};
+  if (table.size() >= sizeof(info.name)) {
+    LOG(ERROR) << "Invalid iptables table name " << table;
+    return "";
+  }
+
+  base::ScopedFD fd(socket(domain, SOCK_RAW | SOCK_CLOEXEC, IPPROTO_RAW));
+  if (!fd.is_valid()) {
+    PLOG(ERROR) << "Failed to create socket for reading iptables " << table;
+    return "";
+  }
+
+  for (int i = 0; i < kGetEntriesAttempts; i++) {
+    memcpy(info.name, table.c_str(), table.size() + 1);
+    socklen_t len = sizeof(info);
+    if (getsockopt(fd.get(), level, info_opt, &info, &len) != 0) {
+      PLOG(ERROR) << "Failed to get the info of iptables " << table;
+      return "";
+    }
+
+    const size_t header_size = offsetof(GetEntries, entrytable);
+    std::vector<char> buffer(header_size + info.size);
+    GetEntries* entries = reinterpret_cast<GetEntries*>(buffer.data());
+    memcpy(entries->name, table.c_str(), table.size() + 1);
+    entries->size = info.size;
+    len = buffer.size();
+    if (getsockopt(fd.get(), level, entries_opt, entries, &len) == 0)
+      return std::string(buffer.data() + header_size, info.size);
+
+    // EAGAIN means that the ruleset changed since the info was read.
+    if (errno != EAGAIN) {
+      PLOG(ERROR) << "Failed to get the entries of iptables " << table;
+      return "";
+    }
+  }
+  LOG(ERROR) << "iptables " << table << " kept changing while being read";
+  return "";
+}
+
+}  // namespace
+
+std::string GetIptablesEntries(sa_family_t family, const std::string& table) {
+  switch (family) {
+    case AF_INET:
+      return ReadEntries<struct ipt_getinfo, struct ipt_get_entries>(
+          AF_INET, IPPROTO_IP, IPT_SO_GET_INFO, IPT_SO_GET_ENTRIES, table);
+    case AF_INET6:
+      return ReadEntries<struct ip6t_getinfo, struct ip6t_get_entries>(
+          AF_INET6, IPPROTO_IPV6, IP6T_SO_GET_INFO, IP6T_SO_GET_ENTRIES,
+          table);
+    default:
+      return "";
+  }
+}
+
+bool ParseIptablesEntries(sa_family_t family,
+                          const std::string& entries,
+                          std::vector<IptablesRule>* rules) {
+  DCHECK(rules);
+  switch (family) {
+    case AF_INET:
+      return ParseEntries<struct ipt_entry>(entries, rules);
+    case AF_INET6:
+      return ParseEntries<struct ip6t_entry>(entries, rules);
+    default:
+      return false;
+  }
+}
+
+}  // namespace patchpanel
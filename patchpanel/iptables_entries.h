@@ -0,0 +1,49 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef PATCHPANEL_IPTABLES_ENTRIES_H_
+#define PATCHPANEL_IPTABLES_ENTRIES_H_
+
+#include <sys/socket.h>
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace patchpanel {
+
+// A rule of a user-defined iptables chain with its counters.
+struct IptablesRule {
+  std::string chain;
+  // The number of matches of the rule, not counting the IP header criteria.
+  int match_count = 0;
+  // True if the rule has a non-inverted "mark" match, with the fwmark value
+  // |mark| and mask |mask|.
+  bool has_mark = false;
+  uint32_t mark = 0;
+  uint32_t mask = 0;
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+};
+
+// Reads the rules of the table |table| with their counters from the kernel,
+// for |family| AF_INET or AF_INET6. This is the ruleset which "iptables -L"
+// reads, so the counters can be obtained without running iptables. Returns an
+// empty string on failure, for instance if the table is only managed through
+// nftables.
+std::string GetIptablesEntries(sa_family_t family, const std::string& table);
+
+// Parses the rules of the user-defined chains of a table read by
+// GetIptablesEntries() for |family|, which is in the format of the
+// IPT_SO_GET_ENTRIES or IP6T_SO_GET_ENTRIES socket options. The rules of the
+// builtin chains and the implicit RETURN rule ending each user-defined chain
+// are not included. Returns false if |entries| is malformed.
+bool ParseIptablesEntries(sa_family_t family,
+                          const std::string& entries,
+                          std::vector<IptablesRule>* rules);
+
+}  // namespace patchpanel
+
+#endif  // PATCHPANEL_IPTABLES_ENTRIES_H_
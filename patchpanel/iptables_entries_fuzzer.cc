@@ -0,0 +1,39 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <sys/socket.h>
+
+#include <string>
+#include <vector>
+
+#include <base/at_exit.h>
+#include <base/logging.h>
+
+#include "patchpanel/iptables_entries.h"
+
+namespace patchpanel {
+namespace {
+
+class Environment {
+ public:
+  Environment() {
+    logging::SetMinLogLevel(logging::LOGGING_FATAL);  // <- DISABLE LOGGING.
+  }
+  base::AtExitManager at_exit;
+};
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static Environment env;
+
+  const std::string entries(reinterpret_cast<const char*>(data), size);
+  std::vector<IptablesRule> rules;
+  ParseIptablesEntries(AF_INET, entries, &rules);
+  rules.clear();
+  ParseIptablesEntries(AF_INET6, entries, &rules);
+
+  return 0;
+}
+
+}  // namespace
+}  // namespace patchpanel
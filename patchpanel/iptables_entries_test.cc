@@ -0,0 +1,189 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "patchpanel/iptables_entries.h"
+
+// The libc definitions must come first to prevent the uapi headers from
+// redefining them.
+#include <netinet/in.h>
+
+#include <linux/netfilter/x_tables.h>
+#include <linux/netfilter/xt_mark.h>
+#include <linux/netfilter_ipv4/ip_tables.h>
+#include <linux/netfilter_ipv6/ip6_tables.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace patchpanel {
+namespace {
+
+void SetSize(struct xt_entry_match* match, size_t size) {
+  match->u.user.match_size = size;
+}
+
+void SetSize(struct xt_entry_target* target, size_t size) {
+  target->u.user.target_size = size;
+}
+
+// Returns an extension with header |Header| named |name|, followed by |data|
+// and padded like the kernel does.
+template <typename Header>
+std::string Extension(const std::string& name,
+                      uint8_t revision,
+                      const std::string& data) {
+  Header header = {};
+  const size_t size = XT_ALIGN(sizeof(header) + data.size());
+  SetSize(&header, size);
+  strncpy(header.u.user.name, name.c_str(), sizeof(header.u.user.name) - 1);
+  header.u.user.revision = revision;
+  std::string extension(reinterpret_cast<const char*>(&header), sizeof(header));
+  extension += data;
+  extension.resize(size);
+  return extension;
+}
+
+std::string MarkMatch(uint32_t mark, uint32_t mask, bool invert = false) {
+  struct xt_mark_mtinfo1 info = {};
+  info.mark = mark;
+  info.mask = mask;
+  info.invert = invert;
+  return Extension<struct xt_entry_match>(
+      "mark", 1,
+      std::string(reinterpret_cast<const char*>(&info), sizeof(info)));
+}
+
+std::string StandardTarget(int verdict) {
+  return Extension<struct xt_entry_target>(
+      XT_STANDARD_TARGET, 0,
+      std::string(reinterpret_cast<const char*>(&verdict), sizeof(verdict)));
+}
+
+std::string ErrorTarget(const std::string& name) {
+  std::string data = name;
+  data.resize(XT_FUNCTION_MAXNAMELEN);
+  return Extension<struct xt_entry_target>(XT_ERROR_TARGET, 0, data);
+}
+
+// |Entry| is ipt_entry or ip6t_entry.
+template <typename Entry>
+std::string MakeEntry(const std::string& matches,
+                      const std::string& target,
+                      uint64_t packets = 0,
+                      uint64_t bytes = 0) {
+  Entry entry = {};
+  entry.target_offset = sizeof(entry) + matches.size();
+  entry.next_offset = entry.target_offset + target.size();
+  entry.counters.pcnt = packets;
+  entry.counters.bcnt = bytes;
+  return std::string(reinterpret_cast<const char*>(&entry), sizeof(entry)) +
+         matches + target;
+}
+
+// Returns a table with a builtin chain and the user-defined chain "rx_eth0"
+// holding a mark rule and a catch-all rule, like CountersService sets up.
+template <typename Entry>
+std::string MakeTable() {
+  return MakeEntry<Entry>("", StandardTarget(-NF_ACCEPT - 1), 100, 10000) +
+         MakeEntry<Entry>("", ErrorTarget("rx_eth0")) +
+         MakeEntry<Entry>(MarkMatch(0x2000, 0x3f00), StandardTarget(XT_RETURN),
+                          5, 694) +
+         MakeEntry<Entry>("", StandardTarget(XT_RETURN), 6, 345) +
+         MakeEntry<Entry>("", StandardTarget(XT_RETURN), 1, 1) +
+         MakeEntry<Entry>("", ErrorTarget(XT_ERROR_TARGET));
+}
+
+template <typename Entry>
+void TestParseTable(sa_family_t family) {
+  std::vector<IptablesRule> rules;
+  ASSERT_TRUE(ParseIptablesEntries(family, MakeTable<Entry>(), &rules));
+  ASSERT_EQ(rules.size(), 2u);
+
+  EXPECT_EQ(rules[0].chain, "rx_eth0");
+  EXPECT_EQ(rules[0].match_count, 1);
+  EXPECT_TRUE(rules[0].has_mark);
+  EXPECT_EQ(rules[0].mark, 0x2000u);
+  EXPECT_EQ(rules[0].mask, 0x3f00u);
+  EXPECT_EQ(rules[0].packets, 5u);
+  EXPECT_EQ(rules[0].bytes, 694u);
+
+  EXPECT_EQ(rules[1].chain, "rx_eth0");
+  EXPECT_EQ(rules[1].match_count, 0);
+  EXPECT_FALSE(rules[1].has_mark);
+  EXPECT_EQ(rules[1].packets, 6u);
+  EXPECT_EQ(rules[1].bytes, 345u);
+}
+
+TEST(IptablesEntriesTest, ParseIPv4) {
+  TestParseTable<struct ipt_entry>(AF_INET);
+}
+
+TEST(IptablesEntriesTest, ParseIPv6) {
+  TestParseTable<struct ip6t_entry>(AF_INET6);
+}
+
+TEST(IptablesEntriesTest, ParseInvertedMark) {
+  const std::string table =
+      MakeEntry<struct ipt_entry>("", ErrorTarget("tx_eth0")) +
+      MakeEntry<struct ipt_entry>(MarkMatch(0x2000, 0x3f00, true /*invert*/),
+                                  StandardTarget(XT_RETURN), 1, 2) +
+      MakeEntry<struct ipt_entry>("", StandardTarget(XT_RETURN)) +
+      MakeEntry<struct ipt_entry>("", ErrorTarget(XT_ERROR_TARGET));
+
+  std::vector<IptablesRule> rules;
+  ASSERT_TRUE(ParseIptablesEntries(AF_INET, table, &rules));
+  ASSERT_EQ(rules.size(), 1u);
+  EXPECT_EQ(rules[0].chain, "tx_eth0");
+  EXPECT_EQ(rules[0].match_count, 1);
+  EXPECT_FALSE(rules[0].has_mark);
+}
+
+TEST(IptablesEntriesTest, ParseEmptyTable) {
+  std::vector<IptablesRule> rules;
+  EXPECT_TRUE(ParseIptablesEntries(
+      AF_INET, MakeEntry<struct ipt_entry>("", ErrorTarget(XT_ERROR_TARGET)),
+      &rules));
+  EXPECT_TRUE(rules.empty());
+}
+
+TEST(IptablesEntriesTest, ParseMalformed) {
+  const std::string table = MakeTable<struct ipt_entry>();
+  std::vector<IptablesRule> rules;
+
+  // No entries, or a table without the final ERROR entry.
+  EXPECT_FALSE(ParseIptablesEntries(AF_INET, "", &rules));
+  EXPECT_FALSE(ParseIptablesEntries(
+      AF_INET, MakeEntry<struct ipt_entry>("", ErrorTarget("rx_eth0")),
+      &rules));
+
+  // Truncated entries.
+  EXPECT_FALSE(
+      ParseIptablesEntries(AF_INET, table.substr(0, table.size() - 1), &rules));
+  EXPECT_FALSE(ParseIptablesEntries(AF_INET, table.substr(0, 10), &rules));
+
+  // A user-defined chain without its RETURN rule.
+  EXPECT_FALSE(ParseIptablesEntries(
+      AF_INET,
+      MakeEntry<struct ipt_entry>("", ErrorTarget("rx_eth0")) +
+          MakeEntry<struct ipt_entry>("", ErrorTarget(XT_ERROR_TARGET)),
+      &rules));
+
+  // An entry whose target is past its end.
+  std::string bad_offset = table;
+  struct ipt_entry entry;
+  memcpy(&entry, bad_offset.data(), sizeof(entry));
+  entry.target_offset = entry.next_offset + 1;
+  memcpy(&bad_offset[0], &entry, sizeof(entry));
+  EXPECT_FALSE(ParseIptablesEntries(AF_INET, bad_offset, &rules));
+
+  // IPv4 entries are not valid IPv6 entries.
+  EXPECT_FALSE(ParseIptablesEntries(AF_INET6, table, &rules));
+}
+
+}  // namespace
+}  // namespace patchpanel
@@ -4,10 +4,16 @@
 
 #include "patchpanel/minijailed_process_runner.h"
 
+#include <errno.h>
 #include <linux/capability.h>
+#include <signal.h>
+#include <time.h>
+
 #include <utility>
 
 #include <base/check.h>
+#include <base/check_op.h>
+#include <base/files/file_util.h>
 #include <base/files/scoped_file.h>
 #include <base/logging.h>
 #include <base/posix/eintr_wrapper.h>
@@ -32,6 +38,8 @@ constexpr uint64_t kNetRawAdminCapMask =
 constexpr char kIpPath[] = "/bin/ip";
 constexpr char kIptablesPath[] = "/sbin/iptables";
 constexpr char kIp6tablesPath[] = "/sbin/ip6tables";
+constexpr char kIptablesRestorePath[] = "/sbin/iptables-restore";
+constexpr char kIp6tablesRestorePath[] = "/sbin/ip6tables-restore";
 constexpr char kModprobePath[] = "/sbin/modprobe";
 
 // An empty string will be returned if read fails.
@@ -59,6 +67,30 @@ std::string ReadBlockingFDToStringAndClose(base::ScopedFD fd) {
   }
 }
 
+// Writes |input| to the pipe |fd|. SIGPIPE is blocked during the write, so
+// that a process exiting before reading all its input, like iptables-restore
+// stopping at its first bad line, makes the write fail with EPIPE instead of
+// killing patchpanel.
+bool WriteToPipe(int fd, const std::string& input) {
+  sigset_t sigpipe_set, old_set, pending_set;
+  sigemptyset(&sigpipe_set);
+  sigaddset(&sigpipe_set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipe_set, &old_set);
+  sigpending(&pending_set);
+  const bool sigpipe_was_pending = sigismember(&pending_set, SIGPIPE);
+
+  const bool success = base::WriteFileDescriptor(fd, input);
+  const int saved_errno = errno;
+  if (!success && saved_errno == EPIPE && !sigpipe_was_pending) {
+    // Consumes the SIGPIPE raised by the failed write before unblocking it.
+    const struct timespec no_wait = {};
+    HANDLE_EINTR(sigtimedwait(&sigpipe_set, nullptr, &no_wait));
+  }
+  pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+  errno = saved_errno;
+  return success;
+}
+
 }  // namespace
 
 int MinijailedProcessRunner::RunSyncDestroy(
@@ -66,6 +98,7 @@ int MinijailedProcessRunner::RunSyncDestroy(
     brillo::Minijail* mj,
     minijail* jail,
     bool log_failures,
+    const std::string* input,
     std::string* output) {
   std::vector<char*> args;
   for (const auto& arg : argv) {
@@ -74,10 +107,23 @@ int MinijailedProcessRunner::RunSyncDestroy(
   args.push_back(nullptr);
 
   pid_t pid;
+  int fd_stdin = -1;
+  int* stdin_p = input ? &fd_stdin : nullptr;
   int fd_stdout = -1;
   int* stdout_p = output ? &fd_stdout : nullptr;
-  bool ran = mj->RunPipesAndDestroy(jail, args, &pid, nullptr /*stdin*/,
-                                    stdout_p, nullptr /*stderr*/);
+  bool ran = mj->RunPipesAndDestroy(jail, args, &pid, stdin_p, stdout_p,
+                                    nullptr /*stderr*/);
+  bool input_written = true;
+  if (input) {
+    // The pipe is closed once written so that the process sees the end of its
+    // input.
+    base::ScopedFD stdin_fd(fd_stdin);
+    if (ran && !WriteToPipe(stdin_fd.get(), *input)) {
+      PLOG(ERROR) << "Failed to write the input of '"
+                  << base::JoinString(argv, " ") << "'";
+      input_written = false;
+    }
+  }
   if (output) {
     *output = ReadBlockingFDToStringAndClose(base::ScopedFD(fd_stdout));
   }
@@ -101,13 +147,25 @@ int MinijailedProcessRunner::RunSyncDestroy(
                    << "' exited with unknown status " << status;
     }
   }
+  // The process did not get all its input, e.g. it exited early on an error:
+  // its exit code does not tell whether all the input was applied.
+  if (!input_written) {
+    return -1;
+  }
   return ran && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
 }
 
 int MinijailedProcessRunner::RunSync(const std::vector<std::string>& argv,
                                      bool log_failures,
                                      std::string* output) {
-  return RunSyncDestroy(argv, mj_, mj_->New(), log_failures, output);
+  return RunSyncDestroy(argv, mj_, mj_->New(), log_failures, nullptr, output);
+}
+
+int MinijailedProcessRunner::RunSyncWithInput(
+    const std::vector<std::string>& argv,
+    const std::string& input,
+    bool log_failures) {
+  return RunSyncDestroy(argv, mj_, mj_->New(), log_failures, &input, nullptr);
 }
 
 void EnterChildProcessJail() {
@@ -136,7 +194,7 @@ int MinijailedProcessRunner::Run(const std::vector<std::string>& argv,
   minijail* jail = mj_->New();
   CHECK(mj_->DropRoot(jail, kUnprivilegedUser, kUnprivilegedUser));
   mj_->UseCapabilities(jail, kNetRawAdminCapMask);
-  return RunSyncDestroy(argv, mj_, jail, log_failures, nullptr);
+  return RunSyncDestroy(argv, mj_, jail, log_failures, nullptr, nullptr);
 }
 
 int MinijailedProcessRunner::ip(const std::string& obj,
@@ -161,6 +219,9 @@ int MinijailedProcessRunner::iptables(const std::string& table,
                                       const std::vector<std::string>& argv,
                                       bool log_failures,
                                       std::string* output) {
+  if (QueueIptablesCommand(&iptables_batch_, table, argv, log_failures, output))
+    return 0;
+
   std::vector<std::string> args = {kIptablesPath, "-t", table};
   args.insert(args.end(), argv.begin(), argv.end());
   return RunSync(args, log_failures, output);
@@ -170,6 +231,11 @@ int MinijailedProcessRunner::ip6tables(const std::string& table,
                                        const std::vector<std::string>& argv,
                                        bool log_failures,
                                        std::string* output) {
+  if (QueueIptablesCommand(&ip6tables_batch_, table, argv, log_failures,
+                           output)) {
+    return 0;
+  }
+
   std::vector<std::string> args = {kIp6tablesPath, "-t", table};
   args.insert(args.end(), argv.begin(), argv.end());
   return RunSync(args, log_failures, output);
@@ -182,7 +248,7 @@ int MinijailedProcessRunner::modprobe_all(
   mj_->UseCapabilities(jail, kModprobeCapMask);
   std::vector<std::string> args = {kModprobePath, "-a"};
   args.insert(args.end(), modules.begin(), modules.end());
-  return RunSyncDestroy(args, mj_, jail, log_failures, nullptr);
+  return RunSyncDestroy(args, mj_, jail, log_failures, nullptr, nullptr);
 }
 
 int MinijailedProcessRunner::ip_netns_add(const std::string& netns_name,
@@ -205,4 +271,71 @@ int MinijailedProcessRunner::ip_netns_delete(const std::string& netns_name,
   return RunSync(args, log_failures, nullptr);
 }
 
+void MinijailedProcessRunner::StartIptablesBatch() {
+  iptables_batch_depth_++;
+}
+
+IptablesBatchResult MinijailedProcessRunner::CommitIptablesBatch() {
+  DCHECK_GT(iptables_batch_depth_, 0);
+  if (--iptables_batch_depth_ > 0)
+    return IptablesBatchResult::kDeferred;
+
+  return ApplyIptablesBatches() ? IptablesBatchResult::kApplied
+                                : IptablesBatchResult::kFailed;
+}
+
+bool MinijailedProcessRunner::QueueIptablesCommand(
+    IptablesBatch* batch,
+    const std::string& table,
+    const std::vector<std::string>& argv,
+    bool log_failures,
+    std::string* output) {
+  if (iptables_batch_depth_ == 0)
+    return false;
+
+  if (log_failures && !output && IptablesBatch::CanBatch(argv)) {
+    batch->Add(table, argv);
+    return true;
+  }
+
+  // The command must see the ruleset with the queued commands applied.
+  ApplyIptablesBatches();
+  return false;
+}
+
+bool MinijailedProcessRunner::ApplyIptablesBatches() {
+  bool success =
+      ApplyIptablesBatch(kIptablesRestorePath, kIptablesPath, &iptables_batch_);
+  success &= ApplyIptablesBatch(kIp6tablesRestorePath, kIp6tablesPath,
+                                &ip6tables_batch_);
+  return success;
+}
+
+bool MinijailedProcessRunner::ApplyIptablesBatch(
+    const std::string& restore_path,
+    const std::string& iptables_path,
+    IptablesBatch* batch) {
+  bool success = true;
+  for (const auto& table : batch->GetTables()) {
+    if (RunSyncWithInput({restore_path, "--noflush", "-w"},
+                         batch->GetRestoreInput(table),
+                         true /*log_failures*/) == 0) {
+      continue;
+    }
+
+    // iptables-restore commits a table atomically: replays the commands one
+    // by one so that only the failing ones are lost, as without batching.
+    LOG(WARNING) << "Failed to restore " << table << " table with "
+                 << restore_path << ", running the commands one by one";
+    for (const auto& argv : batch->GetCommands(table)) {
+      std::vector<std::string> args = {iptables_path, "-t", table};
+      args.insert(args.end(), argv.begin(), argv.end());
+      if (RunSync(args, true /*log_failures*/, nullptr) != 0)
+        success = false;
+    }
+  }
+  batch->Clear();
+  return success;
+}
+
 }  // namespace patchpanel
@@ -13,6 +13,7 @@
 
 #include <brillo/minijail/minijail.h>
 
+#include "patchpanel/iptables_batch.h"
 #include "patchpanel/system.h"
 
 namespace patchpanel {
@@ -22,6 +23,17 @@ namespace patchpanel {
 // patchpaneld user.
 void EnterChildProcessJail();
 
+// Result of MinijailedProcessRunner::CommitIptablesBatch().
+enum class IptablesBatchResult {
+  // All the queued commands were applied.
+  kApplied,
+  // Some of the queued commands failed.
+  kFailed,
+  // The batch is nested in another one, which applies the queued commands and
+  // reports their failures when it is committed.
+  kDeferred,
+};
+
 // Enforces the expected processes are run with the correct privileges.
 class MinijailedProcessRunner {
  public:
@@ -46,7 +58,9 @@ class MinijailedProcessRunner {
                   bool log_failures = true);
 
   // Runs iptables. If |output| is not nullptr, it will be filled with the
-  // result from stdout of iptables command.
+  // result from stdout of iptables command. Inside an iptables batch, commands
+  // which modify the ruleset are queued and return 0, and their failures are
+  // reported by the outermost CommitIptablesBatch(), see StartIptablesBatch().
   virtual int iptables(const std::string& table,
                        const std::vector<std::string>& argv,
                        bool log_failures = true,
@@ -75,6 +89,20 @@ class MinijailedProcessRunner {
   virtual int ip_netns_delete(const std::string& netns_name,
                               bool log_failures = true);
 
+  // Starts queueing the iptables() and ip6tables() commands which modify rules
+  // or chains until the matching CommitIptablesBatch() call. Commands with
+  // |log_failures| false are expected to fail sometimes and are not queued,
+  // nor are commands with |output|: they first apply the queued commands and
+  // then run as usual. Batches can be nested, the outermost one applies the
+  // commands.
+  void StartIptablesBatch();
+  // Applies the queued commands with one iptables-restore or
+  // ip6tables-restore transaction per table. If a transaction fails, none of
+  // its commands is applied and they are run one by one instead. Returns
+  // kFailed if any of the commands failed, or kDeferred without applying
+  // anything if the batch is nested.
+  IptablesBatchResult CommitIptablesBatch();
+
  protected:
   // Runs a process (argv[0]) with optional arguments (argv[1]...)
   // in a minijail as an unprivileged user with CAP_NET_ADMIN and
@@ -88,15 +116,42 @@ class MinijailedProcessRunner {
                       bool log_failures,
                       std::string* output);
 
+  // Invokes RunSyncDestroy() with |mj_|, writing |input| to the stdin of the
+  // process.
+  virtual int RunSyncWithInput(const std::vector<std::string>& argv,
+                               const std::string& input,
+                               bool log_failures);
+
  private:
   int RunSyncDestroy(const std::vector<std::string>& argv,
                      brillo::Minijail* mj,
                      minijail* jail,
                      bool log_failures,
+                     const std::string* input,
                      std::string* output);
 
+  // Queues the command if an iptables batch is started and the command can
+  // be batched, and returns true. Otherwise applies the queued commands first
+  // and returns false.
+  bool QueueIptablesCommand(IptablesBatch* batch,
+                            const std::string& table,
+                            const std::vector<std::string>& argv,
+                            bool log_failures,
+                            std::string* output);
+  // Applies the commands queued for both IP families.
+  bool ApplyIptablesBatches();
+  // Applies the commands of |batch| with |restore_path|, or |iptables_path|
+  // for the tables which fail to restore.
+  bool ApplyIptablesBatch(const std::string& restore_path,
+                          const std::string& iptables_path,
+                          IptablesBatch* batch);
+
   brillo::Minijail* mj_;
   std::unique_ptr<System> system_;
+
+  int iptables_batch_depth_ = 0;
+  IptablesBatch iptables_batch_;
+  IptablesBatch ip6tables_batch_;
 };
 
 }  // namespace patchpanel
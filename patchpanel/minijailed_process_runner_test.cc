@@ -6,6 +6,7 @@
 
 #include <linux/capability.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <memory>
 
@@ -147,5 +148,80 @@ TEST(MinijailProcessRunnerTest, ip6tables) {
   EXPECT_TRUE(runner.ip6tables("table", {"arg1", "arg2"}));
 }
 
+TEST(MinijailProcessRunnerTest, IptablesBatchRestoreExitsEarly) {
+  brillo::MockMinijail mj;
+  auto system = new MockSystem();
+  MinijailedProcessRunner runner(&mj, std::unique_ptr<System>(system));
+
+  // iptables-restore exits without reading its input: writing it fails with
+  // EPIPE, which must neither kill the process nor count as a success.
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  close(fds[0]);
+  pid_t pid = 123;
+  EXPECT_CALL(mj, New()).Times(2);
+  EXPECT_CALL(mj, RunPipesAndDestroy(
+                      _,
+                      ElementsAre(StrEq("/sbin/iptables-restore"),
+                                  StrEq("--noflush"), StrEq("-w"), nullptr),
+                      _, _, nullptr, nullptr))
+      .WillOnce(DoAll(SetArgPointee<2>(pid), SetArgPointee<3>(fds[1]),
+                      Return(true)));
+  // The batched command is then run on its own.
+  EXPECT_CALL(mj, RunPipesAndDestroy(
+                      _,
+                      ElementsAre(StrEq("/sbin/iptables"), StrEq("-t"),
+                                  StrEq("filter"), StrEq("-A"), StrEq("INPUT"),
+                                  StrEq("-j"), StrEq("ACCEPT"), StrEq("-w"),
+                                  nullptr),
+                      _, nullptr, nullptr, nullptr))
+      .WillOnce(DoAll(SetArgPointee<2>(pid), Return(true)));
+  EXPECT_CALL(*system, WaitPid(pid, _, _))
+      .Times(2)
+      .WillRepeatedly(DoAll(SetArgPointee<1>(0), Return(pid)));
+
+  runner.StartIptablesBatch();
+  EXPECT_EQ(0,
+            runner.iptables("filter", {"-A", "INPUT", "-j", "ACCEPT", "-w"}));
+  EXPECT_EQ(IptablesBatchResult::kApplied, runner.CommitIptablesBatch());
+}
+
+TEST(MinijailProcessRunnerTest, NestedIptablesBatch) {
+  brillo::MockMinijail mj;
+  auto system = new MockSystem();
+  MinijailedProcessRunner runner(&mj, std::unique_ptr<System>(system));
+
+  // The nested batch applies nothing, so its result is not known yet.
+  EXPECT_CALL(mj, New()).Times(0);
+  runner.StartIptablesBatch();
+  runner.StartIptablesBatch();
+  EXPECT_EQ(0,
+            runner.iptables("filter", {"-A", "INPUT", "-j", "ACCEPT", "-w"}));
+  EXPECT_EQ(IptablesBatchResult::kDeferred, runner.CommitIptablesBatch());
+  testing::Mock::VerifyAndClearExpectations(&mj);
+
+  // The outermost batch applies the command queued in the nested one, and
+  // reports its failure.
+  pid_t pid = 123;
+  EXPECT_CALL(mj, New()).Times(2);
+  EXPECT_CALL(mj, RunPipesAndDestroy(
+                      _,
+                      ElementsAre(StrEq("/sbin/iptables-restore"),
+                                  StrEq("--noflush"), StrEq("-w"), nullptr),
+                      _, _, nullptr, nullptr))
+      .WillOnce(Return(false));
+  EXPECT_CALL(mj, RunPipesAndDestroy(
+                      _,
+                      ElementsAre(StrEq("/sbin/iptables"), StrEq("-t"),
+                                  StrEq("filter"), StrEq("-A"), StrEq("INPUT"),
+                                  StrEq("-j"), StrEq("ACCEPT"), StrEq("-w"),
+                                  nullptr),
+                      _, nullptr, nullptr, nullptr))
+      .WillOnce(DoAll(SetArgPointee<2>(pid), Return(true)));
+  EXPECT_CALL(*system, WaitPid(pid, _, _))
+      .WillOnce(DoAll(SetArgPointee<1>(1), Return(pid)));
+  EXPECT_EQ(IptablesBatchResult::kFailed, runner.CommitIptablesBatch());
+}
+
 }  // namespace
 }  // namespace patchpanel
@@ -73,6 +73,8 @@ class MockDatapath : public Datapath {
                bool(const std::string& ifname, const bool enable));
   MOCK_METHOD2(DumpIptables,
                std::string(IpFamily family, const std::string& table));
+  MOCK_METHOD2(DumpIptablesEntries,
+               std::string(IpFamily family, const std::string& table));
   MOCK_METHOD1(ModprobeAll, bool(const std::vector<std::string>& modules));
   MOCK_METHOD2(AddInboundIPv4DNAT,
                void(const std::string& ifname, const std::string& ipv4_addr));
@@ -91,6 +93,8 @@ class MockDatapath : public Datapath {
                     const std::string& table,
                     const std::vector<std::string>& argv,
                     bool log_failures));
+  MOCK_METHOD0(StartIptablesBatch, void());
+  MOCK_METHOD0(CommitIptablesBatch, IptablesBatchResult());
 };
 
 }  // namespace patchpanel
@@ -17,6 +17,7 @@
 
 #include <base/bind.h>
 #include <base/check.h>
+#include <base/check_op.h>
 #include <base/logging.h>
 
 #include "patchpanel/dns/dns_protocol.h"
@@ -285,44 +286,57 @@ void MulticastForwarder::OnFileCanReadWithoutBlocking(int fd,
                                                       sa_family_t sa_family) {
   CHECK(sa_family == AF_INET || sa_family == AF_INET6);
 
-  char data[kBufSize];
-
-  struct sockaddr_storage fromaddr_storage = {0};
-  struct sockaddr* fromaddr =
-      reinterpret_cast<struct sockaddr*>(&fromaddr_storage);
-
-  socklen_t addrlen = sizeof(struct sockaddr_storage);
-
-  ssize_t len = Receive(fd, data, kBufSize, fromaddr, &addrlen);
-  if (len < 0) {
-    // Ignore ENETDOWN: this can happen if the interface is not yet configured
-    if (errno != ENETDOWN) {
-      PLOG(WARNING) << "recvfrom failed";
+  // Drains up to kBatchSize datagrams per wakeup so that chatty protocols do
+  // not cost one wakeup and one sendto() per guest for each datagram.
+  char data[kBatchSize][kBufSize];
+  struct sockaddr_storage fromaddrs[kBatchSize];
+  struct iovec iovs[kBatchSize];
+  struct mmsghdr msgs[kBatchSize];
+  memset(msgs, 0, sizeof(msgs));
+  for (unsigned int i = 0; i < kBatchSize; i++) {
+    iovs[i].iov_base = data[i];
+    iovs[i].iov_len = kBufSize;
+    msgs[i].msg_hdr.msg_name = &fromaddrs[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(fromaddrs[i]);
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int count = Receive(fd, msgs, kBatchSize);
+  if (count < 0) {
+    // Ignore ENETDOWN: this can happen if the interface is not yet configured.
+    // Ignore EAGAIN: the datagrams were already read.
+    if (errno != ENETDOWN && errno != EAGAIN) {
+      PLOG(WARNING) << "recvmmsg failed";
     }
     return;
   }
 
   socklen_t expectlen = sa_family == AF_INET ? sizeof(struct sockaddr_in)
                                              : sizeof(struct sockaddr_in6);
-  if (addrlen != expectlen) {
-    LOG(WARNING) << "recvfrom failed: src addr length was " << addrlen
-                 << " but expected " << expectlen;
-    return;
+
+  // The datagrams to forward, which point into |data|, and their sources.
+  struct iovec packets[kBatchSize];
+  const struct sockaddr* packet_fromaddrs[kBatchSize];
+  unsigned int packet_count = 0;
+  for (int i = 0; i < count; i++) {
+    socklen_t addrlen = msgs[i].msg_hdr.msg_namelen;
+    if (addrlen != expectlen) {
+      LOG(WARNING) << "recvmmsg failed: src addr length was " << addrlen
+                   << " but expected " << expectlen;
+      continue;
+    }
+    packets[packet_count].iov_base = data[i];
+    packets[packet_count].iov_len = msgs[i].msg_len;
+    packet_fromaddrs[packet_count] =
+        reinterpret_cast<const struct sockaddr*>(&fromaddrs[i]);
+    packet_count++;
   }
+  if (packet_count == 0)
+    return;
 
   struct sockaddr_storage dst_storage = {0};
   struct sockaddr* dst = reinterpret_cast<struct sockaddr*>(&dst_storage);
-  uint16_t src_port;
-
-  if (sa_family == AF_INET) {
-    const struct sockaddr_in* addr4 =
-        reinterpret_cast<const struct sockaddr_in*>(fromaddr);
-    src_port = ntohs(addr4->sin_port);
-  } else if (sa_family == AF_INET6) {
-    const struct sockaddr_in6* addr6 =
-        reinterpret_cast<const struct sockaddr_in6*>(fromaddr);
-    src_port = ntohs(addr6->sin6_port);
-  }
   SetSockaddr(&dst_storage, sa_family, port_,
               sa_family == AF_INET ? reinterpret_cast<char*>(&mcast_addr_)
                                    : reinterpret_cast<char*>(&mcast_addr6_));
@@ -330,7 +344,7 @@ void MulticastForwarder::OnFileCanReadWithoutBlocking(int fd,
   // Forward ingress traffic to all guests.
   const auto& lan_socket = lan_socket_.find(sa_family);
   if ((lan_socket != lan_socket_.end() && fd == lan_socket->second->fd.get())) {
-    SendToGuests(data, len, dst, addrlen);
+    SendToGuests(packets, packet_count, dst, expectlen);
     return;
   }
 
@@ -340,30 +354,47 @@ void MulticastForwarder::OnFileCanReadWithoutBlocking(int fd,
 
   // Forward egress traffic from one guest to all other guests.
   // No IP translation is required as other guests can route to each other
-  // behind the SNAT setup.
-  SendToGuests(data, len, dst, addrlen, fd);
+  // behind the SNAT setup. This must happen before the datagrams are
+  // translated in place below.
+  SendToGuests(packets, packet_count, dst, expectlen, fd);
 
   // On mDNS, sending to physical network requires translating any IPv4
   // address specific to the guest and not visible to the physical network.
-  if (sa_family == AF_INET && port_ == kMdnsPort) {
+  const bool translate = sa_family == AF_INET && port_ == kMdnsPort;
+  struct in_addr lan_ip = {0};
+  if (translate) {
     // TODO(b/132574450) The replacement address should instead be specified
     // as an input argument, based on the properties of the network
     // currently connected on |lan_ifname_|.
-    const struct in_addr lan_ip =
-        GetInterfaceIp(lan_socket->second->fd.get(), lan_ifname_);
+    lan_ip = GetInterfaceIp(lan_socket->second->fd.get(), lan_ifname_);
     if (lan_ip.s_addr == htonl(INADDR_ANY)) {
       // When the physical interface has no IPv4 address, IPv4 is not
       // provisioned and there is no point in trying to forward traffic in
       // either direction.
       return;
     }
-    TranslateMdnsIp(
-        lan_ip, reinterpret_cast<const struct sockaddr_in*>(fromaddr)->sin_addr,
-        data, len);
   }
 
-  // Forward egress traffic from one guest to outside network.
-  SendTo(src_port, data, len, dst, addrlen);
+  for (unsigned int i = 0; i < packet_count; i++) {
+    uint16_t src_port;
+    if (sa_family == AF_INET) {
+      const struct sockaddr_in* addr4 =
+          reinterpret_cast<const struct sockaddr_in*>(packet_fromaddrs[i]);
+      src_port = ntohs(addr4->sin_port);
+      if (translate) {
+        TranslateMdnsIp(lan_ip, addr4->sin_addr,
+                        static_cast<char*>(packets[i].iov_base),
+                        packets[i].iov_len);
+      }
+    } else {
+      const struct sockaddr_in6* addr6 =
+          reinterpret_cast<const struct sockaddr_in6*>(packet_fromaddrs[i]);
+      src_port = ntohs(addr6->sin6_port);
+    }
+
+    // Forward egress traffic from one guest to outside network.
+    SendTo(src_port, packets[i].iov_base, packets[i].iov_len, dst, expectlen);
+  }
 }
 
 bool MulticastForwarder::SendTo(uint16_t src_port,
@@ -443,11 +474,21 @@ bool MulticastForwarder::SendTo(uint16_t src_port,
   return true;
 }
 
-bool MulticastForwarder::SendToGuests(const void* data,
-                                      ssize_t len,
+bool MulticastForwarder::SendToGuests(struct iovec* packets,
+                                      unsigned int count,
                                       const struct sockaddr* dst,
                                       socklen_t dst_len,
                                       int ignore_fd) {
+  DCHECK_LE(count, kBatchSize);
+  struct mmsghdr msgs[kBatchSize];
+  memset(msgs, 0, sizeof(msgs));
+  for (unsigned int i = 0; i < count; i++) {
+    msgs[i].msg_hdr.msg_name = const_cast<struct sockaddr*>(dst);
+    msgs[i].msg_hdr.msg_namelen = dst_len;
+    msgs[i].msg_hdr.msg_iov = &packets[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
   bool success = true;
   for (const auto& socket : int_sockets_) {
     if (socket.first.first != dst->sa_family)
@@ -456,10 +497,18 @@ bool MulticastForwarder::SendToGuests(const void* data,
     if (fd == ignore_fd)
       continue;
 
-    // Use already created multicast fd.
-    if (sendto(fd, data, len, 0, dst, dst_len) < 0) {
-      PLOG(WARNING) << "sendto " << socket.first.second << " failed";
-      success = false;
+    // Use already created multicast fd. sendmmsg() stops at the first
+    // datagram which cannot be sent, which is skipped.
+    unsigned int sent = 0;
+    while (sent < count) {
+      int ret = SendMessages(fd, &msgs[sent], count - sent);
+      if (ret < 0) {
+        PLOG(WARNING) << "sendmmsg " << socket.first.second << " failed";
+        success = false;
+        sent++;
+        continue;
+      }
+      sent += ret;
     }
   }
   return success;
@@ -515,11 +564,15 @@ void MulticastForwarder::TranslateMdnsIp(const struct in_addr& lan_ip,
   }
 }
 
-ssize_t MulticastForwarder::Receive(int fd,
-                                    char* buffer,
-                                    size_t buffer_size,
-                                    struct sockaddr* src_addr,
-                                    socklen_t* addrlen) {
-  return recvfrom(fd, buffer, buffer_size, 0, src_addr, addrlen);
+int MulticastForwarder::Receive(int fd,
+                                struct mmsghdr* msgs,
+                                unsigned int vlen) {
+  return recvmmsg(fd, msgs, vlen, MSG_DONTWAIT, nullptr);
+}
+
+int MulticastForwarder::SendMessages(int fd,
+                                     struct mmsghdr* msgs,
+                                     unsigned int vlen) {
+  return sendmmsg(fd, msgs, vlen, 0);
 }
 }  // namespace patchpanel
@@ -36,6 +36,10 @@ constexpr uint16_t kSsdpPort = 1900;
 // many guest interfaces.
 class MulticastForwarder {
  public:
+  // Maximum number of datagrams read at once from a socket, which are then
+  // forwarded to each guest with a single sendmmsg() call.
+  static constexpr unsigned int kBatchSize = 16;
+
   MulticastForwarder(const std::string& lan_ifname,
                      uint32_t mcast_addr,
                      const std::string& mcast_addr6,
@@ -89,21 +93,23 @@ class MulticastForwarder {
                       const struct sockaddr* dst,
                       socklen_t dst_len);
 
-  // SendToGuests will forward packet to all Chrome OS guests' (ARC++,
-  // Crostini, etc) internal fd using |port|.
+  // SendToGuests will forward the |count| packets of |packets| to all Chrome
+  // OS guests' (ARC++, Crostini, etc) internal fd using |port|, with one
+  // sendmmsg() call per guest. |count| must not exceed kBatchSize.
   // However, if ignore_fd is not 0, it will skip guest with fd = ignore_fd.
-  virtual bool SendToGuests(const void* data,
-                            ssize_t len,
+  virtual bool SendToGuests(struct iovec* packets,
+                            unsigned int count,
                             const struct sockaddr* dst,
                             socklen_t dst_len,
                             int ignore_fd = -1);
 
-  // Wrapper around libc recvfrom, allowing override in fuzzer tests.
-  virtual ssize_t Receive(int fd,
-                          char* buffer,
-                          size_t buffer_size,
-                          struct sockaddr* src_addr,
-                          socklen_t* addrlen);
+  // Wrapper around libc recvmmsg, allowing override in fuzzer tests. Receives
+  // up to |vlen| datagrams into |msgs| without blocking and returns their
+  // number, or -1 on failure.
+  virtual int Receive(int fd, struct mmsghdr* msgs, unsigned int vlen);
+
+  // Wrapper around libc sendmmsg, allowing override in tests.
+  virtual int SendMessages(int fd, struct mmsghdr* msgs, unsigned int vlen);
 
   virtual std::unique_ptr<Socket> CreateSocket(base::ScopedFD fd,
                                                sa_family_t family);
@@ -0,0 +1,234 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures forwarding SSDP datagrams received on a LAN interface to guest
+// interfaces with MulticastForwarder, reading the datagrams one at a time as
+// with recvfrom() or in batches of MulticastForwarder::kBatchSize. The LAN and
+// guest interfaces are local veth pairs created by the benchmark, which must
+// run with CAP_NET_ADMIN and CAP_SYS_ADMIN. The datagrams are sent from the
+// peer of the LAN interface in a separate network namespace, so that the
+// kernel does not drop them for having a local source address.
+// Usage: multicast_forwarder_benchmark [benchmark flags]
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/at_exit.h>
+#include <base/check.h>
+#include <base/files/scoped_file.h>
+#include <base/logging.h>
+#include <base/process/launch.h>
+#include <base/strings/string_util.h>
+#include <base/strings/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+#include "patchpanel/multicast_forwarder.h"
+
+namespace patchpanel {
+
+namespace {
+
+constexpr char kNetns[] = "ppbench";
+constexpr char kLanIfname[] = "ppbench_lan";
+constexpr char kGuestIfnameFormat[] = "ppbench_g%d";
+// The veth peer of each interface is named after it with this suffix.
+constexpr char kPeerSuffix[] = "p";
+constexpr int kMaxGuests = 8;
+// Datagrams sent per benchmark iteration.
+constexpr int kDatagrams = 64;
+// A typical SSDP NOTIFY message size.
+constexpr size_t kDatagramSize = 300;
+
+std::string GuestIfname(int index) {
+  return base::StringPrintf(kGuestIfnameFormat, index);
+}
+
+bool RunIp(const std::vector<std::string>& args, bool log_failures = true) {
+  std::vector<std::string> argv = {"ip"};
+  argv.insert(argv.end(), args.begin(), args.end());
+  std::string output;
+  if (!base::GetAppOutputAndError(argv, &output)) {
+    LOG_IF(ERROR, log_failures) << "Failed to run ip "
+                                << base::JoinString(args, " ") << ": "
+                                << output;
+    return false;
+  }
+  return true;
+}
+
+// Creates the veth pair |ifname| with the address 10.|subnet|.0.1/24.
+bool CreateVethPair(const std::string& ifname, int subnet) {
+  const std::string peer = ifname + kPeerSuffix;
+  return RunIp({"link", "add", ifname, "type", "veth", "peer", "name", peer}) &&
+         RunIp({"addr", "add", base::StringPrintf("10.%d.0.1/24", subnet),
+                "dev", ifname}) &&
+         RunIp({"link", "set", ifname, "up"}) &&
+         RunIp({"link", "set", peer, "up"});
+}
+
+void DeleteInterfaces() {
+  // Deleting one side of a veth pair deletes its peer.
+  RunIp({"link", "del", kLanIfname}, false /* log_failures */);
+  for (int i = 0; i < kMaxGuests; i++)
+    RunIp({"link", "del", GuestIfname(i)}, false /* log_failures */);
+  RunIp({"netns", "del", kNetns}, false /* log_failures */);
+}
+
+bool CreateInterfaces() {
+  const std::string lan_peer = std::string(kLanIfname) + kPeerSuffix;
+  if (!CreateVethPair(kLanIfname, 200) || !RunIp({"netns", "add", kNetns}) ||
+      !RunIp({"link", "set", lan_peer, "netns", kNetns}) ||
+      !RunIp({"-n", kNetns, "addr", "add", "10.200.0.2/24", "dev", lan_peer}) ||
+      !RunIp({"-n", kNetns, "link", "set", lan_peer, "up"})) {
+    return false;
+  }
+  for (int i = 0; i < kMaxGuests; i++) {
+    if (!CreateVethPair(GuestIfname(i), 201 + i))
+      return false;
+  }
+  return true;
+}
+
+// Returns a socket sending multicast datagrams into the LAN interface from its
+// veth peer, which is created in the network namespace of the peer.
+base::ScopedFD CreateSender() {
+  base::ScopedFD host_ns(open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC));
+  PCHECK(host_ns.is_valid());
+  base::ScopedFD peer_ns(
+      open(base::StringPrintf("/run/netns/%s", kNetns).c_str(),
+           O_RDONLY | O_CLOEXEC));
+  PCHECK(peer_ns.is_valid());
+  PCHECK(setns(peer_ns.get(), CLONE_NEWNET) == 0);
+
+  const std::string peer = std::string(kLanIfname) + kPeerSuffix;
+  base::ScopedFD fd(socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0));
+  PCHECK(fd.is_valid());
+  struct ip_mreqn mreqn;
+  memset(&mreqn, 0, sizeof(mreqn));
+  mreqn.imr_ifindex = if_nametoindex(peer.c_str());
+  CHECK_NE(mreqn.imr_ifindex, 0);
+  PCHECK(setsockopt(fd.get(), IPPROTO_IP, IP_MULTICAST_IF, &mreqn,
+                    sizeof(mreqn)) == 0);
+
+  PCHECK(setns(host_ns.get(), CLONE_NEWNET) == 0);
+  return fd;
+}
+
+// Forwards multicast without watching the sockets, and records how many
+// datagrams were read.
+class BenchmarkForwarder : public MulticastForwarder {
+ public:
+  explicit BenchmarkForwarder(unsigned int batch_size)
+      : MulticastForwarder(
+            kLanIfname, kSsdpMcastAddress, kSsdpMcastAddress6, kSsdpPort),
+        batch_size_(batch_size) {}
+  BenchmarkForwarder(const BenchmarkForwarder&) = delete;
+  BenchmarkForwarder& operator=(const BenchmarkForwarder&) = delete;
+  ~BenchmarkForwarder() override = default;
+
+  int lan_fd() const { return lan_fd_; }
+  int received() const { return received_; }
+
+ protected:
+  std::unique_ptr<Socket> CreateSocket(base::ScopedFD fd,
+                                       sa_family_t sa_family) override {
+    // Init() binds the LAN sockets before any guest is added.
+    if (lan_fd_ < 0 && sa_family == AF_INET)
+      lan_fd_ = fd.get();
+    auto socket = std::make_unique<Socket>();
+    socket->fd = std::move(fd);
+    return socket;
+  }
+
+  int Receive(int fd, struct mmsghdr* msgs, unsigned int vlen) override {
+    int count =
+        MulticastForwarder::Receive(fd, msgs, std::min(vlen, batch_size_));
+    if (count > 0)
+      received_ += count;
+    return count;
+  }
+
+ private:
+  const unsigned int batch_size_;
+  int lan_fd_ = -1;
+  int received_ = 0;
+};
+
+// Arguments: the number of datagrams read at once, and the number of guests.
+void BM_ForwardToGuests(benchmark::State& state) {
+  BenchmarkForwarder forwarder(state.range(0));
+  forwarder.Init();
+  for (int i = 0; i < state.range(1); i++)
+    CHECK(forwarder.AddGuest(GuestIfname(i)));
+  CHECK_GE(forwarder.lan_fd(), 0);
+
+  base::ScopedFD sender = CreateSender();
+  struct sockaddr_in dst;
+  memset(&dst, 0, sizeof(dst));
+  dst.sin_family = AF_INET;
+  dst.sin_port = htons(kSsdpPort);
+  dst.sin_addr.s_addr = kSsdpMcastAddress;
+  const std::string payload(kDatagramSize, 'x');
+
+  for (auto _ : state) {
+    const int expected = forwarder.received() + kDatagrams;
+    for (int i = 0; i < kDatagrams; i++) {
+      PCHECK(sendto(sender.get(), payload.data(), payload.size(), 0,
+                    reinterpret_cast<const struct sockaddr*>(&dst),
+                    sizeof(dst)) >= 0);
+    }
+    while (forwarder.received() < expected) {
+      struct pollfd pfd = {.fd = forwarder.lan_fd(), .events = POLLIN};
+      if (poll(&pfd, 1, 1000) != 1) {
+        state.SkipWithError("Datagrams were lost");
+        return;
+      }
+      forwarder.OnFileCanReadWithoutBlocking(forwarder.lan_fd(), AF_INET);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kDatagrams);
+}
+BENCHMARK(BM_ForwardToGuests)
+    ->ArgNames({"batch", "guests"})
+    ->Args({1, 1})
+    ->Args({MulticastForwarder::kBatchSize, 1})
+    ->Args({1, 4})
+    ->Args({MulticastForwarder::kBatchSize, 4})
+    ->Args({1, kMaxGuests})
+    ->Args({MulticastForwarder::kBatchSize, kMaxGuests});
+
+}  // namespace
+
+}  // namespace patchpanel
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit;
+  logging::SetMinLogLevel(logging::LOGGING_WARNING);
+
+  patchpanel::DeleteInterfaces();
+  if (!patchpanel::CreateInterfaces()) {
+    LOG(ERROR) << "Failed to create the veth interfaces, which requires "
+               << "CAP_NET_ADMIN";
+    patchpanel::DeleteInterfaces();
+    return 1;
+  }
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+
+  patchpanel::DeleteInterfaces();
+  return 0;
+}
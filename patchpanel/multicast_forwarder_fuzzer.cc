@@ -63,29 +63,28 @@ class TestMulticastForwarder : public MulticastForwarder {
     return true;
   }
 
-  bool SendToGuests(const void* data,
-                    ssize_t len,
+  bool SendToGuests(struct iovec* packets,
+                    unsigned int count,
                     const struct sockaddr* dst,
                     socklen_t dst_len,
                     int ignore_fd) override {
     return true;
   }
 
-  ssize_t Receive(int fd,
-                  char* buffer,
-                  size_t buffer_size,
-                  struct sockaddr* src_addr,
-                  socklen_t* addrlen) override {
-    *addrlen = std::min(src_sockaddr.size(), (size_t)*addrlen);
-    if (*addrlen > 0) {
-      memcpy(src_addr, src_sockaddr.data(), *addrlen);
+  int Receive(int fd, struct mmsghdr* msgs, unsigned int vlen) override {
+    struct msghdr* hdr = &msgs[0].msg_hdr;
+    hdr->msg_namelen =
+        std::min(src_sockaddr.size(), static_cast<size_t>(hdr->msg_namelen));
+    if (hdr->msg_namelen > 0) {
+      memcpy(hdr->msg_name, src_sockaddr.data(), hdr->msg_namelen);
     }
-    buffer_size = std::min(payload.size(), buffer_size);
-    if (buffer_size > 0) {
-      memcpy(buffer, payload.data(), buffer_size);
+    size_t len = std::min(payload.size(), hdr->msg_iov->iov_len);
+    if (len > 0) {
+      memcpy(hdr->msg_iov->iov_base, payload.data(), len);
     }
-    src_addr->sa_family = sa_family;
-    return true;
+    reinterpret_cast<struct sockaddr*>(hdr->msg_name)->sa_family = sa_family;
+    msgs[0].msg_len = len;
+    return 1;
   }
 
   std::vector<int> fds;
@@ -0,0 +1,167 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "patchpanel/multicast_forwarder.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/files/scoped_file.h>
+#include <gtest/gtest.h>
+
+#include "patchpanel/net_util.h"
+
+namespace patchpanel {
+namespace {
+
+// A datagram passed to SendMessages() and reported as sent.
+struct SentDatagram {
+  std::string ifname;
+  std::string data;
+};
+
+// Test class that records the datagrams sent to guests instead of sending
+// them, and that makes SendMessages() return the values of |send_results| in
+// order.
+class TestMulticastForwarder : public MulticastForwarder {
+ public:
+  TestMulticastForwarder()
+      : MulticastForwarder("wlan0", kSsdpMcastAddress, kSsdpMcastAddress6,
+                           kSsdpPort) {}
+  TestMulticastForwarder(const TestMulticastForwarder&) = delete;
+  TestMulticastForwarder& operator=(const TestMulticastForwarder&) = delete;
+  ~TestMulticastForwarder() override = default;
+
+  using MulticastForwarder::SendToGuests;
+
+  base::ScopedFD Bind(sa_family_t sa_family,
+                      const std::string& ifname) override {
+    base::ScopedFD fd(socket(sa_family, SOCK_DGRAM, 0));
+    ifnames_[fd.get()] = ifname;
+    return fd;
+  }
+
+  std::unique_ptr<Socket> CreateSocket(base::ScopedFD fd,
+                                       sa_family_t sa_family) override {
+    auto socket = std::make_unique<Socket>();
+    socket->fd = std::move(fd);
+    return socket;
+  }
+
+  int SendMessages(int fd, struct mmsghdr* msgs, unsigned int vlen) override {
+    send_vlens.push_back(vlen);
+    int ret = vlen;
+    if (!send_results.empty()) {
+      ret = std::min(send_results.front(), static_cast<int>(vlen));
+      send_results.pop_front();
+    }
+    if (ret < 0) {
+      errno = EPERM;
+      return ret;
+    }
+    for (int i = 0; i < ret; i++) {
+      const struct iovec* iov = msgs[i].msg_hdr.msg_iov;
+      sent.push_back(
+          {ifnames_[fd],
+           std::string(static_cast<const char*>(iov->iov_base), iov->iov_len)});
+    }
+    return ret;
+  }
+
+  std::deque<int> send_results;
+  std::vector<unsigned int> send_vlens;
+  std::vector<SentDatagram> sent;
+
+ private:
+  std::map<int, std::string> ifnames_;
+};
+
+}  // namespace
+
+class MulticastForwarderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    memset(&dst_, 0, sizeof(dst_));
+    dst_.sin_family = AF_INET;
+    dst_.sin_port = htons(kSsdpPort);
+    dst_.sin_addr.s_addr = kSsdpMcastAddress;
+    for (int i = 0; i < 3; i++) {
+      iovs_[i].iov_base = const_cast<char*>(datagrams_[i].data());
+      iovs_[i].iov_len = datagrams_[i].size();
+    }
+  }
+
+  bool SendToGuests(unsigned int count) {
+    return forwarder_.SendToGuests(
+        iovs_, count, reinterpret_cast<const struct sockaddr*>(&dst_),
+        sizeof(dst_));
+  }
+
+  TestMulticastForwarder forwarder_;
+  const std::string datagrams_[3] = {"datagram0", "datagram1", "datagram2"};
+  struct iovec iovs_[3];
+  struct sockaddr_in dst_;
+};
+
+TEST_F(MulticastForwarderTest, SendToGuests) {
+  ASSERT_TRUE(forwarder_.AddGuest("arc_br0"));
+  ASSERT_TRUE(forwarder_.AddGuest("vmtap0"));
+
+  EXPECT_TRUE(SendToGuests(3));
+
+  // The IPv6 sockets of the guests are not used for IPv4 datagrams.
+  EXPECT_EQ(std::vector<unsigned int>({3, 3}), forwarder_.send_vlens);
+  ASSERT_EQ(6, forwarder_.sent.size());
+  for (int i = 0; i < 6; i++) {
+    EXPECT_EQ(i < 3 ? "arc_br0" : "vmtap0", forwarder_.sent[i].ifname);
+    EXPECT_EQ(datagrams_[i % 3], forwarder_.sent[i].data);
+  }
+}
+
+TEST_F(MulticastForwarderTest, SendToGuestsSkipsFailedDatagram) {
+  ASSERT_TRUE(forwarder_.AddGuest("arc_br0"));
+
+  // sendmmsg() sends the first datagram and stops at the second, which then
+  // fails on its own.
+  forwarder_.send_results = {1, -1};
+  EXPECT_FALSE(SendToGuests(3));
+
+  EXPECT_EQ(std::vector<unsigned int>({3, 2, 1}), forwarder_.send_vlens);
+  ASSERT_EQ(2, forwarder_.sent.size());
+  EXPECT_EQ(datagrams_[0], forwarder_.sent[0].data);
+  EXPECT_EQ(datagrams_[2], forwarder_.sent[1].data);
+}
+
+TEST_F(MulticastForwarderTest, SendToGuestsResumesAfterPartialSend) {
+  ASSERT_TRUE(forwarder_.AddGuest("arc_br0"));
+  ASSERT_TRUE(forwarder_.AddGuest("vmtap0"));
+
+  // sendmmsg() only sends part of the batch, and the rest is sent with
+  // another call. The last datagram then fails for the first guest only.
+  forwarder_.send_results = {1, 1, -1};
+  EXPECT_FALSE(SendToGuests(3));
+
+  EXPECT_EQ(std::vector<unsigned int>({3, 2, 1, 3}), forwarder_.send_vlens);
+  ASSERT_EQ(5, forwarder_.sent.size());
+  EXPECT_EQ("arc_br0", forwarder_.sent[0].ifname);
+  EXPECT_EQ(datagrams_[0], forwarder_.sent[0].data);
+  EXPECT_EQ("arc_br0", forwarder_.sent[1].ifname);
+  EXPECT_EQ(datagrams_[1], forwarder_.sent[1].data);
+  for (int i = 2; i < 5; i++) {
+    EXPECT_EQ("vmtap0", forwarder_.sent[i].ifname);
+    EXPECT_EQ(datagrams_[i - 2], forwarder_.sent[i].data);
+  }
+}
+
+}  // namespace patchpanel
@@ -0,0 +1,149 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures the cost of the MobileOperatorInfo lookups done on modem events,
+// with the serviceproviders.pbf database next to the executable.
+// Usage: cellular_mobile_operator_info_benchmark [benchmark flags]
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/at_exit.h>
+#include <base/check.h>
+#include <base/files/file_path.h>
+#include <base/logging.h>
+#include <benchmark/benchmark.h>
+
+#include "shill/cellular/mobile_operator_info.h"
+#include "shill/event_dispatcher.h"
+#include "shill/mobile_operator_db/mobile_operator_db.pb.h"
+#include "shill/protobuf_lite_streams.h"
+
+namespace shill {
+
+namespace {
+
+// Drops the tasks, since the notifications to observers are not measured.
+class NoopEventDispatcher : public EventDispatcher {
+ public:
+  NoopEventDispatcher() = default;
+  NoopEventDispatcher(const NoopEventDispatcher&) = delete;
+  NoopEventDispatcher& operator=(const NoopEventDispatcher&) = delete;
+  ~NoopEventDispatcher() override = default;
+
+  void DispatchForever() override {}
+  void DispatchPendingEvents() override {}
+  void PostDelayedTask(const base::Location& location,
+                       base::OnceClosure task,
+                       base::TimeDelta delay) override {}
+  void QuitDispatchForever() override {}
+};
+
+base::FilePath* g_database_path = nullptr;
+// Operator codes and names found in the database, to look up.
+std::vector<std::string>* g_imsis = nullptr;
+std::vector<std::string>* g_names = nullptr;
+
+void LoadLookupKeys() {
+  std::unique_ptr<google::protobuf::io::CopyingInputStreamAdaptor> stream(
+      protobuf_lite_file_input_stream(g_database_path->value().c_str()));
+  CHECK(stream) << "Failed to read " << g_database_path->value();
+  mobile_operator_db::MobileOperatorDB database;
+  CHECK(database.ParseFromZeroCopyStream(stream.get()));
+
+  g_imsis = new std::vector<std::string>();
+  g_names = new std::vector<std::string>();
+  for (const auto& mno : database.mno()) {
+    for (const auto& mccmnc : mno.data().mccmnc()) {
+      // Pads the MCCMNC to a 15-digit IMSI.
+      g_imsis->push_back(mccmnc + std::string(15 - mccmnc.size(), '1'));
+    }
+    for (const auto& localized_name : mno.data().localized_name()) {
+      g_names->push_back(localized_name.name());
+    }
+  }
+  CHECK(!g_imsis->empty());
+  CHECK(!g_names->empty());
+}
+
+std::unique_ptr<MobileOperatorInfo> CreateOperatorInfo(
+    EventDispatcher* dispatcher) {
+  auto info = std::make_unique<MobileOperatorInfo>(dispatcher, "benchmark");
+  info->ClearDatabasePaths();
+  info->AddDatabasePath(*g_database_path);
+  CHECK(info->Init());
+  return info;
+}
+
+void BM_Init(benchmark::State& state) {
+  NoopEventDispatcher dispatcher;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(CreateOperatorInfo(&dispatcher));
+  }
+}
+BENCHMARK(BM_Init)->Unit(benchmark::kMillisecond);
+
+// Determines the MNO, then the MVNO by the filters, from an IMSI.
+void BM_UpdateIMSI(benchmark::State& state) {
+  NoopEventDispatcher dispatcher;
+  auto info = CreateOperatorInfo(&dispatcher);
+  size_t i = 0;
+  for (auto _ : state) {
+    info->Reset();
+    info->UpdateIMSI((*g_imsis)[i++ % g_imsis->size()]);
+    benchmark::DoNotOptimize(info->uuid());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UpdateIMSI);
+
+void BM_UpdateOperatorName(benchmark::State& state) {
+  NoopEventDispatcher dispatcher;
+  auto info = CreateOperatorInfo(&dispatcher);
+  size_t i = 0;
+  for (auto _ : state) {
+    info->Reset();
+    info->UpdateOperatorName((*g_names)[i++ % g_names->size()]);
+    benchmark::DoNotOptimize(info->uuid());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UpdateOperatorName);
+
+// A modem event sequence: MCCMNC, operator name, then ICCID and IMSI.
+void BM_UpdateAll(benchmark::State& state) {
+  NoopEventDispatcher dispatcher;
+  auto info = CreateOperatorInfo(&dispatcher);
+  size_t i = 0;
+  for (auto _ : state) {
+    const std::string& imsi = (*g_imsis)[i % g_imsis->size()];
+    info->Reset();
+    info->UpdateMCCMNC(imsi.substr(0, 5));
+    info->UpdateOperatorName((*g_names)[i % g_names->size()]);
+    info->UpdateICCID("8901" + imsi.substr(0, 15));
+    info->UpdateIMSI(imsi);
+    benchmark::DoNotOptimize(info->uuid());
+    i++;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UpdateAll);
+
+}  // namespace
+
+}  // namespace shill
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit;
+  logging::SetMinLogLevel(logging::LOGGING_FATAL);
+
+  shill::g_database_path = new base::FilePath(
+      base::FilePath(argv[0]).DirName().Append("serviceproviders.pbf"));
+  shill::LoadLookupKeys();
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -6,6 +6,7 @@
 
 #include <regex.h>
 
+#include <algorithm>
 #include <memory>
 #include <utility>
 
@@ -87,6 +88,93 @@ base::Optional<std::string> GetIpType(
 
 }  // namespace
 
+MobileOperatorInfoImpl::CompiledFilter::CompiledFilter(
+    const mobile_operator_db::Filter& filter, bool anchored) {
+  DCHECK(filter.has_regex() || filter.range_size());
+  if (filter.range_size()) {
+    DCHECK(!filter.has_regex());
+    for (const auto& r : filter.range()) {
+      ranges_.emplace_back(r.start(), r.end());
+    }
+    // Merges overlapping ranges, so that a value can be looked up with a
+    // binary search.
+    std::sort(ranges_.begin(), ranges_.end());
+    std::vector<std::pair<uint64_t, uint64_t>> merged;
+    for (const auto& r : ranges_) {
+      if (r.first > r.second) {
+        continue;
+      }
+      if (!merged.empty() && r.first <= merged.back().second) {
+        merged.back().second = std::max(merged.back().second, r.second);
+      } else {
+        merged.push_back(r);
+      }
+    }
+    ranges_ = std::move(merged);
+    is_valid_ = true;
+    return;
+  }
+
+  // Must use GNU regex implementation, since C++11 implementation is
+  // incomplete.
+  std::string regex_str = filter.regex();
+  if (anchored) {
+    // |regexec| matches the given regular expression to a substring of the
+    // given query string. Ensure that |regex_str| uses anchors to accept only
+    // a full match.
+    if (regex_str.empty() || regex_str.front() != '^') {
+      regex_str = "^" + regex_str;
+    }
+    if (regex_str.back() != '$') {
+      regex_str = regex_str + "$";
+    }
+  }
+
+  has_regex_ = true;
+  int regcomp_error =
+      regcomp(&regex_, regex_str.c_str(), REG_EXTENDED | REG_NOSUB);
+  if (regcomp_error) {
+    LOG(WARNING) << "Could not compile regex '" << filter.regex() << "'. "
+                 << "Error returned: " << GetRegError(regcomp_error, &regex_)
+                 << ". ";
+    return;
+  }
+  is_valid_ = true;
+}
+
+MobileOperatorInfoImpl::CompiledFilter::~CompiledFilter() {
+  if (has_regex_) {
+    regfree(&regex_);
+  }
+}
+
+bool MobileOperatorInfoImpl::CompiledFilter::Matches(
+    const std::string& value) const {
+  if (!is_valid_) {
+    return false;
+  }
+
+  if (has_regex_) {
+    return regexec(&regex_, value.c_str(), 0, nullptr, 0) == 0;
+  }
+
+  uint64_t match_value;
+  if (!base::StringToUint64(value, &match_value)) {
+    return false;
+  }
+  // Finds the last range starting at or before |match_value|.
+  auto it = std::upper_bound(
+      ranges_.begin(), ranges_.end(), match_value,
+      [](uint64_t v, const std::pair<uint64_t, uint64_t>& r) {
+        return v < r.first;
+      });
+  if (it == ranges_.begin()) {
+    return false;
+  }
+  --it;
+  return match_value <= it->second;
+}
+
 MobileOperatorInfoImpl::MobileOperatorInfoImpl(
     EventDispatcher* dispatcher,
     const std::string& info_owner,
@@ -444,12 +532,21 @@ void MobileOperatorInfoImpl::PreprocessDatabase() {
   mccmnc_to_mnos_.clear();
   sid_to_mnos_.clear();
   name_to_mnos_.clear();
+  compiled_filters_.clear();
+
+  for (const auto& mvno : database_->mvno()) {
+    CompileMVNOFilters(mvno);
+  }
 
   const auto& mnos = database_->mno();
   for (const auto& mno : mnos) {
     // MobileNetworkOperator::data is a required field.
     DCHECK(mno.has_data());
     const auto& data = mno.data();
+    CompileDataFilters(data);
+    for (const auto& mvno : mno.mvno()) {
+      CompileMVNOFilters(mvno);
+    }
 
     const auto& mccmncs = data.mccmnc();
     for (const auto& mccmnc : mccmncs) {
@@ -481,6 +578,37 @@ void MobileOperatorInfoImpl::InsertIntoStringToMNOListMap(
   (*table)[key].push_back(value);
 }
 
+void MobileOperatorInfoImpl::CompileMVNOFilters(
+    const shill::mobile_operator_db::MobileVirtualNetworkOperator& mvno) {
+  for (const auto& filter : mvno.mvno_filter()) {
+    compiled_filters_[&filter] =
+        std::make_unique<CompiledFilter>(filter, /*anchored=*/true);
+  }
+  if (mvno.has_data()) {
+    CompileDataFilters(mvno.data());
+  }
+}
+
+void MobileOperatorInfoImpl::CompileDataFilters(
+    const shill::mobile_operator_db::Data& data) {
+  for (const auto& olp : data.olp()) {
+    if (olp.has_olp_filter()) {
+      compiled_filters_[&olp.olp_filter()] =
+          std::make_unique<CompiledFilter>(olp.olp_filter(), /*anchored=*/true);
+    }
+  }
+  for (const auto& filter : data.roaming_filter()) {
+    // Roaming filters are not anchored, and only regular expressions on MCCMNC
+    // are used.
+    if (filter.type() != mobile_operator_db::Filter_Type_MCCMNC ||
+        !filter.has_regex()) {
+      continue;
+    }
+    compiled_filters_[&filter] =
+        std::make_unique<CompiledFilter>(filter, /*anchored=*/false);
+  }
+}
+
 bool MobileOperatorInfoImpl::AppendToCandidatesByMCCMNC(
     const std::string& mccmnc) {
   // First check that we haven't determined candidates using SID.
@@ -685,22 +813,22 @@ MobileOperatorInfoImpl::PickOneFromDuplicates(
 bool MobileOperatorInfoImpl::FilterMatches(
     const shill::mobile_operator_db::Filter& filter) {
   DCHECK(filter.has_regex() || filter.range_size());
-  std::string to_match;
+  const std::string* to_match;
   switch (filter.type()) {
     case mobile_operator_db::Filter_Type_IMSI:
-      to_match = user_imsi_;
+      to_match = &user_imsi_;
       break;
     case mobile_operator_db::Filter_Type_ICCID:
-      to_match = user_iccid_;
+      to_match = &user_iccid_;
       break;
     case mobile_operator_db::Filter_Type_SID:
-      to_match = user_sid_;
+      to_match = &user_sid_;
       break;
     case mobile_operator_db::Filter_Type_OPERATOR_NAME:
-      to_match = user_operator_name_;
+      to_match = &user_operator_name_;
       break;
     case mobile_operator_db::Filter_Type_MCCMNC:
-      to_match = user_mccmnc_;
+      to_match = &user_mccmnc_;
       break;
     default:
       SLOG(this, 1) << "Unknown filter type [" << filter.type() << "]";
@@ -708,71 +836,27 @@ bool MobileOperatorInfoImpl::FilterMatches(
   }
   // |to_match| can be empty if we have no *user provided* information of the
   // correct type.
-  if (to_match.empty()) {
+  if (to_match->empty()) {
     SLOG(this, 2) << "Nothing to match against (filter: " << filter.regex()
                   << ").";
     return false;
   }
 
-  // Match against numerical ranges rather than a regular expression
-  if (filter.range_size()) {
-    DCHECK(!filter.has_regex());
-
-    uint64_t match_value;
-    if (!base::StringToUint64(to_match, &match_value)) {
-      SLOG(this, 3) << "Need a number to match against a range (" << match_value
-                    << ").";
-      return false;
-    }
-
-    for (auto r : filter.range()) {
-      if ((r.start() <= match_value) && (match_value <= r.end()))
-        return true;
-    }
-    // No range is matching
+  const auto it = compiled_filters_.find(&filter);
+  if (it == compiled_filters_.end()) {
+    LOG(DFATAL) << "Filter not found in the database.";
     return false;
   }
 
-  // Must use GNU regex implementation, since C++11 implementation is
-  // incomplete.
-  regex_t filter_regex;
-  std::string filter_regex_str = filter.regex();
-
-  // |regexec| matches the given regular expression to a substring of the
-  // given query string. Ensure that |filter_regex_str| uses anchors to
-  // accept only a full match.
-  if (filter_regex_str.front() != '^') {
-    filter_regex_str = "^" + filter_regex_str;
-  }
-  if (filter_regex_str.back() != '$') {
-    filter_regex_str = filter_regex_str + "$";
-  }
-
-  int regcomp_error = regcomp(&filter_regex, filter_regex_str.c_str(),
-                              REG_EXTENDED | REG_NOSUB);
-  if (regcomp_error) {
-    LOG(WARNING) << "Could not compile regex '" << filter.regex() << "'. "
-                 << "Error returned: "
-                 << GetRegError(regcomp_error, &filter_regex) << ". ";
-    regfree(&filter_regex);
+  if (!it->second->Matches(*to_match)) {
+    SLOG(this, 2) << "Skipping because string '" << *to_match << "' is not "
+                  << "accepted by the filter (regex: '" << filter.regex()
+                  << "', ranges: " << filter.range_size() << ").";
     return false;
   }
-
-  int regexec_error = regexec(&filter_regex, to_match.c_str(), 0, nullptr, 0);
-  if (regexec_error) {
-    std::string error_string;
-    error_string = GetRegError(regcomp_error, &filter_regex);
-    SLOG(this, 2) << "Skipping because string '" << to_match << "' is not a "
-                  << "match of regexp '" << filter.regex() << "'. "
-                  << (error_string.empty() ? "" : "Error returned: ")
-                  << error_string;
-    regfree(&filter_regex);
-    return false;
-  } else {
-    SLOG(this, 2) << "Regex '" << filter.regex() << "' matches '" << to_match
-                  << "'.";
-  }
-  regfree(&filter_regex);
+  SLOG(this, 2) << "Filter (regex: '" << filter.regex()
+                << "', ranges: " << filter.range_size() << ") accepts '"
+                << *to_match << "'.";
   return true;
 }
 
@@ -849,7 +933,7 @@ void MobileOperatorInfoImpl::ReloadData(
   if (data.roaming_filter_size() > 0) {
     roaming_filter_list_.clear();
     for (const auto& filter : data.roaming_filter()) {
-      roaming_filter_list_.push_back(filter);
+      roaming_filter_list_.push_back(&filter);
     }
   }
 
@@ -859,9 +943,8 @@ void MobileOperatorInfoImpl::ReloadData(
 
   if (data.olp_size() > 0) {
     raw_olp_list_.clear();
-    // Copy the olp list so we can mutate it.
     for (const auto& olp : data.olp()) {
-      raw_olp_list_.push_back(olp);
+      raw_olp_list_.push_back(&olp);
     }
     HandleOnlinePortalUpdate();
   }
@@ -988,11 +1071,11 @@ void MobileOperatorInfoImpl::HandleSIDUpdate() {
 void MobileOperatorInfoImpl::HandleOnlinePortalUpdate() {
   // Always recompute |olp_list_|. We don't expect this list to be big.
   olp_list_.clear();
-  for (const auto& raw_olp : raw_olp_list_) {
-    if (!raw_olp.has_olp_filter() || FilterMatches(raw_olp.olp_filter())) {
+  for (const auto* raw_olp : raw_olp_list_) {
+    if (!raw_olp->has_olp_filter() || FilterMatches(raw_olp->olp_filter())) {
       olp_list_.push_back(MobileOperatorInfo::OnlinePortal{
-          raw_olp.url(), (raw_olp.method() == raw_olp.GET) ? "GET" : "POST",
-          raw_olp.post_data()});
+          raw_olp->url(), (raw_olp->method() == raw_olp->GET) ? "GET" : "POST",
+          raw_olp->post_data()});
     }
   }
   if (!user_olp_empty_) {
@@ -1014,24 +1097,13 @@ void MobileOperatorInfoImpl::UpdateRequiresRoaming(
     const MobileOperatorInfo* serving_operator_info) {
   if (!serving_operator_info || serving_operator_info->mccmnc().empty())
     return;
-  for (const auto& filter : roaming_filter_list_) {
-    if (filter.type() != mobile_operator_db::Filter_Type_MCCMNC ||
-        !filter.has_regex()) {
-      continue;
-    }
-    regex_t roaming_mccmnc_regex;
-    int regcomp_result = regcomp(&roaming_mccmnc_regex, filter.regex().c_str(),
-                                 REG_EXTENDED | REG_NOSUB);
-    if (regcomp_result != 0) {
-      LOG(WARNING) << "Could not compile regex '" << filter.regex() << "'. ";
-      regfree(&roaming_mccmnc_regex);
+  for (const auto* filter : roaming_filter_list_) {
+    // Only the filters of type MCCMNC with a regex are compiled.
+    const auto it = compiled_filters_.find(filter);
+    if (it == compiled_filters_.end() || !it->second->is_valid()) {
       continue;
     }
-    int regexec_result =
-        regexec(&roaming_mccmnc_regex, serving_operator_info->mccmnc().c_str(),
-                0, nullptr, 0);
-    regfree(&roaming_mccmnc_regex);
-    requires_roaming_ = regexec_result == 0;
+    requires_roaming_ = it->second->Matches(serving_operator_info->mccmnc());
     if (requires_roaming_) {
       SLOG(this, 1)
           << "requires_roaming is updated to true due to roaming filtering";
@@ -1039,7 +1111,7 @@ void MobileOperatorInfoImpl::UpdateRequiresRoaming(
     }
     SLOG(this, 2) << "Serving operator MCCMNC: "
                   << serving_operator_info->mccmnc()
-                  << " filtering regex: " << filter.regex()
+                  << " filtering regex: " << filter->regex()
                   << " results, requires_roaming: " << requires_roaming_;
   }
 }
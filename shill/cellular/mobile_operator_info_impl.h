@@ -5,9 +5,13 @@
 #ifndef SHILL_CELLULAR_MOBILE_OPERATOR_INFO_IMPL_H_
 #define SHILL_CELLULAR_MOBILE_OPERATOR_INFO_IMPL_H_
 
+#include <regex.h>
+
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <base/cancelable_callback.h>
@@ -24,9 +28,9 @@ namespace shill {
 
 class MobileOperatorInfoImpl {
  public:
-  using StringToMNOListMap =
-      std::map<std::string,
-               std::vector<const mobile_operator_db::MobileNetworkOperator*>>;
+  using StringToMNOListMap = std::unordered_map<
+      std::string,
+      std::vector<const mobile_operator_db::MobileNetworkOperator*>>;
 
   // Delegates to private constructor
   MobileOperatorInfoImpl(EventDispatcher* dispatcher,
@@ -83,6 +87,29 @@ class MobileOperatorInfoImpl {
   MobileOperatorInfoImpl(const MobileOperatorInfoImpl&) = delete;
   MobileOperatorInfoImpl& operator=(const MobileOperatorInfoImpl&) = delete;
 
+  // A filter of the database prepared for matching when the database is
+  // loaded: its regular expression is compiled and its ranges are sorted.
+  class CompiledFilter {
+   public:
+    // If |anchored| is true, the regular expression only accepts full matches.
+    CompiledFilter(const mobile_operator_db::Filter& filter, bool anchored);
+    CompiledFilter(const CompiledFilter&) = delete;
+    CompiledFilter& operator=(const CompiledFilter&) = delete;
+    ~CompiledFilter();
+
+    // Returns false if the regular expression could not be compiled.
+    bool is_valid() const { return is_valid_; }
+    // Returns true if |value| is accepted by the filter.
+    bool Matches(const std::string& value) const;
+
+   private:
+    bool is_valid_ = false;
+    bool has_regex_ = false;
+    regex_t regex_;
+    // Disjoint ranges of accepted values, sorted by their start.
+    std::vector<std::pair<uint64_t, uint64_t>> ranges_;
+  };
+
   // ///////////////////////////////////////////////////////////////////////////
   // Static variables.
   // Default databases to load.
@@ -102,6 +129,12 @@ class MobileOperatorInfoImpl {
       StringToMNOListMap* table,
       const std::string& key,
       const mobile_operator_db::MobileNetworkOperator* value);
+  // Compiles the filters of |mvno| into |compiled_filters_|.
+  void CompileMVNOFilters(
+      const mobile_operator_db::MobileVirtualNetworkOperator& mvno);
+  // Compiles the roaming and online portal filters of |data| into
+  // |compiled_filters_|.
+  void CompileDataFilters(const mobile_operator_db::Data& data);
 
   bool UpdateMNO();
   bool UpdateMVNO();
@@ -170,6 +203,11 @@ class MobileOperatorInfoImpl {
   StringToMNOListMap mccmnc_to_mnos_;
   StringToMNOListMap sid_to_mnos_;
   StringToMNOListMap name_to_mnos_;
+  // All the MVNO, roaming and online portal filters of |database_|, compiled
+  // at Init().
+  std::unordered_map<const mobile_operator_db::Filter*,
+                     std::unique_ptr<CompiledFilter>>
+      compiled_filters_;
 
   // |candidates_by_operator_code| can be determined either using MCCMNC or
   // using SID.  At any one time, we only expect one of these operator codes to
@@ -203,10 +241,12 @@ class MobileOperatorInfoImpl {
   bool prioritizes_db_operator_name_;
   std::vector<MobileOperatorInfo::MobileAPN> apn_list_;
   std::vector<MobileOperatorInfo::OnlinePortal> olp_list_;
-  std::vector<mobile_operator_db::OnlinePortal> raw_olp_list_;
+  // Points to the online portals in |database_|.
+  std::vector<const mobile_operator_db::OnlinePortal*> raw_olp_list_;
   std::string activation_code_;
   bool requires_roaming_;
-  std::vector<mobile_operator_db::Filter> roaming_filter_list_;
+  // Points to the filters in |database_|.
+  std::vector<const mobile_operator_db::Filter*> roaming_filter_list_;
   int32_t mtu_;
   // These fields store the data obtained from the Update* methods.
   // The database information is kept separate from the information gathered
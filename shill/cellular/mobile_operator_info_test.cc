@@ -1512,6 +1512,32 @@ TEST_P(MobileOperatorInfoDataTest, FilteredOLP) {
   EXPECT_TRUE(found_olp_by_sid);
 }
 
+TEST_P(MobileOperatorInfoDataTest, FilteredOLPAfterReset) {
+  // The OLP accepted by its filter must keep its details, and still be
+  // accepted once the MNO is matched again.
+  for (int i = 0; i < 2; i++) {
+    ExpectEventCount(1);
+    UpdateMCCMNC("200003");
+    VerifyEventCount();
+    VerifyMNOWithUUID("uuid200001");
+
+    const MobileOperatorInfo::OnlinePortal* olp_by_mccmnc = nullptr;
+    for (const auto& olp : operator_info_->olp_list()) {
+      if (olp.url == "olp@mccmnc") {
+        olp_by_mccmnc = &olp;
+      }
+    }
+    ASSERT_NE(nullptr, olp_by_mccmnc);
+    EXPECT_EQ("POST", olp_by_mccmnc->method);
+    EXPECT_EQ("post_data", olp_by_mccmnc->post_data);
+
+    ExpectEventCount(1);
+    operator_info_->Reset();
+    VerifyEventCount();
+    VerifyNoMatch();
+  }
+}
+
 class MobileOperatorInfoObserverTest : public MobileOperatorInfoMainTest {
  public:
   MobileOperatorInfoObserverTest() = default;
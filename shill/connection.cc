@@ -216,6 +216,9 @@ void Connection::UpdateFromIPConfig(const IPConfigRefPtr& config) {
   }
   bool is_p2p = peer.IsValid();
 
+  // Sends the address, route and rule changes below in one go.
+  RTNLHandler::ScopedBatch rtnl_batch(rtnl_handler_);
+
   if (!SetupExcludedRoutes(properties, gateway)) {
     return;
   }
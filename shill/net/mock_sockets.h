@@ -51,6 +51,10 @@ class MockSockets : public Sockets {
               RecvFrom,
               (int, void*, size_t, int, struct sockaddr*, socklen_t*),
               (const, override));
+  MOCK_METHOD(int,
+              RecvMMsg,
+              (int, struct mmsghdr*, unsigned int, int, struct timespec*),
+              (const, override));
   MOCK_METHOD(int,
               Select,
               (int, fd_set*, fd_set*, fd_set*, struct timeval*),
@@ -59,6 +63,10 @@ class MockSockets : public Sockets {
               Send,
               (int, const void*, size_t, int),
               (const, override));
+  MOCK_METHOD(ssize_t,
+              SendMsg,
+              (int, const struct msghdr*, int),
+              (const, override));
   MOCK_METHOD(
       ssize_t,
       SendTo,
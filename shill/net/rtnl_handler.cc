@@ -23,6 +23,7 @@
 
 #include <base/bind.h>
 #include <base/check.h>
+#include <base/check_op.h>
 #include <base/containers/contains.h>
 #include <base/logging.h>
 #include <base/strings/stringprintf.h>
@@ -53,6 +54,7 @@ const uint32_t RTNLHandler::kRequestBridgeNeighbor = 64;
 
 const int RTNLHandler::kErrorWindowSize = 16;
 const uint32_t RTNLHandler::kStoredRequestWindowSize = 32;
+const int RTNLHandler::kReceiveBatchSize = 8;
 
 namespace {
 base::LazyInstance<RTNLHandler>::DestructorAtExit g_rtnl_handler =
@@ -60,6 +62,9 @@ base::LazyInstance<RTNLHandler>::DestructorAtExit g_rtnl_handler =
 
 // Increasing buffer size to avoid overflows on IPV6 routing events.
 constexpr int kReceiveBufferBytes = 3 * 1024 * 1024;
+// Size of a datagram buffer. The kernel sizes the datagrams of dumps after the
+// largest buffer read so far, so this also lets dumps take fewer datagrams.
+constexpr size_t kReceiveDatagramBytes = 16 * 1024;
 }  // namespace
 
 RTNLHandler::RTNLHandler()
@@ -70,6 +75,7 @@ RTNLHandler::RTNLHandler()
       request_flags_(0),
       request_sequence_(0),
       last_dump_sequence_(0),
+      batch_depth_(0),
       io_handler_factory_(
           IOHandlerFactoryContainer::GetInstance()->GetIOHandlerFactory()) {
   error_mask_window_.resize(kErrorWindowSize);
@@ -98,9 +104,9 @@ void RTNLHandler::Start(uint32_t netlink_groups_mask) {
 
   SetReceiverBufferSize(kReceiveBufferBytes);
 
-  rtnl_handler_.reset(io_handler_factory_->CreateIOInputHandler(
-      rtnl_socket_, base::Bind(&RTNLHandler::ParseRTNL, base::Unretained(this)),
-      base::Bind(&RTNLHandler::OnReadError, base::Unretained(this))));
+  rtnl_handler_.reset(io_handler_factory_->CreateIOReadyHandler(
+      rtnl_socket_, IOHandler::kModeInput,
+      base::Bind(&RTNLHandler::OnReadable, base::Unretained(this))));
 
   NextRequest(last_dump_sequence_);
   SLOG(this, 2) << "RTNLHandler started";
@@ -128,6 +134,8 @@ void RTNLHandler::Stop() {
   last_dump_sequence_ = 0;
   stored_requests_.clear();
   oldest_request_sequence_ = 0;
+  // An open batch stays open, so that its FlushBatch() call is balanced.
+  batched_messages_.clear();
 
   SLOG(this, 2) << "RTNLHandler stopped";
 }
@@ -274,6 +282,44 @@ void RTNLHandler::NextRequest(uint32_t seq) {
   in_request_ = true;
 }
 
+void RTNLHandler::OnReadable(int fd) {
+  if (receive_buffer_.empty())
+    receive_buffer_.resize(kReceiveBatchSize * kReceiveDatagramBytes);
+
+  struct iovec iovs[kReceiveBatchSize];
+  struct mmsghdr msgs[kReceiveBatchSize];
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < kReceiveBatchSize; i++) {
+    iovs[i].iov_base = &receive_buffer_[i * kReceiveDatagramBytes];
+    iovs[i].iov_len = kReceiveDatagramBytes;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  // Reads all the datagrams pending, up to |kReceiveBatchSize|. The watcher
+  // calls back again if more are left.
+  int count = sockets_->RecvMMsg(fd, msgs, kReceiveBatchSize, MSG_DONTWAIT,
+                                 nullptr);
+  if (count < 0) {
+    int error = sockets_->Error();
+    if (error == EAGAIN || error == EWOULDBLOCK)
+      return;
+    OnReadError(base::StringPrintf("File read error: %d", error));
+    return;
+  }
+
+  // The requests sent by the listeners, e.g. on a link dump, are batched.
+  ScopedBatch batch(this);
+  for (int i = 0; i < count; i++) {
+    if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      LOG(ERROR) << "RTNL datagram truncated to " << msgs[i].msg_len << "b";
+    }
+    InputData data(static_cast<unsigned char*>(iovs[i].iov_base),
+                   msgs[i].msg_len);
+    ParseRTNL(&data);
+  }
+}
+
 void RTNLHandler::ParseRTNL(InputData* data) {
   const unsigned char* buf = data->buf;
   const unsigned char* end = buf + data->len;
@@ -286,16 +332,20 @@ void RTNLHandler::ParseRTNL(InputData* data) {
     SLOG(this, 5) << __func__ << ": received payload (" << end - buf << ")";
 
     RTNLMessage msg;
-    ByteString payload(reinterpret_cast<const unsigned char*>(hdr),
-                       hdr->nlmsg_len);
-    SLOG(this, 5) << "RTNL received payload length " << payload.GetLength()
-                  << ": \"" << payload.HexEncode() << "\"";
+    SLOG(this, 5) << "RTNL received payload length " << hdr->nlmsg_len
+                  << ": \""
+                  << ByteString(reinterpret_cast<const unsigned char*>(hdr),
+                                hdr->nlmsg_len)
+                         .HexEncode()
+                  << "\"";
 
     // Swapping out of |stored_requests_| here ensures that the RTNLMessage will
     // be destructed regardless of the control flow below.
     std::unique_ptr<RTNLMessage> request_msg = PopStoredRequest(hdr->nlmsg_seq);
 
-    if (!msg.Decode(payload)) {
+    // The message is only valid during this iteration, since its attributes
+    // point into |data|. Listeners copy the values they keep.
+    if (!msg.DecodeView(buf, hdr->nlmsg_len)) {
       SLOG(this, 5) << __func__ << ": rtnl packet type " << hdr->nlmsg_type
                     << " length " << hdr->nlmsg_len << " sequence "
                     << hdr->nlmsg_seq;
@@ -520,6 +570,15 @@ bool RTNLHandler::SendMessageWithErrorMask(std::unique_ptr<RTNLMessage> message,
                 << message->mode() << " with error mask size "
                 << error_mask.size();
 
+  // Sends a full batch rather than letting the error masks of its first
+  // messages leave the window. This is done before queuing the next message
+  // rather than after queuing the last one, so that the response callback of
+  // the last one is already registered if the send fails.
+  if (batch_depth_ > 0 &&
+      batched_messages_.size() >= static_cast<size_t>(kErrorWindowSize)) {
+    SendBatch();
+  }
+
   SetErrorMask(request_sequence_, error_mask);
   message->set_seq(request_sequence_);
   ByteString msgdata = message->Encode();
@@ -534,6 +593,16 @@ bool RTNLHandler::SendMessageWithErrorMask(std::unique_ptr<RTNLMessage> message,
 
   request_sequence_++;
 
+  if (batch_depth_ > 0) {
+    // Keeps the messages aligned in the batch.
+    msgdata.Resize(NLMSG_ALIGN(msgdata.GetLength()));
+    batched_messages_.emplace_back(message->seq(), std::move(msgdata));
+    if (msg_seq)
+      *msg_seq = message->seq();
+    StoreRequest(std::move(message));
+    return true;
+  }
+
   if (sockets_->Send(rtnl_socket_, msgdata.GetConstData(), msgdata.GetLength(),
                      0) < 0) {
     PLOG(ERROR) << "RTNL send failed";
@@ -546,6 +615,64 @@ bool RTNLHandler::SendMessageWithErrorMask(std::unique_ptr<RTNLMessage> message,
   return true;
 }
 
+void RTNLHandler::StartBatch() {
+  batch_depth_++;
+}
+
+bool RTNLHandler::FlushBatch() {
+  CHECK_GT(batch_depth_, 0);
+  if (--batch_depth_ > 0)
+    return true;
+  return SendBatch();
+}
+
+bool RTNLHandler::SendBatch() {
+  if (batched_messages_.empty())
+    return true;
+
+  std::vector<struct iovec> iovs;
+  iovs.reserve(batched_messages_.size());
+  for (auto& message : batched_messages_) {
+    iovs.push_back({message.second.GetData(), message.second.GetLength()});
+  }
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iovs.data();
+  msg.msg_iovlen = iovs.size();
+
+  SLOG(this, 5) << "RTNL sending " << batched_messages_.size()
+                << " batched messages";
+
+  std::vector<std::pair<uint32_t, ByteString>> messages;
+  messages.swap(batched_messages_);
+  if (sockets_->SendMsg(rtnl_socket_, &msg, 0) >= 0)
+    return true;
+
+  int error = sockets_->Error();
+  PLOG(ERROR) << "RTNL batch send failed";
+  // None of the messages has been sent, so no response will come.
+  for (const auto& message : messages) {
+    PopStoredRequest(message.first);
+    auto response_callback_iter = response_callbacks_.find(message.first);
+    if (response_callback_iter != response_callbacks_.end()) {
+      ResponseCallback response_callback =
+          std::move(response_callback_iter->second);
+      response_callbacks_.erase(response_callback_iter);
+      std::move(response_callback).Run(error);
+    }
+  }
+  return false;
+}
+
+RTNLHandler::ScopedBatch::ScopedBatch(RTNLHandler* rtnl_handler)
+    : rtnl_handler_(rtnl_handler) {
+  rtnl_handler_->StartBatch();
+}
+
+RTNLHandler::ScopedBatch::~ScopedBatch() {
+  rtnl_handler_->FlushBatch();
+}
+
 void RTNLHandler::OnReadError(const std::string& error_msg) {
   LOG(ERROR) << "RTNL Socket read returns error: " << error_msg;
   ResetSocket();
@@ -11,6 +11,7 @@
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <base/callback.h>
@@ -132,6 +133,28 @@ class SHILL_EXPORT RTNLHandler {
   // not null, then it will be set to the message's assigned sequence number.
   virtual bool SendMessage(std::unique_ptr<RTNLMessage> message, uint32_t* seq);
 
+  // Queues the messages passed to SendMessage() from now on, until
+  // FlushBatch() sends them together with a single sendmsg() call. Sequence
+  // numbers, error masks and response callbacks are assigned as the messages
+  // are queued, so that their responses are handled as usual. Batches nest:
+  // the messages are sent when the outermost batch is flushed.
+  void StartBatch();
+  // Sends the queued messages. Returns false if sending failed, in which case
+  // the response callbacks of the queued messages are run with the error.
+  bool FlushBatch();
+
+  // Batches the messages sent during its lifetime. See StartBatch().
+  class SHILL_EXPORT ScopedBatch {
+   public:
+    explicit ScopedBatch(RTNLHandler* rtnl_handler);
+    ScopedBatch(const ScopedBatch&) = delete;
+    ScopedBatch& operator=(const ScopedBatch&) = delete;
+    ~ScopedBatch();
+
+   private:
+    RTNLHandler* rtnl_handler_;
+  };
+
  protected:
   RTNLHandler();
   RTNLHandler(const RTNLHandler&) = delete;
@@ -158,6 +181,8 @@ class SHILL_EXPORT RTNLHandler {
   // Size of the window for maintaining RTNLMessages in |stored_requests_| that
   // haven't yet gotten a response.
   static const uint32_t kStoredRequestWindowSize;
+  // Maximum number of datagrams read from the socket at once.
+  static const int kReceiveBatchSize;
 
   // This stops the event-monitoring function of the RTNL handler -- it is
   // private since it will never happen in normal running, but is useful for
@@ -172,6 +197,8 @@ class SHILL_EXPORT RTNLHandler {
   void DispatchEvent(int type, const RTNLMessage& msg);
   // Send the next table-dump request to the kernel
   void NextRequest(uint32_t seq);
+  // Reads the datagrams pending on the socket and parses them.
+  void OnReadable(int fd);
   // Parse an incoming rtnl message from the kernel
   void ParseRTNL(InputData* data);
 
@@ -191,6 +218,9 @@ class SHILL_EXPORT RTNLHandler {
                                 const ErrorMask& error_mask,
                                 uint32_t* msg_seq);
 
+  // Sends the messages queued in |batched_messages_|.
+  bool SendBatch();
+
   // Called by the RTNL read handler on exceptional events.
   void OnReadError(const std::string& error_msg);
 
@@ -229,6 +259,12 @@ class SHILL_EXPORT RTNLHandler {
   uint32_t oldest_request_sequence_;
   // Mapping of sequence number to corresponding RTNLMessage.
   std::map<uint32_t, std::unique_ptr<RTNLMessage>> stored_requests_;
+  // Nesting depth of StartBatch() calls, and encoded messages waiting to be
+  // sent by FlushBatch(), with their sequence numbers.
+  int batch_depth_;
+  std::vector<std::pair<uint32_t, ByteString>> batched_messages_;
+  // Receive buffers of the datagrams read by OnReadable().
+  std::vector<unsigned char> receive_buffer_;
 
   base::ObserverList<RTNLListener> listeners_;
   std::unique_ptr<IOHandler> rtnl_handler_;
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include "shill/net/byte_string.h"
 #include "shill/net/io_handler.h"
 #include "shill/net/rtnl_handler.h"
 #include "shill/net/rtnl_listener.h"
@@ -18,7 +19,10 @@ class RTNLHandlerFuzz {
  public:
   static void Run(const uint8_t* data, size_t size) {
     base::AtExitManager exit_manager;
-    InputData input(static_cast<const unsigned char*>(data), size);
+    // Copies the input, since RTNLHandler decodes messages in place and expects
+    // them to be aligned like in the socket read buffer.
+    ByteString packet(static_cast<const unsigned char*>(data), size);
+    InputData input(packet.GetConstData(), packet.GetLength());
 
     // Listen for all messages.
     RTNLListener listener(~0, base::BindRepeating(&RTNLHandlerFuzz::Listener));
@@ -7,6 +7,7 @@
 #include <limits>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <net/if.h>
@@ -51,6 +52,30 @@ MATCHER_P(MessageType, message_type, "") {
   return std::get<0>(arg).type() == message_type;
 }
 
+// Matches a sendmsg() header with |count| messages, with consecutive sequence
+// numbers from |first_seq|.
+MATCHER_P2(IsBatch, count, first_seq, "") {
+  if (arg->msg_iovlen != count)
+    return false;
+  for (size_t i = 0; i < count; i++) {
+    const auto* hdr =
+        reinterpret_cast<const struct nlmsghdr*>(arg->msg_iov[i].iov_base);
+    if (hdr->nlmsg_seq != first_seq + i)
+      return false;
+  }
+  return true;
+}
+
+// Fills the recvmmsg() buffers with |datagrams|.
+ACTION_P(ReceiveDatagrams, datagrams) {
+  for (size_t i = 0; i < datagrams.size(); i++) {
+    memcpy(arg1[i].msg_hdr.msg_iov[0].iov_base, datagrams[i].GetConstData(),
+           datagrams[i].GetLength());
+    arg1[i].msg_len = datagrams[i].GetLength();
+  }
+  return static_cast<int>(datagrams.size());
+}
+
 std::unique_ptr<RTNLMessage> CreateFakeMessage() {
   return std::make_unique<RTNLMessage>(RTNLMessage::kTypeLink,
                                        RTNLMessage::kModeGet, 0, 0, 0, 0,
@@ -123,6 +148,8 @@ class RTNLHandlerTest : public Test {
     return RTNLHandler::GetInstance()->oldest_request_sequence_;
   }
 
+  void OnReadable() { RTNLHandler::GetInstance()->OnReadable(kTestSocket); }
+
   MOCK_METHOD(void, HandlerCallback, (const RTNLMessage&));
 
  protected:
@@ -158,7 +185,8 @@ void RTNLHandlerTest::StartRTNLHandler() {
   EXPECT_CALL(*sockets_, SetReceiveBuffer(kTestSocket, _))
       .Times(AtLeast(1))
       .WillRepeatedly(Return(0));
-  EXPECT_CALL(io_handler_factory_, CreateIOInputHandler(kTestSocket, _, _));
+  EXPECT_CALL(io_handler_factory_,
+              CreateIOReadyHandler(kTestSocket, IOHandler::kModeInput, _));
   RTNLHandler::GetInstance()->Start(0);
 }
 
@@ -595,4 +623,150 @@ TEST_F(RTNLHandlerTest, AddInterfaceTest) {
   StopRTNLHandler();
 }
 
+TEST_F(RTNLHandlerTest, SendBatch) {
+  StartRTNLHandler();
+  constexpr uint32_t kSequenceNumber = 123;
+  constexpr size_t kBatchSize = 3;
+  SetRequestSequence(kSequenceNumber);
+  EXPECT_CALL(*sockets_, Send(_, _, _, _)).Times(0);
+  EXPECT_CALL(*sockets_,
+              SendMsg(kTestSocket, IsBatch(kBatchSize, kSequenceNumber), 0))
+      .WillOnce(Return(0));
+
+  RTNLHandler* rtnl_handler = RTNLHandler::GetInstance();
+  rtnl_handler->StartBatch();
+  {
+    // A nested batch is sent with the outer one.
+    RTNLHandler::ScopedBatch batch(rtnl_handler);
+    for (size_t i = 0; i < kBatchSize; i++) {
+      uint32_t seq;
+      EXPECT_TRUE(rtnl_handler->SendMessage(CreateFakeMessage(), &seq));
+      EXPECT_EQ(kSequenceNumber + i, seq);
+    }
+  }
+  EXPECT_EQ(kSequenceNumber + kBatchSize, GetRequestSequence());
+  EXPECT_EQ(kBatchSize, CalculateStoredRequestWindowSize());
+  EXPECT_TRUE(rtnl_handler->FlushBatch());
+
+  // Nothing is left to send.
+  { RTNLHandler::ScopedBatch empty_batch(rtnl_handler); }
+
+  StopRTNLHandler();
+}
+
+TEST_F(RTNLHandlerTest, SendBatchLargerThanErrorWindow) {
+  StartRTNLHandler();
+  constexpr uint32_t kSequenceNumber = 123;
+  const size_t window_size = GetErrorWindowSize();
+  SetRequestSequence(kSequenceNumber);
+  EXPECT_CALL(*sockets_,
+              SendMsg(kTestSocket, IsBatch(window_size, kSequenceNumber), 0))
+      .WillOnce(Return(0));
+  EXPECT_CALL(*sockets_,
+              SendMsg(kTestSocket, IsBatch(1u, kSequenceNumber + window_size),
+                      0))
+      .WillOnce(Return(0));
+
+  {
+    RTNLHandler::ScopedBatch batch(RTNLHandler::GetInstance());
+    for (size_t i = 0; i < window_size + 1; i++) {
+      EXPECT_TRUE(RTNLHandler::GetInstance()->SendMessage(CreateFakeMessage(),
+                                                          nullptr));
+    }
+  }
+
+  StopRTNLHandler();
+}
+
+TEST_F(RTNLHandlerTest, SendBatchFailure) {
+  StartRTNLHandler();
+  constexpr uint32_t kSequenceNumber = 123;
+  SetRequestSequence(kSequenceNumber);
+  EXPECT_CALL(*sockets_, SendMsg(kTestSocket, IsBatch(2u, kSequenceNumber), 0))
+      .WillOnce(Return(-1));
+  EXPECT_CALL(*sockets_, Error()).WillOnce(Return(ENOBUFS));
+
+  int32_t response_error = 0;
+  RTNLHandler* rtnl_handler = RTNLHandler::GetInstance();
+  rtnl_handler->StartBatch();
+  EXPECT_TRUE(rtnl_handler->SendMessage(CreateFakeMessage(), nullptr));
+  EXPECT_TRUE(rtnl_handler->AddInterface(
+      "wg0", "wireguard", ByteString{},
+      base::BindOnce([](int32_t* out, int32_t error) { *out = error; },
+                     &response_error)));
+  EXPECT_FALSE(rtnl_handler->FlushBatch());
+
+  // The requests are dropped, and the response callbacks are run.
+  EXPECT_EQ(ENOBUFS, response_error);
+  EXPECT_EQ(nullptr, PopStoredRequest(kSequenceNumber));
+  EXPECT_EQ(nullptr, PopStoredRequest(kSequenceNumber + 1));
+
+  StopRTNLHandler();
+}
+
+TEST_F(RTNLHandlerTest, SendFullBatchFailure) {
+  StartRTNLHandler();
+  constexpr uint32_t kSequenceNumber = 123;
+  const size_t window_size = GetErrorWindowSize();
+  SetRequestSequence(kSequenceNumber);
+  EXPECT_CALL(*sockets_,
+              SendMsg(kTestSocket, IsBatch(window_size, kSequenceNumber), 0))
+      .WillOnce(Return(-1));
+  EXPECT_CALL(*sockets_, Error()).WillOnce(Return(ENOBUFS));
+  EXPECT_CALL(*sockets_,
+              SendMsg(kTestSocket, IsBatch(1u, kSequenceNumber + window_size),
+                      0))
+      .WillOnce(Return(0));
+
+  int32_t response_error = 0;
+  RTNLHandler* rtnl_handler = RTNLHandler::GetInstance();
+  {
+    RTNLHandler::ScopedBatch batch(rtnl_handler);
+    for (size_t i = 0; i < window_size - 1; i++) {
+      EXPECT_TRUE(rtnl_handler->SendMessage(CreateFakeMessage(), nullptr));
+    }
+    // The last message of the full batch registers its response callback
+    // after being queued.
+    EXPECT_TRUE(rtnl_handler->AddInterface(
+        "wg0", "wireguard", ByteString{},
+        base::BindOnce([](int32_t* out, int32_t error) { *out = error; },
+                       &response_error)));
+    EXPECT_EQ(0, response_error);
+
+    // The full batch is sent when the next message is queued.
+    EXPECT_TRUE(rtnl_handler->SendMessage(CreateFakeMessage(), nullptr));
+    EXPECT_EQ(ENOBUFS, response_error);
+  }
+
+  StopRTNLHandler();
+}
+
+TEST_F(RTNLHandlerTest, ReadDatagrams) {
+  StartRTNLHandler();
+
+  RTNLListener listener(
+      RTNLHandler::kRequestLink | RTNLHandler::kRequestNeighbor, callback_);
+  EXPECT_CALL(*this, HandlerCallback(A<const RTNLMessage&>()))
+      .With(MessageType(RTNLMessage::kTypeLink));
+  EXPECT_CALL(*this, HandlerCallback(A<const RTNLMessage&>()))
+      .With(MessageType(RTNLMessage::kTypeNeighbor));
+
+  RTNLMessage link(RTNLMessage::kTypeLink, RTNLMessage::kModeAdd, 0, 0, 0,
+                   kTestDeviceIndex, IPAddress::kFamilyIPv4);
+  RTNLMessage neighbor(RTNLMessage::kTypeNeighbor, RTNLMessage::kModeAdd, 0, 0,
+                       0, kTestDeviceIndex, IPAddress::kFamilyIPv4);
+  std::vector<ByteString> datagrams = {link.Encode(), neighbor.Encode()};
+  EXPECT_CALL(*sockets_, RecvMMsg(kTestSocket, _, _, MSG_DONTWAIT, nullptr))
+      .WillOnce(ReceiveDatagrams(datagrams));
+  OnReadable();
+
+  // Nothing left to read is not an error.
+  EXPECT_CALL(*sockets_, RecvMMsg(kTestSocket, _, _, MSG_DONTWAIT, nullptr))
+      .WillOnce(Return(-1));
+  EXPECT_CALL(*sockets_, Error()).WillOnce(Return(EAGAIN));
+  OnReadable();
+
+  StopRTNLHandler();
+}
+
 }  // namespace shill
@@ -16,7 +16,6 @@
 #include <sys/socket.h>
 
 #include <map>
-#include <memory>
 #include <utility>
 
 #include <base/logging.h>
@@ -222,25 +221,30 @@ std::string GetRouteProtocol(uint8_t protocol) {
   return it->second;
 }
 
-std::unique_ptr<RTNLAttrMap> ParseAttrs(struct rtattr* data, int len) {
-  RTNLAttrMap attrs;
-  ByteString attr_bytes(reinterpret_cast<const char*>(data), len);
+// Parses the rtattr list at |data| into |attrs|, pointing into |data|.
+// Returns false if the list is malformed.
+bool ParseAttrs(struct rtattr* data, int len, RTNLAttrViewMap* attrs) {
+  const unsigned char* attr_bytes = reinterpret_cast<unsigned char*>(data);
+  const int attr_length = len;
 
+  attrs->clear();
   while (data && RTA_OK(data, len)) {
-    attrs[data->rta_type] = ByteString(
-        reinterpret_cast<unsigned char*>(RTA_DATA(data)), RTA_PAYLOAD(data));
+    (*attrs)[data->rta_type] = {
+        reinterpret_cast<unsigned char*>(RTA_DATA(data)), RTA_PAYLOAD(data)};
     // Note: RTA_NEXT() performs subtraction on 'len'. It's important that
     // 'len' is a signed integer, so underflow works properly.
     data = RTA_NEXT(data, len);
   }
 
   if (len) {
-    LOG(ERROR) << "Error parsing RTNL attributes <" << attr_bytes.HexEncode()
+    LOG(ERROR) << "Error parsing RTNL attributes <"
+               << ByteString(attr_bytes, attr_length).HexEncode()
                << ">, trailing length: " << len;
-    return nullptr;
+    attrs->clear();
+    return false;
   }
 
-  return std::make_unique<RTNLAttrMap>(attrs);
+  return true;
 }
 
 // Returns the interface name for the device with interface index |ifindex|, or
@@ -323,19 +327,31 @@ RTNLMessage::RTNLMessage(Type type,
       family_(family) {}
 
 bool RTNLMessage::Decode(const ByteString& msg) {
-  bool ret = DecodeInternal(msg);
+  if (!DecodeView(msg.GetConstData(), msg.GetLength()))
+    return false;
+  CopyAttributes();
+  return true;
+}
+
+bool RTNLMessage::DecodeView(const unsigned char* data, size_t length) {
+  bool ret = DecodeInternal(data, length);
   if (!ret) {
     Reset();
   }
   return ret;
 }
 
-bool RTNLMessage::DecodeInternal(const ByteString& msg) {
-  const RTNLHeader* hdr =
-      reinterpret_cast<const RTNLHeader*>(msg.GetConstData());
+void RTNLMessage::CopyAttributes() {
+  for (const auto& pair : attribute_views_) {
+    attributes_[pair.first] = ByteString(pair.second.data, pair.second.length);
+  }
+  attribute_views_.clear();
+}
+
+bool RTNLMessage::DecodeInternal(const unsigned char* data, size_t length) {
+  const RTNLHeader* hdr = reinterpret_cast<const RTNLHeader*>(data);
 
-  if (msg.GetLength() < sizeof(hdr->hdr) ||
-      msg.GetLength() < hdr->hdr.nlmsg_len)
+  if (length < sizeof(hdr->hdr) || length < hdr->hdr.nlmsg_len)
     return false;
 
   mode_ = kModeUnknown;
@@ -408,16 +424,8 @@ bool RTNLMessage::DecodeInternal(const ByteString& msg) {
   seq_ = hdr->hdr.nlmsg_seq;
   pid_ = hdr->hdr.nlmsg_pid;
 
-  std::unique_ptr<RTNLAttrMap> attrs = ParseAttrs(attr_data, attr_length);
-  if (!attrs) {
-    attributes_.clear();
-    return false;
-  }
-
-  for (const auto& pair : *attrs) {
-    SetAttribute(pair.first, pair.second);
-  }
-  return true;
+  attributes_.clear();
+  return ParseAttrs(attr_data, attr_length, &attribute_views_);
 }
 
 bool RTNLMessage::DecodeLink(const RTNLHeader* hdr,
@@ -434,29 +442,34 @@ bool RTNLMessage::DecodeLink(const RTNLHeader* hdr,
   family_ = hdr->ifi.ifi_family;
   interface_index_ = hdr->ifi.ifi_index;
 
-  std::unique_ptr<RTNLAttrMap> attrs = ParseAttrs(*attr_data, *attr_length);
-  if (!attrs)
+  RTNLAttrViewMap attrs;
+  if (!ParseAttrs(*attr_data, *attr_length, &attrs))
     return false;
 
   base::Optional<std::string> kind_option;
 
-  if (base::Contains(*attrs, IFLA_LINKINFO)) {
-    ByteString& bytes = attrs->find(IFLA_LINKINFO)->second;
-    struct rtattr* link_data =
-        reinterpret_cast<struct rtattr*>(bytes.GetData());
-    size_t link_len = bytes.GetLength();
-    std::unique_ptr<RTNLAttrMap> linkinfo = ParseAttrs(link_data, link_len);
-
-    if (linkinfo && base::Contains(*linkinfo, IFLA_INFO_KIND)) {
-      ByteString& kindBytes = linkinfo->find(IFLA_INFO_KIND)->second;
-      const char* kind = reinterpret_cast<const char*>(kindBytes.GetData());
-      std::string kind_string(kind, strnlen(kind, kindBytes.GetLength()));
+  const auto linkinfo_it = attrs.find(IFLA_LINKINFO);
+  if (linkinfo_it != attrs.end()) {
+    // The nested attributes are aligned, since IFLA_LINKINFO is.
+    struct rtattr* link_data = reinterpret_cast<struct rtattr*>(
+        const_cast<unsigned char*>(linkinfo_it->second.data));
+    int link_len = linkinfo_it->second.length;
+    RTNLAttrViewMap linkinfo;
+    ParseAttrs(link_data, link_len, &linkinfo);
+
+    const auto kind_it = linkinfo.find(IFLA_INFO_KIND);
+    if (kind_it != linkinfo.end()) {
+      const char* kind = reinterpret_cast<const char*>(kind_it->second.data);
+      std::string kind_string(kind, strnlen(kind, kind_it->second.length));
       if (base::IsStringASCII(kind_string))
         kind_option = kind_string;
       else
         LOG(ERROR) << base::StringPrintf(
             "Invalid kind <%s>, interface index %d",
-            kindBytes.HexEncode().c_str(), interface_index_);
+            ByteString(kind_it->second.data, kind_it->second.length)
+                .HexEncode()
+                .c_str(),
+            interface_index_);
     }
   }
 
@@ -663,7 +676,16 @@ ByteString RTNLMessage::Encode() const {
   }
 
   size_t header_length = hdr.hdr.nlmsg_len;
-  ByteString attributes = PackAttrs(attributes_);
+  ByteString attributes;
+  if (attribute_views_.empty()) {
+    attributes = PackAttrs(attributes_);
+  } else {
+    RTNLAttrMap attrs = attributes_;
+    for (const auto& pair : attribute_views_) {
+      attrs[pair.first] = ByteString(pair.second.data, pair.second.length);
+    }
+    attributes = PackAttrs(attrs);
+  }
   hdr.hdr.nlmsg_len = NLMSG_ALIGN(hdr.hdr.nlmsg_len) + attributes.GetLength();
   ByteString packet(reinterpret_cast<unsigned char*>(&hdr), header_length);
   packet.Append(attributes);
@@ -789,20 +811,52 @@ void RTNLMessage::Reset() {
   neighbor_status_ = NeighborStatus();
   rdnss_option_ = RdnssOption();
   attributes_.clear();
+  attribute_views_.clear();
+}
+
+bool RTNLMessage::GetAttributeData(uint16_t attr,
+                                   const unsigned char** data,
+                                   size_t* length) const {
+  const auto it = attributes_.find(attr);
+  if (it != attributes_.end()) {
+    *data = it->second.GetConstData();
+    *length = it->second.GetLength();
+    return true;
+  }
+  const auto view_it = attribute_views_.find(attr);
+  if (view_it != attribute_views_.end()) {
+    *data = view_it->second.data;
+    *length = view_it->second.length;
+    return true;
+  }
+  return false;
+}
+
+const ByteString RTNLMessage::GetAttribute(uint16_t attr) const {
+  const unsigned char* data;
+  size_t length;
+  if (!GetAttributeData(attr, &data, &length))
+    return ByteString(0);
+  return ByteString(data, length);
 }
 
 uint32_t RTNLMessage::GetUint32Attribute(uint16_t attr) const {
+  const unsigned char* data;
+  size_t length;
   uint32_t val = 0;
-  GetAttribute(attr).ConvertToCPUUInt32(&val);
+  // Same as ByteString::ConvertToCPUUInt32(), without the copy.
+  if (GetAttributeData(attr, &data, &length) && length == sizeof(val))
+    memcpy(&val, data, sizeof(val));
   return val;
 }
 
 std::string RTNLMessage::GetStringAttribute(uint16_t attr) const {
-  if (!HasAttribute(attr))
+  const unsigned char* data;
+  size_t length;
+  if (!GetAttributeData(attr, &data, &length))
     return "";
-  ByteString bytes = GetAttribute(attr);
-  size_t len = strnlen(bytes.GetConstCString(), bytes.GetLength());
-  return std::string(bytes.GetConstCString(), len);
+  const char* str = reinterpret_cast<const char*>(data);
+  return std::string(str, strnlen(str, length));
 }
 
 std::string RTNLMessage::GetIflaIfname() const {
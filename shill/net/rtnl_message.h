@@ -25,6 +25,13 @@ struct RTNLHeader;
 
 using RTNLAttrMap = std::unordered_map<uint16_t, ByteString>;
 
+// An rtattr payload which is not copied out of the received packet.
+struct RTNLAttrView {
+  const unsigned char* data;
+  size_t length;
+};
+using RTNLAttrViewMap = std::unordered_map<uint16_t, RTNLAttrView>;
+
 // Helper class for processing rtnetlink messages. See uapi/linux/rtnetlink.h
 // and rtnetlink manual page for details about the message binary encoding and
 // meaning of struct fields populated by the kernel.
@@ -162,6 +169,14 @@ class SHILL_EXPORT RTNLMessage {
 
   // Parse an RTNL message.  Returns true on success.
   bool Decode(const ByteString& data);
+  // Same as Decode(), but the attribute values are not copied: they point into
+  // |data|, which must outlive the message, or be valid until the next
+  // Decode*() or Reset() call. Values are copied only when they are read, or
+  // all at once by CopyAttributes().
+  bool DecodeView(const unsigned char* data, size_t length);
+  // Copies the attribute values which point into the decoded packet, so that
+  // the message does not depend on the packet buffer anymore.
+  void CopyAttributes();
   // Encode an RTNL message.  Returns empty ByteString on failure.
   ByteString Encode() const;
   // Reset all fields.
@@ -205,12 +220,12 @@ class SHILL_EXPORT RTNLMessage {
   // type that's used in the system headers.  Use uint16_t instead and hope
   // that the conversion never ends up truncating on some strange platform.
   bool HasAttribute(uint16_t attr) const {
-    return base::Contains(attributes_, attr);
-  }
-  const ByteString GetAttribute(uint16_t attr) const {
-    return HasAttribute(attr) ? attributes_.find(attr)->second : ByteString(0);
+    return base::Contains(attributes_, attr) ||
+           base::Contains(attribute_views_, attr);
   }
+  const ByteString GetAttribute(uint16_t attr) const;
   void SetAttribute(uint16_t attr, const ByteString& val) {
+    attribute_views_.erase(attr);
     attributes_[attr] = val;
   }
   // Return the value of an rtattr attribute of type uint32_t.
@@ -276,7 +291,11 @@ class SHILL_EXPORT RTNLMessage {
                        const ByteString& info_data);
 
  private:
-  SHILL_PRIVATE bool DecodeInternal(const ByteString& msg);
+  SHILL_PRIVATE bool DecodeInternal(const unsigned char* data, size_t length);
+  // Returns the value of |attr| without copying it, or false if it is absent.
+  SHILL_PRIVATE bool GetAttributeData(uint16_t attr,
+                                      const unsigned char** data,
+                                      size_t* length) const;
   SHILL_PRIVATE bool DecodeLink(const RTNLHeader* hdr,
                                 rtattr** attr_data,
                                 int* attr_length);
@@ -327,8 +346,11 @@ class SHILL_EXPORT RTNLMessage {
   RouteStatus route_status_;
   NeighborStatus neighbor_status_;
   RdnssOption rdnss_option_;
-  // Additional rtattr contained in the message.
+  // Additional rtattr contained in the message. An attribute is either in
+  // |attributes_|, or in |attribute_views_| when it has been decoded by
+  // DecodeView() and not copied since.
   RTNLAttrMap attributes_;
+  RTNLAttrViewMap attribute_views_;
   // NOTE: Update Reset() accordingly when adding a new member field.
 };
 
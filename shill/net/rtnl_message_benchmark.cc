@@ -0,0 +1,185 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Compares decoding RTNL messages with copied attributes (Decode()) against
+// decoding them in place (DecodeView()), as RTNLHandler does on dumps. The
+// input is a dump of netlink messages as read from the socket (the same
+// format as rtnl_handler_fuzzer inputs), or a synthesized dump of addresses
+// and routes if none is given.
+// Usage: rtnl_message_benchmark [--dump=FILE] [benchmark flags]
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <string.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/at_exit.h>
+#include <base/check.h>
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/strings/string_util.h>
+#include <benchmark/benchmark.h>
+
+#include "shill/net/byte_string.h"
+#include "shill/net/ip_address.h"
+#include "shill/net/rtnl_message.h"
+
+namespace shill {
+
+namespace {
+
+constexpr char kDumpFlag[] = "--dump=";
+constexpr int kSynthesizedRoutes = 1000;
+
+ByteString* g_dump = nullptr;
+// Offsets and lengths of the messages in |g_dump|.
+std::vector<std::pair<size_t, size_t>>* g_messages = nullptr;
+
+void AppendMessage(const RTNLMessage& msg) {
+  ByteString packet = msg.Encode();
+  CHECK(!packet.IsEmpty());
+  packet.Resize(NLMSG_ALIGN(packet.GetLength()));
+  g_dump->Append(packet);
+}
+
+// Synthesizes the response to a route dump, with an address per interface.
+void SynthesizeDump() {
+  for (int i = 0; i < kSynthesizedRoutes; i++) {
+    const int interface_index = 2 + i % 8;
+    IPAddress dst(IPAddress::kFamilyIPv4,
+                  ByteString::CreateFromNetUInt32(0x0a000000 | (i << 8)), 24);
+    IPAddress gateway(IPAddress::kFamilyIPv4,
+                      ByteString::CreateFromNetUInt32(0xc0a80001 + i % 8));
+
+    if (i < 8) {
+      RTNLMessage address(RTNLMessage::kTypeAddress, RTNLMessage::kModeAdd, 0,
+                          0, 0, interface_index, IPAddress::kFamilyIPv4);
+      address.set_address_status(
+          RTNLMessage::AddressStatus(24, 0, RT_SCOPE_UNIVERSE));
+      address.SetAttribute(IFA_ADDRESS, gateway.address());
+      address.SetAttribute(IFA_LOCAL, gateway.address());
+      address.SetAttribute(IFA_LABEL, ByteString(std::string("eth0"), true));
+      AppendMessage(address);
+    }
+
+    RTNLMessage route(RTNLMessage::kTypeRoute, RTNLMessage::kModeAdd,
+                      NLM_F_MULTI, 0, 0, 0, IPAddress::kFamilyIPv4);
+    route.set_route_status(RTNLMessage::RouteStatus(
+        dst.prefix(), 0, RT_TABLE_MAIN, RTPROT_BOOT, RT_SCOPE_UNIVERSE,
+        RTN_UNICAST, 0));
+    route.SetAttribute(RTA_DST, dst.address());
+    route.SetAttribute(RTA_GATEWAY, gateway.address());
+    route.SetAttribute(RTA_OIF,
+                       ByteString::CreateFromCPUUInt32(interface_index));
+    route.SetAttribute(RTA_TABLE, ByteString::CreateFromCPUUInt32(1000 + i));
+    route.SetAttribute(RTA_PRIORITY, ByteString::CreateFromCPUUInt32(10));
+    AppendMessage(route);
+  }
+}
+
+void SplitMessages() {
+  g_messages = new std::vector<std::pair<size_t, size_t>>();
+  const unsigned char* buf = g_dump->GetConstData();
+  const size_t length = g_dump->GetLength();
+  size_t offset = 0;
+  while (offset < length) {
+    const struct nlmsghdr* hdr =
+        reinterpret_cast<const struct nlmsghdr*>(buf + offset);
+    if (!NLMSG_OK(hdr, static_cast<unsigned int>(length - offset)))
+      break;
+    g_messages->emplace_back(offset, hdr->nlmsg_len);
+    offset += NLMSG_ALIGN(hdr->nlmsg_len);
+  }
+  CHECK(!g_messages->empty());
+}
+
+// Reads the fields which DeviceInfo and RoutingTable read on dumps.
+void ReadFields(const RTNLMessage& msg) {
+  switch (msg.type()) {
+    case RTNLMessage::kTypeLink:
+      benchmark::DoNotOptimize(msg.GetIflaIfname());
+      break;
+    case RTNLMessage::kTypeAddress:
+      benchmark::DoNotOptimize(msg.GetIfaAddress());
+      break;
+    case RTNLMessage::kTypeRoute:
+      benchmark::DoNotOptimize(msg.GetRtaTable());
+      benchmark::DoNotOptimize(msg.GetRtaDst());
+      benchmark::DoNotOptimize(msg.GetRtaGateway());
+      benchmark::DoNotOptimize(msg.GetUint32Attribute(RTA_OIF));
+      break;
+    default:
+      break;
+  }
+}
+
+void SetCounters(benchmark::State& state) {
+  state.SetItemsProcessed(state.iterations() * g_messages->size());
+  state.SetBytesProcessed(state.iterations() * g_dump->GetLength());
+}
+
+// What RTNLHandler used to do: copies each message, then its attributes.
+void BM_Decode(benchmark::State& state) {
+  const unsigned char* buf = g_dump->GetConstData();
+  for (auto _ : state) {
+    for (const auto& message : *g_messages) {
+      RTNLMessage msg;
+      bool result =
+          msg.Decode(ByteString(buf + message.first, message.second));
+      benchmark::DoNotOptimize(result);
+      if (state.range(0))
+        ReadFields(msg);
+    }
+  }
+  SetCounters(state);
+}
+BENCHMARK(BM_Decode)->ArgName("read")->Arg(0)->Arg(1);
+
+void BM_DecodeView(benchmark::State& state) {
+  const unsigned char* buf = g_dump->GetConstData();
+  for (auto _ : state) {
+    for (const auto& message : *g_messages) {
+      RTNLMessage msg;
+      bool result = msg.DecodeView(buf + message.first, message.second);
+      benchmark::DoNotOptimize(result);
+      if (state.range(0))
+        ReadFields(msg);
+    }
+  }
+  SetCounters(state);
+}
+BENCHMARK(BM_DecodeView)->ArgName("read")->Arg(0)->Arg(1);
+
+}  // namespace
+
+}  // namespace shill
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit;
+  logging::SetMinLogLevel(logging::LOGGING_FATAL);
+
+  shill::g_dump = new shill::ByteString();
+  base::FilePath dump_path;
+  for (int i = 1; i < argc; i++) {
+    if (base::StartsWith(argv[i], shill::kDumpFlag))
+      dump_path = base::FilePath(argv[i] + strlen(shill::kDumpFlag));
+  }
+  if (dump_path.empty()) {
+    shill::SynthesizeDump();
+  } else {
+    std::string content;
+    CHECK(base::ReadFileToString(dump_path, &content))
+        << "Failed to read " << dump_path.value();
+    *shill::g_dump = shill::ByteString(content, false);
+  }
+  shill::SplitMessages();
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
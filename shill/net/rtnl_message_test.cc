@@ -752,6 +752,43 @@ TEST_F(RTNLMessageTest, DelLinkEth0) {
                 kDelLinkMessageEth0OperState);
 }
 
+TEST_F(RTNLMessageTest, DecodeView) {
+  ByteString packet(kNewLinkMessageWlan0, sizeof(kNewLinkMessageWlan0));
+  RTNLMessage msg;
+  EXPECT_TRUE(msg.DecodeView(packet.GetConstData(), packet.GetLength()));
+  EXPECT_EQ(RTNLMessage::kTypeLink, msg.type());
+  EXPECT_EQ(kNewLinkMessageWlan0InterfaceIndex, msg.interface_index());
+  EXPECT_EQ(kNewLinkMessageWlan0InterfaceName, msg.GetIflaIfname());
+  EXPECT_EQ(kNewLinkMessageWlan0MTU, msg.GetUint32Attribute(IFLA_MTU));
+  EXPECT_TRUE(msg.GetAttribute(IFLA_QDISC)
+                  .Equals(ByteString(std::string(kNewLinkMessageWlan0Qdisc),
+                                     true)));
+
+  // Encoding does not depend on whether the attributes have been copied.
+  RTNLMessage copied_msg;
+  EXPECT_TRUE(copied_msg.Decode(packet));
+  EXPECT_TRUE(msg.Encode().Equals(copied_msg.Encode()));
+
+  // A set value replaces the decoded one.
+  msg.SetAttribute(IFLA_MTU, ByteString::CreateFromCPUUInt32(1280));
+  EXPECT_EQ(1280, msg.GetUint32Attribute(IFLA_MTU));
+
+  // The values do not point into the packet anymore once copied.
+  msg.CopyAttributes();
+  packet.Clear();
+  EXPECT_EQ(kNewLinkMessageWlan0InterfaceName, msg.GetIflaIfname());
+  EXPECT_EQ(1280, msg.GetUint32Attribute(IFLA_MTU));
+
+  msg.Reset();
+  EXPECT_FALSE(msg.HasAttribute(IFLA_IFNAME));
+}
+
+TEST_F(RTNLMessageTest, DecodeViewBusted) {
+  RTNLMessage msg;
+  EXPECT_FALSE(msg.DecodeView(kAddRouteBusted, sizeof(kAddRouteBusted)));
+  EXPECT_EQ(RTNLMessage::kTypeUnknown, msg.type());
+}
+
 TEST_F(RTNLMessageTest, NewAddrIPv4) {
   IPAddress addr(IPAddress::kFamilyIPv4);
 
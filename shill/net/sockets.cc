@@ -115,6 +115,14 @@ ssize_t Sockets::RecvFrom(int sockfd,
   return HANDLE_EINTR(recvfrom(sockfd, buf, len, flags, src_addr, addrlen));
 }
 
+int Sockets::RecvMMsg(int sockfd,
+                      struct mmsghdr* msgvec,
+                      unsigned int vlen,
+                      int flags,
+                      struct timespec* timeout) const {
+  return HANDLE_EINTR(recvmmsg(sockfd, msgvec, vlen, flags, timeout));
+}
+
 int Sockets::Select(int nfds,
                     fd_set* readfds,
                     fd_set* writefds,
@@ -130,6 +138,12 @@ ssize_t Sockets::Send(int sockfd,
   return HANDLE_EINTR(send(sockfd, buf, len, flags));
 }
 
+ssize_t Sockets::SendMsg(int sockfd,
+                         const struct msghdr* msg,
+                         int flags) const {
+  return HANDLE_EINTR(sendmsg(sockfd, msg, flags));
+}
+
 ssize_t Sockets::SendTo(int sockfd,
                         const void* buf,
                         size_t len,
@@ -88,6 +88,13 @@ class SHILL_EXPORT Sockets {
                            struct sockaddr* src_addr,
                            socklen_t* addrlen) const;
 
+  // recvmmsg
+  virtual int RecvMMsg(int sockfd,
+                       struct mmsghdr* msgvec,
+                       unsigned int vlen,
+                       int flags,
+                       struct timespec* timeout) const;
+
   // select
   virtual int Select(int nfds,
                      fd_set* readfds,
@@ -101,6 +108,11 @@ class SHILL_EXPORT Sockets {
                        size_t len,
                        int flags) const;
 
+  // sendmsg
+  virtual ssize_t SendMsg(int sockfd,
+                          const struct msghdr* msg,
+                          int flags) const;
+
   // sendto
   virtual ssize_t SendTo(int sockfd,
                          const void* buf,
@@ -4,11 +4,13 @@
 
 #include "shill/profile.h"
 
+#include <memory>
 #include <set>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <base/bind.h>
 #include <base/check.h>
 #include <base/files/file_util.h>
 #include <base/logging.h>
@@ -16,6 +18,7 @@
 #include <base/strings/string_split.h>
 #include <base/strings/string_util.h>
 #include <base/strings/stringprintf.h>
+#include <base/time/time.h>
 #include <chromeos/dbus/service_constants.h>
 #include <chromeos/dbus/shill/dbus-constants.h>
 
@@ -35,6 +38,23 @@
 
 namespace shill {
 
+namespace {
+
+// Delay of writing the profile after a change. Changes often come in bursts,
+// e.g. when a service connects or a scan updates many services, and each of
+// them is followed by a flush.
+constexpr base::TimeDelta kStorageFlushDelay = base::TimeDelta::FromSeconds(1);
+
+// Reports the result of a deferred write of the profile, whose Flush()
+// returned before writing.
+void OnStorageFlushed(const base::FilePath& path, bool success) {
+  if (!success) {
+    LOG(ERROR) << "Failed to write profile storage " << path.value();
+  }
+}
+
+}  // namespace
+
 // static
 const char Profile::kUserProfileListPathname[] = RUNDIR "/loaded_profile_list";
 
@@ -96,7 +116,9 @@ void Profile::OnPropertyChanged(const std::string& /*name*/) {
 bool Profile::InitStorage(InitStorageOption storage_option, Error* error) {
   CHECK(!persistent_profile_path_.empty());
   std::unique_ptr<StoreInterface> storage =
-      CreateStore(persistent_profile_path_, name_.user_hash);
+      CreateStore(persistent_profile_path_, name_.user_hash, kStorageFlushDelay,
+                  base::BindRepeating(&OnStorageFlushed,
+                                      persistent_profile_path_));
   bool already_exists = !storage->IsEmpty();
   if (!already_exists && storage_option != kCreateNew &&
       storage_option != kCreateOrOpenExisting) {
@@ -12,6 +12,7 @@
 #include <utility>
 #include <vector>
 
+#include <base/bind.h>
 #include <base/check.h>
 #include <base/check_op.h>
 #include <base/containers/cxx20_erase.h>
@@ -23,6 +24,7 @@
 #include <base/strings/string_split.h>
 #include <base/strings/string_util.h>
 #include <base/strings/stringprintf.h>
+#include <base/threading/thread_task_runner_handle.h>
 #include <brillo/scoped_umask.h>
 #include <fcntl.h>
 #include <re2/re2.h>
@@ -166,14 +168,20 @@ class Group {
   Group(const Group&) = delete;
   Group& operator=(const Group&) = delete;
 
-  void Set(const std::string& key, const std::string& value) {
-    if (index_.count(key) > 0) {
-      index_[key]->second = value;
-      return;
+  // Returns true if the value of |key| has changed.
+  bool Set(const std::string& key, const std::string& value) {
+    const auto it = index_.find(key);
+    if (it != index_.end()) {
+      if (it->second->second == value) {
+        return false;
+      }
+      it->second->second = value;
+      return true;
     }
 
     entries_.push_back({key, value});
     index_[key] = &entries_.back();
+    return true;
   }
 
   base::Optional<std::string> Get(const std::string& key) const {
@@ -297,9 +305,11 @@ class KeyFileStore::KeyFile {
       return nullptr;
     }
 
-    return std::unique_ptr<KeyFile>(
+    std::unique_ptr<KeyFile> key_file(
         new KeyFile(path, std::move(pre_group_comments), std::move(groups),
                     std::move(index)));
+    key_file->UpdateFileStat();
+    return key_file;
   }
 
   void Set(const std::string& group,
@@ -308,9 +318,12 @@ class KeyFileStore::KeyFile {
     if (index_.count(group) == 0) {
       groups_.emplace_back(group);
       index_[group] = &groups_.back();
+      dirty_ = true;
     }
 
-    index_[group]->Set(key, value);
+    if (index_[group]->Set(key, value)) {
+      dirty_ = true;
+    }
   }
 
   base::Optional<std::string> Get(const std::string& group,
@@ -329,7 +342,11 @@ class KeyFileStore::KeyFile {
       return false;
     }
 
-    return it->second->Delete(key);
+    if (!it->second->Delete(key)) {
+      return false;
+    }
+    dirty_ = true;
+    return true;
   }
 
   bool HasGroup(const std::string& group) const {
@@ -345,6 +362,7 @@ class KeyFileStore::KeyFile {
     Group* grp = it->second;
     index_.erase(it);
     base::EraseIf(groups_, [grp](const Group& g) { return &g == grp; });
+    dirty_ = true;
     return true;
   }
 
@@ -360,13 +378,38 @@ class KeyFileStore::KeyFile {
     const auto lines = base::SplitString(header, "\n", base::KEEP_WHITESPACE,
                                          base::SPLIT_WANT_ALL);
 
-    pre_group_comments_.clear();
+    std::list<std::string> pre_group_comments;
     for (const std::string& line : lines) {
-      pre_group_comments_.push_back("#" + line);
+      pre_group_comments.push_back("#" + line);
+    }
+    if (pre_group_comments != pre_group_comments_) {
+      pre_group_comments_ = std::move(pre_group_comments);
+      dirty_ = true;
     }
   }
 
-  bool Flush() const {
+  // Returns true if the contents have changed since the key file was read or
+  // written last, or if the file has been modified or replaced since then.
+  bool NeedsFlush() const {
+    if (dirty_) {
+      return true;
+    }
+
+    struct stat file_stat;
+    if (stat(path_.value().c_str(), &file_stat) != 0) {
+      return true;
+    }
+    return file_stat.st_dev != file_stat_.st_dev ||
+           file_stat.st_ino != file_stat_.st_ino ||
+           file_stat.st_mode != file_stat_.st_mode ||
+           file_stat.st_size != file_stat_.st_size ||
+           file_stat.st_mtim.tv_sec != file_stat_.st_mtim.tv_sec ||
+           file_stat.st_mtim.tv_nsec != file_stat_.st_mtim.tv_nsec;
+  }
+
+  // Writes the key file. On success, stores the number of bytes written to
+  // |bytes_written|.
+  bool Flush(size_t* bytes_written) {
     std::string to_write;
     for (const std::string& line : pre_group_comments_) {
       to_write += line + '\n';
@@ -380,6 +423,9 @@ class KeyFileStore::KeyFile {
       LOG(ERROR) << "Failed to store key file: " << path_.value();
       return false;
     }
+    dirty_ = false;
+    UpdateFileStat();
+    *bytes_written = to_write.size();
     return true;
   }
 
@@ -395,10 +441,20 @@ class KeyFileStore::KeyFile {
   KeyFile(const KeyFile&) = delete;
   KeyFile& operator=(const KeyFile&) = delete;
 
+  // Records the status of the file as read or written by us.
+  void UpdateFileStat() {
+    if (stat(path_.value().c_str(), &file_stat_) != 0) {
+      file_stat_ = {};
+    }
+  }
+
   base::FilePath path_;
   std::list<std::string> pre_group_comments_;
   std::list<Group> groups_;
   std::map<std::string, Group*> index_;
+  // Whether the contents have changed since the key file was read or written.
+  bool dirty_ = false;
+  struct stat file_stat_ = {};
 };
 
 const char KeyFileStore::kCorruptSuffix[] = ".corrupted";
@@ -412,7 +468,17 @@ KeyFileStore::KeyFileStore(const base::FilePath& path,
   CHECK(!path_.empty());
 }
 
-KeyFileStore::~KeyFileStore() = default;
+KeyFileStore::~KeyFileStore() {
+  if (flush_scheduled_ && key_file_) {
+    FlushNow();
+  }
+}
+
+void KeyFileStore::EnableDeferredFlush(base::TimeDelta delay,
+                                       FlushResultCallback result_callback) {
+  flush_delay_ = delay;
+  flush_result_callback_ = std::move(result_callback);
+}
 
 bool KeyFileStore::IsEmpty() const {
   int64_t file_size = 0;
@@ -423,6 +489,9 @@ bool KeyFileStore::Open() {
   CHECK(!key_file_);
   if (IsEmpty()) {
     LOG(INFO) << "Creating a new key file at " << path_.value();
+    // The file may not be written again if nothing is stored to it, so create
+    // it with the same permissions as Flush() does.
+    brillo::ScopedUmask owner_only_umask(~(S_IRUSR | S_IWUSR) & 0777);
     base::File f(path_, base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_READ |
                             base::File::FLAG_WRITE);
   }
@@ -437,13 +506,65 @@ bool KeyFileStore::Open() {
 }
 
 bool KeyFileStore::Close() {
-  bool success = Flush();
+  bool success = FlushNow();
   key_file_.reset();
   return success;
 }
 
 bool KeyFileStore::Flush() {
-  return key_file_->Flush();
+  CHECK(key_file_);
+  // After a failed write, callers get the result of their own write until
+  // the key file can be written again.
+  if (flush_delay_.is_zero() || deferred_flush_failed_ ||
+      !base::ThreadTaskRunnerHandle::IsSet()) {
+    return FlushNow();
+  }
+
+  if (flush_scheduled_) {
+    // Coalesced into the scheduled flush.
+    flush_stats_.flushes_avoided++;
+    return true;
+  }
+
+  flush_scheduled_ = true;
+  base::ThreadTaskRunnerHandle::Get()->PostDelayedTask(
+      FROM_HERE,
+      base::BindOnce(&KeyFileStore::OnDeferredFlush,
+                     weak_ptr_factory_.GetWeakPtr()),
+      flush_delay_);
+  return true;
+}
+
+bool KeyFileStore::FlushNow() {
+  CHECK(key_file_);
+  flush_scheduled_ = false;
+  weak_ptr_factory_.InvalidateWeakPtrs();
+
+  if (!key_file_->NeedsFlush()) {
+    SLOG(this, 5) << "Skipping flush of unchanged " << path_.value();
+    flush_stats_.flushes_avoided++;
+    deferred_flush_failed_ = false;
+    return true;
+  }
+
+  size_t bytes_written = 0;
+  if (!key_file_->Flush(&bytes_written)) {
+    return false;
+  }
+  flush_stats_.writes++;
+  flush_stats_.bytes_written += bytes_written;
+  deferred_flush_failed_ = false;
+  return true;
+}
+
+void KeyFileStore::OnDeferredFlush() {
+  const bool success = FlushNow();
+  if (!success) {
+    deferred_flush_failed_ = true;
+  }
+  if (!flush_result_callback_.is_null()) {
+    flush_result_callback_.Run(success);
+  }
 }
 
 bool KeyFileStore::MarkAsCorrupted() {
@@ -831,4 +952,14 @@ std::unique_ptr<StoreInterface> CreateStore(const base::FilePath& path,
   return std::make_unique<KeyFileStore>(path, user_hash);
 }
 
+std::unique_ptr<StoreInterface> CreateStore(
+    const base::FilePath& path,
+    const std::string& user_hash,
+    base::TimeDelta flush_delay,
+    KeyFileStore::FlushResultCallback flush_result_callback) {
+  auto store = std::make_unique<KeyFileStore>(path, user_hash);
+  store->EnableDeferredFlush(flush_delay, std::move(flush_result_callback));
+  return store;
+}
+
 }  // namespace shill
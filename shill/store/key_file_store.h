@@ -10,7 +10,10 @@
 #include <string>
 #include <vector>
 
+#include <base/callback.h>
 #include <base/files/file_path.h>
+#include <base/memory/weak_ptr.h>
+#include <base/time/time.h>
 #include <gtest/gtest_prod.h>  // for FRIEND_TEST
 
 #include "shill/store/crypto.h"
@@ -30,6 +33,17 @@ class KeyFileStore : public StoreInterface {
  public:
   static constexpr CK_SLOT_ID kInvalidSlot = ULONG_MAX;
 
+  // Counters of the key file writes.
+  struct FlushStats {
+    // Number of times the key file was written.
+    uint64_t writes = 0;
+    // Total number of bytes written to the key file.
+    uint64_t bytes_written = 0;
+    // Number of flushes which did not write the key file, either because
+    // nothing had changed or because they were coalesced into a scheduled one.
+    uint64_t flushes_avoided = 0;
+  };
+
   explicit KeyFileStore(const base::FilePath& path,
                         const std::string& user_hash = "");
   KeyFileStore(const KeyFileStore&) = delete;
@@ -37,6 +51,20 @@ class KeyFileStore : public StoreInterface {
 
   ~KeyFileStore() override;
 
+  // Called with the result of each deferred write of the key file.
+  using FlushResultCallback = base::RepeatingCallback<void(bool success)>;
+
+  // Makes Flush() write the key file |delay| later instead of immediately, so
+  // that a burst of changes each followed by Flush() results in one write.
+  // Pending changes are written by Close() or on destruction. Since Flush()
+  // returns before writing, the result of the write is passed to
+  // |result_callback|. After a deferred write fails, Flush() writes
+  // immediately and returns the result until a write succeeds again.
+  void EnableDeferredFlush(base::TimeDelta delay,
+                           FlushResultCallback result_callback);
+
+  const FlushStats& flush_stats() const { return flush_stats_; }
+
   // Inherited from StoreInterface.
   bool IsEmpty() const override;
   bool Open() override;
@@ -116,10 +144,23 @@ class KeyFileStore : public StoreInterface {
 
   bool TryGetPKCS11SlotID() const;
 
+  // Writes the key file now unless it is unchanged, and cancels the scheduled
+  // flush if any.
+  bool FlushNow();
+  void OnDeferredFlush();
+
   std::unique_ptr<KeyFile> key_file_;
   const base::FilePath path_;
   const std::string user_hash_;
   mutable CK_SLOT_ID slot_id_;
+
+  base::TimeDelta flush_delay_;
+  FlushResultCallback flush_result_callback_;
+  bool flush_scheduled_ = false;
+  bool deferred_flush_failed_ = false;
+  FlushStats flush_stats_;
+
+  base::WeakPtrFactory<KeyFileStore> weak_ptr_factory_{this};
 };
 
 // Creates a store, implementing StoreInterface, at the specified |path|.
@@ -127,6 +168,14 @@ class KeyFileStore : public StoreInterface {
 std::unique_ptr<StoreInterface> CreateStore(const base::FilePath& path,
                                             const std::string& user_hash = "");
 
+// Same as above, with the flushes deferred by |flush_delay| as
+// KeyFileStore::EnableDeferredFlush() does.
+std::unique_ptr<StoreInterface> CreateStore(
+    const base::FilePath& path,
+    const std::string& user_hash,
+    base::TimeDelta flush_delay,
+    KeyFileStore::FlushResultCallback flush_result_callback);
+
 }  // namespace shill
 
 #endif  // SHILL_STORE_KEY_FILE_STORE_H_
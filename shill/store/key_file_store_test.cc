@@ -12,12 +12,14 @@
 #include <string>
 #include <vector>
 
+#include <base/bind.h>
 #include <base/containers/contains.h>
 #include <base/files/file_enumerator.h>
 #include <base/files/file_util.h>
 #include <base/files/scoped_temp_dir.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/stringprintf.h>
+#include <base/test/task_environment.h>
 #include <gtest/gtest.h>
 #include <inttypes.h>
 
@@ -43,6 +45,8 @@ class KeyFileStoreTest : public Test {
   std::string ReadKeyFile();
   void WriteKeyFile(std::string data);
 
+  base::test::TaskEnvironment task_environment_{
+      base::test::TaskEnvironment::TimeSource::MOCK_TIME};
   base::ScopedTempDir temp_dir_;
   base::FilePath test_file_;
   std::unique_ptr<KeyFileStore> store_;
@@ -916,6 +920,108 @@ TEST_F(KeyFileStoreTest, Flush) {
 }
 }  // namespace
 
+TEST_F(KeyFileStoreTest, FlushSkipsUnchanged) {
+  static const char kGroup[] = "string-group";
+  static const char kKey[] = "test-string";
+  ASSERT_TRUE(store_->Open());
+  ASSERT_TRUE(store_->SetString(kGroup, kKey, "foo"));
+  ASSERT_TRUE(store_->Flush());
+  EXPECT_EQ(1, store_->flush_stats().writes);
+  EXPECT_EQ(ReadKeyFile().size(), store_->flush_stats().bytes_written);
+
+  // Setting the same value is not a change.
+  ASSERT_TRUE(store_->SetString(kGroup, kKey, "foo"));
+  ASSERT_TRUE(store_->Flush());
+  EXPECT_EQ(1, store_->flush_stats().writes);
+  EXPECT_EQ(1, store_->flush_stats().flushes_avoided);
+
+  ASSERT_TRUE(store_->SetString(kGroup, kKey, "bar"));
+  ASSERT_TRUE(store_->Flush());
+  EXPECT_EQ(2, store_->flush_stats().writes);
+  ASSERT_TRUE(OpenCheckClose(test_file_, kGroup, kKey, "bar"));
+
+  // The file is rewritten if it was modified by others.
+  WriteKeyFile("[other]\n");
+  ASSERT_TRUE(store_->Flush());
+  EXPECT_EQ(3, store_->flush_stats().writes);
+  ASSERT_TRUE(OpenCheckClose(test_file_, kGroup, kKey, "bar"));
+
+  ASSERT_TRUE(store_->Close());
+  EXPECT_EQ(3, store_->flush_stats().writes);
+  EXPECT_EQ(2, store_->flush_stats().flushes_avoided);
+}
+
+TEST_F(KeyFileStoreTest, DeferredFlush) {
+  static const char kGroup[] = "int-group";
+  static const char kKey[] = "test-int";
+  constexpr base::TimeDelta kDelay = base::TimeDelta::FromSeconds(1);
+  std::vector<bool> results;
+  store_->EnableDeferredFlush(
+      kDelay, base::BindRepeating(
+                  [](std::vector<bool>* results, bool success) {
+                    results->push_back(success);
+                  },
+                  &results));
+  ASSERT_TRUE(store_->Open());
+
+  // A burst of changes results in one write.
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(store_->SetInt(kGroup, kKey, i));
+    ASSERT_TRUE(store_->Flush());
+  }
+  EXPECT_EQ(0, store_->flush_stats().writes);
+  EXPECT_EQ(9, store_->flush_stats().flushes_avoided);
+  EXPECT_EQ("", ReadKeyFile());
+
+  task_environment_.FastForwardBy(kDelay);
+  EXPECT_EQ(1, store_->flush_stats().writes);
+  EXPECT_EQ(base::StringPrintf("[%s]\n%s=9\n", kGroup, kKey), ReadKeyFile());
+  EXPECT_EQ(std::vector<bool>({true}), results);
+
+  // Pending changes are written on destruction.
+  ASSERT_TRUE(store_->SetInt(kGroup, kKey, 10));
+  ASSERT_TRUE(store_->Flush());
+  store_.reset();
+  EXPECT_EQ(base::StringPrintf("[%s]\n%s=10\n", kGroup, kKey), ReadKeyFile());
+}
+
+TEST_F(KeyFileStoreTest, DeferredFlushFailure) {
+  static const char kGroup[] = "int-group";
+  static const char kKey[] = "test-int";
+  constexpr base::TimeDelta kDelay = base::TimeDelta::FromSeconds(1);
+  std::vector<bool> results;
+  store_->EnableDeferredFlush(
+      kDelay, base::BindRepeating(
+                  [](std::vector<bool>* results, bool success) {
+                    results->push_back(success);
+                  },
+                  &results));
+  ASSERT_TRUE(store_->Open());
+
+  // Replace file with directory, to force the deferred write to fail.
+  ASSERT_TRUE(base::DeleteFile(test_file_));
+  ASSERT_TRUE(base::CreateDirectory(test_file_));
+  ASSERT_TRUE(store_->SetInt(kGroup, kKey, 1));
+  ASSERT_TRUE(store_->Flush());
+  task_environment_.FastForwardBy(kDelay);
+  EXPECT_EQ(std::vector<bool>({false}), results);
+
+  // The following flushes are synchronous and report their own result.
+  ASSERT_TRUE(store_->SetInt(kGroup, kKey, 2));
+  EXPECT_FALSE(store_->Flush());
+  ASSERT_TRUE(base::DeletePathRecursively(test_file_));
+  EXPECT_TRUE(store_->Flush());
+  EXPECT_EQ(base::StringPrintf("[%s]\n%s=2\n", kGroup, kKey), ReadKeyFile());
+
+  // Once a write succeeded, flushes are deferred again.
+  ASSERT_TRUE(store_->SetInt(kGroup, kKey, 3));
+  EXPECT_TRUE(store_->Flush());
+  EXPECT_EQ(base::StringPrintf("[%s]\n%s=2\n", kGroup, kKey), ReadKeyFile());
+  task_environment_.FastForwardBy(kDelay);
+  EXPECT_EQ(base::StringPrintf("[%s]\n%s=3\n", kGroup, kKey), ReadKeyFile());
+  EXPECT_EQ(std::vector<bool>({false, true}), results);
+}
+
 TEST_F(KeyFileStoreTest, EmptyFile) {
   ASSERT_TRUE(store_->Open());
   ASSERT_TRUE(store_->Close());
@@ -25,6 +25,7 @@
 #include <linux/errno.h>
 
 #include "verity/dm-bht.h"
+#include "verity/multi_sha256.h"
 
 #define DM_MSG_PREFIX "dm bht"
 
@@ -138,6 +139,35 @@ int dm_bht_compute_hash(struct dm_bht* bht,
   return 0;
 }
 
+/**
+ * dm_bht_compute_hashes: hashes @count pages of data, several at once when
+ * the CPU allows it
+ * @buffers: array of @count pages
+ * @digests: array of @count digests
+ */
+int dm_bht_compute_hashes(struct dm_bht* bht,
+                          const uint8_t* const* buffers,
+                          uint8_t* const* digests,
+                          unsigned int count) {
+  unsigned int i;
+
+  if (!HasMultiSha256()) {
+    for (i = 0; i < count; i++) {
+      int r = dm_bht_compute_hash(bht, buffers[i], digests[i]);
+
+      if (r)
+        return r;
+    }
+    return 0;
+  }
+  for (i = 0; i < count; i += kMaxSha256Messages) {
+    MultiSha256(buffers + i, PAGE_SIZE, bht->have_salt ? bht->salt : NULL,
+                bht->have_salt ? sizeof(bht->salt) : 0,
+                std::min(count - i, kMaxSha256Messages), digests + i);
+  }
+  return 0;
+}
+
 const char kSha256HashName[] = "sha256";
 
 /**
@@ -600,6 +630,76 @@ void dm_bht_set_buffer(struct dm_bht* bht, void* buffer) {
   }
 }
 
+/**
+ * dm_bht_compute_entries - computes the hashes of some entries of a level
+ * @bht: pointer to a dm_bht_create()d bht
+ * @depth: depth of the level, above the block hashes
+ * @begin: index of the first entry to compute
+ * @end: index of the entry after the last one to compute
+ *
+ * Returns 0 on success, and <0 when an error has occurred.
+ *
+ * The entries of the level below must have been computed. Distinct entries
+ * may be computed concurrently.
+ */
+int dm_bht_compute_entries(struct dm_bht* bht,
+                           int depth,
+                           unsigned int begin,
+                           unsigned int end) {
+  struct dm_bht_level* level = dm_bht_get_level(bht, depth);
+  struct dm_bht_level* child_level = level + 1;
+  unsigned int i, j;
+
+  CHECK_LT(depth, bht->depth - 1);
+  CHECK_LE(end, level->count);
+  for (i = begin; i < end; i++) {
+    struct dm_bht_entry* entry = &level->entries[i];
+    /* All the entries but the last one have node_count children. */
+    struct dm_bht_entry* child =
+        &child_level->entries[i << bht->node_count_shift];
+    unsigned int count = bht->node_count;
+
+    memset(entry->nodes, 0, PAGE_SIZE);
+    entry->state = DM_BHT_ENTRY_READY;
+
+    if (i == (level->count - 1))
+      count = child_level->count % bht->node_count;
+    if (count == 0)
+      count = bht->node_count;
+    for (j = 0; j < count; j += kMaxSha256Messages) {
+      const uint8_t* buffers[kMaxSha256Messages];
+      uint8_t* digests[kMaxSha256Messages];
+      unsigned int k, n = std::min(count - j, kMaxSha256Messages);
+
+      for (k = 0; k < n; k++, child++) {
+        buffers[k] = child->nodes;
+        digests[k] = dm_bht_node(bht, entry, j + k);
+      }
+      int r = dm_bht_compute_hashes(bht, buffers, digests, n);
+
+      if (r) {
+        DLOG(ERROR) << "Failed to update (d=" << depth << ",i=" << i << ")";
+        return r;
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * dm_bht_compute_root - computes the root hash from the entry of level 0
+ * @bht: pointer to a dm_bht_create()d bht
+ *
+ * Returns 0 on success, and <0 when an error has occurred.
+ */
+int dm_bht_compute_root(struct dm_bht* bht) {
+  int r =
+      dm_bht_compute_hash(bht, bht->levels[0].entries->nodes, bht->root_digest);
+  if (r)
+    DLOG(ERROR) << "Failed to update root hash";
+  return r;
+}
+
 /**
  * dm_bht_compute - computes and updates all non-block-level hashes in a tree
  * @bht: pointer to a dm_bht_create()d bht
@@ -611,42 +711,15 @@ void dm_bht_set_buffer(struct dm_bht* bht, void* buffer) {
  * hashes below.
  */
 int dm_bht_compute(struct dm_bht* bht) {
-  int depth, r = 0;
+  int depth, r;
 
   for (depth = bht->depth - 2; depth >= 0; depth--) {
-    struct dm_bht_level* level = dm_bht_get_level(bht, depth);
-    struct dm_bht_level* child_level = level + 1;
-    struct dm_bht_entry* entry = level->entries;
-    struct dm_bht_entry* child = child_level->entries;
-    unsigned int i, j;
-
-    for (i = 0; i < level->count; i++, entry++) {
-      unsigned int count = bht->node_count;
-
-      memset(entry->nodes, 0, PAGE_SIZE);
-      entry->state = DM_BHT_ENTRY_READY;
-
-      if (i == (level->count - 1))
-        count = child_level->count % bht->node_count;
-      if (count == 0)
-        count = bht->node_count;
-      for (j = 0; j < count; j++, child++) {
-        uint8_t* digest = dm_bht_node(bht, entry, j);
-
-        r = dm_bht_compute_hash(bht, child->nodes, digest);
-        if (r) {
-          DLOG(ERROR) << "Failed to update (d=" << depth << ",i=" << i << ")";
-          goto out;
-        }
-      }
-    }
+    r = dm_bht_compute_entries(bht, depth, 0,
+                               dm_bht_get_level(bht, depth)->count);
+    if (r)
+      return r;
   }
-  r = dm_bht_compute_hash(bht, bht->levels[0].entries->nodes, bht->root_digest);
-  if (r)
-    DLOG(ERROR) << "Failed to update root hash";
-
-out:
-  return r;
+  return dm_bht_compute_root(bht);
 }
 
 /**
@@ -657,6 +730,8 @@ out:
  *
  * Returns 0 on success.
  *
+ * Distinct blocks may be stored concurrently.
+ *
  * If the containing entry in the tree is unallocated, it will allocate memory
  * and mark the entry as ready.  All other block entries will be 0s.
  *
@@ -673,6 +748,44 @@ int dm_bht_store_block(struct dm_bht* bht,
   return dm_bht_compute_hash(bht, block_data, node);
 }
 
+/**
+ * dm_bht_store_blocks - sets the hashes of consecutive blocks in the tree
+ * @bht: pointer to a dm_bht_create()d bht
+ * @block: numeric index of the first block in the tree
+ * @count: number of blocks
+ * @block_data: array of @count * PAGE_SIZE uint8_ts containing the blocks
+ *
+ * Returns 0 on success.
+ *
+ * Like dm_bht_store_block(), but several blocks may be hashed at once.
+ */
+int dm_bht_store_blocks(struct dm_bht* bht,
+                        unsigned int block,
+                        unsigned int count,
+                        uint8_t* block_data) {
+  int depth = bht->depth;
+  unsigned int i, j;
+
+  for (i = 0; i < count; i += kMaxSha256Messages) {
+    const uint8_t* buffers[kMaxSha256Messages];
+    uint8_t* digests[kMaxSha256Messages];
+    unsigned int n = std::min(count - i, kMaxSha256Messages);
+
+    for (j = 0; j < n; j++) {
+      struct dm_bht_entry* entry =
+          dm_bht_get_entry(bht, depth - 1, block + i + j);
+
+      buffers[j] = block_data + (i + j) * PAGE_SIZE;
+      digests[j] = dm_bht_get_node(bht, entry, depth, block + i + j);
+    }
+    int r = dm_bht_compute_hashes(bht, buffers, digests, n);
+
+    if (r)
+      return r;
+  }
+  return 0;
+}
+
 /*-----------------------------------------------
  * Accessors
  *-----------------------------------------------*/
@@ -793,6 +906,12 @@ int DmBht::StoreBlock(unsigned int block, uint8_t* block_data) {
   return dm_bht_store_block(dm_bht_ptr_.get(), block, block_data);
 }
 
+int DmBht::StoreBlocks(unsigned int block,
+                       unsigned int count,
+                       uint8_t* block_data) {
+  return dm_bht_store_blocks(dm_bht_ptr_.get(), block, count, block_data);
+}
+
 int DmBht::Compute() {
   return dm_bht_compute(dm_bht_ptr_.get());
 }
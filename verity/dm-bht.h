@@ -167,22 +167,48 @@ int dm_bht_zeroread_callback(void* ctx,
 BRILLO_EXPORT
 void dm_bht_read_completed(struct dm_bht_entry* entry, int status);
 
+BRILLO_EXPORT
 int dm_bht_compute_hash(struct dm_bht* bht,
                         const uint8_t* buffer,
                         uint8_t* digest);
+BRILLO_EXPORT
+int dm_bht_compute_hashes(struct dm_bht* bht,
+                          const uint8_t* const* buffers,
+                          uint8_t* const* digests,
+                          unsigned int count);
 
 /* Functions for creating struct dm_bhts on disk.  A newly created dm_bht
  * should not be directly used for verification. (It should be repopulated.)
- * In addition, these functions aren't meant to be called in parallel.
+ * In addition, these functions aren't meant to be called in parallel, except
+ * for dm_bht_store_block(), dm_bht_store_blocks() and dm_bht_compute_entries()
+ * on distinct blocks and entries.
  */
 BRILLO_EXPORT
 int dm_bht_compute(struct dm_bht* bht);
+/* Steps of dm_bht_compute(), for callers computing the entries of each level
+ * concurrently, from the deepest level up.
+ */
+BRILLO_EXPORT
+int dm_bht_compute_entries(struct dm_bht* bht,
+                           int depth,
+                           unsigned int begin,
+                           unsigned int end);
+BRILLO_EXPORT
+int dm_bht_compute_root(struct dm_bht* bht);
 BRILLO_EXPORT
 void dm_bht_set_buffer(struct dm_bht* bht, void* buffer);
 BRILLO_EXPORT
 int dm_bht_store_block(struct dm_bht* bht,
                        unsigned int block,
                        uint8_t* block_data);
+/* Stores @count consecutive blocks, hashed several at once when the CPU has
+ * SIMD or SHA instructions for it.
+ */
+BRILLO_EXPORT
+int dm_bht_store_blocks(struct dm_bht* bht,
+                        unsigned int block,
+                        unsigned int count,
+                        uint8_t* block_data);
 
 /* Functions for converting indices to nodes. */
 
@@ -238,6 +264,10 @@ class DmBhtInterface {
   virtual sector_t Sectors() = 0;
   virtual unsigned int DigestSize() = 0;
   virtual int StoreBlock(unsigned int block, uint8_t* block_data) = 0;
+  // Stores the |count| blocks of |block_data|, from block |block| on.
+  virtual int StoreBlocks(unsigned int block,
+                          unsigned int count,
+                          uint8_t* block_data) = 0;
   virtual int Compute() = 0;
   virtual void HexDigest(uint8_t* hexdigest, int available) = 0;
 };
@@ -260,6 +290,9 @@ class BRILLO_EXPORT DmBht : public DmBhtInterface {
   sector_t Sectors() override;
   unsigned int DigestSize() override;
   int StoreBlock(unsigned int block, uint8_t* block_data) override;
+  int StoreBlocks(unsigned int block,
+                  unsigned int count,
+                  uint8_t* block_data) override;
   int Compute() override;
   void HexDigest(uint8_t* hexdigest, int available) override;
 
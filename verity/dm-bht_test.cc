@@ -6,6 +6,7 @@
 
 #include <stdlib.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -13,6 +14,7 @@
 #include <gtest/gtest.h>
 
 #include "verity/dm-bht.h"
+#include "verity/multi_sha256.h"
 
 namespace verity {
 
@@ -62,6 +64,88 @@ TEST(DmBht, CreateZeroPopulateDestroy) {
   free(data);
 }
 
+// Pages hashed several at once must have the digests of pages hashed one by
+// one, including when fewer pages than can be hashed at once are left, with
+// each backend of MultiSha256() the CPU supports and without any.
+TEST(DmBht, ComputeHashesMatchesComputeHash) {
+  static const char kSalt[] =
+      "01ad1f06255d452d91337bf037953053cc3e452541db4b8ca05811bf3e2b6027";
+  constexpr unsigned int kPages = 19;
+  std::vector<uint8_t> data(kPages * PAGE_SIZE);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = i * 7 + i / PAGE_SIZE;
+
+  const MultiSha256Backend default_backend = GetMultiSha256Backend();
+  for (MultiSha256Backend backend :
+       {MultiSha256Backend::kNone, MultiSha256Backend::kAvx2,
+        MultiSha256Backend::kSha}) {
+    if (!SetMultiSha256BackendForTesting(backend))
+      continue;
+    for (const char* salt : {static_cast<const char*>(NULL), kSalt}) {
+      struct dm_bht bht;
+      EXPECT_EQ(0, dm_bht_create(&bht, kPages, "sha256"));
+      if (salt)
+        dm_bht_set_salt(&bht, salt);
+
+      std::vector<uint8_t> expected(kPages * bht.digest_size);
+      for (unsigned int i = 0; i < kPages; i++) {
+        EXPECT_EQ(0, dm_bht_compute_hash(&bht, &data[i * PAGE_SIZE],
+                                         &expected[i * bht.digest_size]));
+      }
+      for (unsigned int count = 0; count <= kPages; count++) {
+        std::vector<uint8_t> digests(kPages * bht.digest_size);
+        std::vector<const uint8_t*> buffer_pointers;
+        std::vector<uint8_t*> digest_pointers;
+        for (unsigned int i = 0; i < count; i++) {
+          buffer_pointers.push_back(&data[i * PAGE_SIZE]);
+          digest_pointers.push_back(&digests[i * bht.digest_size]);
+        }
+        EXPECT_EQ(0, dm_bht_compute_hashes(&bht, buffer_pointers.data(),
+                                           digest_pointers.data(), count));
+        EXPECT_TRUE(std::equal(digests.begin(),
+                               digests.begin() + count * bht.digest_size,
+                               expected.begin()))
+            << "backend: " << static_cast<int>(backend) << " count: " << count
+            << " salt: " << (salt ? salt : "none");
+      }
+      EXPECT_EQ(0, dm_bht_destroy(&bht));
+    }
+  }
+  EXPECT_TRUE(SetMultiSha256BackendForTesting(default_backend));
+}
+
+// Blocks stored several at once must give the tree of blocks stored one by
+// one.
+TEST(DmBht, StoreBlocksMatchesStoreBlock) {
+  constexpr unsigned int kBlocks = 1001;
+  std::vector<uint8_t> data(kBlocks * PAGE_SIZE);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = i * 13 + i / PAGE_SIZE;
+
+  std::vector<uint8_t> hash_data[2];
+  uint8_t digests[2][DM_BHT_MAX_DIGEST_SIZE * 2 + 1];
+  for (int batched = 0; batched < 2; batched++) {
+    struct dm_bht bht;
+    EXPECT_EQ(0, dm_bht_create(&bht, kBlocks, "sha256"));
+    hash_data[batched].resize(verity_to_bytes(dm_bht_sectors(&bht)));
+    dm_bht_set_buffer(&bht, hash_data[batched].data());
+    if (batched) {
+      EXPECT_EQ(0, dm_bht_store_blocks(&bht, 0, 3, &data[0]));
+      EXPECT_EQ(0, dm_bht_store_blocks(&bht, 3, kBlocks - 3,
+                                       &data[3 * PAGE_SIZE]));
+    } else {
+      for (unsigned int i = 0; i < kBlocks; i++)
+        EXPECT_EQ(0, dm_bht_store_block(&bht, i, &data[i * PAGE_SIZE]));
+    }
+    EXPECT_EQ(0, dm_bht_compute(&bht));
+    dm_bht_root_hexdigest(&bht, digests[batched], sizeof(digests[batched]));
+    EXPECT_EQ(0, dm_bht_destroy(&bht));
+  }
+  EXPECT_EQ(hash_data[0], hash_data[1]);
+  EXPECT_STREQ(reinterpret_cast<char*>(digests[0]),
+               reinterpret_cast<char*>(digests[1]));
+}
+
 class MemoryBhtTest : public ::testing::Test {
  public:
   void SetUp() { bht_ = NULL; }
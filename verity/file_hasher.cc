@@ -14,15 +14,22 @@
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include <base/bind.h>
 #include <base/bits.h>
+#include <base/callback.h>
 #include <base/check.h>
 #include <base/files/file.h>
 #include <base/logging.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/string_util.h>
+#include <base/threading/simple_thread.h>
 
 #include "verity/file_hasher.h"
 
@@ -43,6 +50,62 @@ int64_t GetFileSize(base::File* file) {
   }
   return file->GetLength();
 }
+
+// Blocks read at once by each thread hashing the source.
+constexpr unsigned int kBlocksPerRead = 256;
+// Entries of a level computed at once by each thread computing the tree.
+constexpr unsigned int kEntriesPerJob = 64;
+
+// Hands out jobs to the threads running it, until all the jobs are done or
+// one of them fails.
+class JobQueue : public base::DelegateSimpleThread::Delegate {
+ public:
+  // |job| is run with the index of each job, and returns whether it
+  // succeeded.
+  JobQueue(unsigned int job_count,
+           base::RepeatingCallback<bool(unsigned int)> job)
+      : job_count_(job_count), job_(std::move(job)) {}
+  JobQueue(const JobQueue&) = delete;
+  JobQueue& operator=(const JobQueue&) = delete;
+
+  void Run() override {
+    for (unsigned int i = next_job_++; i < job_count_ && !failed_;
+         i = next_job_++) {
+      if (!job_.Run(i))
+        failed_ = true;
+    }
+  }
+
+  bool failed() const { return failed_; }
+
+ private:
+  const unsigned int job_count_;
+  const base::RepeatingCallback<bool(unsigned int)> job_;
+  std::atomic<unsigned int> next_job_{0};
+  std::atomic<bool> failed_{false};
+};
+
+// Runs the |job_count| jobs of |job| on up to |thread_count| threads, and
+// returns whether they all succeeded. A single thread is the calling one.
+bool RunJobs(unsigned int thread_count,
+             unsigned int job_count,
+             base::RepeatingCallback<bool(unsigned int)> job) {
+  JobQueue queue(job_count, std::move(job));
+  if (thread_count == 1) {
+    queue.Run();
+    return !queue.failed();
+  }
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  for (unsigned int i = 0; i < std::min(thread_count, job_count); i++) {
+    threads.push_back(
+        std::make_unique<base::DelegateSimpleThread>(&queue, "verity"));
+    threads.back()->Start();
+  }
+  for (auto& thread : threads)
+    thread->Join();
+  return !queue.failed();
+}
+
 }  // namespace
 
 FileHasher::~FileHasher() {
@@ -100,23 +163,69 @@ bool FileHasher::Store() {
 }
 
 bool FileHasher::Hash() {
-  // TODO(wad) abstract size when dm-bht needs to do break from PAGE_SIZE
-  uint8_t block_data[PAGE_SIZE];
-  uint32_t block = 0;
-
-  while (block < block_limit_) {
-    if (source_->ReadAtCurrentPos(reinterpret_cast<char*>(block_data),
-                                  PAGE_SIZE) < 0) {
-      PLOG(ERROR) << "Failed to read for block: " << block;
-      return false;
-    }
-    if (dm_bht_store_block(&tree_, block, block_data)) {
-      LOG(ERROR) << "Failed to store block " << block;
+  // Start from the current position of the source, and leave it after the
+  // last block.
+  const int64_t offset = source_->Seek(base::File::FROM_CURRENT, 0);
+  if (offset < 0) {
+    PLOG(ERROR) << "Failed to get the source position";
+    return false;
+  }
+  const unsigned int read_count =
+      (block_limit_ + kBlocksPerRead - 1) / kBlocksPerRead;
+  if (!RunJobs(thread_count_, read_count,
+               base::BindRepeating(&FileHasher::HashBlocks,
+                                   base::Unretained(this), offset))) {
+    return false;
+  }
+  if (source_->Seek(base::File::FROM_BEGIN,
+                    offset + static_cast<int64_t>(block_limit_) * PAGE_SIZE) <
+      0) {
+    PLOG(ERROR) << "Failed to seek the source";
+    return false;
+  }
+
+  // Each level is computed from the level below it.
+  for (int depth = tree_.depth - 2; depth >= 0; depth--) {
+    const unsigned int entry_count = dm_bht_get_level(&tree_, depth)->count;
+    if (!RunJobs(thread_count_,
+                 (entry_count + kEntriesPerJob - 1) / kEntriesPerJob,
+                 base::BindRepeating(&FileHasher::ComputeEntries,
+                                     base::Unretained(this), depth))) {
       return false;
     }
-    ++block;
   }
-  return !dm_bht_compute(&tree_);
+  return !dm_bht_compute_root(&tree_);
+}
+
+bool FileHasher::HashBlocks(int64_t offset, unsigned int read) {
+  const unsigned int first_block = read * kBlocksPerRead;
+  const unsigned int block_count =
+      std::min(kBlocksPerRead, block_limit_ - first_block);
+  std::vector<uint8_t> block_data(block_count * PAGE_SIZE);
+  const int size = block_data.size();
+  if (source_->Read(offset + static_cast<int64_t>(first_block) * PAGE_SIZE,
+                    reinterpret_cast<char*>(block_data.data()),
+                    size) != size) {
+    PLOG(ERROR) << "Failed to read for block: " << first_block;
+    return false;
+  }
+  if (dm_bht_store_blocks(&tree_, first_block, block_count,
+                          block_data.data())) {
+    LOG(ERROR) << "Failed to store blocks from " << first_block;
+    return false;
+  }
+  return true;
+}
+
+bool FileHasher::ComputeEntries(int depth, unsigned int job) {
+  const unsigned int entry_count = dm_bht_get_level(&tree_, depth)->count;
+  const unsigned int begin = job * kEntriesPerJob;
+  return !dm_bht_compute_entries(&tree_, depth, begin,
+                                 std::min(entry_count, begin + kEntriesPerJob));
+}
+
+void FileHasher::set_thread_count(unsigned int thread_count) {
+  thread_count_ = std::max(thread_count, 1u);
 }
 
 void FileHasher::set_salt(const char* salt) {
@@ -21,7 +21,8 @@ namespace verity {
 // FileHasher takes a |base::File| object and reads in |block_size|
 // bytes creating SHA-256 hashes as it goes.
 // TODO(wad) allow any hashing format supported by openssl (and the kernel).
-// This class may not be used by multiple threads at once.
+// This class may not be used by multiple threads at once, but it can hash
+// with multiple threads itself, see set_thread_count().
 class BRILLO_EXPORT FileHasher {
  public:
   FileHasher(std::unique_ptr<base::File> source,
@@ -32,7 +33,8 @@ class BRILLO_EXPORT FileHasher {
         destination_(std::move(destination)),
         block_limit_(blocks),
         alg_(alg),
-        initialized_(false) {}
+        initialized_(false),
+        thread_count_(1) {}
   virtual ~FileHasher();
 
   // TODO(wad) add initialized_ variable to check.
@@ -46,6 +48,10 @@ class BRILLO_EXPORT FileHasher {
   virtual const char* RandomSalt();
   virtual void set_salt(const char* salt);
   virtual const char* salt(void) { return salt_; }
+  // Number of threads hashing the source, 1 by default. Each of them reads
+  // many blocks at once, and the levels of the tree are computed one after
+  // the other, each across all the threads. The result is the same.
+  virtual void set_thread_count(unsigned int thread_count);
 
  private:
   std::unique_ptr<base::File> source_;
@@ -58,6 +64,13 @@ class BRILLO_EXPORT FileHasher {
   struct dm_bht tree_;
   sector_t sectors_;
   bool initialized_;
+  unsigned int thread_count_;
+
+  // Hashes the |read|th range of blocks of the source, which starts at
+  // |offset|.
+  bool HashBlocks(int64_t offset, unsigned int read);
+  // Computes the |job|th range of entries of the level at |depth|.
+  bool ComputeEntries(int depth, unsigned int job);
 
   FileHasher(const FileHasher&) = delete;
   FileHasher& operator=(const FileHasher&) = delete;
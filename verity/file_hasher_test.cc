@@ -4,10 +4,13 @@
 //
 // Tests for verity::FileHasher
 
+#include <memory>
+#include <string>
 #include <utility>
 
 #include <base/files/file_util.h>
 #include <base/files/scoped_temp_dir.h>
+#include <base/strings/string_number_conversions.h>
 #include <gtest/gtest.h>
 
 #include "verity/file_hasher.h"
@@ -63,6 +66,43 @@ TEST_F(FileHasherTest, EndToEnd) {
             "23456789abcdef0123456789abcdef0123456789");
 }
 
+TEST_F(FileHasherTest, ConcurrentHash) {
+  // Enough blocks for a tree of 2 levels, and more than the blocks read at
+  // once by each thread, but not a multiple of them.
+  constexpr size_t kBlocks = 1000;
+  const base::FilePath source_path = temp_dir_.GetPath().Append("source.bin");
+  std::string source_data;
+  for (int i = 0; source_data.size() < kBlocks * PAGE_SIZE; i++)
+    source_data += base::NumberToString(i);
+  source_data.resize(kBlocks * PAGE_SIZE);
+  ASSERT_TRUE(base::WriteFile(source_path, source_data));
+
+  std::string tables[2];
+  std::string trees[2];
+  const unsigned int thread_counts[2] = {1, 4};
+  for (int i = 0; i < 2; i++) {
+    const base::FilePath tree_path = temp_dir_.GetPath().Append(
+        "tree" + base::NumberToString(thread_counts[i]));
+    verity::FileHasher hasher(
+        std::make_unique<base::File>(
+            source_path, base::File::FLAG_OPEN | base::File::FLAG_READ),
+        std::make_unique<base::File>(
+            tree_path, base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE),
+        0, kSha256HashName);
+    ASSERT_TRUE(hasher.Initialize());
+    hasher.set_salt(reinterpret_cast<const char*>(kSalt));
+    hasher.set_thread_count(thread_counts[i]);
+    ASSERT_TRUE(hasher.Hash());
+    ASSERT_TRUE(hasher.Store());
+    tables[i] = hasher.GetTable(true);
+    ASSERT_TRUE(base::ReadFileToString(tree_path, &trees[i]));
+  }
+  // The 8 pages of block hashes, and the page above them.
+  EXPECT_EQ(trees[0].size(), 9u * PAGE_SIZE);
+  EXPECT_EQ(tables[0], tables[1]);
+  EXPECT_EQ(trees[0], trees[1]);
+}
+
 TEST_F(FileHasherTest, BadSourceFile) {
   verity::FileHasher hasher(nullptr, std::move(target_file_), 0,
                             kSha256HashName);
@@ -33,6 +33,10 @@ class MockDmBht : public DmBhtInterface {
               StoreBlock,
               (unsigned int block, uint8_t* block_data),
               (override));
+  MOCK_METHOD(int,
+              StoreBlocks,
+              (unsigned int block, unsigned int count, uint8_t* block_data),
+              (override));
   MOCK_METHOD(int, Compute, (), (override));
   MOCK_METHOD(void,
               HexDigest,
@@ -0,0 +1,424 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by the GPL v2 license that can
+// be found in the LICENSE file.
+//
+// Implementation of MultiSha256(). SHA-256 is a chain of dependent rounds,
+// which leaves most of a core idle when a single message is hashed. The
+// messages are hashed side by side instead: one per 32-bit lane of the AVX2
+// registers, or two interleaved streams of the SHA extensions.
+
+#include "verity/multi_sha256.h"
+
+#include <string.h>
+
+#include <utility>
+
+#include <base/check.h>
+#include <base/check_op.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace verity {
+
+namespace {
+
+constexpr size_t kBlockSize = 64;
+// Blocks after the data: what remains of it, the suffix, the 0x80 byte and
+// the 64-bit length of the padding.
+constexpr size_t kMaxTailBlocks =
+    (kBlockSize - 1 + kMaxSha256SuffixSize + 1 + 8 + kBlockSize - 1) /
+    kBlockSize;
+
+// The messages being hashed, split into blocks.
+struct Messages {
+  unsigned int count;
+  // Blocks read from the data itself.
+  size_t data_blocks;
+  const uint8_t* data[kMaxSha256Messages];
+  // Blocks built in |tails| for the end of the messages.
+  size_t tail_blocks;
+  uint8_t tails[kMaxSha256Messages][kMaxTailBlocks * kBlockSize];
+  uint8_t* digests[kMaxSha256Messages];
+};
+
+// Returns block |block| of message |message|.
+inline const uint8_t* GetBlock(const Messages& messages,
+                               unsigned int message,
+                               size_t block) {
+  if (block < messages.data_blocks)
+    return messages.data[message] + block * kBlockSize;
+  return messages.tails[message] + (block - messages.data_blocks) * kBlockSize;
+}
+
+using HashFunction = void (*)(const Messages& messages);
+
+#if defined(__x86_64__)
+
+alignas(32) constexpr uint32_t kRoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+constexpr uint32_t kInitialState[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+// == AVX2: one message per 32-bit lane ======================================
+
+template <int bits>
+__attribute__((target("avx2"))) inline __m256i RotateRight(__m256i x) {
+  return _mm256_or_si256(_mm256_srli_epi32(x, bits),
+                         _mm256_slli_epi32(x, 32 - bits));
+}
+
+// Transposes the 8 words of each of |rows|, so that |rows[i]| has word |i| of
+// each of the original rows, in order.
+__attribute__((target("avx2"))) inline void Transpose(__m256i rows[8]) {
+  __m256i pairs[8];
+  for (int i = 0; i < 8; i += 2) {
+    pairs[i] = _mm256_unpacklo_epi32(rows[i], rows[i + 1]);
+    pairs[i + 1] = _mm256_unpackhi_epi32(rows[i], rows[i + 1]);
+  }
+  __m256i quads[8];
+  for (int i = 0; i < 8; i += 4) {
+    quads[i] = _mm256_unpacklo_epi64(pairs[i], pairs[i + 2]);
+    quads[i + 1] = _mm256_unpackhi_epi64(pairs[i], pairs[i + 2]);
+    quads[i + 2] = _mm256_unpacklo_epi64(pairs[i + 1], pairs[i + 3]);
+    quads[i + 3] = _mm256_unpackhi_epi64(pairs[i + 1], pairs[i + 3]);
+  }
+  for (int i = 0; i < 4; i++) {
+    rows[i] = _mm256_permute2x128_si256(quads[i], quads[i + 4], 0x20);
+    rows[i + 4] = _mm256_permute2x128_si256(quads[i], quads[i + 4], 0x31);
+  }
+}
+
+// Round |t| of SHA-256 on |state|, with the schedule |w| of the last 16 words.
+template <int t>
+__attribute__((target("avx2"))) inline void Avx2Round(__m256i w[16],
+                                                      __m256i state[8]) {
+  if (t >= 16) {
+    const __m256i w15 = w[(t - 15) & 15];
+    const __m256i w2 = w[(t - 2) & 15];
+    const __m256i s0 =
+        _mm256_xor_si256(_mm256_xor_si256(RotateRight<7>(w15),
+                                          RotateRight<18>(w15)),
+                         _mm256_srli_epi32(w15, 3));
+    const __m256i s1 =
+        _mm256_xor_si256(_mm256_xor_si256(RotateRight<17>(w2),
+                                          RotateRight<19>(w2)),
+                         _mm256_srli_epi32(w2, 10));
+    w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0),
+                                 _mm256_add_epi32(w[(t - 7) & 15], s1));
+  }
+  // The state rotates by one word every round: |a| is |state[(-t) & 7]|.
+  const __m256i& a = state[(8 - t % 8) & 7];
+  const __m256i& b = state[(9 - t % 8) & 7];
+  const __m256i& c = state[(10 - t % 8) & 7];
+  __m256i& d = state[(11 - t % 8) & 7];
+  const __m256i& e = state[(12 - t % 8) & 7];
+  const __m256i& f = state[(13 - t % 8) & 7];
+  const __m256i& g = state[(14 - t % 8) & 7];
+  __m256i& h = state[(15 - t % 8) & 7];
+  const __m256i sum1 = _mm256_xor_si256(
+      _mm256_xor_si256(RotateRight<6>(e), RotateRight<11>(e)),
+      RotateRight<25>(e));
+  const __m256i choice =
+      _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+  const __m256i temp1 = _mm256_add_epi32(
+      _mm256_add_epi32(_mm256_add_epi32(h, sum1),
+                       _mm256_add_epi32(choice, w[t & 15])),
+      _mm256_set1_epi32(kRoundConstants[t]));
+  const __m256i sum0 = _mm256_xor_si256(
+      _mm256_xor_si256(RotateRight<2>(a), RotateRight<13>(a)),
+      RotateRight<22>(a));
+  const __m256i majority = _mm256_or_si256(
+      _mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+  d = _mm256_add_epi32(d, temp1);
+  // |h| becomes the |a| of the next round.
+  h = _mm256_add_epi32(temp1, _mm256_add_epi32(sum0, majority));
+}
+
+// Runs rounds |t...|, unrolled so that the words are kept in registers.
+template <int... t>
+__attribute__((target("avx2"))) inline void Avx2Rounds(
+    std::integer_sequence<int, t...>, __m256i w[16], __m256i state[8]) {
+  (Avx2Round<t>(w, state), ...);
+}
+
+__attribute__((target("avx2"))) void HashAvx2(const Messages& messages) {
+  // Swaps the bytes of each 32-bit word, which SHA-256 reads big-endian.
+  const __m256i byte_swap =
+      _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3,
+                       2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  __m256i state[8];
+  for (int i = 0; i < 8; i++)
+    state[i] = _mm256_set1_epi32(kInitialState[i]);
+
+  const size_t block_count = messages.data_blocks + messages.tail_blocks;
+  for (size_t block = 0; block < block_count; block++) {
+    // Unused lanes hash the first message again.
+    const uint8_t* blocks[kMaxSha256Messages];
+    for (unsigned int i = 0; i < kMaxSha256Messages; i++)
+      blocks[i] = GetBlock(messages, i < messages.count ? i : 0, block);
+
+    __m256i w[16];
+    for (int half = 0; half < 2; half++) {
+      for (unsigned int i = 0; i < kMaxSha256Messages; i++) {
+        w[half * 8 + i] = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(blocks[i] + half * 32));
+      }
+      Transpose(&w[half * 8]);
+      for (int i = 0; i < 8; i++)
+        w[half * 8 + i] = _mm256_shuffle_epi8(w[half * 8 + i], byte_swap);
+    }
+
+    __m256i round_state[8];
+    for (int i = 0; i < 8; i++)
+      round_state[i] = state[i];
+    Avx2Rounds(std::make_integer_sequence<int, 64>(), w, round_state);
+    for (int i = 0; i < 8; i++)
+      state[i] = _mm256_add_epi32(state[i], round_state[i]);
+  }
+
+  // The transposition turns the words of the state into the lanes' digests.
+  Transpose(state);
+  for (unsigned int i = 0; i < messages.count; i++) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(messages.digests[i]),
+                        _mm256_shuffle_epi8(state[i], byte_swap));
+  }
+}
+
+// == SHA extensions: two interleaved messages ===============================
+
+// Messages hashed side by side, to hide the latency of the SHA instructions.
+constexpr unsigned int kShaStreams = 2;
+
+// Step |step| of the streams: 4 rounds, with the next 4 words of their
+// schedules |w|.
+template <int step>
+__attribute__((target("sha,sse4.1"))) inline void ShaStep(
+    __m128i w[kShaStreams][4],
+    __m128i abef[kShaStreams],
+    __m128i cdgh[kShaStreams]) {
+  const __m128i k = _mm_load_si128(
+      reinterpret_cast<const __m128i*>(&kRoundConstants[step * 4]));
+  for (unsigned int s = 0; s < kShaStreams; s++) {
+    if (step >= 4) {
+      w[s][step & 3] = _mm_sha256msg2_epu32(
+          _mm_add_epi32(
+              _mm_sha256msg1_epu32(w[s][step & 3], w[s][(step + 1) & 3]),
+              _mm_alignr_epi8(w[s][(step + 3) & 3], w[s][(step + 2) & 3], 4)),
+          w[s][(step + 3) & 3]);
+    }
+    const __m128i words = _mm_add_epi32(w[s][step & 3], k);
+    cdgh[s] = _mm_sha256rnds2_epu32(cdgh[s], abef[s], words);
+    abef[s] =
+        _mm_sha256rnds2_epu32(abef[s], cdgh[s], _mm_shuffle_epi32(words, 0x0e));
+  }
+}
+
+// Runs steps |step...|, unrolled so that the words are kept in registers.
+template <int... step>
+__attribute__((target("sha,sse4.1"))) inline void ShaSteps(
+    std::integer_sequence<int, step...>,
+    __m128i w[kShaStreams][4],
+    __m128i abef[kShaStreams],
+    __m128i cdgh[kShaStreams]) {
+  (ShaStep<step>(w, abef, cdgh), ...);
+}
+
+__attribute__((target("sha,sse4.1"))) void HashSha(const Messages& messages) {
+  const __m128i byte_swap =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  // The SHA instructions use the state as ABEF and CDGH.
+  const __m128i dcba =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(&kInitialState[0]));
+  const __m128i hgfe =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(&kInitialState[4]));
+  const __m128i initial_abef = _mm_alignr_epi8(
+      _mm_shuffle_epi32(dcba, 0xb1), _mm_shuffle_epi32(hgfe, 0x1b), 8);
+  const __m128i initial_cdgh = _mm_blend_epi16(
+      _mm_shuffle_epi32(hgfe, 0x1b), _mm_shuffle_epi32(dcba, 0xb1), 0xf0);
+
+  const size_t block_count = messages.data_blocks + messages.tail_blocks;
+  for (unsigned int first = 0; first < messages.count; first += kShaStreams) {
+    unsigned int message[kShaStreams];
+    __m128i abef[kShaStreams], cdgh[kShaStreams];
+    for (unsigned int s = 0; s < kShaStreams; s++) {
+      // A missing last stream hashes the first message of the pair again.
+      message[s] = first + s < messages.count ? first + s : first;
+      abef[s] = initial_abef;
+      cdgh[s] = initial_cdgh;
+    }
+
+    for (size_t block = 0; block < block_count; block++) {
+      __m128i saved_abef[kShaStreams], saved_cdgh[kShaStreams];
+      __m128i w[kShaStreams][4];
+      for (unsigned int s = 0; s < kShaStreams; s++) {
+        saved_abef[s] = abef[s];
+        saved_cdgh[s] = cdgh[s];
+        const uint8_t* data = GetBlock(messages, message[s], block);
+        for (int i = 0; i < 4; i++) {
+          w[s][i] = _mm_shuffle_epi8(
+              _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 16)),
+              byte_swap);
+        }
+      }
+      ShaSteps(std::make_integer_sequence<int, 16>(), w, abef, cdgh);
+      for (unsigned int s = 0; s < kShaStreams; s++) {
+        abef[s] = _mm_add_epi32(abef[s], saved_abef[s]);
+        cdgh[s] = _mm_add_epi32(cdgh[s], saved_cdgh[s]);
+      }
+    }
+
+    for (unsigned int s = 0; s < kShaStreams && first + s < messages.count;
+         s++) {
+      const __m128i feba = _mm_shuffle_epi32(abef[s], 0x1b);
+      const __m128i dchg = _mm_shuffle_epi32(cdgh[s], 0xb1);
+      __m128i* digest = reinterpret_cast<__m128i*>(messages.digests[first + s]);
+      _mm_storeu_si128(
+          digest,
+          _mm_shuffle_epi8(_mm_blend_epi16(feba, dchg, 0xf0), byte_swap));
+      _mm_storeu_si128(
+          digest + 1,
+          _mm_shuffle_epi8(_mm_alignr_epi8(dchg, feba, 8), byte_swap));
+    }
+  }
+}
+
+// Returns whether the OS saves the AVX registers, and the CPU has AVX2.
+bool HasAvx2() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE) ||
+      !(ecx & bit_AVX)) {
+    return false;
+  }
+  unsigned int xcr0, xcr0_high;
+  asm("xgetbv" : "=a"(xcr0), "=d"(xcr0_high) : "c"(0));
+  // The XMM and YMM states.
+  if ((xcr0 & 0x6) != 0x6)
+    return false;
+  return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2);
+}
+
+// Returns whether the CPU has the SHA extensions, and the SSE4.1 they are
+// used with.
+bool HasSha() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSSE3) ||
+      !(ecx & bit_SSE4_1)) {
+    return false;
+  }
+  return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+}
+
+#endif  // defined(__x86_64__)
+
+// Returns the function of |backend|, or null if the CPU does not support it.
+HashFunction GetBackendFunction(MultiSha256Backend backend) {
+#if defined(__x86_64__)
+  if (backend == MultiSha256Backend::kAvx2 && HasAvx2())
+    return HashAvx2;
+  if (backend == MultiSha256Backend::kSha && HasSha())
+    return HashSha;
+#endif
+  return nullptr;
+}
+
+// Returns the fastest backend of the CPU.
+MultiSha256Backend SelectBackend() {
+  // Two streams of the SHA extensions beat eight AVX2 lanes.
+  for (MultiSha256Backend backend :
+       {MultiSha256Backend::kSha, MultiSha256Backend::kAvx2}) {
+    if (GetBackendFunction(backend))
+      return backend;
+  }
+  return MultiSha256Backend::kNone;
+}
+
+// The backend in use and its function, selected on the first call.
+struct Backend {
+  MultiSha256Backend backend;
+  HashFunction hash_function;
+};
+
+Backend& GetBackend() {
+  static Backend backend = [] {
+    const MultiSha256Backend selected = SelectBackend();
+    return Backend{selected, GetBackendFunction(selected)};
+  }();
+  return backend;
+}
+
+HashFunction GetHashFunction() {
+  return GetBackend().hash_function;
+}
+
+}  // namespace
+
+bool HasMultiSha256() {
+  return GetHashFunction() != nullptr;
+}
+
+MultiSha256Backend GetMultiSha256Backend() {
+  return GetBackend().backend;
+}
+
+bool SetMultiSha256BackendForTesting(MultiSha256Backend backend) {
+  const HashFunction hash_function = GetBackendFunction(backend);
+  if (backend != MultiSha256Backend::kNone && !hash_function)
+    return false;
+  GetBackend() = Backend{backend, hash_function};
+  return true;
+}
+
+void MultiSha256(const uint8_t* const* data,
+                 size_t size,
+                 const uint8_t* suffix,
+                 size_t suffix_size,
+                 unsigned int count,
+                 uint8_t* const* digests) {
+  const HashFunction hash_function = GetHashFunction();
+  CHECK(hash_function);
+  CHECK_LE(count, kMaxSha256Messages);
+  CHECK_LE(suffix_size, kMaxSha256SuffixSize);
+  if (count == 0)
+    return;
+
+  Messages messages;
+  messages.count = count;
+  messages.data_blocks = size / kBlockSize;
+  const size_t data_tail_size = size % kBlockSize;
+  const size_t tail_size = data_tail_size + suffix_size;
+  messages.tail_blocks = (tail_size + 1 + 8 + kBlockSize - 1) / kBlockSize;
+  const size_t padded_tail_size = messages.tail_blocks * kBlockSize;
+  const uint64_t bit_count = (static_cast<uint64_t>(size) + suffix_size) * 8;
+  for (unsigned int i = 0; i < count; i++) {
+    messages.data[i] = data[i];
+    messages.digests[i] = digests[i];
+    uint8_t* tail = messages.tails[i];
+    memcpy(tail, data[i] + messages.data_blocks * kBlockSize, data_tail_size);
+    if (suffix_size)
+      memcpy(tail + data_tail_size, suffix, suffix_size);
+    tail[tail_size] = 0x80;
+    memset(tail + tail_size + 1, 0, padded_tail_size - tail_size - 1);
+    for (int byte = 0; byte < 8; byte++)
+      tail[padded_tail_size - 1 - byte] = bit_count >> (byte * 8);
+  }
+  hash_function(messages);
+}
+
+}  // namespace verity
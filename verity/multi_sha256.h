@@ -0,0 +1,61 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by the GPL v2 license that can
+// be found in the LICENSE file.
+//
+// SHA-256 of several messages of the same size at once, with the SIMD
+// instructions of the CPU when it has suitable ones.
+
+#ifndef VERITY_MULTI_SHA256_H_
+#define VERITY_MULTI_SHA256_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <brillo/brillo_export.h>
+
+namespace verity {
+
+// Largest number of messages hashed by one call to MultiSha256().
+constexpr unsigned int kMaxSha256Messages = 8;
+// Largest suffix of the messages hashed by MultiSha256().
+constexpr size_t kMaxSha256SuffixSize = 64;
+
+// Returns whether MultiSha256() can be used: the CPU must have AVX2 or the
+// SHA extensions. The backend is selected on the first call.
+BRILLO_EXPORT
+bool HasMultiSha256();
+
+// Computes the SHA-256 digests of |count| messages, made of the |size| bytes
+// of |data[i]| followed by the |suffix_size| bytes of |suffix|, which are the
+// same for all the messages. The 32 bytes of the digest of message |i| are
+// written to |digests[i]|. |count| must be at most kMaxSha256Messages, and
+// |suffix_size| at most kMaxSha256SuffixSize.
+BRILLO_EXPORT
+void MultiSha256(const uint8_t* const* data,
+                 size_t size,
+                 const uint8_t* suffix,
+                 size_t suffix_size,
+                 unsigned int count,
+                 uint8_t* const* digests);
+
+// The SIMD instructions MultiSha256() hashes the messages with.
+enum class MultiSha256Backend {
+  // None: HasMultiSha256() returns false.
+  kNone,
+  kAvx2,
+  kSha,
+};
+
+// Returns the backend used by MultiSha256().
+BRILLO_EXPORT
+MultiSha256Backend GetMultiSha256Backend();
+
+// Makes MultiSha256() use |backend| instead of the fastest backend of the CPU,
+// so that tests can cover each of them. Returns false, and leaves the backend
+// unchanged, if the CPU does not support |backend|. Not thread-safe.
+BRILLO_EXPORT
+bool SetMultiSha256BackendForTesting(MultiSha256Backend backend);
+
+}  // namespace verity
+
+#endif  // VERITY_MULTI_SHA256_H_
@@ -0,0 +1,98 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by the GPL v2 license that can
+// be found in the LICENSE file.
+//
+// Tests for verity::MultiSha256(), with each backend the CPU supports.
+
+#include <string>
+#include <vector>
+
+#include <crypto/sha2.h>
+#include <gtest/gtest.h>
+
+#include "verity/multi_sha256.h"
+
+namespace verity {
+
+class MultiSha256Test : public ::testing::TestWithParam<MultiSha256Backend> {
+ public:
+  void SetUp() override {
+    default_backend_ = GetMultiSha256Backend();
+    if (!SetMultiSha256BackendForTesting(GetParam()))
+      GTEST_SKIP() << "The CPU does not support the backend";
+    ASSERT_TRUE(HasMultiSha256());
+  }
+
+  void TearDown() override {
+    EXPECT_TRUE(SetMultiSha256BackendForTesting(default_backend_));
+  }
+
+ private:
+  MultiSha256Backend default_backend_;
+};
+
+// The digests must be those of SHA-256 for all the numbers of messages, and
+// sizes of messages and suffixes that end the data in each part of a block or
+// need one more block for the padding.
+TEST_P(MultiSha256Test, MatchesSha256) {
+  const std::string suffix(kMaxSha256SuffixSize, 's');
+  for (size_t size : {0, 1, 55, 56, 63, 64, 65, 119, 120, 4096}) {
+    for (size_t suffix_size : {size_t{0}, size_t{9}, size_t{32},
+                               kMaxSha256SuffixSize}) {
+      std::vector<std::string> messages;
+      std::vector<const uint8_t*> data;
+      for (unsigned int i = 0; i < kMaxSha256Messages; i++) {
+        std::string message(size, '\0');
+        for (size_t j = 0; j < size; j++)
+          message[j] = j * 7 + i * 31;
+        messages.push_back(message);
+      }
+      for (const std::string& message : messages)
+        data.push_back(reinterpret_cast<const uint8_t*>(message.data()));
+
+      for (unsigned int count = 0; count <= kMaxSha256Messages; count++) {
+        std::vector<uint8_t> digests(kMaxSha256Messages *
+                                     crypto::kSHA256Length);
+        std::vector<uint8_t*> digest_pointers;
+        for (unsigned int i = 0; i < kMaxSha256Messages; i++)
+          digest_pointers.push_back(&digests[i * crypto::kSHA256Length]);
+        MultiSha256(data.data(), size,
+                    reinterpret_cast<const uint8_t*>(suffix.data()),
+                    suffix_size, count, digest_pointers.data());
+
+        for (unsigned int i = 0; i < kMaxSha256Messages; i++) {
+          const std::string digest(
+              reinterpret_cast<const char*>(digest_pointers[i]),
+              crypto::kSHA256Length);
+          // The digests of the messages past |count| must not be written.
+          const std::string expected =
+              i < count ? crypto::SHA256HashString(
+                              messages[i] + suffix.substr(0, suffix_size))
+                        : std::string(crypto::kSHA256Length, '\0');
+          EXPECT_EQ(expected, digest)
+              << "size: " << size << " suffix size: " << suffix_size
+              << " count: " << count << " message: " << i;
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends,
+                         MultiSha256Test,
+                         ::testing::Values(MultiSha256Backend::kAvx2,
+                                           MultiSha256Backend::kSha));
+
+TEST(MultiSha256BackendTest, ForceNone) {
+  const MultiSha256Backend default_backend = GetMultiSha256Backend();
+  EXPECT_EQ(default_backend != MultiSha256Backend::kNone, HasMultiSha256());
+
+  EXPECT_TRUE(SetMultiSha256BackendForTesting(MultiSha256Backend::kNone));
+  EXPECT_EQ(MultiSha256Backend::kNone, GetMultiSha256Backend());
+  EXPECT_FALSE(HasMultiSha256());
+
+  EXPECT_TRUE(SetMultiSha256BackendForTesting(default_backend));
+  EXPECT_EQ(default_backend, GetMultiSha256Backend());
+}
+
+}  // namespace verity
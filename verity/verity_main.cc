@@ -7,10 +7,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <memory>
 
 #include <base/files/file.h>
 #include <base/logging.h>
+#include <base/system/sys_info.h>
 #include <brillo/syslog_logging.h>
 
 #include "verity/file_hasher.h"
@@ -31,6 +33,8 @@ void print_usage(const char* name) {
       "  hashtree          Path to a hash tree to create or read from\n"
       "  root_hexdigest    Digest of the root node (in hex) for verification\n"
       "  salt              Salt (in hex)\n"
+      "  threads           Number of threads hashing the image (default 1,\n"
+      "                    at most the number of processors)\n"
       "\n",
       name);
 }
@@ -40,13 +44,32 @@ typedef enum { VERITY_NONE = 0, VERITY_CREATE, VERITY_VERIFY } verity_mode_t;
 static unsigned int parse_blocks(const char* block_s) {
   return (unsigned int)strtoul(block_s, NULL, 0);
 }
+
+// Parses the number of threads in |threads_s| into |threads|, which is
+// clamped to the number of processors. Returns false if |threads_s| is not a
+// positive number. Numbers too large for strtoul() are clamped as well.
+bool parse_threads(const char* threads_s, unsigned int* threads) {
+  char* end = NULL;
+  // strtoul() would accept a sign, and wrap negative numbers around.
+  if (threads_s[0] < '0' || threads_s[0] > '9')
+    return false;
+  const unsigned long value =  // NOLINT(runtime/int)
+      strtoul(threads_s, &end, 0);
+  if (*end != '\0' || value == 0)
+    return false;
+  const unsigned long max_threads =  // NOLINT(runtime/int)
+      std::max(base::SysInfo::NumberOfProcessors(), 1);
+  *threads = (unsigned int)std::min(value, max_threads);
+  return true;
+}
 }  // namespace
 
 static int verity_create(const char* alg,
                          const char* image_path,
                          unsigned int image_blocks,
                          const char* hash_path,
-                         const char* salt);
+                         const char* salt,
+                         unsigned int threads);
 
 void splitarg(char* arg, char** key, char** val) {
   char* sp = NULL;
@@ -61,6 +84,7 @@ int main(int argc, char** argv) {
   const char* hashtree = NULL;
   const char* salt = NULL;
   unsigned int payload_blocks = 0;
+  unsigned int threads = 1;
   int i;
   char *key, *val;
 
@@ -87,6 +111,12 @@ int main(int argc, char** argv) {
       // Silently drop the mode for now...
     } else if (!strcmp(key, "salt")) {
       salt = val;
+    } else if (!strcmp(key, "threads")) {
+      if (!parse_threads(val, &threads)) {
+        fprintf(stderr, "invalid threads: '%s'\n", val);
+        print_usage(argv[0]);
+        return -1;
+      }
     } else {
       fprintf(stderr, "bogus key: '%s'\n", key);
       print_usage(argv[0]);
@@ -102,7 +132,8 @@ int main(int argc, char** argv) {
   }
 
   if (mode == VERITY_CREATE) {
-    return verity_create(alg, payload, payload_blocks, hashtree, salt);
+    return verity_create(alg, payload, payload_blocks, hashtree, salt,
+                         threads);
   } else {
     LOG(FATAL) << "Verification not done yet";
   }
@@ -113,7 +144,8 @@ static int verity_create(const char* alg,
                          const char* image_path,
                          unsigned int image_blocks,
                          const char* hash_path,
-                         const char* salt) {
+                         const char* salt,
+                         unsigned int threads) {
   auto source = std::make_unique<base::File>(
       base::FilePath(image_path),
       base::File::FLAG_OPEN | base::File::FLAG_READ);
@@ -131,6 +163,7 @@ static int verity_create(const char* alg,
   LOG_IF(FATAL, !hasher.Initialize()) << "Failed to initialize hasher";
   if (salt)
     hasher.set_salt(salt);
+  hasher.set_thread_count(threads);
   LOG_IF(FATAL, !hasher.Hash()) << "Failed to hash hasher";
   LOG_IF(FATAL, !hasher.Store()) << "Failed to store hasher";
   hasher.PrintTable(true);